@@ -0,0 +1,75 @@
+/*
+ * Example plugin: a tremolo, one input and one output.
+ *
+ * Build with `make plugins`, which puts the library next to this file in
+ * plugins/, where Soundflow looks for it at startup.
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include "plugin.h"
+
+#define TREMOLO_PI 3.14159265358979323846
+
+enum { TREMOLO_RATE, TREMOLO_DEPTH };
+
+static const struct soundflow_param tremolo_params[] = {
+    { "Rate", 0.1f, 20.0f, 5.0f, 0.1f },
+    { "Depth", 0.0f, 1.0f, 0.5f, 0.01f },
+};
+
+struct tremolo {
+    uint32_t channels;
+    float sample_rate;
+    double phase;               /* Cycles, 0..1 */
+};
+
+static void *tremolo_create(uint32_t channels, uint32_t sample_rate)
+{
+    struct tremolo *tr = calloc(1, sizeof(*tr));
+    if (tr == NULL)
+        return NULL;
+    tr->channels = channels;
+    tr->sample_rate = (float)sample_rate;
+    return tr;
+}
+
+static void tremolo_destroy(void *instance)
+{
+    free(instance);
+}
+
+static void tremolo_process(void *instance, const struct soundflow_block *block)
+{
+    struct tremolo *tr = instance;
+    const float *in = block->inputs[0];
+    float *out = block->outputs[0];
+    const double increment = block->params[TREMOLO_RATE] / tr->sample_rate;
+    const float depth = block->params[TREMOLO_DEPTH];
+
+    for (uint32_t f = 0; f < block->frame_count; f++) {
+        float gain = 1.0f - depth * 0.5f * (1.0f - (float)cos(2.0 * TREMOLO_PI * tr->phase));
+        for (uint32_t ch = 0; ch < block->channels; ch++)
+            out[f * block->channels + ch] = in[f * block->channels + ch] * gain;
+        tr->phase += increment;
+        tr->phase -= floor(tr->phase);
+    }
+}
+
+static const struct soundflow_plugin tremolo_plugin = {
+    SOUNDFLOW_PLUGIN_VERSION,
+    "Tremolo",
+    1,      /* One input. */
+    1,      /* One output. */
+    sizeof(tremolo_params) / sizeof(tremolo_params[0]),
+    tremolo_params,
+    0,      /* No tail. */
+    tremolo_create,
+    tremolo_destroy,
+    tremolo_process,
+};
+
+SOUNDFLOW_PLUGIN_EXPORT const struct soundflow_plugin *soundflow_plugin_entry(uint32_t index)
+{
+    return index == 0 ? &tremolo_plugin : NULL;
+}
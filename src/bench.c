@@ -0,0 +1,364 @@
+/*
+ * Headless DSP benchmarks. Build with `make bench build=release` and run
+ * ./soundflow_bench from the repository root.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define MINIAUDIO_IMPLEMENTATION
+#define MA_NO_DEVICE_IO
+#include "miniaudio.h"
+
+#define SOKOL_TIME_IMPL
+#include "sokol_time.h"
+
+#include "kernels.c"
+#include "biquad.c"
+#include "fft.c"
+#include "mixer.c"
+#include "channel_mix.c"
+
+/* Runs `fn` until at least `min_seconds` have passed, returns seconds per call. */
+static double bench_run(void (*fn)(void *), void *user, double min_seconds)
+{
+    ma_uint64 iterations = 1;
+    for (;;) {
+        ma_uint64 start = stm_now();
+        for (ma_uint64 i = 0; i < iterations; i++)
+            fn(user);
+        double elapsed = stm_sec(stm_since(start));
+        if (elapsed >= min_seconds)
+            return elapsed / (double)iterations;
+        iterations *= 2;
+    }
+}
+
+struct bench_fft {
+    const struct fft_plan *plan;
+    float *in, *re, *im, *scratch;
+};
+
+static void bench_fft_roundtrip(void *user)
+{
+    struct bench_fft *b = (struct bench_fft *)user;
+    fft_forward(b->plan, b->in, b->re, b->im, b->scratch);
+    fft_inverse(b->plan, b->re, b->im, b->in, b->scratch);
+}
+
+static void bench_fft(void)
+{
+    static const ma_uint32 sizes[] = {
+        64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536,
+        120, 480, 960, 1920, 3840, 6000, 7680,
+    };
+
+    printf("Real FFT, forward + inverse\n");
+    printf("%8s %12s %12s %10s\n", "size", "ns/pair", "ns/sample", "MFLOPS");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        struct bench_fft b;
+        ma_uint32 n = sizes[i];
+        b.plan = fft_plan_get(n);
+        if (b.plan == NULL)
+            continue;
+        b.in = dsp_alloc(n);
+        b.re = dsp_alloc(n / 2 + 1);
+        b.im = dsp_alloc(n / 2 + 1);
+        b.scratch = dsp_alloc(fft_scratch_size(b.plan));
+        for (ma_uint32 k = 0; k < n; k++)
+            b.in[k] = (float)rand() / (float)RAND_MAX - 0.5f;
+
+        double seconds = bench_run(bench_fft_roundtrip, &b, 0.2);
+        /* Conventional 2.5 N log2 N flops per real transform, two transforms per call. */
+        double flops = 2.0 * 2.5 * n * log2((double)n);
+        printf("%8u %12.0f %12.2f %10.0f\n", n, seconds * 1e9, seconds * 1e9 / n, flops / seconds * 1e-6);
+
+        dsp_free(b.in);
+        dsp_free(b.re);
+        dsp_free(b.im);
+        dsp_free(b.scratch);
+    }
+    printf("\n");
+}
+
+struct bench_kernels {
+    const struct kernel_table *table;
+    ma_uint32 n;
+    float *acc_re, *acc_im, *xr, *xi, *hr, *hi;
+};
+
+static void bench_kernels_cmac(void *user)
+{
+    struct bench_kernels *b = (struct bench_kernels *)user;
+    b->table->cmac(b->acc_re, b->acc_im, b->xr, b->xi, b->hr, b->hi, b->n);
+}
+
+static void bench_kernels_multiply_add(void *user)
+{
+    struct bench_kernels *b = (struct bench_kernels *)user;
+    b->table->multiply_add(b->acc_re, b->xr, b->hr, b->n);
+}
+
+/* Every kernel variant this CPU runs, at sizes that stay in L1. */
+static void bench_kernels(void)
+{
+    const enum kernels_level level = kernels_detect();
+    static const ma_uint32 sizes[] = { 260, 1028, 4100 };
+
+    printf("Kernels, ns per call (selected: %s)\n", kernels_init());
+    printf("%10s %8s %12s %12s\n", "variant", "size", "cmac", "mul-add");
+    for (int v = 0; v <= (int)level; v++) {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            struct bench_kernels b;
+            b.table = &kernels_variants[v];
+            b.n = sizes[i];
+            float **buffers[] = { &b.acc_re, &b.acc_im, &b.xr, &b.xi, &b.hr, &b.hi };
+            for (int k = 0; k < 6; k++) {
+                *buffers[k] = dsp_alloc(b.n);
+                for (ma_uint32 j = 0; j < b.n; j++)
+                    (*buffers[k])[j] = ((float)rand() / (float)RAND_MAX - 0.5f) * 1e-3f;
+            }
+
+            double cmac = bench_run(bench_kernels_cmac, &b, 0.1);
+            double multiply_add = bench_run(bench_kernels_multiply_add, &b, 0.1);
+            printf("%10s %8u %12.1f %12.1f\n", b.table->name, b.n, cmac * 1e9, multiply_add * 1e9);
+
+            for (int k = 0; k < 6; k++)
+                dsp_free(*buffers[k]);
+        }
+    }
+    printf("\n");
+}
+
+struct bench_mixer {
+    struct mixer_node mixer;
+    const float *in[MIXER_MAX_INPUTS];
+    float *out;
+};
+
+static void bench_mixer_block(void *user)
+{
+    struct bench_mixer *b = (struct bench_mixer *)user;
+    mixer_node_mix(&b->mixer, b->in, b->out, 0, MIXER_CHUNK);
+}
+
+struct bench_biquad {
+    struct biquad_cascade cascade;
+    float *frames;
+};
+
+static void bench_biquad_block(void *user)
+{
+    struct bench_biquad *b = (struct bench_biquad *)user;
+    biquad_cascade_process(&b->cascade, b->frames, b->frames, 512);
+}
+
+struct bench_channel_mix {
+    struct channel_mix mix;
+    float *in, *out;
+};
+
+static void bench_channel_mix_block(void *user)
+{
+    struct bench_channel_mix *b = (struct bench_channel_mix *)user;
+    channel_mix_process(&b->mix, b->out, b->in, 512);
+}
+
+/*
+ * The kernels that fall back to their module's 4-wide code in the baseline
+ * set, run through the whole node path under each variant: where the wider
+ * sets pay off outside the flat loops above.
+ */
+static void bench_dispatch(void)
+{
+    const enum kernels_level level = kernels_detect();
+    static const ma_uint32 fft_sizes[] = { 960, 4096 };
+    const ma_uint32 inputs = 8;
+    struct bench_fft f[2];
+    struct bench_mixer m;
+    struct bench_biquad b;
+    struct bench_channel_mix up, wide;
+
+    for (int i = 0; i < 2; i++) {
+        const ma_uint32 n = fft_sizes[i];
+        f[i].plan = fft_plan_get(n);
+        f[i].in = dsp_alloc(n);
+        f[i].re = dsp_alloc(n / 2 + 1);
+        f[i].im = dsp_alloc(n / 2 + 1);
+        f[i].scratch = dsp_alloc(fft_scratch_size(f[i].plan));
+        for (ma_uint32 k = 0; k < n; k++)
+            f[i].in[k] = (float)rand() / (float)RAND_MAX - 0.5f;
+    }
+
+    /* A stereo bus of eight inputs, laid out by hand: the node itself is never attached to a graph. */
+    memset(&m.mixer, 0, sizeof(m.mixer));
+    m.mixer.channels = 2;
+    m.mixer.input_count = inputs;
+    mixer_node_layout(&m.mixer);
+    dsp_arena_init(&m.mixer.arena, m.mixer.arena.used);
+    mixer_node_layout(&m.mixer);
+    for (ma_uint32 i = 0; i < inputs; i++) {
+        float *in = dsp_alloc(2 * MIXER_CHUNK);
+        for (ma_uint32 k = 0; k < 2 * MIXER_CHUNK; k++)
+            in[k] = (float)rand() / (float)RAND_MAX - 0.5f;
+        m.in[i] = in;
+        m.mixer.inputs[i].gain = 0.5f;
+        m.mixer.inputs[i].pan = (float)i / (float)inputs - 0.5f;
+    }
+    m.out = dsp_alloc(2 * MIXER_CHUNK);
+
+    /* An order 8 stereo low pass: one group, so every pass is the two-channel kernel. */
+    struct biquad_cascade_config config = biquad_cascade_config_init(2, 48000, BIQUAD_LOWPASS, 2000.0f, 8);
+    biquad_cascade_init(&config, NULL, &b.cascade);
+    b.frames = dsp_alloc(2 * 512);
+    for (ma_uint32 k = 0; k < 2 * 512; k++)
+        b.frames[k] = (float)rand() / (float)RAND_MAX - 0.5f;
+
+    /* Mono to stereo, and stereo to 7.1 through the general matrix. */
+    struct channel_mix_config up_config = channel_mix_config_init(1, 2), wide_config = channel_mix_config_init(2, 8);
+    channel_mix_init(&up_config, &up.mix);
+    channel_mix_init(&wide_config, &wide.mix);
+    up.in = wide.in = dsp_alloc(2 * 512);
+    up.out = wide.out = dsp_alloc(8 * 512);
+    for (ma_uint32 k = 0; k < 2 * 512; k++)
+        up.in[k] = (float)rand() / (float)RAND_MAX - 0.5f;
+
+    printf("Dispatched node kernels, ns per call\n");
+    printf("%10s %12s %12s %14s %14s %10s %10s\n", "variant", "fft 960", "fft 4096", "mix 8x2x512", "biquad 2x512",
+            "1>2 x512", "2>8 x512");
+    for (int v = 0; v <= (int)level; v++) {
+        /* Best of three, the variants are close enough for noise to swap them. */
+        double fft_small = 1e9, fft_large = 1e9, mix = 1e9, biquad = 1e9, upmix = 1e9, widen = 1e9;
+        kernels = kernels_variants[v];
+        for (int r = 0; r < 3; r++) {
+            fft_small = DSP_MIN(fft_small, bench_run(bench_fft_roundtrip, &f[0], 0.05));
+            fft_large = DSP_MIN(fft_large, bench_run(bench_fft_roundtrip, &f[1], 0.05));
+            mix = DSP_MIN(mix, bench_run(bench_mixer_block, &m, 0.05));
+            biquad = DSP_MIN(biquad, bench_run(bench_biquad_block, &b, 0.05));
+            upmix = DSP_MIN(upmix, bench_run(bench_channel_mix_block, &up, 0.05));
+            widen = DSP_MIN(widen, bench_run(bench_channel_mix_block, &wide, 0.05));
+        }
+        printf("%10s %12.0f %12.0f %14.0f %14.0f %10.0f %10.0f\n", kernels.name, fft_small * 1e9, fft_large * 1e9,
+                mix * 1e9, biquad * 1e9, upmix * 1e9, widen * 1e9);
+    }
+    kernels_init();
+    printf("\n");
+
+    for (int i = 0; i < 2; i++) {
+        dsp_free(f[i].in);
+        dsp_free(f[i].re);
+        dsp_free(f[i].im);
+        dsp_free(f[i].scratch);
+    }
+    for (ma_uint32 i = 0; i < inputs; i++)
+        dsp_free((float *)m.in[i]);
+    dsp_free(m.out);
+    dsp_arena_uninit(&m.mixer.arena);
+    biquad_cascade_uninit(&b.cascade, NULL);
+    dsp_free(b.frames);
+    channel_mix_uninit(&up.mix);
+    channel_mix_uninit(&wide.mix);
+    dsp_free(up.in);
+    dsp_free(up.out);
+}
+
+/* Stereo low pass cascades in both precisions, at a cutoff where float still holds up. */
+static void bench_biquad(void)
+{
+    static const ma_uint32 orders[] = { 2, 4, 8, 16 };
+
+    printf("Biquad cascade, stereo, ns per frame\n");
+    printf("%8s %12s %12s\n", "order", "32-bit", "64-bit");
+    for (size_t i = 0; i < sizeof(orders) / sizeof(orders[0]); i++) {
+        double seconds[2];
+        for (int precise = 0; precise < 2; precise++) {
+            struct bench_biquad b;
+            struct biquad_cascade_config config = biquad_cascade_config_init(2, 48000, BIQUAD_LOWPASS, 2000.0f, orders[i]);
+            biquad_cascade_init(&config, NULL, &b.cascade);
+            biquad_cascade_set_precise(&b.cascade, precise);
+            b.frames = dsp_alloc(2 * 512);
+            for (ma_uint32 k = 0; k < 2 * 512; k++)
+                b.frames[k] = (float)rand() / (float)RAND_MAX - 0.5f;
+            seconds[precise] = bench_run(bench_biquad_block, &b, 0.1);
+            biquad_cascade_uninit(&b.cascade, NULL);
+            dsp_free(b.frames);
+        }
+        printf("%8u %12.2f %12.2f\n", orders[i], seconds[0] * 1e9 / 512, seconds[1] * 1e9 / 512);
+    }
+    printf("\n");
+}
+
+struct bench_denormals {
+    struct biquad_cascade cascade;
+    ma_delay delay;
+    float *silence, *out;
+    float seed;     /* State at the start of every block */
+};
+
+/* A low pass ringing out on silence; the state is reseeded every call so each block starts mid-tail. */
+static void bench_denormals_biquad(void *user)
+{
+    struct bench_denormals *b = (struct bench_denormals *)user;
+    for (ma_uint32 i = 0; i < 2 * BIQUAD_MAX_STAGES * 2; i++)
+        b->cascade.z1[i] = b->seed;
+    biquad_cascade_process(&b->cascade, b->out, b->silence, 512);
+}
+
+/* An echo fading out, the delay node's feedback path. */
+static void bench_denormals_delay(void *user)
+{
+    struct bench_denormals *b = (struct bench_denormals *)user;
+    for (ma_uint32 i = 0; i < b->delay.bufferSizeInFrames * 2; i++)
+        b->delay.pBuffer[i] = b->seed;
+    ma_delay_process_pcm_frames(&b->delay, b->out, b->silence, 512);
+}
+
+/* Tails with normal state, then with denormal state without and with flushing. */
+static void bench_denormals(void)
+{
+    static const struct { const char *name; void (*fn)(void *); } cases[] = {
+        { "low pass", bench_denormals_biquad },
+        { "delay", bench_denormals_delay },
+    };
+    struct bench_denormals b;
+
+    struct biquad_cascade_config cascadeConfig = biquad_cascade_config_init(2, 48000, BIQUAD_LOWPASS, 200.0f, 8);
+    biquad_cascade_init(&cascadeConfig, NULL, &b.cascade);
+    biquad_cascade_set_precise(&b.cascade, MA_FALSE);  // Double state would be nowhere near its denormals
+    ma_delay_config delayConfig = ma_delay_config_init(2, 48000, 512, 0.5f);
+    ma_delay_init(&delayConfig, NULL, &b.delay);
+    b.silence = dsp_alloc(2 * 512);
+    b.out = dsp_alloc(2 * 512);
+
+    printf("Decaying tails, stereo, ns per frame\n");
+    printf("%10s %12s %12s %12s\n", "", "normal", "denormal", "flushed");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        double seconds[3];
+        for (int column = 0; column < 3; column++) {
+            b.seed = column == 0 ? 1e-3f : 1e-39f;
+            ma_uint64 mode = dsp_denormals_flush(column == 2);
+            seconds[column] = bench_run(cases[i].fn, &b, 0.1);
+            dsp_denormals_restore(mode);
+        }
+        printf("%10s %12.2f %12.2f %12.2f\n", cases[i].name,
+                seconds[0] * 1e9 / 512, seconds[1] * 1e9 / 512, seconds[2] * 1e9 / 512);
+    }
+    printf("\n");
+
+    biquad_cascade_uninit(&b.cascade, NULL);
+    ma_delay_uninit(&b.delay, NULL);
+    dsp_free(b.silence);
+    dsp_free(b.out);
+}
+
+int main(void)
+{
+    stm_setup();
+    bench_kernels();
+    bench_dispatch();
+    bench_biquad();
+    bench_denormals();
+    bench_fft();
+    fft_plan_cache_clear();
+    return 0;
+}
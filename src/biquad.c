@@ -0,0 +1,611 @@
+/*
+ * Biquad cascade engine.
+ *
+ * A filter of order N is split into N/2 second order sections (plus one first
+ * order section for odd orders) which must run in series. Instead of running
+ * one section at a time, the sections are mapped onto SIMD lanes and run as a
+ * wavefront: at step t lane s processes sample t-s, taking the output lane s-1
+ * produced on the previous step. Every step therefore advances four sections
+ * at once while still producing exactly the serial result, without latency.
+ * Steps at the edges of a block are masked so sections that have no sample yet
+ * (or no sample left) keep their state.
+ *
+ * Coefficients are designed once per block. When a parameter changes, the
+ * cutoff is smoothed towards its target and the coefficients are interpolated
+ * across the block in short sub-blocks, so sweeping a knob doesn't zipper.
+ *
+ * A low cutoff puts the poles right next to z = 1, where a float a1 and a2
+ * can no longer place them: the response drifts from the design, the
+ * rounding noise is amplified by the section's huge gain near DC, and high
+ * orders can go unstable. Cascades whose poles come within
+ * BIQUAD_PRECISE_MARGIN of the unit circle therefore run in double precision:
+ * the same wavefront two sections at a time, with double coefficients and
+ * state. The switch happens per block as the cutoff moves, carrying the
+ * state across, so it is inaudible.
+ *
+ * Float cascades run channels in pairs. Where the kernel table (kernels.c)
+ * has an eight-lane biquad kernel, the two channels' wavefronts share one
+ * vector, a 128-bit half each; otherwise they run one after the other.
+ */
+#include "dsp.h"
+
+#define BIQUAD_MAX_ORDER    16
+#define BIQUAD_MAX_STAGES   (BIQUAD_MAX_ORDER / 2)
+#define BIQUAD_LANES        4
+#define BIQUAD_MAX_GROUPS   (BIQUAD_MAX_STAGES / BIQUAD_LANES)
+#define BIQUAD_LANES64      2       /* Sections per double precision group */
+#define BIQUAD_PRECISE_MARGIN   0.02    /* Float error stays under about -90 dB outside it */
+#define BIQUAD_RAMP_FRAMES  32      /* Coefficient update interval while a parameter moves. */
+#define BIQUAD_SMOOTH_TIME  0.03f   /* Cutoff smoothing time constant in seconds. */
+
+enum biquad_filter_type {
+    BIQUAD_LOWPASS,
+    BIQUAD_HIGHPASS,
+    BIQUAD_FILTER_TYPE_COUNT,
+};
+
+/* Stage coefficients, one array per term so a group of four loads as one vector. */
+struct biquad_coeffs {
+    float b0[BIQUAD_MAX_STAGES];
+    float b1[BIQUAD_MAX_STAGES];
+    float b2[BIQUAD_MAX_STAGES];
+    float a1[BIQUAD_MAX_STAGES];
+    float a2[BIQUAD_MAX_STAGES];
+};
+
+/* The same in double precision, designed for every cascade and narrowed when floats are enough. */
+struct biquad_coeffs64 {
+    double b0[BIQUAD_MAX_STAGES];
+    double b1[BIQUAD_MAX_STAGES];
+    double b2[BIQUAD_MAX_STAGES];
+    double a1[BIQUAD_MAX_STAGES];
+    double a2[BIQUAD_MAX_STAGES];
+};
+
+struct biquad_cascade_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    enum biquad_filter_type type;
+    float cutoff;
+    ma_uint32 order;
+};
+
+struct biquad_cascade {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+
+    /* Requested by the UI thread, accessed atomically. */
+    float target_cutoff;
+    ma_uint32 target_order;
+    ma_uint32 target_type;
+
+    /* Written by the audio thread, read by the UI. */
+    ma_uint32 precise;      /* Running in double precision */
+
+    /* Audio thread only. */
+    float cutoff;
+    ma_uint32 order;
+    ma_uint32 type;
+    ma_uint32 stage_count;
+    struct biquad_coeffs64 coeffs;
+    float *z1;      /* channels * BIQUAD_MAX_STAGES */
+    float *z2;
+    double *z1d;    /* The same, while precise */
+    double *z2d;
+};
+
+static struct biquad_cascade_config
+biquad_cascade_config_init(ma_uint32 channels, ma_uint32 sample_rate, enum biquad_filter_type type,
+        float cutoff, ma_uint32 order)
+{
+    struct biquad_cascade_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.type = type;
+    config.cutoff = cutoff;
+    config.order = order;
+    return config;
+}
+
+static float biquad_clamp_cutoff(const struct biquad_cascade *bq, float cutoff)
+{
+    return DSP_CLAMP(cutoff, 10.0f, 0.49f * (float)bq->sample_rate);
+}
+
+static void biquad_coeffs_identity(struct biquad_coeffs *c)
+{
+    for (int s = 0; s < BIQUAD_MAX_STAGES; s++) {
+        c->b0[s] = 1.0f;
+        c->b1[s] = c->b2[s] = c->a1[s] = c->a2[s] = 0.0f;
+    }
+}
+
+static void biquad_coeffs_set(struct biquad_coeffs *c, int s,
+        double b0, double b1, double b2, double a0, double a1, double a2)
+{
+    c->b0[s] = (float)(b0 / a0);
+    c->b1[s] = (float)(b1 / a0);
+    c->b2[s] = (float)(b2 / a0);
+    c->a1[s] = (float)(a1 / a0);
+    c->a2[s] = (float)(a2 / a0);
+}
+
+static void biquad_coeffs64_identity(struct biquad_coeffs64 *c)
+{
+    for (int s = 0; s < BIQUAD_MAX_STAGES; s++) {
+        c->b0[s] = 1.0;
+        c->b1[s] = c->b2[s] = c->a1[s] = c->a2[s] = 0.0;
+    }
+}
+
+static void biquad_coeffs64_set(struct biquad_coeffs64 *c, int s,
+        double b0, double b1, double b2, double a0, double a1, double a2)
+{
+    c->b0[s] = b0 / a0;
+    c->b1[s] = b1 / a0;
+    c->b2[s] = b2 / a0;
+    c->a1[s] = a1 / a0;
+    c->a2[s] = a2 / a0;
+}
+
+static void biquad_coeffs_narrow(struct biquad_coeffs *dst, const struct biquad_coeffs64 *src)
+{
+    for (int s = 0; s < BIQUAD_MAX_STAGES; s++) {
+        dst->b0[s] = (float)src->b0[s];
+        dst->b1[s] = (float)src->b1[s];
+        dst->b2[s] = (float)src->b2[s];
+        dst->a1[s] = (float)src->a1[s];
+        dst->a2[s] = (float)src->a2[s];
+    }
+}
+
+/* True when a pole of any section lies within BIQUAD_PRECISE_MARGIN of the unit circle. */
+static bool biquad_coeffs64_precise(const struct biquad_coeffs64 *c)
+{
+    for (int s = 0; s < BIQUAD_MAX_STAGES; s++) {
+        /* Poles of z^2 + a1 z + a2: a conjugate pair of radius sqrt(a2), or two real ones. */
+        const double a1 = c->a1[s], a2 = c->a2[s], d = a1 * a1 - 4.0 * a2;
+        const double radius = d < 0.0 ? sqrt(a2) : (fabs(a1) + sqrt(d)) / 2.0;
+        if (radius > 1.0 - BIQUAD_PRECISE_MARGIN)
+            return true;
+    }
+    return false;
+}
+
+/* Butterworth design: one RBJ section per pole pair, bilinear first order section for odd orders. */
+static void biquad_design_butterworth(struct biquad_coeffs64 *c, enum biquad_filter_type type,
+        double cutoff, double sample_rate, ma_uint32 order)
+{
+    const double w0 = 2.0 * DSP_PI * cutoff / sample_rate;
+    const double cosw = cos(w0);
+    const double sinw = sin(w0);
+    const ma_uint32 pairs = order / 2;
+
+    biquad_coeffs64_identity(c);
+
+    for (ma_uint32 k = 0; k < pairs; k++) {
+        double q = 1.0 / (2.0 * cos(DSP_PI * (2.0 * k + 1.0) / (2.0 * order)));
+        double alpha = sinw / (2.0 * q);
+        if (type == BIQUAD_HIGHPASS)
+            biquad_coeffs64_set(c, k, (1 + cosw) / 2, -(1 + cosw), (1 + cosw) / 2, 1 + alpha, -2 * cosw, 1 - alpha);
+        else
+            biquad_coeffs64_set(c, k, (1 - cosw) / 2, 1 - cosw, (1 - cosw) / 2, 1 + alpha, -2 * cosw, 1 - alpha);
+    }
+
+    if (order & 1) {
+        double K = tan(w0 / 2.0);
+        if (type == BIQUAD_HIGHPASS)
+            biquad_coeffs64_set(c, pairs, 1, -1, 0, 1 + K, K - 1, 0);
+        else
+            biquad_coeffs64_set(c, pairs, K, K, 0, 1 + K, K - 1, 0);
+    }
+}
+
+static ma_uint32 biquad_stage_count(ma_uint32 order)
+{
+    return (order + 1) / 2;
+}
+
+/* Changes precision, carrying the state over: both run the same transposed direct form II. */
+static void biquad_cascade_set_precise(struct biquad_cascade *bq, bool precise)
+{
+    const size_t count = (size_t)bq->channels * BIQUAD_MAX_STAGES * 2;
+    if (precise == (bq->precise != 0))
+        return;
+    for (size_t i = 0; i < count; i++) {
+        if (precise)
+            bq->z1d[i] = bq->z1[i];
+        else
+            bq->z1[i] = (float)bq->z1d[i];
+    }
+    dsp_store_u32(&bq->precise, precise);
+}
+
+/*
+ * Makes `c` the cascade's coefficients. Precision follows every commit, so a
+ * cascade that ramps away from the unit circle drops back to float once it
+ * gets there instead of waiting for the next change.
+ */
+static void biquad_cascade_commit(struct biquad_cascade *bq, const struct biquad_coeffs64 *c)
+{
+    bq->coeffs = *c;
+    biquad_cascade_set_precise(bq, biquad_coeffs64_precise(c));
+}
+
+static ma_result
+biquad_cascade_init(const struct biquad_cascade_config *config, const ma_allocation_callbacks *alloc,
+        struct biquad_cascade *bq)
+{
+    struct biquad_coeffs64 design;
+
+    if (bq == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(bq, 0, sizeof(*bq));
+    if (config->channels == 0 || config->sample_rate == 0
+            || config->order == 0 || config->order > BIQUAD_MAX_ORDER
+            || config->type >= BIQUAD_FILTER_TYPE_COUNT)
+        return MA_INVALID_ARGS;
+
+    bq->channels = config->channels;
+    bq->sample_rate = config->sample_rate;
+    bq->z1 = (float *)ma_calloc(sizeof(float) * config->channels * BIQUAD_MAX_STAGES * 2, alloc);
+    bq->z1d = (double *)ma_calloc(sizeof(double) * config->channels * BIQUAD_MAX_STAGES * 2, alloc);
+    if (bq->z1 == NULL || bq->z1d == NULL) {
+        ma_free(bq->z1, alloc);
+        ma_free(bq->z1d, alloc);
+        return MA_OUT_OF_MEMORY;
+    }
+    bq->z2 = bq->z1 + config->channels * BIQUAD_MAX_STAGES;
+    bq->z2d = bq->z1d + config->channels * BIQUAD_MAX_STAGES;
+
+    bq->cutoff = bq->target_cutoff = biquad_clamp_cutoff(bq, config->cutoff);
+    bq->order = bq->target_order = config->order;
+    bq->type = bq->target_type = config->type;
+    bq->stage_count = biquad_stage_count(bq->order);
+    biquad_design_butterworth(&design, (enum biquad_filter_type)bq->type, bq->cutoff, bq->sample_rate, bq->order);
+    biquad_cascade_commit(bq, &design);
+    return MA_SUCCESS;
+}
+
+static void biquad_cascade_uninit(struct biquad_cascade *bq, const ma_allocation_callbacks *alloc)
+{
+    ma_free(bq->z1, alloc);
+    ma_free(bq->z1d, alloc);
+    bq->z1 = bq->z2 = NULL;
+    bq->z1d = bq->z2d = NULL;
+}
+
+static void biquad_cascade_set_cutoff(struct biquad_cascade *bq, float cutoff)
+{
+    dsp_store_f32(&bq->target_cutoff, biquad_clamp_cutoff(bq, cutoff));
+}
+
+static void biquad_cascade_set_order(struct biquad_cascade *bq, ma_uint32 order)
+{
+    dsp_store_u32(&bq->target_order, DSP_CLAMP(order, 1u, (ma_uint32)BIQUAD_MAX_ORDER));
+}
+
+static void biquad_cascade_set_type(struct biquad_cascade *bq, enum biquad_filter_type type)
+{
+    if (type < BIQUAD_FILTER_TYPE_COUNT)
+        dsp_store_u32(&bq->target_type, type);
+}
+
+static float biquad_cascade_get_cutoff(struct biquad_cascade *bq) { return dsp_load_f32(&bq->target_cutoff); }
+static ma_uint32 biquad_cascade_get_order(struct biquad_cascade *bq) { return dsp_load_u32(&bq->target_order); }
+static enum biquad_filter_type biquad_cascade_get_type(struct biquad_cascade *bq) { return (enum biquad_filter_type)dsp_load_u32(&bq->target_type); }
+static bool biquad_cascade_is_precise(struct biquad_cascade *bq) { return dsp_load_u32(&bq->precise) != 0; }
+
+/*
+ * One wavefront step. Lane s of `x` holds the input of section s; lanes are
+ * only committed where `valid` is set.
+ */
+#define BIQUAD_STEP(x, y, z1, z2)                                           \
+    do {                                                                    \
+        y = v4f_madd(b0, x, z1);                                            \
+        z1 = v4f_sub(v4f_madd(b1, x, z2), v4f_mul(a1, y));                  \
+        z2 = v4f_sub(v4f_mul(b2, x), v4f_mul(a2, y));                       \
+    } while (0)
+
+static inline v4m biquad_valid_lanes(ma_uint32 t, ma_uint32 n)
+{
+    /* Lane s is busy at step t when 0 <= t - s < n. */
+    const v4f lane = v4f_set(0.0f, 1.0f, 2.0f, 3.0f);
+    const v4f ft = v4f_set1((float)t);
+    return v4m_and(v4f_cmpge(ft, lane), v4f_cmpgt(v4f_add(lane, v4f_set1((float)n)), ft));
+}
+
+/* Runs four sections over one channel of `n` interleaved frames. `in` may equal `out`. */
+static void biquad_group_process(float *out, const float *in, ma_uint32 n, ma_uint32 stride,
+        const struct biquad_coeffs *c, int stage, float *z1s, float *z2s)
+{
+    const v4f b0 = v4f_load(c->b0 + stage), b1 = v4f_load(c->b1 + stage), b2 = v4f_load(c->b2 + stage);
+    const v4f a1 = v4f_load(c->a1 + stage), a2 = v4f_load(c->a2 + stage);
+    v4f z1 = v4f_load(z1s + stage), z2 = v4f_load(z2s + stage);
+    v4f y = v4f_zero();
+    const ma_uint32 lag = BIQUAD_LANES - 1;
+    ma_uint32 t = 0;
+
+    /* Prologue: later sections have no input yet. */
+    for (; t < DSP_MIN(lag, n); t++) {
+        v4f x = v4f_shift_in(y, in[t * stride]);
+        v4f nz1 = z1, nz2 = z2;
+        v4m valid = biquad_valid_lanes(t, n);
+        BIQUAD_STEP(x, y, nz1, nz2);
+        z1 = v4f_select(valid, nz1, z1);
+        z2 = v4f_select(valid, nz2, z2);
+    }
+
+    /* Steady state: every section busy. */
+    for (; t < n; t++) {
+        v4f x = v4f_shift_in(y, in[t * stride]);
+        BIQUAD_STEP(x, y, z1, z2);
+        out[(t - lag) * stride] = v4f_lane3(y);
+    }
+
+    /* Epilogue: drain the samples still travelling through later sections. */
+    for (; t < n + lag; t++) {
+        v4f x = v4f_shift_in(y, 0.0f);
+        v4f nz1 = z1, nz2 = z2;
+        v4m valid = biquad_valid_lanes(t, n);
+        BIQUAD_STEP(x, y, nz1, nz2);
+        z1 = v4f_select(valid, nz1, z1);
+        z2 = v4f_select(valid, nz2, z2);
+        if (t >= lag)
+            out[(t - lag) * stride] = v4f_lane3(y);
+    }
+
+    v4f_store(z1s + stage, z1);
+    v4f_store(z2s + stage, z2);
+}
+
+/* biquad_group_process in double precision, two sections at a time. */
+static void biquad_group_process64(float *out, const float *in, ma_uint32 n, ma_uint32 stride,
+        const struct biquad_coeffs64 *c, int stage, double *z1s, double *z2s)
+{
+    const v2d b0 = v2d_load(c->b0 + stage), b1 = v2d_load(c->b1 + stage), b2 = v2d_load(c->b2 + stage);
+    const v2d a1 = v2d_load(c->a1 + stage), a2 = v2d_load(c->a2 + stage);
+    const v2d lane = v2d_set(0.0, 1.0);
+    v2d z1 = v2d_load(z1s + stage), z2 = v2d_load(z2s + stage);
+    v2d y = v2d_zero();
+
+#define BIQUAD_STEP64(x)                                                    \
+    do {                                                                    \
+        y = v2d_madd(b0, x, z1);                                            \
+        z1 = v2d_sub(v2d_madd(b1, x, z2), v2d_mul(a1, y));                  \
+        z2 = v2d_sub(v2d_mul(b2, x), v2d_mul(a2, y));                       \
+    } while (0)
+
+    /* Prologue and epilogue are one step each: only lane 0 or lane 1 is busy. */
+    {
+        v2d x = v2d_shift_in(y, (double)in[0]);
+        v2d p1 = z1, p2 = z2;
+        BIQUAD_STEP64(x);
+        v2m valid = v2d_cmpgt(v2d_set1(1.0), lane);
+        z1 = v2d_select(valid, z1, p1);
+        z2 = v2d_select(valid, z2, p2);
+    }
+    for (ma_uint32 t = 1; t < n; t++) {
+        v2d x = v2d_shift_in(y, (double)in[t * stride]);
+        BIQUAD_STEP64(x);
+        out[(t - 1) * stride] = (float)v2d_lane1(y);
+    }
+    {
+        v2d x = v2d_shift_in(y, 0.0);
+        v2d p1 = z1, p2 = z2;
+        BIQUAD_STEP64(x);
+        v2m valid = v2d_cmpge(lane, v2d_set1(1.0));
+        z1 = v2d_select(valid, z1, p1);
+        z2 = v2d_select(valid, z2, p2);
+        out[(n - 1) * stride] = (float)v2d_lane1(y);
+    }
+#undef BIQUAD_STEP64
+
+    v2d_store(z1s + stage, z1);
+    v2d_store(z2s + stage, z2);
+}
+
+/*
+ * biquad_group_process over channels `ch` and `ch + 1` of the buffer, with
+ * the second channel's state BIQUAD_MAX_STAGES after the first's. Where the
+ * kernel table has a two-channel kernel both wavefronts share one vector.
+ */
+static void biquad_group_process_pair(float *out, const float *in, ma_uint32 n, ma_uint32 stride,
+        const struct biquad_coeffs *c, int stage, float *z1s, float *z2s)
+{
+    float rows[5 * BIQUAD_LANES];
+
+    if (kernels.biquad_pair == NULL) {
+        biquad_group_process(out, in, n, stride, c, stage, z1s, z2s);
+        biquad_group_process(out + 1, in + 1, n, stride, c, stage,
+                z1s + BIQUAD_MAX_STAGES, z2s + BIQUAD_MAX_STAGES);
+        return;
+    }
+    memcpy(rows + 0 * BIQUAD_LANES, c->b0 + stage, sizeof(float) * BIQUAD_LANES);
+    memcpy(rows + 1 * BIQUAD_LANES, c->b1 + stage, sizeof(float) * BIQUAD_LANES);
+    memcpy(rows + 2 * BIQUAD_LANES, c->b2 + stage, sizeof(float) * BIQUAD_LANES);
+    memcpy(rows + 3 * BIQUAD_LANES, c->a1 + stage, sizeof(float) * BIQUAD_LANES);
+    memcpy(rows + 4 * BIQUAD_LANES, c->a2 + stage, sizeof(float) * BIQUAD_LANES);
+    kernels.biquad_pair(out, in, n, stride, rows, z1s + stage, z2s + stage, BIQUAD_MAX_STAGES);
+}
+
+static void biquad_cascade_run(struct biquad_cascade *bq, float *out, const float *in, ma_uint32 frame_count,
+        const struct biquad_coeffs64 *c)
+{
+    struct biquad_coeffs narrow;
+
+    if (bq->precise) {
+        for (ma_uint32 ch = 0; ch < bq->channels; ch++) {
+            const float *src = in + ch;
+            double *z1 = bq->z1d + ch * BIQUAD_MAX_STAGES;
+            double *z2 = bq->z2d + ch * BIQUAD_MAX_STAGES;
+            for (ma_uint32 s = 0; s < bq->stage_count; s += BIQUAD_LANES64) {
+                biquad_group_process64(out + ch, src, frame_count, bq->channels, c, s, z1, z2);
+                src = out + ch;
+            }
+        }
+        return;
+    }
+
+    /* Channels go in pairs; an odd last channel runs on its own. */
+    biquad_coeffs_narrow(&narrow, c);
+    for (ma_uint32 ch = 0; ch < bq->channels; ch += 2) {
+        const bool pair = ch + 1 < bq->channels;
+        const float *src = in + ch;
+        float *z1 = bq->z1 + ch * BIQUAD_MAX_STAGES;
+        float *z2 = bq->z2 + ch * BIQUAD_MAX_STAGES;
+        for (ma_uint32 s = 0; s < bq->stage_count; s += BIQUAD_LANES) {
+            if (pair)
+                biquad_group_process_pair(out + ch, src, frame_count, bq->channels, &narrow, s, z1, z2);
+            else
+                biquad_group_process(out + ch, src, frame_count, bq->channels, &narrow, s, z1, z2);
+            src = out + ch;
+        }
+    }
+}
+
+static void biquad_coeffs_lerp(struct biquad_coeffs *dst, const struct biquad_coeffs *a,
+        const struct biquad_coeffs *b, float t)
+{
+    const float *pa = (const float *)a, *pb = (const float *)b;
+    float *pd = (float *)dst;
+    for (size_t i = 0; i < sizeof(*dst) / sizeof(float); i++)
+        pd[i] = pa[i] + (pb[i] - pa[i]) * t;
+}
+
+static void biquad_coeffs64_lerp(struct biquad_coeffs64 *dst, const struct biquad_coeffs64 *a,
+        const struct biquad_coeffs64 *b, double t)
+{
+    const double *pa = (const double *)a, *pb = (const double *)b;
+    double *pd = (double *)dst;
+    for (size_t i = 0; i < sizeof(*dst) / sizeof(double); i++)
+        pd[i] = pa[i] + (pb[i] - pa[i]) * t;
+}
+
+/*
+ * Picks up parameter changes for this block. Returns true when the block has
+ * to ramp from the old coefficients to `next`.
+ */
+static bool biquad_cascade_update(struct biquad_cascade *bq, ma_uint32 frame_count, struct biquad_coeffs64 *next)
+{
+    const float target = dsp_load_f32(&bq->target_cutoff);
+    const ma_uint32 order = dsp_load_u32(&bq->target_order);
+    const ma_uint32 type = dsp_load_u32(&bq->target_type);
+
+    if (target == bq->cutoff && order == bq->order && type == bq->type)
+        return false;
+
+    /* Exponential approach in the log-frequency domain, independent of block size. */
+    float k = 1.0f - expf(-(float)frame_count / (BIQUAD_SMOOTH_TIME * (float)bq->sample_rate));
+    float ratio = target / bq->cutoff;
+    if (fabsf(ratio - 1.0f) < 1e-3f)
+        bq->cutoff = target;
+    else
+        bq->cutoff *= powf(ratio, k);
+
+    /* Sections being added or removed ramp from/to identity, so both orders stay active this block. */
+    bq->stage_count = DSP_MAX(biquad_stage_count(order), biquad_stage_count(bq->order));
+    bq->order = order;
+    bq->type = type;
+    biquad_design_butterworth(next, (enum biquad_filter_type)type, bq->cutoff, bq->sample_rate, order);
+    return true;
+}
+
+static void biquad_cascade_process(struct biquad_cascade *bq, float *out, const float *in, ma_uint32 frame_count)
+{
+    struct biquad_coeffs64 next, step;
+
+    if (frame_count == 0)
+        return;
+
+    if (!biquad_cascade_update(bq, frame_count, &next)) {
+        biquad_cascade_run(bq, out, in, frame_count, &bq->coeffs);
+        return;
+    }
+
+    /* Precise for the whole ramp if either end needs it. */
+    biquad_cascade_set_precise(bq, biquad_coeffs64_precise(&bq->coeffs) || biquad_coeffs64_precise(&next));
+
+    /* Linear interpolation of both numerator and denominator stays inside the stability triangle. */
+    ma_uint32 steps = (frame_count + BIQUAD_RAMP_FRAMES - 1) / BIQUAD_RAMP_FRAMES;
+    for (ma_uint32 i = 0; i < steps; i++) {
+        ma_uint32 offset = i * BIQUAD_RAMP_FRAMES;
+        ma_uint32 n = DSP_MIN((ma_uint32)BIQUAD_RAMP_FRAMES, frame_count - offset);
+        biquad_coeffs64_lerp(&step, &bq->coeffs, &next, (double)(i + 1) / (double)steps);
+        biquad_cascade_run(bq, out + offset * bq->channels, in + offset * bq->channels, n, &step);
+    }
+    biquad_cascade_commit(bq, &next);
+    bq->stage_count = biquad_stage_count(bq->order);
+}
+
+/*
+ * Filter Node
+ */
+struct filter_node_config {
+    ma_node_config node_config;
+    struct biquad_cascade_config cascade;
+};
+
+struct filter_node {
+    ma_node_base base;
+    struct biquad_cascade cascade;
+};
+
+static struct filter_node_config
+filter_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, enum biquad_filter_type type,
+        float cutoff, ma_uint32 order)
+{
+    struct filter_node_config config;
+    config.node_config = ma_node_config_init();
+    config.cascade = biquad_cascade_config_init(channels, sample_rate, type, cutoff, order);
+    return config;
+}
+
+static void filter_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct filter_node *filter = (struct filter_node *)node;
+    (void)frame_count_in;
+    biquad_cascade_process(&filter->cascade, frames_out[0], frames_in[0], *frame_count_out);
+}
+
+static ma_node_vtable filter_node_vtable = {
+    filter_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input. */
+    1,      /* One output. */
+    0       /* Default flags. */
+};
+
+static ma_result
+filter_node_init(ma_node_graph *graph, const struct filter_node_config *config,
+        const ma_allocation_callbacks *alloc, struct filter_node *filter)
+{
+    ma_result result;
+
+    if (filter == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(filter, 0, sizeof(*filter));
+
+    result = biquad_cascade_init(&config->cascade, alloc, &filter->cascade);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &filter_node_vtable;
+    base_config.pInputChannels = &config->cascade.channels;
+    base_config.pOutputChannels = &config->cascade.channels;
+
+    result = ma_node_init(graph, &base_config, alloc, &filter->base);
+    if (result != MA_SUCCESS) {
+        biquad_cascade_uninit(&filter->cascade, alloc);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void filter_node_uninit(struct filter_node *filter, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&filter->base, alloc);
+    biquad_cascade_uninit(&filter->cascade, alloc);
+}
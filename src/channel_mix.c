@@ -0,0 +1,246 @@
+/*
+ * Channel count conversion.
+ *
+ * Connections between nodes of different channel counts go through a
+ * channel mix node that applies an out x in matrix to every frame. The
+ * matrix comes from miniaudio's channel converter, which knows the
+ * standard layouts from mono up to 7.1 and beyond: it is probed with one
+ * impulse per input channel at init. The audio thread then runs its own
+ * kernels instead of the converter:
+ *
+ * - mono to stereo and stereo to mono, four frames per vector;
+ * - everything else, the output channels of a frame four per vector,
+ *   four frames at a time.
+ *
+ * Where the kernel table (kernels.c) has wider variants of these, they run
+ * instead.
+ */
+#include "dsp.h"
+
+#define CHANNEL_MIX_MAX_STRIDE  ((MA_MAX_CHANNELS + 3) & ~3)
+
+struct channel_mix_config {
+    ma_uint32 channels_in;
+    ma_uint32 channels_out;
+};
+
+struct channel_mix {
+    ma_uint32 channels_in;
+    ma_uint32 channels_out;
+    ma_uint32 stride;           /* channels_out rounded up to the vector width */
+    float *matrix;              /* [in][stride], column of output gains per input channel */
+};
+
+static struct channel_mix_config channel_mix_config_init(ma_uint32 channels_in, ma_uint32 channels_out)
+{
+    struct channel_mix_config config;
+    config.channels_in = channels_in;
+    config.channels_out = channels_out;
+    return config;
+}
+
+static ma_result channel_mix_init(const struct channel_mix_config *config, struct channel_mix *mix)
+{
+    ma_channel_converter converter;
+    ma_result result;
+    float impulse[MA_MAX_CHANNELS], response[MA_MAX_CHANNELS];
+
+    memset(mix, 0, sizeof(*mix));
+    if (config->channels_in == 0 || config->channels_in > MA_MAX_CHANNELS
+            || config->channels_out == 0 || config->channels_out > MA_MAX_CHANNELS)
+        return MA_INVALID_ARGS;
+
+    mix->channels_in = config->channels_in;
+    mix->channels_out = config->channels_out;
+    mix->stride = (config->channels_out + 3) & ~3u;
+    mix->matrix = dsp_alloc((size_t)mix->channels_in * mix->stride);
+    if (mix->matrix == NULL)
+        return MA_OUT_OF_MEMORY;
+
+    /* Default channel maps for both counts, default (rectangular) mixing. */
+    ma_channel_converter_config converter_config = ma_channel_converter_config_init(ma_format_f32,
+            config->channels_in, NULL, config->channels_out, NULL, ma_channel_mix_mode_default);
+    result = ma_channel_converter_init(&converter_config, NULL, &converter);
+    if (result != MA_SUCCESS) {
+        dsp_free(mix->matrix);
+        mix->matrix = NULL;
+        return result;
+    }
+    for (ma_uint32 i = 0; i < mix->channels_in; i++) {
+        memset(impulse, 0, sizeof(impulse));
+        impulse[i] = 1.0f;
+        ma_channel_converter_process_pcm_frames(&converter, response, impulse, 1);
+        memcpy(mix->matrix + (size_t)i * mix->stride, response, sizeof(float) * mix->channels_out);
+    }
+    ma_channel_converter_uninit(&converter, NULL);
+    return MA_SUCCESS;
+}
+
+static void channel_mix_uninit(struct channel_mix *mix)
+{
+    dsp_free(mix->matrix);
+    mix->matrix = NULL;
+}
+
+static void channel_mix_mono_to_stereo(const struct channel_mix *mix, float *out, const float *in, ma_uint32 frame_count)
+{
+    const v4f gains = v4f_set(mix->matrix[0], mix->matrix[1], mix->matrix[0], mix->matrix[1]);
+    ma_uint32 f = 0;
+    for (; f + 4 <= frame_count; f += 4) {
+        v4f lo, hi;
+        v4f x = v4f_load(in + f);
+        v4f_zip(x, x, &lo, &hi);
+        v4f_store(out + 2 * f, v4f_mul(lo, gains));
+        v4f_store(out + 2 * f + 4, v4f_mul(hi, gains));
+    }
+    for (; f < frame_count; f++) {
+        out[2 * f] = in[f] * mix->matrix[0];
+        out[2 * f + 1] = in[f] * mix->matrix[1];
+    }
+}
+
+static void channel_mix_stereo_to_mono(const struct channel_mix *mix, float *out, const float *in, ma_uint32 frame_count)
+{
+    const float gl = mix->matrix[0], gr = mix->matrix[mix->stride];
+    const v4f left_gain = v4f_set1(gl), right_gain = v4f_set1(gr);
+    ma_uint32 f = 0;
+    for (; f + 4 <= frame_count; f += 4) {
+        v4f left, right;
+        v4f_unzip(v4f_load(in + 2 * f), v4f_load(in + 2 * f + 4), &left, &right);
+        v4f_store(out + f, v4f_madd(left, left_gain, v4f_mul(right, right_gain)));
+    }
+    for (; f < frame_count; f++)
+        out[f] = in[2 * f] * gl + in[2 * f + 1] * gr;
+}
+
+/*
+ * Any counts: a frame's outputs are built four at a time from one column per
+ * input channel, for four frames at once so the accumulations are
+ * independent. The padding lanes spill into the start of the next frame,
+ * which is stored afterwards as the vectors go from last to first, so only
+ * the last few frames go through a copy.
+ */
+static void channel_mix_generic(const struct channel_mix *mix, float *out, const float *in, ma_uint32 frame_count)
+{
+    const ma_uint32 cin = mix->channels_in, cout = mix->channels_out, stride = mix->stride;
+    ma_uint32 f = 0;
+
+    for (; f + 4 <= frame_count && (size_t)(f + 3) * cout + stride <= (size_t)frame_count * cout; f += 4) {
+        const float *x = in + (size_t)f * cin;
+        float *y = out + (size_t)f * cout;
+        for (ma_uint32 end = stride; end > 0; end -= 4) {
+            const ma_uint32 v = end - 4;
+            v4f acc0 = v4f_zero(), acc1 = v4f_zero(), acc2 = v4f_zero(), acc3 = v4f_zero();
+            for (ma_uint32 i = 0; i < cin; i++) {
+                v4f column = v4f_load_aligned(mix->matrix + (size_t)i * stride + v);
+                acc0 = v4f_madd(column, v4f_set1(x[i]), acc0);
+                acc1 = v4f_madd(column, v4f_set1(x[cin + i]), acc1);
+                acc2 = v4f_madd(column, v4f_set1(x[2 * cin + i]), acc2);
+                acc3 = v4f_madd(column, v4f_set1(x[3 * cin + i]), acc3);
+            }
+            v4f_store(y + v, acc0);
+            v4f_store(y + cout + v, acc1);
+            v4f_store(y + 2 * cout + v, acc2);
+            v4f_store(y + 3 * cout + v, acc3);
+        }
+    }
+    for (; f < frame_count; f++) {
+        const float *x = in + (size_t)f * cin;
+        float frame[CHANNEL_MIX_MAX_STRIDE];
+        for (ma_uint32 v = 0; v < stride; v += 4) {
+            v4f acc = v4f_zero();
+            for (ma_uint32 i = 0; i < cin; i++)
+                acc = v4f_madd(v4f_load_aligned(mix->matrix + (size_t)i * stride + v), v4f_set1(x[i]), acc);
+            v4f_store(frame + v, acc);
+        }
+        memcpy(out + (size_t)f * cout, frame, sizeof(float) * cout);
+    }
+}
+
+static void channel_mix_process(const struct channel_mix *mix, float *out, const float *in, ma_uint32 frame_count)
+{
+    if (mix->channels_in == 1 && mix->channels_out == 2) {
+        if (kernels.mono_to_stereo != NULL)
+            kernels.mono_to_stereo(out, in, frame_count, mix->matrix[0], mix->matrix[1]);
+        else
+            channel_mix_mono_to_stereo(mix, out, in, frame_count);
+    } else if (mix->channels_in == 2 && mix->channels_out == 1) {
+        if (kernels.stereo_to_mono != NULL)
+            kernels.stereo_to_mono(out, in, frame_count, mix->matrix[0], mix->matrix[mix->stride]);
+        else
+            channel_mix_stereo_to_mono(mix, out, in, frame_count);
+    } else if (kernels.channel_matrix != NULL) {
+        kernels.channel_matrix(out, in, frame_count, mix->matrix, mix->channels_in, mix->channels_out, mix->stride);
+    } else {
+        channel_mix_generic(mix, out, in, frame_count);
+    }
+}
+
+
+/*
+ * Channel Mix Node
+ */
+struct channel_mix_node_config {
+    ma_node_config node_config;
+    struct channel_mix_config mix;
+};
+
+struct channel_mix_node {
+    ma_node_base base;
+    struct channel_mix mix;
+};
+
+static struct channel_mix_node_config channel_mix_node_config_init(ma_uint32 channels_in, ma_uint32 channels_out)
+{
+    struct channel_mix_node_config config;
+    config.node_config = ma_node_config_init();
+    config.mix = channel_mix_config_init(channels_in, channels_out);
+    return config;
+}
+
+static void channel_mix_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct channel_mix_node *mix = (struct channel_mix_node *)node;
+    (void)frame_count_in;
+    channel_mix_process(&mix->mix, frames_out[0], frames_in[0], *frame_count_out);
+}
+
+static ma_node_vtable channel_mix_node_vtable = {
+    channel_mix_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input. */
+    1,      /* One output. */
+    0       /* Default flags. */
+};
+
+static ma_result channel_mix_node_init(ma_node_graph *graph, const struct channel_mix_node_config *config,
+        const ma_allocation_callbacks *alloc, struct channel_mix_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = channel_mix_init(&config->mix, &node->mix);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &channel_mix_node_vtable;
+    base_config.pInputChannels = &config->mix.channels_in;
+    base_config.pOutputChannels = &config->mix.channels_out;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        channel_mix_uninit(&node->mix);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void channel_mix_node_uninit(struct channel_mix_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    channel_mix_uninit(&node->mix);
+}
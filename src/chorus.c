@@ -0,0 +1,290 @@
+/*
+ * Modulated fractional delay: chorus, flanger and vibrato.
+ *
+ * Each channel has a delay line read at a position swept by a sine LFO and
+ * interpolated with a cubic Hermite. Four consecutive frames are computed
+ * per vector. With feedback, a frame's read can depend on what an earlier
+ * frame of the same vector writes, so the delay never drops below
+ * CHORUS_MIN_FRAMES. That keeps every read of a vector in frames written by
+ * earlier vectors. The LFO is a complex phasor per lane, rotated once per
+ * vector, so there are no per-sample sin calls. The base delay and depth
+ * ramp across the block, so moving them doesn't click.
+ */
+#include "dsp.h"
+
+#define CHORUS_MAX_DELAY        50.0f   /* ms, base delay */
+#define CHORUS_MAX_DEPTH        20.0f   /* ms, sweep either side of the base */
+#define CHORUS_MAX_FEEDBACK     0.95f
+#define CHORUS_MIN_FRAMES       6       /* Shortest delay: lane 3 reads up to two frames ahead of its position. */
+
+struct chorus_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    float delay;
+    float depth;
+    float rate;
+    float feedback;
+    float mix;
+};
+
+struct chorus {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+
+    /* Written by the UI thread, read once per block. */
+    float delay;                /* ms */
+    float depth;                /* ms */
+    float rate;                 /* Hz */
+    float feedback;             /* -CHORUS_MAX_FEEDBACK .. CHORUS_MAX_FEEDBACK */
+    float mix;                  /* 0 dry .. 1 wet, 1 for vibrato */
+
+    /* Audio thread state. */
+    float applied_delay;        /* frames */
+    float applied_depth;        /* frames */
+    float *lfo_re, *lfo_im;     /* [channel][4], LFO phasor of each lane of the next vector */
+    float *lines;               /* [channel][mask + 1] */
+    ma_uint32 mask;
+    ma_uint32 write;
+    struct dsp_arena arena;
+};
+
+static struct chorus_config chorus_config_init(ma_uint32 channels, ma_uint32 sample_rate,
+        float delay, float depth, float rate, float feedback, float mix)
+{
+    struct chorus_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.delay = delay;
+    config.depth = depth;
+    config.rate = rate;
+    config.feedback = feedback;
+    config.mix = mix;
+    return config;
+}
+
+static void chorus_layout(struct chorus *ch)
+{
+    ch->lfo_re = dsp_arena_floats(&ch->arena, (size_t)ch->channels * 4);
+    ch->lfo_im = dsp_arena_floats(&ch->arena, (size_t)ch->channels * 4);
+    ch->lines = dsp_arena_floats(&ch->arena, (size_t)ch->channels * (ch->mask + 1));
+}
+
+/* Delay and depth in frames, clamped so the read stays between CHORUS_MIN_FRAMES and the line length. */
+static void chorus_targets(const struct chorus *ch, float *delay, float *depth)
+{
+    const float ms = (float)ch->sample_rate / 1000.0f;
+    *depth = DSP_CLAMP(dsp_load_f32(&ch->depth), 0.0f, CHORUS_MAX_DEPTH) * ms;
+    *delay = DSP_CLAMP(dsp_load_f32(&ch->delay), 0.0f, CHORUS_MAX_DELAY) * ms;
+    *delay = DSP_MAX(*delay, *depth + (float)CHORUS_MIN_FRAMES);
+}
+
+static ma_result chorus_init(const struct chorus_config *config, struct chorus *ch)
+{
+    ma_result result;
+
+    memset(ch, 0, sizeof(*ch));
+    if (config->channels == 0 || config->sample_rate == 0)
+        return MA_INVALID_ARGS;
+
+    ch->channels = config->channels;
+    ch->sample_rate = config->sample_rate;
+    ch->delay = config->delay;
+    ch->depth = config->depth;
+    ch->rate = config->rate;
+    ch->feedback = config->feedback;
+    ch->mix = config->mix;
+
+    /* Longest read plus the interpolation taps, rounded up to a power of two. */
+    ma_uint32 longest = (ma_uint32)ceilf((CHORUS_MAX_DELAY + CHORUS_MAX_DEPTH) * config->sample_rate / 1000.0f)
+            + CHORUS_MIN_FRAMES + 4;
+    ma_uint32 size = 1;
+    while (size < longest)
+        size <<= 1;
+    ch->mask = size - 1;
+
+    chorus_layout(ch);
+    result = dsp_arena_init(&ch->arena, ch->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    chorus_layout(ch);
+
+    /* Channels sweep a quarter cycle apart, which widens the stereo image. */
+    for (ma_uint32 c = 0; c < ch->channels; c++) {
+        for (ma_uint32 lane = 0; lane < 4; lane++) {
+            ch->lfo_re[c * 4 + lane] = cosf((float)(DSP_PI / 2.0) * (float)c);
+            ch->lfo_im[c * 4 + lane] = sinf((float)(DSP_PI / 2.0) * (float)c);
+        }
+    }
+    chorus_targets(ch, &ch->applied_delay, &ch->applied_depth);
+    return MA_SUCCESS;
+}
+
+static void chorus_uninit(struct chorus *ch)
+{
+    dsp_arena_uninit(&ch->arena);
+}
+
+/* Complex multiply of the lane phasors by (c, s). */
+static inline void chorus_rotate(v4f *re, v4f *im, v4f c, v4f s)
+{
+    v4f r = v4f_sub(v4f_mul(*re, c), v4f_mul(*im, s));
+    *im = v4f_madd(*re, s, v4f_mul(*im, c));
+    *re = r;
+}
+
+static void chorus_process(struct chorus *ch, float *out, const float *in, ma_uint32 frame_count)
+{
+    const ma_uint32 channels = ch->channels, mask = ch->mask, size = mask + 1;
+    const ma_uint32 groups = (frame_count + 3) / 4;
+    const float omega = (float)(2.0 * DSP_PI) * DSP_CLAMP(dsp_load_f32(&ch->rate), 0.0f, 20.0f) / (float)ch->sample_rate;
+    const v4f feedback = v4f_set1(DSP_CLAMP(dsp_load_f32(&ch->feedback), -CHORUS_MAX_FEEDBACK, CHORUS_MAX_FEEDBACK));
+    const v4f mix = v4f_set1(DSP_CLAMP(dsp_load_f32(&ch->mix), 0.0f, 1.0f));
+    const v4f lane = v4f_set(0.0f, 1.0f, 2.0f, 3.0f);
+    const v4f c4 = v4f_set1(cosf(4.0f * omega)), s4 = v4f_set1(sinf(4.0f * omega));
+    float target_delay, target_depth;
+
+    if (frame_count == 0)
+        return;
+    chorus_targets(ch, &target_delay, &target_depth);
+    const float delay_step = (target_delay - ch->applied_delay) / (float)groups;
+    const float depth_step = (target_depth - ch->applied_depth) / (float)groups;
+
+    for (ma_uint32 c = 0; c < channels; c++) {
+        float *line = ch->lines + (size_t)c * size;
+        v4f lfo_re = v4f_load(ch->lfo_re + c * 4), lfo_im = v4f_load(ch->lfo_im + c * 4);
+        float delay = ch->applied_delay, depth = ch->applied_depth;
+        ma_uint32 write = ch->write;
+        float x[4], index[4], y[4];
+
+        for (ma_uint32 g = 0; g < groups; g++) {
+            const ma_uint32 f0 = g * 4, count = DSP_MIN(4u, frame_count - f0);
+            delay += delay_step;
+            depth += depth_step;
+
+            /* Read positions relative to the write position, so the fraction keeps full precision. */
+            v4f d = v4f_madd(v4f_set1(depth), lfo_im, v4f_set1(delay));
+            v4f pos = v4f_sub(lane, d);
+            v4f whole = v4f_floor(pos);
+            v4f t = v4f_sub(pos, whole);
+            v4f_store(index, whole);
+
+            float taps[4][4];   /* [tap][lane] */
+            for (ma_uint32 l = 0; l < 4; l++) {
+                ma_uint32 i = write + (ma_uint32)(int)index[l];
+                taps[0][l] = line[(i - 1) & mask];
+                taps[1][l] = line[i & mask];
+                taps[2][l] = line[(i + 1) & mask];
+                taps[3][l] = line[(i + 2) & mask];
+            }
+            v4f xm1 = v4f_load(taps[0]), x0 = v4f_load(taps[1]), x1 = v4f_load(taps[2]), x2 = v4f_load(taps[3]);
+            v4f c1 = v4f_mul(v4f_set1(0.5f), v4f_sub(x1, xm1));
+            v4f c2 = v4f_add(v4f_sub(xm1, v4f_mul(v4f_set1(2.5f), x0)),
+                    v4f_sub(v4f_add(x1, x1), v4f_mul(v4f_set1(0.5f), x2)));
+            v4f c3 = v4f_madd(v4f_set1(0.5f), v4f_sub(x2, xm1), v4f_mul(v4f_set1(1.5f), v4f_sub(x0, x1)));
+            v4f wet = v4f_madd(v4f_madd(v4f_madd(c3, t, c2), t, c1), t, x0);
+
+            for (ma_uint32 l = 0; l < 4; l++)
+                x[l] = l < count ? in[(size_t)(f0 + l) * channels + c] : 0.0f;
+            v4f dry = v4f_load(x);
+            v4f_store(index, v4f_madd(feedback, wet, dry));
+            v4f_store(y, v4f_madd(mix, v4f_sub(wet, dry), dry));
+            for (ma_uint32 l = 0; l < count; l++) {
+                line[(write + l) & mask] = index[l];
+                out[(size_t)(f0 + l) * channels + c] = y[l];
+            }
+            write = (write + count) & mask;
+
+            if (count == 4) {
+                chorus_rotate(&lfo_re, &lfo_im, c4, s4);
+            } else {
+                chorus_rotate(&lfo_re, &lfo_im, v4f_set1(cosf((float)count * omega)),
+                        v4f_set1(sinf((float)count * omega)));
+            }
+        }
+
+        /* Lanes are rebuilt from lane 0 every block so rounding can't pull them apart or off the unit circle. */
+        float re0 = v4f_lane0(lfo_re), im0 = v4f_lane0(lfo_im);
+        float norm = 1.0f / sqrtf(re0 * re0 + im0 * im0);
+        re0 *= norm;
+        im0 *= norm;
+        for (ma_uint32 l = 0; l < 4; l++) {
+            float cl = cosf((float)l * omega), sl = sinf((float)l * omega);
+            ch->lfo_re[c * 4 + l] = re0 * cl - im0 * sl;
+            ch->lfo_im[c * 4 + l] = re0 * sl + im0 * cl;
+        }
+    }
+
+    ch->applied_delay = target_delay;
+    ch->applied_depth = target_depth;
+    ch->write = (ch->write + frame_count) & mask;
+}
+
+
+/*
+ * Chorus Node
+ */
+struct chorus_node_config {
+    ma_node_config node_config;
+    struct chorus_config chorus;
+};
+
+struct chorus_node {
+    ma_node_base base;
+    struct chorus chorus;
+};
+
+static struct chorus_node_config chorus_node_config_init(ma_uint32 channels, ma_uint32 sample_rate,
+        float delay, float depth, float rate, float feedback, float mix)
+{
+    struct chorus_node_config config;
+    config.node_config = ma_node_config_init();
+    config.chorus = chorus_config_init(channels, sample_rate, delay, depth, rate, feedback, mix);
+    return config;
+}
+
+static void chorus_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct chorus_node *chorus = (struct chorus_node *)node;
+    (void)frame_count_in;
+    chorus_process(&chorus->chorus, frames_out[0], frames_in[0], *frame_count_out);
+}
+
+static ma_node_vtable chorus_node_vtable = {
+    chorus_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input. */
+    1,      /* One output. */
+    MA_NODE_FLAG_CONTINUOUS_PROCESSING  /* Feedback keeps ringing after the input stops. */
+};
+
+static ma_result chorus_node_init(ma_node_graph *graph, const struct chorus_node_config *config,
+        const ma_allocation_callbacks *alloc, struct chorus_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = chorus_init(&config->chorus, &node->chorus);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &chorus_node_vtable;
+    base_config.pInputChannels = &config->chorus.channels;
+    base_config.pOutputChannels = &config->chorus.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        chorus_uninit(&node->chorus);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void chorus_node_uninit(struct chorus_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    chorus_uninit(&node->chorus);
+}
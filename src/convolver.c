@@ -0,0 +1,467 @@
+/*
+ * Partitioned FFT convolution.
+ *
+ * `struct upols` is a uniformly partitioned overlap-save convolver: the
+ * impulse response is cut into partitions of one block, each partition is
+ * transformed once, and every new input block is transformed once and kept
+ * in a frequency domain delay line. One block of output is then a sum of
+ * complex products over all partitions and a single inverse FFT.
+ *
+ * The convolver node splits long impulse responses non-uniformly: the head
+ * uses small blocks on the audio thread for low latency, and the tail is cut
+ * into levels with 8x and 64x larger blocks that run on worker threads. A
+ * level with block T starts 2T into the response, so a worker has a full
+ * block period after its input is complete before the result is needed.
+ */
+#include <pthread.h>
+
+#include "dsp.h"
+
+/*
+ * Uniformly partitioned overlap-save convolver
+ */
+struct upols {
+    ma_uint32 block;
+    ma_uint32 bins;             /* block + 1 */
+    ma_uint32 stride;           /* bins rounded up to the vector width */
+    ma_uint32 partitions;
+    ma_uint32 channels;
+    ma_uint32 ir_channels;
+    const struct fft_plan *plan;
+    float *ir_re, *ir_im;       /* [ir_channel][partition][stride] */
+    float *fdl_re, *fdl_im;     /* [channel][partition][stride], ring of input spectra */
+    ma_uint32 fdl_pos;          /* Slot of the newest spectrum. */
+    float *window;              /* [channel][2 * block] */
+    float *acc_re, *acc_im;
+    float *time;
+    float *scratch;
+    struct dsp_arena arena;
+};
+
+static void upols_layout(struct upols *c)
+{
+    size_t spectra = (size_t)c->partitions * c->stride;
+    c->ir_re = dsp_arena_floats(&c->arena, spectra * c->ir_channels);
+    c->ir_im = dsp_arena_floats(&c->arena, spectra * c->ir_channels);
+    c->fdl_re = dsp_arena_floats(&c->arena, spectra * c->channels);
+    c->fdl_im = dsp_arena_floats(&c->arena, spectra * c->channels);
+    c->window = dsp_arena_floats(&c->arena, (size_t)2 * c->block * c->channels);
+    c->acc_re = dsp_arena_floats(&c->arena, c->stride);
+    c->acc_im = dsp_arena_floats(&c->arena, c->stride);
+    c->time = dsp_arena_floats(&c->arena, 2 * c->block);
+    c->scratch = dsp_arena_floats(&c->arena, fft_scratch_size(c->plan));
+}
+
+/*
+ * Partition spectra of `ir` (at most partitions * block frames of
+ * ir_channels) into `ir_re`/`ir_im`, laid out like the convolver's own.
+ * `time` holds 2 * block floats and `scratch` fft_scratch_size(), so another
+ * thread can prepare a response with buffers of its own.
+ */
+static void upols_transform(const struct upols *c, const float *ir, ma_uint32 ir_frames,
+        float *ir_re, float *ir_im, float *time, float *scratch)
+{
+    const ma_uint32 block = c->block, ir_channels = c->ir_channels;
+
+    /* Transform each partition once; fold the 1/2B inverse FFT scale in here. */
+    const float scale = 1.0f / (float)(2 * block);
+    for (ma_uint32 ch = 0; ch < ir_channels; ch++) {
+        for (ma_uint32 p = 0; p < c->partitions; p++) {
+            memset(time, 0, sizeof(float) * 2 * block);
+            for (ma_uint32 i = 0; i < block && p * block + i < ir_frames; i++)
+                time[i] = ir[(size_t)(p * block + i) * ir_channels + ch] * scale;
+            size_t offset = ((size_t)ch * c->partitions + p) * c->stride;
+            fft_forward(c->plan, time, ir_re + offset, ir_im + offset, scratch);
+        }
+    }
+}
+
+/*
+ * `ir` is interleaved with `ir_channels` channels. Input channel c is
+ * convolved with response channel c % ir_channels. `block` must be an FFT
+ * friendly size (see fft_next_size()).
+ */
+static ma_result upols_init(struct upols *c, const float *ir, ma_uint32 ir_frames, ma_uint32 ir_channels,
+        ma_uint32 channels, ma_uint32 block)
+{
+    ma_result result;
+
+    memset(c, 0, sizeof(*c));
+    if (ir_frames == 0 || ir_channels == 0 || channels == 0 || block == 0)
+        return MA_INVALID_ARGS;
+
+    c->plan = fft_plan_get(2 * block);
+    if (c->plan == NULL)
+        return MA_INVALID_ARGS;
+    c->block = block;
+    c->bins = block + 1;
+    c->stride = (c->bins + 3) & ~3u;
+    c->partitions = (ir_frames + block - 1) / block;
+    c->channels = channels;
+    c->ir_channels = ir_channels;
+
+    upols_layout(c);
+    result = dsp_arena_init(&c->arena, c->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    upols_layout(c);
+
+    upols_transform(c, ir, ir_frames, c->ir_re, c->ir_im, c->time, c->scratch);
+    return MA_SUCCESS;
+}
+
+static void upols_uninit(struct upols *c)
+{
+    dsp_arena_uninit(&c->arena);
+}
+
+/* Consumes one block per channel from planar `in` into the frequency domain delay line. */
+static void upols_push(struct upols *c, const float *in)
+{
+    const ma_uint32 B = c->block;
+    const size_t spectra = (size_t)c->partitions * c->stride;
+
+    c->fdl_pos = (c->fdl_pos + 1) % c->partitions;
+
+    for (ma_uint32 ch = 0; ch < c->channels; ch++) {
+        float *window = c->window + (size_t)ch * 2 * B;
+        float *fdl_re = c->fdl_re + ch * spectra, *fdl_im = c->fdl_im + ch * spectra;
+
+        /* Slide the input window and transform it into the newest delay line slot. */
+        memmove(window, window + B, sizeof(float) * B);
+        memcpy(window + B, in + (size_t)ch * B, sizeof(float) * B);
+        fft_forward(c->plan, window, fdl_re + c->fdl_pos * c->stride, fdl_im + c->fdl_pos * c->stride, c->scratch);
+    }
+}
+
+/*
+ * Writes one block per channel to planar `out`: the delay line convolved
+ * with the partition spectra `ir_re`/`ir_im` (see upols_transform()).
+ * Several responses can be applied to the same pushed input.
+ */
+static void upols_convolve(struct upols *c, const float *ir_re_all, const float *ir_im_all, float *out)
+{
+    const ma_uint32 B = c->block, P = c->partitions;
+    const size_t spectra = (size_t)P * c->stride;
+
+    for (ma_uint32 ch = 0; ch < c->channels; ch++) {
+        const float *fdl_re = c->fdl_re + ch * spectra, *fdl_im = c->fdl_im + ch * spectra;
+        const ma_uint32 ir_ch = ch % c->ir_channels;
+        const float *ir_re = ir_re_all + ir_ch * spectra, *ir_im = ir_im_all + ir_ch * spectra;
+
+        memset(c->acc_re, 0, sizeof(float) * c->stride);
+        memset(c->acc_im, 0, sizeof(float) * c->stride);
+        for (ma_uint32 p = 0; p < P; p++) {
+            ma_uint32 slot = (c->fdl_pos + P - p) % P;
+            kernels.cmac(c->acc_re, c->acc_im, fdl_re + slot * c->stride, fdl_im + slot * c->stride,
+                    ir_re + p * c->stride, ir_im + p * c->stride, c->stride);
+        }
+
+        /* Overlap-save: the first half of the inverse transform is circular garbage. */
+        fft_inverse(c->plan, c->acc_re, c->acc_im, c->time, c->scratch);
+        memcpy(out + (size_t)ch * B, c->time + B, sizeof(float) * B);
+    }
+}
+
+/* Consumes one block per channel from planar `in` and writes one block per channel to planar `out`. */
+static void upols_process(struct upols *c, const float *in, float *out)
+{
+    upols_push(c, in);
+    upols_convolve(c, c->ir_re, c->ir_im, out);
+}
+
+
+/*
+ * Convolver Node
+ */
+#define CONVOLVER_HEAD_BLOCK    128
+#define CONVOLVER_LEVEL_FACTOR  8
+#define CONVOLVER_MAX_LEVELS    2   /* Tail levels, each on its own worker thread. */
+
+struct convolver_level {
+    struct upols conv;
+    ma_uint32 block;
+    float *in_slots;                /* [2][channel][block], double buffered input */
+    float *out_slots;               /* [2][channel][block], double buffered output */
+    ma_uint32 fill;                 /* Frames gathered into the current input slot. */
+    ma_uint32 posted;               /* Blocks handed to the worker, accessed atomically. */
+    ma_uint32 done;                 /* Blocks finished by the worker, accessed atomically. */
+    ma_uint32 quit;
+    struct dsp_wake wake;
+    pthread_t thread;
+    bool running;
+};
+
+struct convolver_node_config {
+    ma_node_config node_config;
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    const char *file_name;
+};
+
+struct convolver_node {
+    ma_node_base base;
+    ma_uint32 channels;
+    ma_uint32 block;
+    ma_uint32 ir_frames;
+    struct upols head;
+    struct convolver_level levels[CONVOLVER_MAX_LEVELS];
+    ma_uint32 level_count;
+
+    /* Block FIFO between the graph and the head convolver, planar. */
+    float *in_block;
+    float *dry_block;
+    float *wet_block;
+    ma_uint32 pos;
+    ma_uint64 clock;                /* Frames convolved so far. */
+
+    float mix;                      /* 0 = dry, 1 = wet. Set from the UI thread. */
+    ma_uint32 underruns;            /* Tail blocks that were late, read by the UI thread. */
+};
+
+static struct convolver_node_config
+convolver_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, const char *file_name)
+{
+    struct convolver_node_config config;
+    config.node_config = ma_node_config_init();
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.file_name = file_name;
+    return config;
+}
+
+static void *convolver_level_worker(void *user)
+{
+    struct convolver_level *level = (struct convolver_level *)user;
+    const size_t slot_size = (size_t)level->conv.channels * level->block;
+    const ma_uint64 fp_mode = dsp_denormals_flush(MA_TRUE);
+    ma_uint32 next = 0;
+
+    for (;;) {
+        dsp_wake_wait(&level->wake);
+        if (dsp_load_u32(&level->quit))
+            break;
+        /* Catch up on everything posted so far; later wake-ups may then find nothing new. */
+        while (next != dsp_load_acquire_u32(&level->posted)) {
+            upols_process(&level->conv, level->in_slots + (next & 1) * slot_size,
+                    level->out_slots + (next & 1) * slot_size);
+            next++;
+            dsp_store_release_u32(&level->done, next);
+        }
+    }
+    dsp_denormals_restore(fp_mode);
+    return NULL;
+}
+
+static ma_result convolver_level_init(struct convolver_level *level, const float *ir, ma_uint32 ir_frames,
+        ma_uint32 ir_channels, ma_uint32 channels, ma_uint32 block)
+{
+    ma_result result;
+
+    memset(level, 0, sizeof(*level));
+    level->block = block;
+    result = upols_init(&level->conv, ir, ir_frames, ir_channels, channels, block);
+    if (result != MA_SUCCESS)
+        return result;
+
+    level->in_slots = dsp_alloc((size_t)2 * channels * block);
+    level->out_slots = dsp_alloc((size_t)2 * channels * block);
+    if (level->in_slots == NULL || level->out_slots == NULL)
+        return MA_OUT_OF_MEMORY;
+
+    result = dsp_wake_init(&level->wake);
+    if (result != MA_SUCCESS)
+        return result;
+    if (pthread_create(&level->thread, NULL, convolver_level_worker, level) != 0) {
+        dsp_wake_uninit(&level->wake);
+        return MA_ERROR;
+    }
+    level->running = true;
+    return MA_SUCCESS;
+}
+
+static void convolver_level_uninit(struct convolver_level *level)
+{
+    if (level->running) {
+        dsp_store_u32(&level->quit, 1);
+        dsp_wake_post(&level->wake);
+        pthread_join(level->thread, NULL);
+        dsp_wake_uninit(&level->wake);
+        level->running = false;
+    }
+    upols_uninit(&level->conv);
+    dsp_free(level->in_slots);
+    dsp_free(level->out_slots);
+    level->in_slots = level->out_slots = NULL;
+}
+
+/* Runs one head block: convolves in_block into wet_block and exchanges blocks with the tail workers. */
+static void convolver_process_block(struct convolver_node *cv)
+{
+    const ma_uint32 B = cv->block;
+
+    upols_process(&cv->head, cv->in_block, cv->wet_block);
+
+    for (ma_uint32 l = 0; l < cv->level_count; l++) {
+        struct convolver_level *level = &cv->levels[l];
+        const ma_uint32 T = level->block;
+        const size_t slot_size = (size_t)cv->channels * T;
+
+        /* Tail block k lands 2T later, so this head block reads block clock / T - 2. */
+        ma_uint64 k = cv->clock / T;
+        if (k >= 2) {
+            ma_uint32 wanted = (ma_uint32)(k - 2);
+            if (dsp_load_acquire_u32(&level->done) > wanted) {
+                const float *slot = level->out_slots + (wanted & 1) * slot_size + cv->clock % T;
+                for (ma_uint32 ch = 0; ch < cv->channels; ch++) {
+                    float *wet = cv->wet_block + (size_t)ch * B;
+                    const float *tail = slot + (size_t)ch * T;
+                    for (ma_uint32 i = 0; i < B; i += 4)
+                        v4f_store(wet + i, v4f_add(v4f_load(wet + i), v4f_load(tail + i)));
+                }
+            } else {
+                dsp_store_u32(&cv->underruns, dsp_load_u32(&cv->underruns) + 1);
+            }
+        }
+
+        /* Gather input for the worker and wake it once a whole tail block is ready. */
+        float *slot = level->in_slots + (level->posted & 1) * slot_size + level->fill;
+        for (ma_uint32 ch = 0; ch < cv->channels; ch++)
+            memcpy(slot + (size_t)ch * T, cv->in_block + (size_t)ch * B, sizeof(float) * B);
+        level->fill += B;
+        if (level->fill == T) {
+            level->fill = 0;
+            dsp_store_release_u32(&level->posted, level->posted + 1);
+            dsp_wake_post(&level->wake);
+        }
+    }
+    cv->clock += B;
+}
+
+static void convolver_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct convolver_node *cv = (struct convolver_node *)node;
+    const ma_uint32 channels = cv->channels, B = cv->block;
+    const float mix = dsp_load_f32(&cv->mix);
+    const float *in = frames_in[0];
+    float *out = frames_out[0];
+    ma_uint32 frame_count = *frame_count_out;
+    (void)frame_count_in;
+
+    while (frame_count > 0) {
+        ma_uint32 n = DSP_MIN(frame_count, B - cv->pos);
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            float *in_block = cv->in_block + (size_t)ch * B + cv->pos;
+            const float *dry = cv->dry_block + (size_t)ch * B + cv->pos;
+            const float *wet = cv->wet_block + (size_t)ch * B + cv->pos;
+            for (ma_uint32 i = 0; i < n; i++) {
+                in_block[i] = in[i * channels + ch];
+                out[i * channels + ch] = dry[i] + (wet[i] - dry[i]) * mix;
+            }
+        }
+        in += n * channels;
+        out += n * channels;
+        frame_count -= n;
+        cv->pos += n;
+
+        if (cv->pos == B) {
+            convolver_process_block(cv);
+            memcpy(cv->dry_block, cv->in_block, sizeof(float) * B * channels);
+            cv->pos = 0;
+        }
+    }
+}
+
+static ma_node_vtable convolver_node_vtable = {
+    convolver_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input. */
+    1,      /* One output. */
+    0       /* Default flags. */
+};
+
+static void convolver_node_uninit(struct convolver_node *cv, const ma_allocation_callbacks *alloc)
+{
+    if (cv->base.vtable != NULL)
+        ma_node_uninit(&cv->base, alloc);
+    for (ma_uint32 l = 0; l < cv->level_count; l++)
+        convolver_level_uninit(&cv->levels[l]);
+    cv->level_count = 0;
+    upols_uninit(&cv->head);
+    dsp_free(cv->in_block);
+    cv->in_block = NULL;
+}
+
+static ma_result convolver_node_init(ma_node_graph *graph, const struct convolver_node_config *config,
+        const ma_allocation_callbacks *alloc, struct convolver_node *cv)
+{
+    ma_result result;
+    ma_uint64 frames = 0;
+    void *ir = NULL;
+
+    if (cv == NULL || config == NULL || config->file_name == NULL || config->channels == 0)
+        return MA_INVALID_ARGS;
+    memset(cv, 0, sizeof(*cv));
+    cv->channels = config->channels;
+    cv->block = CONVOLVER_HEAD_BLOCK;
+    cv->mix = 0.5f;
+
+    /* Decode the whole response at the engine rate, keeping its own channel count. */
+    ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_f32, 0, config->sample_rate);
+    result = ma_decode_file(config->file_name, &decoder_config, &frames, &ir);
+    if (result != MA_SUCCESS)
+        return result;
+    if (frames == 0 || frames > 0xFFFFFFFF / 2) {
+        ma_free(ir, NULL);
+        return MA_INVALID_FILE;
+    }
+    cv->ir_frames = (ma_uint32)frames;
+    const ma_uint32 ir_channels = decoder_config.channels;
+    const float *h = (const float *)ir;
+
+    /* Head covers [0, 2 T1), level l covers [2 Tl, 2 Tl+1), the last level runs to the end. */
+    ma_uint32 head_frames = DSP_MIN(cv->ir_frames, 2 * cv->block * CONVOLVER_LEVEL_FACTOR);
+    result = upols_init(&cv->head, h, head_frames, ir_channels, cv->channels, cv->block);
+
+    ma_uint32 start = head_frames, block = cv->block * CONVOLVER_LEVEL_FACTOR;
+    for (ma_uint32 l = 0; result == MA_SUCCESS && l < CONVOLVER_MAX_LEVELS && start < cv->ir_frames; l++) {
+        ma_uint32 end = l + 1 < CONVOLVER_MAX_LEVELS ? 2 * block * CONVOLVER_LEVEL_FACTOR : cv->ir_frames;
+        end = DSP_MIN(end, cv->ir_frames);
+        result = convolver_level_init(&cv->levels[l], h + (size_t)start * ir_channels, end - start,
+                ir_channels, cv->channels, block);
+        cv->level_count = l + 1;
+        start = end;
+        block *= CONVOLVER_LEVEL_FACTOR;
+    }
+    ma_free(ir, NULL);
+
+    if (result == MA_SUCCESS) {
+        cv->in_block = dsp_alloc((size_t)3 * cv->block * cv->channels);
+        if (cv->in_block == NULL)
+            result = MA_OUT_OF_MEMORY;
+    }
+    if (result != MA_SUCCESS) {
+        convolver_node_uninit(cv, alloc);
+        return result;
+    }
+    cv->dry_block = cv->in_block + cv->block * cv->channels;
+    cv->wet_block = cv->dry_block + cv->block * cv->channels;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &convolver_node_vtable;
+    base_config.pInputChannels = &config->channels;
+    base_config.pOutputChannels = &config->channels;
+    result = ma_node_init(graph, &base_config, alloc, &cv->base);
+    if (result != MA_SUCCESS) {
+        convolver_node_uninit(cv, alloc);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+/* Latency of the wet signal in frames. */
+static ma_uint32 convolver_node_get_latency(const struct convolver_node *cv)
+{
+    return cv->block;
+}
@@ -0,0 +1,574 @@
+/*
+ * Shared helpers for the DSP modules: a 4-wide float vector layer over
+ * SSE2 / NEON with a scalar fallback, a 2-wide double one for the few
+ * places that need the precision, aligned buffers and relaxed atomics
+ * for parameters written by the UI thread and read by the audio thread.
+ */
+#ifndef DSP_H
+#define DSP_H
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "miniaudio.h"
+
+/* Define DSP_NO_SIMD to build the scalar fallback on any target. */
+#if defined(DSP_NO_SIMD)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define DSP_SSE2
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define DSP_NEON
+    #include <arm_neon.h>
+#endif
+
+#define DSP_ALIGNMENT 64
+
+#ifndef DSP_PI
+#define DSP_PI 3.14159265358979323846
+#endif
+#define DSP_SQRT2 1.41421356237309504880
+
+#define DSP_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define DSP_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define DSP_CLAMP(x, lo, hi) DSP_MIN(DSP_MAX(x, lo), hi)
+
+/* Vector of four floats and the matching lane mask. */
+#if defined(DSP_SSE2)
+typedef __m128 v4f;
+typedef __m128 v4m;
+
+static inline v4f v4f_zero(void)                      { return _mm_setzero_ps(); }
+static inline v4f v4f_set1(float x)                   { return _mm_set1_ps(x); }
+static inline v4f v4f_set(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+static inline v4f v4f_load(const float *p)            { return _mm_loadu_ps(p); }
+static inline v4f v4f_load_aligned(const float *p)    { return _mm_load_ps(p); }
+static inline void v4f_store(float *p, v4f v)         { _mm_storeu_ps(p, v); }
+static inline void v4f_store_aligned(float *p, v4f v) { _mm_store_ps(p, v); }
+static inline v4f v4f_add(v4f a, v4f b)               { return _mm_add_ps(a, b); }
+static inline v4f v4f_sub(v4f a, v4f b)               { return _mm_sub_ps(a, b); }
+static inline v4f v4f_mul(v4f a, v4f b)               { return _mm_mul_ps(a, b); }
+static inline v4f v4f_madd(v4f a, v4f b, v4f c)       { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static inline v4f v4f_min(v4f a, v4f b)               { return _mm_min_ps(a, b); }
+static inline v4f v4f_max(v4f a, v4f b)               { return _mm_max_ps(a, b); }
+static inline v4f v4f_abs(v4f a)                      { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline v4m v4f_cmpgt(v4f a, v4f b)             { return _mm_cmpgt_ps(a, b); }
+static inline v4m v4f_cmpge(v4f a, v4f b)             { return _mm_cmpge_ps(a, b); }
+static inline v4m v4m_and(v4m a, v4m b)               { return _mm_and_ps(a, b); }
+static inline v4f v4f_select(v4m m, v4f a, v4f b)     { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+static inline float v4f_lane0(v4f v)                  { return _mm_cvtss_f32(v); }
+static inline float v4f_lane3(v4f v)                  { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))); }
+
+/* [x, v0, v1, v2]: feeds each lane with the previous lane's value. */
+static inline v4f v4f_shift_in(v4f v, float x)
+{
+    v4f shifted = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4));
+    return _mm_move_ss(shifted, _mm_set_ss(x));
+}
+
+static inline float v4f_hsum(v4f v)
+{
+    v4f t = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    t = _mm_add_ss(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(t);
+}
+
+static inline void v4f_transpose(v4f *r0, v4f *r1, v4f *r2, v4f *r3)
+{
+    _MM_TRANSPOSE4_PS(*r0, *r1, *r2, *r3);
+}
+
+/* lo = [a0, b0, a1, b1], hi = [a2, b2, a3, b3] */
+static inline void v4f_zip(v4f a, v4f b, v4f *lo, v4f *hi)
+{
+    *lo = _mm_unpacklo_ps(a, b);
+    *hi = _mm_unpackhi_ps(a, b);
+}
+
+/* even = [a0, a2, b0, b2], odd = [a1, a3, b1, b3] */
+static inline void v4f_unzip(v4f a, v4f b, v4f *even, v4f *odd)
+{
+    *even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    *odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+static inline v4f v4f_reverse(v4f v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)); }
+
+static inline v4f v4f_div(v4f a, v4f b) { return _mm_div_ps(a, b); }
+static inline v4f v4f_sqrt(v4f a)       { return _mm_sqrt_ps(a); }
+
+static inline float v4f_hmax(v4f v)
+{
+    v4f t = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    t = _mm_max_ss(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(t);
+}
+
+/* Mantissa and exponent of positive x as floats: x = m * 2^(e - 126), m in [0.5, 1). */
+static inline void v4f_frexp(v4f x, v4f *m, v4f *e)
+{
+    __m128i bits = _mm_castps_si128(x);
+    *m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f000000)));
+    *e = _mm_cvtepi32_ps(_mm_srli_epi32(bits, 23));
+}
+
+/* 2^i for integral i in [-126, 127] held as floats. */
+static inline v4f v4f_ldexp1(v4f i)
+{
+    return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(i), _mm_set1_epi32(127)), 23));
+}
+
+static inline v4f v4f_floor(v4f x)
+{
+    v4f t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+#elif defined(DSP_NEON)
+typedef float32x4_t v4f;
+typedef uint32x4_t v4m;
+
+static inline v4f v4f_zero(void)                      { return vdupq_n_f32(0.0f); }
+static inline v4f v4f_set1(float x)                   { return vdupq_n_f32(x); }
+static inline v4f v4f_set(float a, float b, float c, float d) { float t[4] = { a, b, c, d }; return vld1q_f32(t); }
+static inline v4f v4f_load(const float *p)            { return vld1q_f32(p); }
+static inline v4f v4f_load_aligned(const float *p)    { return vld1q_f32(p); }
+static inline void v4f_store(float *p, v4f v)         { vst1q_f32(p, v); }
+static inline void v4f_store_aligned(float *p, v4f v) { vst1q_f32(p, v); }
+static inline v4f v4f_add(v4f a, v4f b)               { return vaddq_f32(a, b); }
+static inline v4f v4f_sub(v4f a, v4f b)               { return vsubq_f32(a, b); }
+static inline v4f v4f_mul(v4f a, v4f b)               { return vmulq_f32(a, b); }
+static inline v4f v4f_madd(v4f a, v4f b, v4f c)       { return vmlaq_f32(c, a, b); }
+static inline v4f v4f_min(v4f a, v4f b)               { return vminq_f32(a, b); }
+static inline v4f v4f_max(v4f a, v4f b)               { return vmaxq_f32(a, b); }
+static inline v4f v4f_abs(v4f a)                      { return vabsq_f32(a); }
+static inline v4m v4f_cmpgt(v4f a, v4f b)             { return vcgtq_f32(a, b); }
+static inline v4m v4f_cmpge(v4f a, v4f b)             { return vcgeq_f32(a, b); }
+static inline v4m v4m_and(v4m a, v4m b)               { return vandq_u32(a, b); }
+static inline v4f v4f_select(v4m m, v4f a, v4f b)     { return vbslq_f32(m, a, b); }
+static inline float v4f_lane0(v4f v)                  { return vgetq_lane_f32(v, 0); }
+static inline float v4f_lane3(v4f v)                  { return vgetq_lane_f32(v, 3); }
+
+static inline v4f v4f_shift_in(v4f v, float x)
+{
+    return vextq_f32(vdupq_n_f32(x), v, 3);
+}
+
+static inline float v4f_hsum(v4f v)
+{
+    float32x2_t t = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(t, t), 0);
+}
+
+static inline void v4f_transpose(v4f *r0, v4f *r1, v4f *r2, v4f *r3)
+{
+    float32x4x2_t t01 = vtrnq_f32(*r0, *r1);
+    float32x4x2_t t23 = vtrnq_f32(*r2, *r3);
+    *r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    *r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    *r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    *r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+static inline void v4f_zip(v4f a, v4f b, v4f *lo, v4f *hi)
+{
+    float32x4x2_t z = vzipq_f32(a, b);
+    *lo = z.val[0];
+    *hi = z.val[1];
+}
+
+static inline void v4f_unzip(v4f a, v4f b, v4f *even, v4f *odd)
+{
+    float32x4x2_t u = vuzpq_f32(a, b);
+    *even = u.val[0];
+    *odd = u.val[1];
+}
+
+static inline v4f v4f_reverse(v4f v)
+{
+    v4f r = vrev64q_f32(v);
+    return vcombine_f32(vget_high_f32(r), vget_low_f32(r));
+}
+
+static inline v4f v4f_div(v4f a, v4f b)
+{
+#if defined(__aarch64__)
+    return vdivq_f32(a, b);
+#else
+    v4f r = vrecpeq_f32(b);
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    return vmulq_f32(a, r);
+#endif
+}
+
+static inline v4f v4f_sqrt(v4f a)
+{
+#if defined(__aarch64__)
+    return vsqrtq_f32(a);
+#else
+    /* a * rsqrt(a), refined twice; zero stays zero. */
+    v4f r = vrsqrteq_f32(a);
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a, r), r));
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a, r), r));
+    return vbslq_f32(vcgtq_f32(a, vdupq_n_f32(0.0f)), vmulq_f32(a, r), vdupq_n_f32(0.0f));
+#endif
+}
+
+static inline float v4f_hmax(v4f v)
+{
+    float32x2_t t = vmax_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpmax_f32(t, t), 0);
+}
+
+static inline void v4f_frexp(v4f x, v4f *m, v4f *e)
+{
+    uint32x4_t bits = vreinterpretq_u32_f32(x);
+    *m = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x007fffff)), vdupq_n_u32(0x3f000000)));
+    *e = vcvtq_f32_u32(vshrq_n_u32(bits, 23));
+}
+
+static inline v4f v4f_ldexp1(v4f i)
+{
+    return vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(i), vdupq_n_s32(127)), 23));
+}
+
+static inline v4f v4f_floor(v4f x)
+{
+    v4f t = vcvtq_f32_s32(vcvtq_s32_f32(x));
+    return vsubq_f32(t, vreinterpretq_f32_u32(vandq_u32(vcgtq_f32(t, x), vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+}
+
+#else
+typedef struct { float v[4]; } v4f;
+typedef struct { ma_uint32 v[4]; } v4m;
+
+#define V4F_MAP2(expr) v4f r; for (int i = 0; i < 4; i++) r.v[i] = (expr); return r
+
+static inline v4f v4f_zero(void)                      { v4f r = {{ 0, 0, 0, 0 }}; return r; }
+static inline v4f v4f_set1(float x)                   { v4f r = {{ x, x, x, x }}; return r; }
+static inline v4f v4f_set(float a, float b, float c, float d) { v4f r = {{ a, b, c, d }}; return r; }
+static inline v4f v4f_load(const float *p)            { v4f r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline v4f v4f_load_aligned(const float *p)    { return v4f_load(p); }
+static inline void v4f_store(float *p, v4f v)         { memcpy(p, v.v, sizeof(v.v)); }
+static inline void v4f_store_aligned(float *p, v4f v) { v4f_store(p, v); }
+static inline v4f v4f_add(v4f a, v4f b)               { V4F_MAP2(a.v[i] + b.v[i]); }
+static inline v4f v4f_sub(v4f a, v4f b)               { V4F_MAP2(a.v[i] - b.v[i]); }
+static inline v4f v4f_mul(v4f a, v4f b)               { V4F_MAP2(a.v[i] * b.v[i]); }
+static inline v4f v4f_madd(v4f a, v4f b, v4f c)       { V4F_MAP2(a.v[i] * b.v[i] + c.v[i]); }
+static inline v4f v4f_min(v4f a, v4f b)               { V4F_MAP2(a.v[i] < b.v[i] ? a.v[i] : b.v[i]); }
+static inline v4f v4f_max(v4f a, v4f b)               { V4F_MAP2(a.v[i] > b.v[i] ? a.v[i] : b.v[i]); }
+static inline v4f v4f_abs(v4f a)                      { V4F_MAP2(fabsf(a.v[i])); }
+static inline v4m v4f_cmpgt(v4f a, v4f b)             { v4m r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] > b.v[i] ? ~0u : 0; return r; }
+static inline v4m v4f_cmpge(v4f a, v4f b)             { v4m r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] >= b.v[i] ? ~0u : 0; return r; }
+static inline v4m v4m_and(v4m a, v4m b)               { v4m r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] & b.v[i]; return r; }
+static inline v4f v4f_select(v4m m, v4f a, v4f b)     { V4F_MAP2(m.v[i] ? a.v[i] : b.v[i]); }
+static inline float v4f_lane0(v4f v)                  { return v.v[0]; }
+static inline float v4f_lane3(v4f v)                  { return v.v[3]; }
+static inline v4f v4f_shift_in(v4f v, float x)        { v4f r = {{ x, v.v[0], v.v[1], v.v[2] }}; return r; }
+static inline float v4f_hsum(v4f v)                   { return (v.v[0] + v.v[1]) + (v.v[2] + v.v[3]); }
+
+static inline void v4f_transpose(v4f *r0, v4f *r1, v4f *r2, v4f *r3)
+{
+    v4f *rows[4] = { r0, r1, r2, r3 };
+    v4f t[4] = { *r0, *r1, *r2, *r3 };
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            rows[i]->v[j] = t[j].v[i];
+}
+
+static inline void v4f_zip(v4f a, v4f b, v4f *lo, v4f *hi)
+{
+    v4f l = {{ a.v[0], b.v[0], a.v[1], b.v[1] }};
+    v4f h = {{ a.v[2], b.v[2], a.v[3], b.v[3] }};
+    *lo = l;
+    *hi = h;
+}
+
+static inline void v4f_unzip(v4f a, v4f b, v4f *even, v4f *odd)
+{
+    v4f e = {{ a.v[0], a.v[2], b.v[0], b.v[2] }};
+    v4f o = {{ a.v[1], a.v[3], b.v[1], b.v[3] }};
+    *even = e;
+    *odd = o;
+}
+
+static inline v4f v4f_reverse(v4f v) { v4f r = {{ v.v[3], v.v[2], v.v[1], v.v[0] }}; return r; }
+static inline v4f v4f_div(v4f a, v4f b)               { V4F_MAP2(a.v[i] / b.v[i]); }
+static inline v4f v4f_sqrt(v4f a)                     { V4F_MAP2(sqrtf(a.v[i])); }
+static inline float v4f_hmax(v4f v)                   { float a = v.v[0] > v.v[1] ? v.v[0] : v.v[1], b = v.v[2] > v.v[3] ? v.v[2] : v.v[3]; return a > b ? a : b; }
+static inline v4f v4f_floor(v4f x)                    { V4F_MAP2(floorf(x.v[i])); }
+static inline v4f v4f_ldexp1(v4f x)                   { V4F_MAP2(ldexpf(1.0f, (int)x.v[i])); }
+
+static inline void v4f_frexp(v4f x, v4f *m, v4f *e)
+{
+    for (int i = 0; i < 4; i++) {
+        ma_uint32 bits;
+        float f;
+        memcpy(&bits, &x.v[i], sizeof(bits));
+        e->v[i] = (float)(bits >> 23);
+        bits = (bits & 0x007fffff) | 0x3f000000;
+        memcpy(&f, &bits, sizeof(f));
+        m->v[i] = f;
+    }
+}
+
+#undef V4F_MAP2
+#endif
+
+/*
+ * Vector of two doubles and the matching lane mask, for the filters whose
+ * poles sit too close to the unit circle for floats. 32-bit ARM has no
+ * double NEON, so it takes the scalar fallback.
+ */
+#if defined(DSP_SSE2)
+typedef __m128d v2d;
+typedef __m128d v2m;
+
+static inline v2d v2d_zero(void)                      { return _mm_setzero_pd(); }
+static inline v2d v2d_set1(double x)                  { return _mm_set1_pd(x); }
+static inline v2d v2d_set(double a, double b)         { return _mm_setr_pd(a, b); }
+static inline v2d v2d_load(const double *p)           { return _mm_loadu_pd(p); }
+static inline void v2d_store(double *p, v2d v)        { _mm_storeu_pd(p, v); }
+static inline v2d v2d_add(v2d a, v2d b)               { return _mm_add_pd(a, b); }
+static inline v2d v2d_sub(v2d a, v2d b)               { return _mm_sub_pd(a, b); }
+static inline v2d v2d_mul(v2d a, v2d b)               { return _mm_mul_pd(a, b); }
+static inline v2d v2d_madd(v2d a, v2d b, v2d c)       { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+static inline v2m v2d_cmpgt(v2d a, v2d b)             { return _mm_cmpgt_pd(a, b); }
+static inline v2m v2d_cmpge(v2d a, v2d b)             { return _mm_cmpge_pd(a, b); }
+static inline v2m v2m_and(v2m a, v2m b)               { return _mm_and_pd(a, b); }
+static inline v2d v2d_select(v2m m, v2d a, v2d b)     { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+static inline double v2d_lane1(v2d v)                 { return _mm_cvtsd_f64(_mm_unpackhi_pd(v, v)); }
+/* [x, v0] */
+static inline v2d v2d_shift_in(v2d v, double x)       { return _mm_unpacklo_pd(_mm_set_sd(x), v); }
+
+#elif defined(DSP_NEON) && defined(__aarch64__)
+typedef float64x2_t v2d;
+typedef uint64x2_t v2m;
+
+static inline v2d v2d_zero(void)                      { return vdupq_n_f64(0.0); }
+static inline v2d v2d_set1(double x)                  { return vdupq_n_f64(x); }
+static inline v2d v2d_set(double a, double b)         { return vcombine_f64(vdup_n_f64(a), vdup_n_f64(b)); }
+static inline v2d v2d_load(const double *p)           { return vld1q_f64(p); }
+static inline void v2d_store(double *p, v2d v)        { vst1q_f64(p, v); }
+static inline v2d v2d_add(v2d a, v2d b)               { return vaddq_f64(a, b); }
+static inline v2d v2d_sub(v2d a, v2d b)               { return vsubq_f64(a, b); }
+static inline v2d v2d_mul(v2d a, v2d b)               { return vmulq_f64(a, b); }
+static inline v2d v2d_madd(v2d a, v2d b, v2d c)       { return vaddq_f64(vmulq_f64(a, b), c); }
+static inline v2m v2d_cmpgt(v2d a, v2d b)             { return vcgtq_f64(a, b); }
+static inline v2m v2d_cmpge(v2d a, v2d b)             { return vcgeq_f64(a, b); }
+static inline v2m v2m_and(v2m a, v2m b)               { return vandq_u64(a, b); }
+static inline v2d v2d_select(v2m m, v2d a, v2d b)     { return vbslq_f64(m, a, b); }
+static inline double v2d_lane1(v2d v)                 { return vgetq_lane_f64(v, 1); }
+static inline v2d v2d_shift_in(v2d v, double x)       { return vcombine_f64(vdup_n_f64(x), vget_low_f64(v)); }
+
+#else
+typedef struct { double v[2]; } v2d;
+typedef struct { ma_uint64 v[2]; } v2m;
+
+#define V2D_MAP2(expr) v2d r; for (int i = 0; i < 2; i++) r.v[i] = (expr); return r
+
+static inline v2d v2d_zero(void)                      { v2d r = {{ 0, 0 }}; return r; }
+static inline v2d v2d_set1(double x)                  { v2d r = {{ x, x }}; return r; }
+static inline v2d v2d_set(double a, double b)         { v2d r = {{ a, b }}; return r; }
+static inline v2d v2d_load(const double *p)           { v2d r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void v2d_store(double *p, v2d v)        { memcpy(p, v.v, sizeof(v.v)); }
+static inline v2d v2d_add(v2d a, v2d b)               { V2D_MAP2(a.v[i] + b.v[i]); }
+static inline v2d v2d_sub(v2d a, v2d b)               { V2D_MAP2(a.v[i] - b.v[i]); }
+static inline v2d v2d_mul(v2d a, v2d b)               { V2D_MAP2(a.v[i] * b.v[i]); }
+static inline v2d v2d_madd(v2d a, v2d b, v2d c)       { V2D_MAP2(a.v[i] * b.v[i] + c.v[i]); }
+static inline v2m v2d_cmpgt(v2d a, v2d b)             { v2m r; for (int i = 0; i < 2; i++) r.v[i] = a.v[i] > b.v[i] ? ~(ma_uint64)0 : 0; return r; }
+static inline v2m v2d_cmpge(v2d a, v2d b)             { v2m r; for (int i = 0; i < 2; i++) r.v[i] = a.v[i] >= b.v[i] ? ~(ma_uint64)0 : 0; return r; }
+static inline v2m v2m_and(v2m a, v2m b)               { v2m r; for (int i = 0; i < 2; i++) r.v[i] = a.v[i] & b.v[i]; return r; }
+static inline v2d v2d_select(v2m m, v2d a, v2d b)     { V2D_MAP2(m.v[i] ? a.v[i] : b.v[i]); }
+static inline double v2d_lane1(v2d v)                 { return v.v[1]; }
+static inline v2d v2d_shift_in(v2d v, double x)       { v2d r = {{ x, v.v[0] }}; return r; }
+
+#undef V2D_MAP2
+#endif
+
+/*
+ * Fast log2 and exp2 for levels and gains: rational approximations good to
+ * about 1e-4 (0.001 dB). log2 expects x > 0.
+ */
+static inline v4f v4f_log2(v4f x)
+{
+    v4f m, e;
+    v4f_frexp(x, &m, &e);
+    v4f r = v4f_div(v4f_set1(-1.72587999f), v4f_add(m, v4f_set1(0.3520887068f)));
+    r = v4f_madd(m, v4f_set1(0.501969698f), r);
+    return v4f_add(r, v4f_sub(e, v4f_set1(125.22551499f)));
+}
+
+static inline v4f v4f_exp2(v4f x)
+{
+    x = v4f_min(v4f_max(x, v4f_set1(-126.0f)), v4f_set1(127.0f));
+    v4f i = v4f_floor(x);
+    v4f z = v4f_sub(x, i);
+    v4f r = v4f_div(v4f_set1(27.7280233f), v4f_sub(v4f_set1(4.84252568f), z));
+    r = v4f_madd(z, v4f_set1(-0.49012907f), v4f_add(r, v4f_set1(-4.7259425f)));
+    return v4f_mul(r, v4f_ldexp1(i));
+}
+
+/* Aligned, zeroed float buffers for scratch and state that the audio thread touches. */
+static inline float *dsp_alloc(size_t count)
+{
+    float *p = (float *)ma_aligned_malloc(count * sizeof(float), DSP_ALIGNMENT, NULL);
+    if (p)
+        memset(p, 0, count * sizeof(float));
+    return p;
+}
+
+static inline void dsp_free(void *p)
+{
+    if (p)
+        ma_aligned_free(p, NULL);
+}
+
+/*
+ * Bump allocator over one aligned block, so a node can carve all of its
+ * buffers out of a single allocation made at init. Run the layout once with
+ * a zeroed arena to measure it, dsp_arena_init() with the measured size, then
+ * run the same layout again to hand out the buffers.
+ */
+struct dsp_arena {
+    char *base;
+    size_t size;
+    size_t used;
+};
+
+static inline ma_result dsp_arena_init(struct dsp_arena *arena, size_t size)
+{
+    arena->base = (char *)dsp_alloc((size + sizeof(float) - 1) / sizeof(float));
+    arena->size = size;
+    arena->used = 0;
+    return arena->base ? MA_SUCCESS : MA_OUT_OF_MEMORY;
+}
+
+static inline void dsp_arena_uninit(struct dsp_arena *arena)
+{
+    dsp_free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
+
+/* Returns NULL while measuring. */
+static inline float *dsp_arena_floats(struct dsp_arena *arena, size_t count)
+{
+    size_t offset = (arena->used + DSP_ALIGNMENT - 1) & ~(size_t)(DSP_ALIGNMENT - 1);
+    size_t bytes = count * sizeof(float);
+    arena->used = offset + bytes;
+    if (arena->base == NULL)
+        return NULL;
+    assert(arena->used <= arena->size);
+    return (float *)(arena->base + offset);
+}
+
+/*
+ * Parameters are written by the UI thread and read by the audio thread once
+ * per block. Relaxed atomics are enough: only the value itself is shared.
+ */
+static inline float dsp_load_f32(const float *p)          { float v; __atomic_load(p, &v, __ATOMIC_RELAXED); return v; }
+static inline void dsp_store_f32(float *p, float v)       { __atomic_store(p, &v, __ATOMIC_RELAXED); }
+static inline ma_uint32 dsp_load_u32(const ma_uint32 *p)  { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+static inline void dsp_store_u32(ma_uint32 *p, ma_uint32 v) { __atomic_store_n(p, v, __ATOMIC_RELAXED); }
+
+/* For handing buffers between threads: publish with release, observe with acquire. */
+static inline ma_uint32 dsp_load_acquire_u32(const ma_uint32 *p)    { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void dsp_store_release_u32(ma_uint32 *p, ma_uint32 v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+/*
+ * Wakes a worker thread from the audio thread. ma_event and ma_semaphore
+ * are a mutex and a condition variable on POSIX, which the audio thread
+ * must not take, so this is the platform's own counting semaphore: posting
+ * is an atomic increment, plus a system call that never blocks when the
+ * worker is asleep. Posts don't coalesce; a worker that catches up on
+ * everything at once just finds nothing to do on the extra wake-ups.
+ */
+#if defined(_WIN32)
+#include <windows.h>
+struct dsp_wake { HANDLE sem; };
+
+static inline ma_result dsp_wake_init(struct dsp_wake *w)
+{
+    w->sem = CreateSemaphoreW(NULL, 0, 0x7FFFFFFF, NULL);
+    return w->sem != NULL ? MA_SUCCESS : MA_ERROR;
+}
+static inline void dsp_wake_uninit(struct dsp_wake *w)   { CloseHandle(w->sem); }
+static inline void dsp_wake_post(struct dsp_wake *w)     { ReleaseSemaphore(w->sem, 1, NULL); }
+static inline void dsp_wake_wait(struct dsp_wake *w)     { WaitForSingleObject(w->sem, INFINITE); }
+
+#elif defined(__APPLE__)
+/* Unnamed POSIX semaphores are not implemented on macOS. */
+#include <dispatch/dispatch.h>
+struct dsp_wake { dispatch_semaphore_t sem; };
+
+static inline ma_result dsp_wake_init(struct dsp_wake *w)
+{
+    w->sem = dispatch_semaphore_create(0);
+    return w->sem != NULL ? MA_SUCCESS : MA_ERROR;
+}
+static inline void dsp_wake_uninit(struct dsp_wake *w)   { dispatch_release(w->sem); }
+static inline void dsp_wake_post(struct dsp_wake *w)     { dispatch_semaphore_signal(w->sem); }
+static inline void dsp_wake_wait(struct dsp_wake *w)     { dispatch_semaphore_wait(w->sem, DISPATCH_TIME_FOREVER); }
+
+#else
+#include <errno.h>
+#include <semaphore.h>
+struct dsp_wake { sem_t sem; };
+
+static inline ma_result dsp_wake_init(struct dsp_wake *w)
+{
+    return sem_init(&w->sem, 0, 0) == 0 ? MA_SUCCESS : MA_ERROR;
+}
+static inline void dsp_wake_uninit(struct dsp_wake *w)   { sem_destroy(&w->sem); }
+static inline void dsp_wake_post(struct dsp_wake *w)     { sem_post(&w->sem); }
+static inline void dsp_wake_wait(struct dsp_wake *w)     { while (sem_wait(&w->sem) != 0 && errno == EINTR) {} }
+#endif
+
+static inline float dsp_db_to_gain(float db)  { return powf(10.0f, db * 0.05f); }
+static inline float dsp_gain_to_db(float g)   { return 20.0f * log10f(g > 1e-20f ? g : 1e-20f); }
+
+/*
+ * Tails decaying towards zero (feedback delays, filter state, reverbs) pass
+ * through the denormal range, where x86 takes a microcode assist on every
+ * operation and a block can cost many times its usual time. Every thread that
+ * runs DSP flushes them: dsp_denormals_flush() sets flush-to-zero and
+ * denormals-are-zero (MXCSR on x86, FPCR.FZ on AArch64) for the calling
+ * thread and returns the previous mode for dsp_denormals_restore(). Threads
+ * we don't own, like the device callback's, get their mode back on the way
+ * out of every call.
+ */
+#if defined(DSP_SSE2)
+#define DSP_MXCSR_FTZ_DAZ 0x8040u
+
+static inline ma_uint64 dsp_denormals_flush(ma_bool32 flush)
+{
+    const unsigned int mode = _mm_getcsr();
+    _mm_setcsr(flush ? mode | DSP_MXCSR_FTZ_DAZ : mode & ~DSP_MXCSR_FTZ_DAZ);
+    return mode;
+}
+
+static inline void dsp_denormals_restore(ma_uint64 mode) { _mm_setcsr((unsigned int)mode); }
+
+#elif defined(__aarch64__)
+#define DSP_FPCR_FZ ((ma_uint64)1 << 24)
+
+static inline ma_uint64 dsp_denormals_flush(ma_bool32 flush)
+{
+    ma_uint64 mode;
+    __asm__ volatile("mrs %0, fpcr" : "=r"(mode));
+    const ma_uint64 next = flush ? mode | DSP_FPCR_FZ : mode & ~DSP_FPCR_FZ;
+    __asm__ volatile("msr fpcr, %0" : : "r"(next));
+    return mode;
+}
+
+static inline void dsp_denormals_restore(ma_uint64 mode) { __asm__ volatile("msr fpcr, %0" : : "r"(mode)); }
+
+#else
+/* 32-bit NEON always flushes; elsewhere there is nothing portable to set. */
+static inline ma_uint64 dsp_denormals_flush(ma_bool32 flush) { (void)flush; return 0; }
+static inline void dsp_denormals_restore(ma_uint64 mode)     { (void)mode; }
+#endif
+
+#endif /* DSP_H */
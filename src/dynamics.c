@@ -0,0 +1,340 @@
+/*
+ * Lookahead compressor / limiter.
+ *
+ * The detector runs in short blocks through four stages:
+ *
+ *   1. true peak of each frame, linked across channels (truepeak.c),
+ *   2. a sliding max over the lookahead window, O(1) per frame with the
+ *      van Herk / Gil-Werman split into prefix and suffix maxima,
+ *   3. the soft knee gain computer, vectorised in the log domain with no
+ *      branches,
+ *   4. an instant-attack / exponential-release follower written as a min,
+ *      then a moving average over the lookahead that becomes the attack.
+ *
+ * The audio is delayed by the lookahead, so the moving average has fully
+ * reached a peak's gain by the time the peak comes out: with an infinite
+ * ratio the output never exceeds the threshold, inter-sample peaks
+ * included.
+ *
+ * The node has a second input, the sidechain key. While one is connected
+ * the detector reads it instead of the main input, straight from the
+ * graph's input buffer, and only the main input reaches the output. The
+ * graph pulls both inputs before processing the node, so the key is always
+ * computed first. Ducking music under a voice is the key case.
+ */
+#include "dsp.h"
+
+#define DYNAMICS_BLOCK          64      /* Frames per detector block. */
+#define DYNAMICS_MAX_RATIO      50.0f   /* Ratios at or above this limit. */
+#define DYNAMICS_DB_PER_OCTAVE  6.02059991f
+#define DYNAMICS_FLOOR          1e-10f
+#define DYNAMICS_LIMIT_MARGIN   0.01f   /* dB the limiter aims under its threshold, covering the fast log/exp error. */
+
+struct compressor_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    float threshold;
+    float ratio;
+    float knee;
+    float release;
+    float lookahead;
+};
+
+struct compressor {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+
+    /* Written by the UI thread, read once per block. */
+    float threshold;            /* dB */
+    float ratio;                /* DYNAMICS_MAX_RATIO and above is a limiter. */
+    float knee;                 /* dB, full width */
+    float release;              /* Seconds */
+    float makeup;               /* dB */
+    ma_uint32 keyed;            /* Detect on the sidechain input instead of the main one. */
+    float gain_reduction;       /* dB, written by the audio thread for metering. */
+
+    ma_uint32 lookahead;        /* Frames, also the attack. */
+    ma_uint32 delay;            /* Frames the audio is held back. */
+    struct truepeak truepeak;
+
+    /* Sliding max over lookahead + 1 frames. */
+    float *window;              /* [lookahead + 1] current block of the window */
+    float *suffix;              /* [lookahead + 2] suffix maxima of the previous block */
+    float prefix;
+    ma_uint32 window_pos;
+
+    /* Gain follower. */
+    float envelope;
+    float *average;             /* [lookahead] */
+    double average_sum;
+    ma_uint32 average_pos;
+
+    float *line;                /* [mask + 1][channel] */
+    ma_uint32 mask;
+    ma_uint32 write;
+    struct dsp_arena arena;
+};
+
+static struct compressor_config
+compressor_config_init(ma_uint32 channels, ma_uint32 sample_rate, float threshold, float ratio, float lookahead)
+{
+    struct compressor_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.threshold = threshold;
+    config.ratio = ratio;
+    config.knee = 6.0f;
+    config.release = 0.1f;
+    config.lookahead = lookahead;
+    return config;
+}
+
+static void compressor_layout(struct compressor *comp)
+{
+    comp->window = dsp_arena_floats(&comp->arena, comp->lookahead + 1);
+    comp->suffix = dsp_arena_floats(&comp->arena, comp->lookahead + 2);
+    comp->average = dsp_arena_floats(&comp->arena, comp->lookahead);
+    comp->line = dsp_arena_floats(&comp->arena, (size_t)(comp->mask + 1) * comp->channels);
+}
+
+static ma_result compressor_init(const struct compressor_config *config, struct compressor *comp)
+{
+    ma_result result;
+
+    memset(comp, 0, sizeof(*comp));
+    if (config->channels == 0 || config->sample_rate == 0 || config->ratio < 1.0f || config->lookahead <= 0.0f)
+        return MA_INVALID_ARGS;
+
+    comp->channels = config->channels;
+    comp->sample_rate = config->sample_rate;
+    comp->threshold = config->threshold;
+    comp->ratio = config->ratio;
+    comp->knee = config->knee;
+    comp->release = config->release;
+    comp->lookahead = DSP_MAX((ma_uint32)(config->lookahead * config->sample_rate), 1u);
+    /* Frame n of the output is input n - delay, whose true peak reaches the detector TRUEPEAK_DELAY later. */
+    comp->delay = comp->lookahead + TRUEPEAK_DELAY - 1;
+    /* Room for the delay plus a whole block, which is written before any of it is read. */
+    comp->mask = 1;
+    while (comp->mask < comp->delay + DYNAMICS_BLOCK)
+        comp->mask <<= 1;
+    comp->mask -= 1;
+
+    result = truepeak_init(&comp->truepeak, comp->channels);
+    if (result != MA_SUCCESS)
+        return result;
+
+    compressor_layout(comp);
+    result = dsp_arena_init(&comp->arena, comp->arena.used);
+    if (result != MA_SUCCESS) {
+        truepeak_uninit(&comp->truepeak);
+        return result;
+    }
+    compressor_layout(comp);
+
+    comp->envelope = 1.0f;
+    for (ma_uint32 i = 0; i < comp->lookahead; i++)
+        comp->average[i] = 1.0f;
+    comp->average_sum = comp->lookahead;
+    return MA_SUCCESS;
+}
+
+static void compressor_uninit(struct compressor *comp)
+{
+    truepeak_uninit(&comp->truepeak);
+    dsp_arena_uninit(&comp->arena);
+}
+
+static ma_uint32 compressor_get_latency(const struct compressor *comp)
+{
+    return comp->delay;
+}
+
+/* Max of each frame's level over the last lookahead + 1 frames, in place. */
+static void compressor_sliding_max(struct compressor *comp, float *level, ma_uint32 count)
+{
+    const ma_uint32 width = comp->lookahead + 1;
+    float *window = comp->window, *suffix = comp->suffix;
+    float prefix = comp->prefix;
+    ma_uint32 pos = comp->window_pos;
+
+    for (ma_uint32 i = 0; i < count; i++) {
+        window[pos] = level[i];
+        prefix = DSP_MAX(prefix, level[i]);
+        level[i] = DSP_MAX(prefix, suffix[pos + 1]);
+        if (++pos == width) {
+            suffix[width] = 0.0f;
+            for (ma_uint32 j = width; j-- > 0;)
+                suffix[j] = DSP_MAX(window[j], suffix[j + 1]);
+            prefix = 0.0f;
+            pos = 0;
+        }
+    }
+    comp->prefix = prefix;
+    comp->window_pos = pos;
+}
+
+/* Level to gain, in place. `count` is rounded up to whole vectors. */
+static void compressor_gain_computer(const struct compressor *comp, float *level, ma_uint32 count)
+{
+    const float ratio = DSP_MAX(dsp_load_f32(&comp->ratio), 1.0f);
+    const float knee = DSP_MAX(dsp_load_f32(&comp->knee), 0.01f);
+    const bool limit = ratio >= DYNAMICS_MAX_RATIO;
+    const v4f threshold = v4f_set1(dsp_load_f32(&comp->threshold) - (limit ? DYNAMICS_LIMIT_MARGIN : 0.0f));
+    const v4f slope = v4f_set1(limit ? -1.0f : 1.0f / ratio - 1.0f);
+    const v4f half_knee = v4f_set1(0.5f * knee);
+    const v4f full_knee = v4f_set1(knee);
+    const v4f inv_double_knee = v4f_set1(0.5f / knee);
+    const v4f to_db = v4f_set1(DYNAMICS_DB_PER_OCTAVE);
+    const v4f from_db = v4f_set1(1.0f / DYNAMICS_DB_PER_OCTAVE);
+    const v4f floor = v4f_set1(DYNAMICS_FLOOR);
+    const v4f zero = v4f_zero();
+
+    for (ma_uint32 i = 0; i < count; i += 4) {
+        v4f db = v4f_mul(v4f_log2(v4f_max(v4f_load(level + i), floor)), to_db);
+        v4f over = v4f_sub(db, threshold);
+        /* Quadratic through the knee, linear above it: slope * (t^2 / 2k + max(over - k/2, 0)). */
+        v4f t = v4f_min(v4f_max(v4f_add(over, half_knee), zero), full_knee);
+        v4f curve = v4f_madd(v4f_mul(t, t), inv_double_knee, v4f_max(v4f_sub(over, half_knee), zero));
+        v4f_store(level + i, v4f_exp2(v4f_mul(v4f_mul(curve, slope), from_db)));
+    }
+}
+
+/* Pushes `count` frames of `in` into the delay line and writes the delayed frames times `gain` to `out`. */
+static void compressor_delay(struct compressor *comp, float *out, const float *in, const float *gain, ma_uint32 count)
+{
+    const ma_uint32 channels = comp->channels, size = comp->mask + 1;
+    ma_uint32 at = comp->write & comp->mask;
+    ma_uint32 first = DSP_MIN(count, size - at);
+
+    memcpy(comp->line + (size_t)at * channels, in, sizeof(float) * first * channels);
+    memcpy(comp->line, in + (size_t)first * channels, sizeof(float) * (count - first) * channels);
+
+    ma_uint32 read = (comp->write - comp->delay) & comp->mask;
+    for (ma_uint32 f = 0; f < count; f++) {
+        const float *delayed = comp->line + (size_t)read * channels;
+        for (ma_uint32 ch = 0; ch < channels; ch++)
+            out[f * channels + ch] = delayed[ch] * gain[f];
+        read = (read + 1) & comp->mask;
+    }
+    comp->write += count;
+}
+
+/* Interleaved in and out; `in` may equal `out`. `key` drives the detector when not NULL. */
+static void compressor_process(struct compressor *comp, float *out, const float *in, const float *key,
+        ma_uint32 frame_count)
+{
+    const ma_uint32 channels = comp->channels;
+    const float release = 1.0f - expf(-1.0f / (DSP_MAX(dsp_load_f32(&comp->release), 0.001f) * comp->sample_rate));
+    const float makeup = dsp_db_to_gain(dsp_load_f32(&comp->makeup));
+    const double inv_lookahead = 1.0 / comp->lookahead;
+    float gain[DYNAMICS_BLOCK];
+    float lowest = 1.0f;
+
+    while (frame_count > 0) {
+        ma_uint32 count = DSP_MIN(frame_count, DYNAMICS_BLOCK);
+
+        truepeak_process(&comp->truepeak, key != NULL ? key : in, count, gain);
+        compressor_sliding_max(comp, gain, count);
+        for (ma_uint32 f = count; f % 4 != 0; f++)
+            gain[f] = 0.0f;
+        compressor_gain_computer(comp, gain, count);
+
+        float envelope = comp->envelope;
+        double sum = comp->average_sum;
+        ma_uint32 pos = comp->average_pos;
+        for (ma_uint32 f = 0; f < count; f++) {
+            /* Falls at once, recovers exponentially: never above the target. */
+            envelope = DSP_MIN(gain[f], envelope + (gain[f] - envelope) * release);
+            sum += envelope - comp->average[pos];
+            comp->average[pos] = envelope;
+            pos = pos + 1 == comp->lookahead ? 0 : pos + 1;
+            gain[f] = (float)(sum * inv_lookahead);
+            lowest = DSP_MIN(lowest, gain[f]);
+            gain[f] *= makeup;
+        }
+        comp->envelope = envelope;
+        comp->average_sum = sum;
+        comp->average_pos = pos;
+
+        compressor_delay(comp, out, in, gain, count);
+        in += count * channels;
+        out += count * channels;
+        if (key != NULL)
+            key += count * channels;
+        frame_count -= count;
+    }
+    dsp_store_f32(&comp->gain_reduction, dsp_gain_to_db(lowest));
+}
+
+/*
+ * Compressor Node
+ */
+struct compressor_node_config {
+    ma_node_config node_config;
+    struct compressor_config compressor;
+};
+
+struct compressor_node {
+    ma_node_base base;
+    struct compressor compressor;
+};
+
+static struct compressor_node_config
+compressor_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, float threshold, float ratio, float lookahead)
+{
+    struct compressor_node_config config;
+    config.node_config = ma_node_config_init();
+    config.compressor = compressor_config_init(channels, sample_rate, threshold, ratio, lookahead);
+    return config;
+}
+
+static void compressor_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct compressor_node *comp = (struct compressor_node *)node;
+    const float *key = dsp_load_u32(&comp->compressor.keyed) ? frames_in[1] : NULL;
+    (void)frame_count_in;
+    compressor_process(&comp->compressor, frames_out[0], frames_in[0], key, *frame_count_out);
+}
+
+static ma_node_vtable compressor_node_vtable = {
+    compressor_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    2,      /* Main input and sidechain key. */
+    1,      /* One output. */
+    0       /* Default flags. */
+};
+
+static ma_result compressor_node_init(ma_node_graph *graph, const struct compressor_node_config *config,
+        const ma_allocation_callbacks *alloc, struct compressor_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = compressor_init(&config->compressor, &node->compressor);
+    if (result != MA_SUCCESS)
+        return result;
+
+    /* The key has the main input's layout; the editor converts other counts on the link. */
+    const ma_uint32 input_channels[2] = { config->compressor.channels, config->compressor.channels };
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &compressor_node_vtable;
+    base_config.pInputChannels = input_channels;
+    base_config.pOutputChannels = &config->compressor.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        compressor_uninit(&node->compressor);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void compressor_node_uninit(struct compressor_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    compressor_uninit(&node->compressor);
+}
@@ -0,0 +1,332 @@
+/*
+ * Multi-band parametric EQ.
+ *
+ * Each band is one RBJ biquad section, and the eight bands fill the stage
+ * slots of a struct biquad_coeffs, so the whole EQ runs on the wavefront
+ * kernel from biquad.c as two groups of four sections. A group whose bands
+ * are all flat is skipped.
+ *
+ * Parameter changes are picked up once per block: every moved band is
+ * smoothed towards its target and redesigned in one batch, then the block
+ * ramps from the old coefficients to the new ones in BIQUAD_RAMP_FRAMES
+ * sub-blocks, like the filter cascade.
+ */
+#include "dsp.h"
+
+#define EQ_BANDS            BIQUAD_MAX_STAGES
+#define EQ_GROUPS           (EQ_BANDS / BIQUAD_LANES)
+#define EQ_MAX_GAIN         24.0f   /* dB */
+#define EQ_MIN_Q            0.1f
+#define EQ_MAX_Q            18.0f
+
+enum eq_band_type {
+    EQ_OFF,
+    EQ_PEAK,
+    EQ_LOW_SHELF,
+    EQ_HIGH_SHELF,
+    EQ_LOWPASS,
+    EQ_HIGHPASS,
+    EQ_BAND_TYPE_COUNT
+};
+
+static const char *eq_band_type_names[EQ_BAND_TYPE_COUNT] = {
+    "Off", "Peak", "Low Shelf", "High Shelf", "Low Pass", "High Pass",
+};
+
+struct eq_band {
+    ma_uint32 type;
+    float frequency;            /* Hz */
+    float gain;                 /* dB, peak and shelf only */
+    float q;                    /* Shelf slope for the shelves */
+};
+
+struct equalizer_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+};
+
+struct equalizer {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+
+    /* Written by the UI thread, read once per block. */
+    struct eq_band bands[EQ_BANDS];
+
+    /* Audio thread only. */
+    struct eq_band applied[EQ_BANDS];
+    struct biquad_coeffs coeffs;
+    float *z1;                  /* channels * BIQUAD_MAX_STAGES */
+    float *z2;
+};
+
+static struct equalizer_config equalizer_config_init(ma_uint32 channels, ma_uint32 sample_rate)
+{
+    struct equalizer_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    return config;
+}
+
+/* RBJ cookbook section for one band into stage `s`. */
+static void eq_design_band(struct biquad_coeffs *c, int s, const struct eq_band *band, double sample_rate)
+{
+    const double w0 = 2.0 * DSP_PI * band->frequency / sample_rate;
+    const double cosw = cos(w0);
+    const double alpha = sin(w0) / (2.0 * band->q);
+    const double A = pow(10.0, band->gain / 40.0);
+    const double root = 2.0 * sqrt(A) * alpha;
+    ma_uint32 type = band->type;
+
+    /* Flat peaks and shelves design to exactly identity so their group can be skipped. */
+    if ((type == EQ_PEAK || type == EQ_LOW_SHELF || type == EQ_HIGH_SHELF) && band->gain == 0.0f)
+        type = EQ_OFF;
+
+    switch (type) {
+    case EQ_PEAK:
+        biquad_coeffs_set(c, s, 1 + alpha * A, -2 * cosw, 1 - alpha * A, 1 + alpha / A, -2 * cosw, 1 - alpha / A);
+        break;
+    case EQ_LOW_SHELF:
+        biquad_coeffs_set(c, s,
+                A * ((A + 1) - (A - 1) * cosw + root), 2 * A * ((A - 1) - (A + 1) * cosw), A * ((A + 1) - (A - 1) * cosw - root),
+                (A + 1) + (A - 1) * cosw + root, -2 * ((A - 1) + (A + 1) * cosw), (A + 1) + (A - 1) * cosw - root);
+        break;
+    case EQ_HIGH_SHELF:
+        biquad_coeffs_set(c, s,
+                A * ((A + 1) + (A - 1) * cosw + root), -2 * A * ((A - 1) + (A + 1) * cosw), A * ((A + 1) + (A - 1) * cosw - root),
+                (A + 1) - (A - 1) * cosw + root, 2 * ((A - 1) - (A + 1) * cosw), (A + 1) - (A - 1) * cosw - root);
+        break;
+    case EQ_LOWPASS:
+        biquad_coeffs_set(c, s, (1 - cosw) / 2, 1 - cosw, (1 - cosw) / 2, 1 + alpha, -2 * cosw, 1 - alpha);
+        break;
+    case EQ_HIGHPASS:
+        biquad_coeffs_set(c, s, (1 + cosw) / 2, -(1 + cosw), (1 + cosw) / 2, 1 + alpha, -2 * cosw, 1 - alpha);
+        break;
+    default:
+        biquad_coeffs_set(c, s, 1, 0, 0, 1, 0, 0);
+        break;
+    }
+}
+
+static bool eq_band_is_flat(const struct biquad_coeffs *c, int s)
+{
+    return c->b0[s] == 1.0f && c->b1[s] == 0.0f && c->b2[s] == 0.0f && c->a1[s] == 0.0f && c->a2[s] == 0.0f;
+}
+
+static void eq_band_clamp(const struct equalizer *eq, struct eq_band *band)
+{
+    band->type = DSP_MIN(band->type, (ma_uint32)EQ_BAND_TYPE_COUNT - 1);
+    band->frequency = DSP_CLAMP(band->frequency, 10.0f, 0.49f * (float)eq->sample_rate);
+    band->gain = DSP_CLAMP(band->gain, -EQ_MAX_GAIN, EQ_MAX_GAIN);
+    band->q = DSP_CLAMP(band->q, EQ_MIN_Q, EQ_MAX_Q);
+}
+
+static ma_result equalizer_init(const struct equalizer_config *config, const ma_allocation_callbacks *alloc,
+        struct equalizer *eq)
+{
+    /* Low shelf, six peaks an octave and a bit apart, high shelf; all flat. */
+    static const float frequencies[EQ_BANDS] = { 80, 160, 320, 640, 1250, 2500, 5000, 10000 };
+
+    if (eq == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(eq, 0, sizeof(*eq));
+    if (config->channels == 0 || config->sample_rate == 0)
+        return MA_INVALID_ARGS;
+
+    eq->channels = config->channels;
+    eq->sample_rate = config->sample_rate;
+    eq->z1 = (float *)ma_calloc(sizeof(float) * config->channels * BIQUAD_MAX_STAGES * 2, alloc);
+    if (eq->z1 == NULL)
+        return MA_OUT_OF_MEMORY;
+    eq->z2 = eq->z1 + config->channels * BIQUAD_MAX_STAGES;
+
+    for (int b = 0; b < EQ_BANDS; b++) {
+        struct eq_band *band = &eq->bands[b];
+        band->type = b == 0 ? EQ_LOW_SHELF : b == EQ_BANDS - 1 ? EQ_HIGH_SHELF : EQ_PEAK;
+        band->frequency = frequencies[b];
+        band->gain = 0.0f;
+        band->q = b == 0 || b == EQ_BANDS - 1 ? 0.707f : 1.0f;
+        eq->applied[b] = *band;
+        eq_band_clamp(eq, &eq->applied[b]);
+    }
+    biquad_coeffs_identity(&eq->coeffs);
+    return MA_SUCCESS;
+}
+
+static void equalizer_uninit(struct equalizer *eq, const ma_allocation_callbacks *alloc)
+{
+    ma_free(eq->z1, alloc);
+    eq->z1 = eq->z2 = NULL;
+}
+
+/*
+ * Smooths every band towards the UI parameters and redesigns the ones that
+ * moved into `next`. Returns true when the block has to ramp to `next`.
+ */
+static bool equalizer_update(struct equalizer *eq, ma_uint32 frame_count, struct biquad_coeffs *next)
+{
+    const float k = 1.0f - expf(-(float)frame_count / (BIQUAD_SMOOTH_TIME * (float)eq->sample_rate));
+    bool changed = false;
+
+    *next = eq->coeffs;
+    for (int b = 0; b < EQ_BANDS; b++) {
+        struct eq_band target, *applied = &eq->applied[b];
+        target.type = dsp_load_u32(&eq->bands[b].type);
+        target.frequency = dsp_load_f32(&eq->bands[b].frequency);
+        target.gain = dsp_load_f32(&eq->bands[b].gain);
+        target.q = dsp_load_f32(&eq->bands[b].q);
+        eq_band_clamp(eq, &target);
+
+        if (target.type == applied->type && target.frequency == applied->frequency
+                && target.gain == applied->gain && target.q == applied->q)
+            continue;
+
+        /* A band switched on or to another type starts from its target, the coefficient ramp covers the jump. */
+        if (target.type != applied->type) {
+            *applied = target;
+        } else {
+            float ratio = target.frequency / applied->frequency;
+            applied->frequency = fabsf(ratio - 1.0f) < 1e-3f ? target.frequency : applied->frequency * powf(ratio, k);
+            ratio = target.q / applied->q;
+            applied->q = fabsf(ratio - 1.0f) < 1e-3f ? target.q : applied->q * powf(ratio, k);
+            float diff = target.gain - applied->gain;
+            applied->gain = fabsf(diff) < 0.01f ? target.gain : applied->gain + diff * k;
+        }
+        eq_design_band(next, b, applied, eq->sample_rate);
+        changed = true;
+    }
+    return changed;
+}
+
+static void equalizer_run(struct equalizer *eq, float *out, const float *in, ma_uint32 frame_count,
+        const struct biquad_coeffs *c, const bool *active)
+{
+    /* Channels go in pairs, as in biquad_cascade_run. */
+    for (ma_uint32 ch = 0; ch < eq->channels; ch += 2) {
+        const ma_uint32 width = DSP_MIN(2u, eq->channels - ch);
+        float *z1 = eq->z1 + ch * BIQUAD_MAX_STAGES;
+        float *z2 = eq->z2 + ch * BIQUAD_MAX_STAGES;
+        const float *src = in + ch;
+        for (ma_uint32 g = 0; g < EQ_GROUPS; g++) {
+            if (!active[g])
+                continue;
+            if (width == 2)
+                biquad_group_process_pair(out + ch, src, frame_count, eq->channels, c, g * BIQUAD_LANES, z1, z2);
+            else
+                biquad_group_process(out + ch, src, frame_count, eq->channels, c, g * BIQUAD_LANES, z1, z2);
+            src = out + ch;
+        }
+        if (src != out + ch && out != in) {
+            for (ma_uint32 f = 0; f < frame_count; f++) {
+                for (ma_uint32 i = 0; i < width; i++)
+                    out[f * eq->channels + ch + i] = in[f * eq->channels + ch + i];
+            }
+        }
+    }
+}
+
+static void equalizer_process(struct equalizer *eq, float *out, const float *in, ma_uint32 frame_count)
+{
+    struct biquad_coeffs next, step;
+    bool active[EQ_GROUPS];
+
+    if (frame_count == 0)
+        return;
+
+    bool ramp = equalizer_update(eq, frame_count, &next);
+
+    /* A group runs while any of its sections is, or is about to be, non-flat. Idle groups keep no history. */
+    for (ma_uint32 g = 0; g < EQ_GROUPS; g++) {
+        active[g] = false;
+        for (int s = g * BIQUAD_LANES; s < (int)(g + 1) * BIQUAD_LANES; s++)
+            active[g] |= !eq_band_is_flat(&eq->coeffs, s) || (ramp && !eq_band_is_flat(&next, s));
+        if (!active[g]) {
+            for (ma_uint32 ch = 0; ch < eq->channels; ch++) {
+                memset(eq->z1 + ch * BIQUAD_MAX_STAGES + g * BIQUAD_LANES, 0, sizeof(float) * BIQUAD_LANES);
+                memset(eq->z2 + ch * BIQUAD_MAX_STAGES + g * BIQUAD_LANES, 0, sizeof(float) * BIQUAD_LANES);
+            }
+        }
+    }
+
+    if (!ramp) {
+        equalizer_run(eq, out, in, frame_count, &eq->coeffs, active);
+        return;
+    }
+
+    ma_uint32 steps = (frame_count + BIQUAD_RAMP_FRAMES - 1) / BIQUAD_RAMP_FRAMES;
+    for (ma_uint32 i = 0; i < steps; i++) {
+        ma_uint32 offset = i * BIQUAD_RAMP_FRAMES;
+        ma_uint32 n = DSP_MIN((ma_uint32)BIQUAD_RAMP_FRAMES, frame_count - offset);
+        biquad_coeffs_lerp(&step, &eq->coeffs, &next, (float)(i + 1) / (float)steps);
+        equalizer_run(eq, out + offset * eq->channels, in + offset * eq->channels, n, &step, active);
+    }
+    eq->coeffs = next;
+}
+
+
+/*
+ * EQ Node
+ */
+struct equalizer_node_config {
+    ma_node_config node_config;
+    struct equalizer_config equalizer;
+};
+
+struct equalizer_node {
+    ma_node_base base;
+    struct equalizer equalizer;
+};
+
+static struct equalizer_node_config equalizer_node_config_init(ma_uint32 channels, ma_uint32 sample_rate)
+{
+    struct equalizer_node_config config;
+    config.node_config = ma_node_config_init();
+    config.equalizer = equalizer_config_init(channels, sample_rate);
+    return config;
+}
+
+static void equalizer_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct equalizer_node *eq = (struct equalizer_node *)node;
+    (void)frame_count_in;
+    equalizer_process(&eq->equalizer, frames_out[0], frames_in[0], *frame_count_out);
+}
+
+static ma_node_vtable equalizer_node_vtable = {
+    equalizer_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input. */
+    1,      /* One output. */
+    0       /* Default flags. */
+};
+
+static ma_result equalizer_node_init(ma_node_graph *graph, const struct equalizer_node_config *config,
+        const ma_allocation_callbacks *alloc, struct equalizer_node *eq)
+{
+    ma_result result;
+
+    if (eq == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(eq, 0, sizeof(*eq));
+
+    result = equalizer_init(&config->equalizer, alloc, &eq->equalizer);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &equalizer_node_vtable;
+    base_config.pInputChannels = &config->equalizer.channels;
+    base_config.pOutputChannels = &config->equalizer.channels;
+    result = ma_node_init(graph, &base_config, alloc, &eq->base);
+    if (result != MA_SUCCESS) {
+        equalizer_uninit(&eq->equalizer, alloc);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void equalizer_node_uninit(struct equalizer_node *eq, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&eq->base, alloc);
+    equalizer_uninit(&eq->equalizer, alloc);
+}
@@ -0,0 +1,714 @@
+/*
+ * Expression node.
+ *
+ * A typed formula such as `in0 * sin(2*pi*220*t)` is compiled once, on the
+ * UI thread, into a register program: each operation reads one or two
+ * registers and writes a third, and every register holds EXPRESSION_BLOCK
+ * frames. The audio thread runs the program one operation at a time over
+ * the whole block, four frames per vector, so the dispatch cost is paid
+ * once per operation per block rather than per sample.
+ *
+ * Names: in0 and in1 are the two inputs, t the time in seconds since the
+ * node started (or was reset), a to d the editor's parameters, pi and e
+ * constants. Operators, loosest first: < >, + -, * / %, unary -, ^.
+ * Functions: sin cos tan exp exp2 log log2 sqrt abs floor tanh, and
+ * min max pow of two arguments. Comparisons give 1 or 0.
+ *
+ * The compiler folds constant subexpressions, turns small integer powers
+ * into multiplies and reuses temporaries, so a program rarely needs more
+ * than a handful of registers. exp, log and pow use the fast approximations
+ * of dsp.h, good to about 1e-4. Each channel runs the program on its own,
+ * and the output is limited to +-EXPRESSION_LIMIT with NaN turned to
+ * silence, so a typo can't blow up the next node.
+ *
+ * t is a float: past a few minutes it is too coarse for audio rate
+ * phases, which is what the Reset button is for.
+ */
+#include "dsp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define EXPRESSION_BLOCK        64      /* Frames per register */
+#define EXPRESSION_MAX_REGS     48
+#define EXPRESSION_MAX_OPS      128
+#define EXPRESSION_MAX_TEXT     256
+#define EXPRESSION_PARAMS       4       /* a, b, c, d */
+#define EXPRESSION_LIMIT        4.0f    /* Output clamp, +12 dBFS */
+
+enum expression_register {
+    EXPRESSION_IN0,
+    EXPRESSION_IN1,
+    EXPRESSION_TIME,
+    EXPRESSION_PARAM,           /* EXPRESSION_PARAMS of them */
+    EXPRESSION_CONSTANT = EXPRESSION_PARAM + EXPRESSION_PARAMS,
+};
+
+enum expression_code {
+    EXPRESSION_ADD,
+    EXPRESSION_SUB,
+    EXPRESSION_MUL,
+    EXPRESSION_DIV,
+    EXPRESSION_MOD,
+    EXPRESSION_POW,
+    EXPRESSION_MIN,
+    EXPRESSION_MAX,
+    EXPRESSION_LT,
+    EXPRESSION_GT,
+    EXPRESSION_NEG,
+    EXPRESSION_SIN,
+    EXPRESSION_COS,
+    EXPRESSION_TAN,
+    EXPRESSION_EXP,
+    EXPRESSION_EXP2,
+    EXPRESSION_LOG,
+    EXPRESSION_LOG2,
+    EXPRESSION_SQRT,
+    EXPRESSION_ABS,
+    EXPRESSION_FLOOR,
+    EXPRESSION_TANH,
+    EXPRESSION_CODE_COUNT
+};
+
+struct expression_op {
+    ma_uint8 code;
+    ma_uint8 dst;
+    ma_uint8 x;
+    ma_uint8 y;                 /* Unused by one argument codes */
+};
+
+struct expression_program {
+    struct expression_op ops[EXPRESSION_MAX_OPS];
+    ma_uint32 op_count;
+    float constants[EXPRESSION_MAX_REGS - EXPRESSION_CONSTANT];    /* Registers from EXPRESSION_CONSTANT */
+    ma_uint32 constant_count;
+    ma_uint32 result;           /* Register holding the output */
+};
+
+/*
+ * Kernels: d = f(x, y) over n frames, n a multiple of 4. d may be x or y;
+ * one argument kernels are passed x as y.
+ */
+static v4f expression_sin4(v4f x)
+{
+    /* Reduce to [-pi, pi] in two steps, fold into [-pi/2, pi/2], then odd Taylor terms to x^11. */
+    const v4f k = v4f_floor(v4f_madd(x, v4f_set1((float)(0.5 / DSP_PI)), v4f_set1(0.5f)));
+    v4f r = v4f_sub(x, v4f_mul(k, v4f_set1(6.28125f)));
+    r = v4f_sub(r, v4f_mul(k, v4f_set1(1.9353071795864769e-3f)));
+    const v4f half_pi = v4f_set1((float)(DSP_PI / 2.0));
+    const v4f pi = v4f_set1((float)DSP_PI);
+    r = v4f_select(v4f_cmpgt(r, half_pi), v4f_sub(pi, r), r);
+    r = v4f_select(v4f_cmpgt(v4f_sub(v4f_zero(), half_pi), r), v4f_sub(v4f_sub(v4f_zero(), pi), r), r);
+    const v4f r2 = v4f_mul(r, r);
+    v4f p = v4f_set1(-2.5052108385e-8f);
+    p = v4f_madd(p, r2, v4f_set1(2.7557319224e-6f));
+    p = v4f_madd(p, r2, v4f_set1(-1.9841269841e-4f));
+    p = v4f_madd(p, r2, v4f_set1(8.3333333333e-3f));
+    p = v4f_madd(p, r2, v4f_set1(-1.6666666667e-1f));
+    p = v4f_madd(p, r2, v4f_set1(1.0f));
+    return v4f_mul(p, r);
+}
+
+static v4f expression_cos4(v4f x)
+{
+    return expression_sin4(v4f_add(x, v4f_set1((float)(DSP_PI / 2.0))));
+}
+
+/* e^x = 2^(x log2 e) */
+static v4f expression_exp4(v4f x)
+{
+    return v4f_exp2(v4f_mul(x, v4f_set1(1.4426950409f)));
+}
+
+/* log2 of x, -126 where x is zero or negative */
+static v4f expression_log24(v4f x)
+{
+    v4m positive = v4f_cmpgt(x, v4f_zero());
+    return v4f_select(positive, v4f_log2(v4f_max(x, v4f_set1(1e-37f))), v4f_set1(-126.0f));
+}
+
+#define EXPRESSION_KERNEL(name, expr)                                                   \
+    static void expression_##name(float *d, const float *xs, const float *ys, ma_uint32 n) \
+    {                                                                                   \
+        for (ma_uint32 f = 0; f < n; f += 4) {                                          \
+            v4f x = v4f_load(xs + f);                                                   \
+            v4f y = v4f_load(ys + f);                                                   \
+            (void)y;                                                                    \
+            v4f_store(d + f, expr);                                                     \
+        }                                                                               \
+    }
+
+EXPRESSION_KERNEL(add, v4f_add(x, y))
+EXPRESSION_KERNEL(sub, v4f_sub(x, y))
+EXPRESSION_KERNEL(mul, v4f_mul(x, y))
+EXPRESSION_KERNEL(div, v4f_div(x, y))
+EXPRESSION_KERNEL(mod, v4f_sub(x, v4f_mul(y, v4f_floor(v4f_div(x, y)))))
+EXPRESSION_KERNEL(pow, v4f_select(v4f_cmpgt(x, v4f_zero()), v4f_exp2(v4f_mul(y, expression_log24(x))), v4f_zero()))
+EXPRESSION_KERNEL(min, v4f_min(x, y))
+EXPRESSION_KERNEL(max, v4f_max(x, y))
+EXPRESSION_KERNEL(lt, v4f_select(v4f_cmpgt(y, x), v4f_set1(1.0f), v4f_zero()))
+EXPRESSION_KERNEL(gt, v4f_select(v4f_cmpgt(x, y), v4f_set1(1.0f), v4f_zero()))
+EXPRESSION_KERNEL(neg, v4f_sub(v4f_zero(), x))
+EXPRESSION_KERNEL(sin, expression_sin4(x))
+EXPRESSION_KERNEL(cos, expression_cos4(x))
+EXPRESSION_KERNEL(tan, v4f_div(expression_sin4(x), expression_cos4(x)))
+EXPRESSION_KERNEL(exp, expression_exp4(x))
+EXPRESSION_KERNEL(exp2, v4f_exp2(x))
+EXPRESSION_KERNEL(log, v4f_mul(expression_log24(x), v4f_set1(0.6931471806f)))
+EXPRESSION_KERNEL(log2, expression_log24(x))
+EXPRESSION_KERNEL(sqrt, v4f_sqrt(v4f_max(x, v4f_zero())))
+EXPRESSION_KERNEL(abs, v4f_abs(x))
+EXPRESSION_KERNEL(floor, v4f_floor(x))
+EXPRESSION_KERNEL(tanh, v4f_sub(v4f_set1(1.0f), v4f_div(v4f_set1(2.0f),
+        v4f_add(expression_exp4(v4f_mul(v4f_set1(2.0f), x)), v4f_set1(1.0f)))))
+
+#undef EXPRESSION_KERNEL
+
+typedef void (*expression_kernel)(float *d, const float *x, const float *y, ma_uint32 n);
+
+static const expression_kernel expression_kernels[EXPRESSION_CODE_COUNT] = {
+    expression_add, expression_sub, expression_mul, expression_div, expression_mod,
+    expression_pow, expression_min, expression_max, expression_lt, expression_gt,
+    expression_neg, expression_sin, expression_cos, expression_tan, expression_exp,
+    expression_exp2, expression_log, expression_log2, expression_sqrt, expression_abs,
+    expression_floor, expression_tanh,
+};
+
+/*
+ * Compiler: recursive descent straight to register code. Constants fill
+ * registers upwards from EXPRESSION_CONSTANT, temporaries downwards from
+ * the top; temporaries are freed as soon as an operation consumes them,
+ * which the evaluation order keeps last in, first out.
+ */
+struct expression_compiler {
+    const char *text;
+    const char *p;
+    struct expression_program *program;
+    ma_uint32 temp_top;         /* Lowest temporary in use; EXPRESSION_MAX_REGS when none */
+    ma_uint32 uses[EXPRESSION_MAX_REGS - EXPRESSION_CONSTANT];  /* Per constant, by the parser or by ops */
+    char *error;
+    size_t error_size;
+};
+
+static const struct {
+    const char *name;
+    enum expression_code code;
+    int arity;
+} expression_functions[] = {
+    { "sin", EXPRESSION_SIN, 1 }, { "cos", EXPRESSION_COS, 1 }, { "tan", EXPRESSION_TAN, 1 },
+    { "exp", EXPRESSION_EXP, 1 }, { "exp2", EXPRESSION_EXP2, 1 }, { "log", EXPRESSION_LOG, 1 },
+    { "log2", EXPRESSION_LOG2, 1 }, { "sqrt", EXPRESSION_SQRT, 1 }, { "abs", EXPRESSION_ABS, 1 },
+    { "floor", EXPRESSION_FLOOR, 1 }, { "tanh", EXPRESSION_TANH, 1 },
+    { "min", EXPRESSION_MIN, 2 }, { "max", EXPRESSION_MAX, 2 }, { "pow", EXPRESSION_POW, 2 },
+};
+
+static int expression_fail(struct expression_compiler *c, const char *message)
+{
+    if (c->error[0] == '\0')
+        snprintf(c->error, c->error_size, "%s at %d", message, (int)(c->p - c->text) + 1);
+    return -1;
+}
+
+static bool expression_is_constant(const struct expression_compiler *c, int r)
+{
+    return r >= EXPRESSION_CONSTANT && (ma_uint32)r < EXPRESSION_CONSTANT + c->program->constant_count;
+}
+
+static bool expression_is_temp(const struct expression_compiler *c, int r)
+{
+    return (ma_uint32)r >= c->temp_top;
+}
+
+static int expression_constant(struct expression_compiler *c, float value)
+{
+    struct expression_program *prog = c->program;
+    for (ma_uint32 i = 0; i < prog->constant_count; i++) {
+        if (prog->constants[i] == value) {
+            c->uses[i]++;
+            return EXPRESSION_CONSTANT + (int)i;
+        }
+    }
+    if (EXPRESSION_CONSTANT + prog->constant_count >= c->temp_top)
+        return expression_fail(c, "too many values");
+    prog->constants[prog->constant_count] = value;
+    c->uses[prog->constant_count] = 1;
+    return EXPRESSION_CONSTANT + (int)prog->constant_count++;
+}
+
+/* Drops one use of constant `r`, giving back the registers of any unused ones on top. */
+static void expression_release(struct expression_compiler *c, int r)
+{
+    struct expression_program *prog = c->program;
+    c->uses[r - EXPRESSION_CONSTANT]--;
+    while (prog->constant_count > 0 && c->uses[prog->constant_count - 1] == 0)
+        prog->constant_count--;
+}
+
+static float expression_constant_value(const struct expression_compiler *c, int r)
+{
+    return c->program->constants[r - EXPRESSION_CONSTANT];
+}
+
+/* Emits dst = code(x, y), y -1 for one argument codes; frees temporary operands unless `keep`. */
+static int expression_emit_op(struct expression_compiler *c, enum expression_code code, int x, int y, bool keep)
+{
+    if (x < 0 || (y < 0 && code < EXPRESSION_NEG))
+        return -1;
+
+    /* Constant operands: evaluate now, with the same kernel the audio thread would use. */
+    if (expression_is_constant(c, x) && (y < 0 || expression_is_constant(c, y))) {
+        float xs[4], ys[4], d[4];
+        for (int i = 0; i < 4; i++) {
+            xs[i] = expression_constant_value(c, x);
+            ys[i] = y < 0 ? 0.0f : expression_constant_value(c, y);
+        }
+        expression_kernels[code](d, xs, y < 0 ? xs : ys, 4);
+        expression_release(c, x);
+        if (y >= 0)
+            expression_release(c, y);
+        return expression_constant(c, d[0]);
+    }
+
+    if (!keep) {
+        /* The latest temporary is the lowest, so free in ascending order. */
+        int lo = y >= 0 ? DSP_MIN(x, y) : x, hi = y >= 0 ? DSP_MAX(x, y) : x;
+        if (expression_is_temp(c, lo) && (ma_uint32)lo == c->temp_top)
+            c->temp_top++;
+        if (hi != lo && expression_is_temp(c, hi) && (ma_uint32)hi == c->temp_top)
+            c->temp_top++;
+    }
+    if (c->program->op_count == EXPRESSION_MAX_OPS)
+        return expression_fail(c, "expression too long");
+    if (c->temp_top <= EXPRESSION_CONSTANT + c->program->constant_count)
+        return expression_fail(c, "expression too deep");
+    int dst = (int)--c->temp_top;
+    struct expression_op *op = &c->program->ops[c->program->op_count++];
+    op->code = (ma_uint8)code;
+    op->dst = (ma_uint8)dst;
+    op->x = (ma_uint8)x;
+    op->y = (ma_uint8)(y < 0 ? x : y);
+    return dst;
+}
+
+static int expression_emit(struct expression_compiler *c, enum expression_code code, int x, int y)
+{
+    return expression_emit_op(c, code, x, y, false);
+}
+
+static void expression_skip_space(struct expression_compiler *c)
+{
+    while (*c->p == ' ' || *c->p == '\t')
+        c->p++;
+}
+
+static bool expression_accept(struct expression_compiler *c, char ch)
+{
+    expression_skip_space(c);
+    if (*c->p != ch)
+        return false;
+    c->p++;
+    return true;
+}
+
+static int expression_parse(struct expression_compiler *c);
+static int expression_parse_unary(struct expression_compiler *c);
+
+static int expression_parse_primary(struct expression_compiler *c)
+{
+    expression_skip_space(c);
+    const char *start = c->p;
+
+    if ((*c->p >= '0' && *c->p <= '9') || *c->p == '.') {
+        char *end;
+        double value = strtod(c->p, &end);
+        if (end == c->p)
+            return expression_fail(c, "bad number");
+        c->p = end;
+        return expression_constant(c, (float)value);
+    }
+    if (expression_accept(c, '(')) {
+        int r = expression_parse(c);
+        if (r >= 0 && !expression_accept(c, ')'))
+            return expression_fail(c, "missing )");
+        return r;
+    }
+
+    while ((*c->p >= 'a' && *c->p <= 'z') || (*c->p >= 'A' && *c->p <= 'Z')
+            || (*c->p >= '0' && *c->p <= '9') || *c->p == '_')
+        c->p++;
+    size_t length = (size_t)(c->p - start);
+    if (length == 0)
+        return expression_fail(c, "expected a value");
+
+#define EXPRESSION_NAME_IS(s) (length == sizeof(s) - 1 && memcmp(start, s, length) == 0)
+    if (EXPRESSION_NAME_IS("in0"))
+        return EXPRESSION_IN0;
+    if (EXPRESSION_NAME_IS("in1"))
+        return EXPRESSION_IN1;
+    if (EXPRESSION_NAME_IS("t"))
+        return EXPRESSION_TIME;
+    if (length == 1 && *start >= 'a' && *start < 'a' + EXPRESSION_PARAMS)
+        return EXPRESSION_PARAM + (*start - 'a');
+    if (EXPRESSION_NAME_IS("pi"))
+        return expression_constant(c, (float)DSP_PI);
+    if (EXPRESSION_NAME_IS("e"))
+        return expression_constant(c, 2.7182818285f);
+#undef EXPRESSION_NAME_IS
+
+    for (size_t i = 0; i < sizeof(expression_functions) / sizeof(expression_functions[0]); i++) {
+        if (strlen(expression_functions[i].name) != length || memcmp(start, expression_functions[i].name, length) != 0)
+            continue;
+        if (!expression_accept(c, '('))
+            return expression_fail(c, "missing (");
+        int x = expression_parse(c), y = -1;
+        if (expression_functions[i].arity == 2) {
+            if (x >= 0 && !expression_accept(c, ','))
+                return expression_fail(c, "missing ,");
+            y = expression_parse(c);
+        }
+        if (x < 0 || (expression_functions[i].arity == 2 && y < 0))
+            return -1;
+        if (!expression_accept(c, ')'))
+            return expression_fail(c, "missing )");
+        return expression_emit(c, expression_functions[i].code, x, y);
+    }
+    c->p = start;
+    return expression_fail(c, "unknown name");
+}
+
+/* primary ^ unary, right associative. Small integer powers become multiplies. */
+static int expression_parse_power(struct expression_compiler *c)
+{
+    int x = expression_parse_primary(c);
+    if (x < 0 || !expression_accept(c, '^'))
+        return x;
+    int y = expression_parse_unary(c);
+    if (y < 0)
+        return -1;
+    if (expression_is_constant(c, y) && !expression_is_constant(c, x)) {
+        float n = expression_constant_value(c, y);
+        if (n == 0.5f || n == 1.0f || n == 2.0f || n == 3.0f || n == 4.0f)
+            expression_release(c, y);
+        if (n == 1.0f)
+            return x;
+        if (n == 0.5f)
+            return expression_emit(c, EXPRESSION_SQRT, x, -1);
+        if (n == 2.0f)
+            return expression_emit(c, EXPRESSION_MUL, x, x);
+        if (n == 3.0f)
+            return expression_emit(c, EXPRESSION_MUL, expression_emit_op(c, EXPRESSION_MUL, x, x, true), x);
+        if (n == 4.0f) {
+            int square = expression_emit(c, EXPRESSION_MUL, x, x);
+            return expression_emit(c, EXPRESSION_MUL, square, square);
+        }
+    }
+    return expression_emit(c, EXPRESSION_POW, x, y);
+}
+
+static int expression_parse_unary(struct expression_compiler *c)
+{
+    if (expression_accept(c, '-'))
+        return expression_emit(c, EXPRESSION_NEG, expression_parse_unary(c), -1);
+    if (expression_accept(c, '+'))
+        return expression_parse_unary(c);
+    return expression_parse_power(c);
+}
+
+static int expression_parse_product(struct expression_compiler *c)
+{
+    int x = expression_parse_unary(c);
+    while (x >= 0) {
+        if (expression_accept(c, '*'))
+            x = expression_emit(c, EXPRESSION_MUL, x, expression_parse_unary(c));
+        else if (expression_accept(c, '/'))
+            x = expression_emit(c, EXPRESSION_DIV, x, expression_parse_unary(c));
+        else if (expression_accept(c, '%'))
+            x = expression_emit(c, EXPRESSION_MOD, x, expression_parse_unary(c));
+        else
+            break;
+    }
+    return x;
+}
+
+static int expression_parse_sum(struct expression_compiler *c)
+{
+    int x = expression_parse_product(c);
+    while (x >= 0) {
+        if (expression_accept(c, '+'))
+            x = expression_emit(c, EXPRESSION_ADD, x, expression_parse_product(c));
+        else if (expression_accept(c, '-'))
+            x = expression_emit(c, EXPRESSION_SUB, x, expression_parse_product(c));
+        else
+            break;
+    }
+    return x;
+}
+
+static int expression_parse(struct expression_compiler *c)
+{
+    int x = expression_parse_sum(c);
+    while (x >= 0) {
+        if (expression_accept(c, '<'))
+            x = expression_emit(c, EXPRESSION_LT, x, expression_parse_sum(c));
+        else if (expression_accept(c, '>'))
+            x = expression_emit(c, EXPRESSION_GT, x, expression_parse_sum(c));
+        else
+            break;
+    }
+    return x;
+}
+
+/* UI thread. Returns false with a message in `error` when `text` doesn't parse. */
+static bool expression_compile(const char *text, struct expression_program *program, char *error, size_t error_size)
+{
+    struct expression_compiler c;
+    memset(program, 0, sizeof(*program));
+    c.text = text;
+    c.p = text;
+    c.program = program;
+    c.temp_top = EXPRESSION_MAX_REGS;
+    c.error = error;
+    c.error_size = error_size;
+    error[0] = '\0';
+
+    int result = expression_parse(&c);
+    expression_skip_space(&c);
+    if (result >= 0 && *c.p != '\0')
+        result = expression_fail(&c, "unexpected character");
+    if (result < 0) {
+        memset(program, 0, sizeof(*program));
+        return false;
+    }
+    program->result = (ma_uint32)result;
+    return true;
+}
+
+/*
+ * Evaluator
+ */
+struct expression_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    const char *text;
+};
+
+struct expression {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+
+    /* Written by the UI thread, read once per block. */
+    float params[EXPRESSION_PARAMS];
+    ma_uint32 reset;            /* Set to restart t, cleared by the audio thread */
+
+    /*
+     * Two program slots: the UI thread fills the one the audio thread isn't
+     * running and publishes it through `active`; the audio thread reports
+     * the slot it runs in `in_use`.
+     */
+    struct expression_program programs[2];
+    ma_uint32 active;
+    ma_uint32 in_use;
+
+    /* Audio thread state. */
+    ma_uint32 loaded;           /* Slot whose constants are in the registers, plus one */
+    double time;                /* Seconds */
+    float *regs;                /* [EXPRESSION_MAX_REGS][EXPRESSION_BLOCK] */
+    struct dsp_arena arena;
+};
+
+static struct expression_config expression_config_init(ma_uint32 channels, ma_uint32 sample_rate, const char *text)
+{
+    struct expression_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.text = text;
+    return config;
+}
+
+static void expression_layout(struct expression *ex)
+{
+    ex->regs = dsp_arena_floats(&ex->arena, (size_t)EXPRESSION_MAX_REGS * EXPRESSION_BLOCK);
+}
+
+static ma_result expression_init(const struct expression_config *config, struct expression *ex)
+{
+    char error[64];
+    ma_result result;
+
+    memset(ex, 0, sizeof(*ex));
+    if (config->channels == 0 || config->sample_rate == 0 || config->text == NULL)
+        return MA_INVALID_ARGS;
+    if (!expression_compile(config->text, &ex->programs[0], error, sizeof(error)))
+        return MA_INVALID_ARGS;
+    ex->channels = config->channels;
+    ex->sample_rate = config->sample_rate;
+
+    expression_layout(ex);
+    result = dsp_arena_init(&ex->arena, ex->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    expression_layout(ex);
+    return MA_SUCCESS;
+}
+
+static void expression_uninit(struct expression *ex)
+{
+    dsp_arena_uninit(&ex->arena);
+}
+
+/* UI thread. Returns false while the audio thread hasn't moved on from the previous swap yet; try again later. */
+static bool expression_set_program(struct expression *ex, const struct expression_program *program)
+{
+    const ma_uint32 slot = ex->active ^ 1;
+    if (dsp_load_acquire_u32(&ex->in_use) == slot)
+        return false;
+    ex->programs[slot] = *program;
+    dsp_store_release_u32(&ex->active, slot);
+    return true;
+}
+
+static void expression_fill(float *reg, float value, ma_uint32 n)
+{
+    const v4f v = v4f_set1(value);
+    for (ma_uint32 f = 0; f < n; f += 4)
+        v4f_store_aligned(reg + f, v);
+}
+
+static void expression_process(struct expression *ex, float *out, const float *in0, const float *in1, ma_uint32 frame_count)
+{
+    const ma_uint32 channels = ex->channels;
+    const ma_uint32 slot = dsp_load_acquire_u32(&ex->active);
+    dsp_store_release_u32(&ex->in_use, slot);
+    const struct expression_program *prog = &ex->programs[slot];
+    float *const regs = ex->regs;
+
+    if (ex->loaded != slot + 1) {
+        for (ma_uint32 i = 0; i < prog->constant_count; i++)
+            expression_fill(regs + (EXPRESSION_CONSTANT + i) * EXPRESSION_BLOCK, prog->constants[i], EXPRESSION_BLOCK);
+        ex->loaded = slot + 1;
+    }
+    if (dsp_load_u32(&ex->reset)) {
+        ex->time = 0.0;
+        dsp_store_u32(&ex->reset, 0);
+    }
+    for (ma_uint32 i = 0; i < EXPRESSION_PARAMS; i++)
+        expression_fill(regs + (EXPRESSION_PARAM + i) * EXPRESSION_BLOCK, dsp_load_f32(&ex->params[i]), EXPRESSION_BLOCK);
+
+    const float dt = 1.0f / (float)ex->sample_rate;
+    const v4f limit = v4f_set1(EXPRESSION_LIMIT);
+    for (ma_uint32 done = 0; done < frame_count; ) {
+        const ma_uint32 n = DSP_MIN(frame_count - done, (ma_uint32)EXPRESSION_BLOCK);
+        const ma_uint32 vn = (n + 3) & ~3u;
+
+        /* t in double across blocks, float steps within one. */
+        float *time = regs + EXPRESSION_TIME * EXPRESSION_BLOCK;
+        const v4f step = v4f_set1(4.0f * dt);
+        v4f tv = v4f_madd(v4f_set(0.0f, 1.0f, 2.0f, 3.0f), v4f_set1(dt), v4f_set1((float)ex->time));
+        for (ma_uint32 f = 0; f < vn; f += 4, tv = v4f_add(tv, step))
+            v4f_store_aligned(time + f, tv);
+
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            float *x0 = regs + EXPRESSION_IN0 * EXPRESSION_BLOCK, *x1 = regs + EXPRESSION_IN1 * EXPRESSION_BLOCK;
+            const float *s0 = in0 + (size_t)done * channels + ch, *s1 = in1 + (size_t)done * channels + ch;
+            for (ma_uint32 f = 0; f < n; f++) {
+                x0[f] = s0[(size_t)f * channels];
+                x1[f] = s1[(size_t)f * channels];
+            }
+            for (ma_uint32 f = n; f < vn; f++)
+                x0[f] = x1[f] = 0.0f;
+
+            for (ma_uint32 i = 0; i < prog->op_count; i++) {
+                const struct expression_op *op = &prog->ops[i];
+                expression_kernels[op->code](regs + op->dst * EXPRESSION_BLOCK,
+                        regs + op->x * EXPRESSION_BLOCK, regs + op->y * EXPRESSION_BLOCK, vn);
+            }
+
+            /* Limit, and NaN (which fails every comparison) to silence. */
+            float *result = regs + prog->result * EXPRESSION_BLOCK;
+            float *y = regs + EXPRESSION_IN0 * EXPRESSION_BLOCK;
+            for (ma_uint32 f = 0; f < vn; f += 4) {
+                v4f v = v4f_load_aligned(result + f);
+                v4f clamped = v4f_min(v4f_max(v, v4f_sub(v4f_zero(), limit)), limit);
+                v4f_store_aligned(y + f, v4f_select(v4f_cmpge(v, v), clamped, v4f_zero()));
+            }
+            float *dst = out + (size_t)done * channels + ch;
+            for (ma_uint32 f = 0; f < n; f++)
+                dst[(size_t)f * channels] = y[f];
+        }
+        ex->time += (double)n * dt;
+        done += n;
+    }
+}
+
+
+/*
+ * Expression Node
+ */
+struct expression_node_config {
+    ma_node_config node_config;
+    struct expression_config expression;
+};
+
+struct expression_node {
+    ma_node_base base;
+    struct expression expression;
+};
+
+static struct expression_node_config
+expression_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, const char *text)
+{
+    struct expression_node_config config;
+    config.node_config = ma_node_config_init();
+    config.expression = expression_config_init(channels, sample_rate, text);
+    return config;
+}
+
+static void expression_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct expression_node *ex = (struct expression_node *)node;
+    (void)frame_count_in;
+    expression_process(&ex->expression, frames_out[0], frames_in[0], frames_in[1], *frame_count_out);
+}
+
+static ma_node_vtable expression_node_vtable = {
+    expression_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    2,      /* in0 and in1. */
+    1,      /* One output. */
+    MA_NODE_FLAG_CONTINUOUS_PROCESSING  /* Runs with nothing linked, as a generator. */
+};
+
+static ma_result expression_node_init(ma_node_graph *graph, const struct expression_node_config *config,
+        const ma_allocation_callbacks *alloc, struct expression_node *node)
+{
+    ma_result result;
+    ma_uint32 input_channels[2];
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = expression_init(&config->expression, &node->expression);
+    if (result != MA_SUCCESS)
+        return result;
+
+    input_channels[0] = config->expression.channels;
+    input_channels[1] = config->expression.channels;
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &expression_node_vtable;
+    base_config.pInputChannels = input_channels;
+    base_config.pOutputChannels = &config->expression.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        expression_uninit(&node->expression);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void expression_node_uninit(struct expression_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    expression_uninit(&node->expression);
+}
@@ -0,0 +1,360 @@
+/*
+ * Feedback delay network reverb.
+ *
+ * Sixteen delay lines of prime lengths feed back through a 16x16 orthogonal
+ * matrix: a Hadamard across the four vectors of lines and a Householder
+ * inside each vector. Their product is dense with every entry +-1/4, so one
+ * pass spreads each line into all the others, and it costs a handful of
+ * vector adds and four horizontal sums per frame. Each line has its own
+ * slow LFO on the read position to break up metallic ringing, and a one-pole
+ * shelf that sets separate decay times below and above the crossover.
+ *
+ * Cost is fixed per frame and independent of the decay time; the delay
+ * memory is allocated once at init.
+ */
+#include "dsp.h"
+
+#define FDN_LINES               16
+#define FDN_VECTORS             (FDN_LINES / 4)
+#define FDN_MIN_LENGTH          0.029   /* Seconds, shortest delay line. */
+#define FDN_MAX_LENGTH          0.087   /* Seconds, longest delay line. */
+#define FDN_MAX_DEPTH           0.001   /* Seconds of read modulation at full depth. */
+#define FDN_MIN_RATE            0.13    /* Hz, slowest LFO. */
+#define FDN_MAX_RATE            0.87    /* Hz, fastest LFO. */
+#define FDN_CROSSOVER           3000.0  /* Hz, between the low and high decay bands. */
+
+struct fdn_reverb_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    float decay;
+    float damping;
+    float modulation;
+    float mix;
+};
+
+struct fdn_reverb {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+
+    /* Written by the UI thread, read once per block. */
+    float decay;                /* Seconds to -60 dB below the crossover. */
+    float damping;              /* 0 keeps highs as long as lows, 1 makes them die 20x faster. */
+    float modulation;           /* 0..1 of FDN_MAX_DEPTH. */
+    float mix;
+
+    /* Audio thread state, one entry per line. */
+    float applied_decay, applied_damping;
+    float length[FDN_LINES];    /* Base delay in frames. */
+    float gain_high[FDN_LINES]; /* Per pass gain above the crossover. */
+    float gain_diff[FDN_LINES]; /* Low band gain minus high band gain. */
+    float lowpass[FDN_LINES];
+    float lfo_sin[FDN_LINES], lfo_cos[FDN_LINES];
+    float lfo_step_sin[FDN_LINES], lfo_step_cos[FDN_LINES];
+    float crossover;            /* One-pole coefficient. */
+    float *in_gain;             /* [channel][FDN_LINES] */
+    float *out_gain;            /* [channel][FDN_LINES] */
+    float *lines[FDN_LINES];
+    ma_uint32 mask[FDN_LINES];
+    ma_uint32 write;
+    struct dsp_arena arena;
+};
+
+static struct fdn_reverb_config
+fdn_reverb_config_init(ma_uint32 channels, ma_uint32 sample_rate, float decay, float damping, float mix)
+{
+    struct fdn_reverb_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.decay = decay;
+    config.damping = damping;
+    config.modulation = 0.5f;
+    config.mix = mix;
+    return config;
+}
+
+static ma_uint32 fdn_next_prime(ma_uint32 n)
+{
+    for (;; n++) {
+        ma_uint32 d = 2;
+        while (d * d <= n && n % d != 0)
+            d++;
+        if (d * d > n && n > 1)
+            return n;
+    }
+}
+
+static ma_uint32 fdn_next_pow2(ma_uint32 n)
+{
+    ma_uint32 p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+static void fdn_reverb_layout(struct fdn_reverb *fdn)
+{
+    fdn->in_gain = dsp_arena_floats(&fdn->arena, (size_t)fdn->channels * FDN_LINES);
+    fdn->out_gain = dsp_arena_floats(&fdn->arena, (size_t)fdn->channels * FDN_LINES);
+    for (ma_uint32 i = 0; i < FDN_LINES; i++)
+        fdn->lines[i] = dsp_arena_floats(&fdn->arena, (size_t)fdn->mask[i] + 1);
+}
+
+/* Gain per pass through a line of `length` frames for a -60 dB decay in `rt60` seconds. */
+static float fdn_line_gain(float length, float rt60, ma_uint32 sample_rate)
+{
+    return powf(10.0f, -3.0f * length / (rt60 * (float)sample_rate));
+}
+
+static void fdn_reverb_update_decay(struct fdn_reverb *fdn, float decay, float damping)
+{
+    float high = decay * (1.0f - 0.95f * damping);
+    for (ma_uint32 i = 0; i < FDN_LINES; i++) {
+        float g_low = fdn_line_gain(fdn->length[i], decay, fdn->sample_rate);
+        float g_high = fdn_line_gain(fdn->length[i], high, fdn->sample_rate);
+        fdn->gain_high[i] = g_high;
+        fdn->gain_diff[i] = g_low - g_high;
+    }
+    fdn->applied_decay = decay;
+    fdn->applied_damping = damping;
+}
+
+static ma_result fdn_reverb_init(const struct fdn_reverb_config *config, struct fdn_reverb *fdn)
+{
+    ma_result result;
+
+    memset(fdn, 0, sizeof(*fdn));
+    if (config->channels == 0 || config->sample_rate == 0 || config->decay <= 0.0f)
+        return MA_INVALID_ARGS;
+    fdn->channels = config->channels;
+    fdn->sample_rate = config->sample_rate;
+    fdn->decay = config->decay;
+    fdn->damping = DSP_CLAMP(config->damping, 0.0f, 1.0f);
+    fdn->modulation = DSP_CLAMP(config->modulation, 0.0f, 1.0f);
+    fdn->mix = DSP_CLAMP(config->mix, 0.0f, 1.0f);
+
+    /* Lengths spread geometrically and rounded up to primes, so no two lines share a period. */
+    const float sr = (float)config->sample_rate;
+    const float depth = (float)(FDN_MAX_DEPTH * config->sample_rate);
+    for (ma_uint32 i = 0; i < FDN_LINES; i++) {
+        float t = (float)i / (FDN_LINES - 1);
+        double seconds = FDN_MIN_LENGTH * pow(FDN_MAX_LENGTH / FDN_MIN_LENGTH, t);
+        ma_uint32 length = fdn_next_prime((ma_uint32)(seconds * sr));
+        fdn->length[i] = (float)length;
+        fdn->mask[i] = fdn_next_pow2(length + (ma_uint32)ceilf(2.0f * depth) + 2) - 1;
+
+        double rate = FDN_MIN_RATE * pow(FDN_MAX_RATE / FDN_MIN_RATE, (double)((i * 7) % FDN_LINES) / (FDN_LINES - 1));
+        double w = 2.0 * DSP_PI * rate / sr;
+        double phase = 2.0 * DSP_PI * i / FDN_LINES;
+        fdn->lfo_sin[i] = (float)sin(phase);
+        fdn->lfo_cos[i] = (float)cos(phase);
+        fdn->lfo_step_sin[i] = (float)sin(w);
+        fdn->lfo_step_cos[i] = (float)cos(w);
+    }
+    fdn->crossover = (float)(1.0 - exp(-2.0 * DSP_PI * FDN_CROSSOVER / sr));
+
+    fdn_reverb_layout(fdn);
+    result = dsp_arena_init(&fdn->arena, fdn->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    fdn_reverb_layout(fdn);
+
+    /*
+     * Channel c feeds and taps every line i with i % channels == c. Output taps
+     * alternate in sign so the channels decorrelate.
+     */
+    for (ma_uint32 ch = 0; ch < fdn->channels; ch++) {
+        ma_uint32 count = 0;
+        for (ma_uint32 i = 0; i < FDN_LINES; i++)
+            count += (i % fdn->channels == ch % FDN_LINES);
+        float scale = count ? 1.0f / sqrtf((float)count) : 0.0f;
+        for (ma_uint32 i = 0, n = 0; i < FDN_LINES; i++) {
+            if (i % fdn->channels != ch % FDN_LINES)
+                continue;
+            fdn->in_gain[ch * FDN_LINES + i] = scale;
+            fdn->out_gain[ch * FDN_LINES + i] = (n++ & 1) ? -scale : scale;
+        }
+    }
+
+    fdn_reverb_update_decay(fdn, fdn->decay, fdn->damping);
+    return MA_SUCCESS;
+}
+
+static void fdn_reverb_uninit(struct fdn_reverb *fdn)
+{
+    dsp_arena_uninit(&fdn->arena);
+}
+
+/* Interleaved in and out; `in` may equal `out`. */
+static void fdn_reverb_process(struct fdn_reverb *fdn, float *out, const float *in, ma_uint32 frame_count)
+{
+    const ma_uint32 channels = fdn->channels;
+    float decay = DSP_MAX(dsp_load_f32(&fdn->decay), 0.05f);
+    float damping = DSP_CLAMP(dsp_load_f32(&fdn->damping), 0.0f, 1.0f);
+    if (decay != fdn->applied_decay || damping != fdn->applied_damping)
+        fdn_reverb_update_decay(fdn, decay, damping);
+
+    const float mix = DSP_CLAMP(dsp_load_f32(&fdn->mix), 0.0f, 1.0f);
+    const float depth = DSP_CLAMP(dsp_load_f32(&fdn->modulation), 0.0f, 1.0f)
+            * (float)(FDN_MAX_DEPTH * fdn->sample_rate);
+    const v4f crossover = v4f_set1(fdn->crossover);
+    const v4f half = v4f_set1(0.5f);
+
+    v4f lp[FDN_VECTORS], g_high[FDN_VECTORS], g_diff[FDN_VECTORS];
+    v4f lfo_s[FDN_VECTORS], lfo_c[FDN_VECTORS], step_s[FDN_VECTORS], step_c[FDN_VECTORS];
+    for (ma_uint32 v = 0; v < FDN_VECTORS; v++) {
+        lp[v] = v4f_load(fdn->lowpass + 4 * v);
+        g_high[v] = v4f_load(fdn->gain_high + 4 * v);
+        g_diff[v] = v4f_load(fdn->gain_diff + 4 * v);
+        lfo_s[v] = v4f_load(fdn->lfo_sin + 4 * v);
+        lfo_c[v] = v4f_load(fdn->lfo_cos + 4 * v);
+        step_s[v] = v4f_load(fdn->lfo_step_sin + 4 * v);
+        step_c[v] = v4f_load(fdn->lfo_step_cos + 4 * v);
+    }
+
+    float taps[FDN_LINES], offsets[FDN_LINES];
+    ma_uint32 write = fdn->write;
+    for (ma_uint32 f = 0; f < frame_count; f++) {
+        /* Rotate the quadrature LFOs and turn them into read offsets of 0..2 * depth. */
+        for (ma_uint32 v = 0; v < FDN_VECTORS; v++) {
+            v4f s = v4f_madd(lfo_s[v], step_c[v], v4f_mul(lfo_c[v], step_s[v]));
+            lfo_c[v] = v4f_sub(v4f_mul(lfo_c[v], step_c[v]), v4f_mul(lfo_s[v], step_s[v]));
+            lfo_s[v] = s;
+            v4f_store(offsets + 4 * v, v4f_mul(v4f_add(s, v4f_set1(1.0f)), v4f_set1(depth)));
+        }
+
+        /* Fractional reads, the only per-line scalar work. */
+        for (ma_uint32 i = 0; i < FDN_LINES; i++) {
+            const float *line = fdn->lines[i];
+            float delay = fdn->length[i] + offsets[i];
+            ma_uint32 whole = (ma_uint32)delay;
+            float frac = delay - (float)whole;
+            float a = line[(write - whole) & fdn->mask[i]];
+            float b = line[(write - whole - 1) & fdn->mask[i]];
+            taps[i] = a + (b - a) * frac;
+        }
+
+        v4f x[FDN_VECTORS];
+        for (ma_uint32 v = 0; v < FDN_VECTORS; v++)
+            x[v] = v4f_load(taps + 4 * v);
+
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            const float *g = fdn->out_gain + ch * FDN_LINES;
+            v4f acc = v4f_mul(v4f_load(g), x[0]);
+            for (ma_uint32 v = 1; v < FDN_VECTORS; v++)
+                acc = v4f_madd(v4f_load(g + 4 * v), x[v], acc);
+            float dry = in[f * channels + ch];
+            out[f * channels + ch] = dry + (v4f_hsum(acc) - dry) * mix;
+        }
+
+        /* Two band decay: gain_high + (gain_low - gain_high) * lowpass. */
+        v4f y[FDN_VECTORS];
+        for (ma_uint32 v = 0; v < FDN_VECTORS; v++) {
+            lp[v] = v4f_madd(v4f_sub(x[v], lp[v]), crossover, lp[v]);
+            y[v] = v4f_madd(g_high[v], x[v], v4f_mul(g_diff[v], lp[v]));
+        }
+
+        /* Hadamard across vectors, then Householder within each. */
+        v4f s01 = v4f_add(y[0], y[1]), d01 = v4f_sub(y[0], y[1]);
+        v4f s23 = v4f_add(y[2], y[3]), d23 = v4f_sub(y[2], y[3]);
+        v4f z[FDN_VECTORS];
+        z[0] = v4f_mul(v4f_add(s01, s23), half);
+        z[1] = v4f_mul(v4f_add(d01, d23), half);
+        z[2] = v4f_mul(v4f_sub(s01, s23), half);
+        z[3] = v4f_mul(v4f_sub(d01, d23), half);
+        for (ma_uint32 v = 0; v < FDN_VECTORS; v++)
+            z[v] = v4f_sub(z[v], v4f_set1(0.5f * v4f_hsum(z[v])));
+
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            const float *g = fdn->in_gain + ch * FDN_LINES;
+            v4f dry = v4f_set1(in[f * channels + ch]);
+            for (ma_uint32 v = 0; v < FDN_VECTORS; v++)
+                z[v] = v4f_madd(v4f_load(g + 4 * v), dry, z[v]);
+        }
+
+        for (ma_uint32 v = 0; v < FDN_VECTORS; v++)
+            v4f_store(taps + 4 * v, z[v]);
+        for (ma_uint32 i = 0; i < FDN_LINES; i++)
+            fdn->lines[i][write & fdn->mask[i]] = taps[i];
+        write++;
+    }
+    fdn->write = write;
+
+    /* Renormalise the LFOs once per block so rounding can't make them drift. */
+    for (ma_uint32 v = 0; v < FDN_VECTORS; v++) {
+        v4f r2 = v4f_madd(lfo_s[v], lfo_s[v], v4f_mul(lfo_c[v], lfo_c[v]));
+        v4f k = v4f_mul(v4f_sub(v4f_set1(3.0f), r2), half);
+        v4f_store(fdn->lfo_sin + 4 * v, v4f_mul(lfo_s[v], k));
+        v4f_store(fdn->lfo_cos + 4 * v, v4f_mul(lfo_c[v], k));
+        v4f_store(fdn->lowpass + 4 * v, lp[v]);
+    }
+}
+
+
+/*
+ * FDN Reverb Node
+ */
+struct fdn_reverb_node_config {
+    ma_node_config node_config;
+    struct fdn_reverb_config reverb;
+};
+
+struct fdn_reverb_node {
+    ma_node_base base;
+    struct fdn_reverb reverb;
+};
+
+static struct fdn_reverb_node_config
+fdn_reverb_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, float decay, float damping, float mix)
+{
+    struct fdn_reverb_node_config config;
+    config.node_config = ma_node_config_init();
+    config.reverb = fdn_reverb_config_init(channels, sample_rate, decay, damping, mix);
+    return config;
+}
+
+static void fdn_reverb_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct fdn_reverb_node *reverb = (struct fdn_reverb_node *)node;
+    (void)frame_count_in;
+    fdn_reverb_process(&reverb->reverb, frames_out[0], frames_in[0], *frame_count_out);
+}
+
+static ma_node_vtable fdn_reverb_node_vtable = {
+    fdn_reverb_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input. */
+    1,      /* One output. */
+    MA_NODE_FLAG_CONTINUOUS_PROCESSING  /* Keep ringing out after the input stops. */
+};
+
+static ma_result fdn_reverb_node_init(ma_node_graph *graph, const struct fdn_reverb_node_config *config,
+        const ma_allocation_callbacks *alloc, struct fdn_reverb_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = fdn_reverb_init(&config->reverb, &node->reverb);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &fdn_reverb_node_vtable;
+    base_config.pInputChannels = &config->reverb.channels;
+    base_config.pOutputChannels = &config->reverb.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        fdn_reverb_uninit(&node->reverb);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void fdn_reverb_node_uninit(struct fdn_reverb_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    fdn_reverb_uninit(&node->reverb);
+}
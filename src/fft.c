@@ -0,0 +1,507 @@
+/*
+ * Real FFT.
+ *
+ * A real transform of size N is computed as a complex transform of size N/2
+ * on the even/odd samples followed by a split step. The complex transform is
+ * a Stockham autosort FFT (no bit reversal pass) with radix 4, 2, 3 and 5
+ * stages, so N/2 may be any product of those. Data is kept in split format
+ * (separate real and imaginary arrays) so butterflies vectorise cleanly:
+ * early stages vectorise across butterflies, later ones across the stride.
+ * Stages whose stride is a multiple of 8 take kernels.fft_stage, eight
+ * lanes wide, when the CPU has it (see kernels.c).
+ *
+ * Plans hold the twiddles for one size and are shared through a cache; get
+ * them at init, never from the audio thread. Transforms need a scratch
+ * buffer of fft_scratch_size() floats that belongs to the caller, so one plan
+ * can be used from several nodes and threads at once.
+ *
+ * Spectra are N/2+1 bins in split format. The inverse is unnormalised:
+ * fft_inverse(fft_forward(x)) == N * x.
+ */
+#include <pthread.h>
+
+#include "dsp.h"
+
+#define FFT_MAX_STAGES  32
+#define FFT_CACHE_SIZE  64
+
+struct fft_stage {
+    ma_uint32 radix;
+    ma_uint32 length;       /* Length of the sub-transforms at this stage. */
+    ma_uint32 stride;
+    const float *tw_re;     /* (radix - 1) rows of length / radix twiddles. */
+    const float *tw_im;
+};
+
+struct fft_plan {
+    ma_uint32 size;         /* Real transform size. */
+    ma_uint32 half;         /* Complex transform size. */
+    ma_uint32 stage_count;
+    struct fft_stage stages[FFT_MAX_STAGES];
+    const float *split_re;  /* exp(-2 pi i k / size) for k = 0..half/2 */
+    const float *split_im;
+    float *memory;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct fft_plan *plans[FFT_CACHE_SIZE];
+    int count;
+} fft_cache = { PTHREAD_MUTEX_INITIALIZER, { 0 }, 0 };
+
+static ma_uint32 fft_scratch_size(const struct fft_plan *plan)
+{
+    return plan->size * 2;
+}
+
+/* Smallest size >= n the plans support, e.g. for picking a convolution block. */
+static ma_uint32 fft_next_size(ma_uint32 n)
+{
+    for (ma_uint32 size = DSP_MAX(n, 2u); ; size++) {
+        ma_uint32 m = size;
+        if (m & 1)
+            continue;
+        m /= 2;
+        while (m % 2 == 0) m /= 2;
+        while (m % 3 == 0) m /= 3;
+        while (m % 5 == 0) m /= 5;
+        if (m == 1)
+            return size;
+    }
+}
+
+static struct fft_plan *fft_plan_create(ma_uint32 size)
+{
+    ma_uint32 radices[FFT_MAX_STAGES];
+    ma_uint32 count = 0, m, twiddle_count = 0;
+
+    if (size < 2 || (size & 1))
+        return NULL;
+
+    /* Radix 4 first so the stride of later stages is a multiple of the vector width. */
+    m = size / 2;
+    while (m % 4 == 0) { radices[count++] = 4; m /= 4; }
+    while (m % 2 == 0) { radices[count++] = 2; m /= 2; }
+    while (m % 3 == 0) { radices[count++] = 3; m /= 3; }
+    while (m % 5 == 0) { radices[count++] = 5; m /= 5; }
+    if (m != 1)
+        return NULL;
+
+    struct fft_plan *plan = (struct fft_plan *)ma_calloc(sizeof(*plan), NULL);
+    if (plan == NULL)
+        return NULL;
+    plan->size = size;
+    plan->half = size / 2;
+    plan->stage_count = count;
+
+    ma_uint32 length = plan->half;
+    for (ma_uint32 i = 0; i < count; i++) {
+        twiddle_count += (radices[i] - 1) * (length / radices[i]);
+        length /= radices[i];
+    }
+    ma_uint32 split_count = plan->half / 2 + 1;
+    ma_uint32 padded = (twiddle_count + 15) & ~15u;
+
+    plan->memory = dsp_alloc(2 * padded + 2 * split_count);
+    if (plan->memory == NULL) {
+        ma_free(plan, NULL);
+        return NULL;
+    }
+
+    float *tw_re = plan->memory, *tw_im = plan->memory + padded;
+    length = plan->half;
+    ma_uint32 stride = 1;
+    for (ma_uint32 i = 0; i < count; i++) {
+        struct fft_stage *st = &plan->stages[i];
+        ma_uint32 r = radices[i], rows = length / r;
+        st->radix = r;
+        st->length = length;
+        st->stride = stride;
+        st->tw_re = tw_re;
+        st->tw_im = tw_im;
+        for (ma_uint32 u = 1; u < r; u++) {
+            for (ma_uint32 p = 0; p < rows; p++) {
+                double angle = -2.0 * DSP_PI * (double)(p * u) / (double)length;
+                *tw_re++ = (float)cos(angle);
+                *tw_im++ = (float)sin(angle);
+            }
+        }
+        length = rows;
+        stride *= r;
+    }
+
+    float *split_re = plan->memory + 2 * padded;
+    float *split_im = split_re + split_count;
+    for (ma_uint32 k = 0; k < split_count; k++) {
+        double angle = -2.0 * DSP_PI * (double)k / (double)size;
+        split_re[k] = (float)cos(angle);
+        split_im[k] = (float)sin(angle);
+    }
+    plan->split_re = split_re;
+    plan->split_im = split_im;
+    return plan;
+}
+
+/* Returns the shared plan for `size`, or NULL if the size isn't supported. */
+static const struct fft_plan *fft_plan_get(ma_uint32 size)
+{
+    struct fft_plan *plan = NULL;
+
+    pthread_mutex_lock(&fft_cache.lock);
+    for (int i = 0; i < fft_cache.count; i++) {
+        if (fft_cache.plans[i]->size == size) {
+            plan = fft_cache.plans[i];
+            break;
+        }
+    }
+    if (plan == NULL && fft_cache.count < FFT_CACHE_SIZE) {
+        plan = fft_plan_create(size);
+        if (plan)
+            fft_cache.plans[fft_cache.count++] = plan;
+    }
+    pthread_mutex_unlock(&fft_cache.lock);
+    return plan;
+}
+
+static void fft_plan_cache_clear(void)
+{
+    pthread_mutex_lock(&fft_cache.lock);
+    for (int i = 0; i < fft_cache.count; i++) {
+        dsp_free(fft_cache.plans[i]->memory);
+        ma_free(fft_cache.plans[i], NULL);
+    }
+    fft_cache.count = 0;
+    pthread_mutex_unlock(&fft_cache.lock);
+}
+
+/* In-place DFT of `radix` points held in vectors. */
+static inline void fft_dft_v4f(ma_uint32 radix, v4f *re, v4f *im)
+{
+    v4f t0r, t0i, t1r, t1i, t2r, t2i, t3r, t3i;
+
+    switch (radix) {
+    case 2:
+        t0r = re[0]; t0i = im[0];
+        re[0] = v4f_add(t0r, re[1]); im[0] = v4f_add(t0i, im[1]);
+        re[1] = v4f_sub(t0r, re[1]); im[1] = v4f_sub(t0i, im[1]);
+        break;
+    case 3: {
+        v4f sr = v4f_add(re[1], re[2]), si = v4f_add(im[1], im[2]);
+        v4f dr = v4f_mul(v4f_sub(re[1], re[2]), v4f_set1(FFT_S3));
+        v4f di = v4f_mul(v4f_sub(im[1], im[2]), v4f_set1(FFT_S3));
+        v4f mr = v4f_madd(sr, v4f_set1(FFT_C3), re[0]), mi = v4f_madd(si, v4f_set1(FFT_C3), im[0]);
+        re[0] = v4f_add(re[0], sr); im[0] = v4f_add(im[0], si);
+        re[1] = v4f_add(mr, di); im[1] = v4f_sub(mi, dr);
+        re[2] = v4f_sub(mr, di); im[2] = v4f_add(mi, dr);
+        break;
+    }
+    case 4:
+        t0r = v4f_add(re[0], re[2]); t0i = v4f_add(im[0], im[2]);
+        t1r = v4f_sub(re[0], re[2]); t1i = v4f_sub(im[0], im[2]);
+        t2r = v4f_add(re[1], re[3]); t2i = v4f_add(im[1], im[3]);
+        t3r = v4f_sub(re[1], re[3]); t3i = v4f_sub(im[1], im[3]);
+        re[0] = v4f_add(t0r, t2r); im[0] = v4f_add(t0i, t2i);
+        re[2] = v4f_sub(t0r, t2r); im[2] = v4f_sub(t0i, t2i);
+        re[1] = v4f_add(t1r, t3i); im[1] = v4f_sub(t1i, t3r);
+        re[3] = v4f_sub(t1r, t3i); im[3] = v4f_add(t1i, t3r);
+        break;
+    case 5: {
+        v4f s14r = v4f_add(re[1], re[4]), s14i = v4f_add(im[1], im[4]);
+        v4f d14r = v4f_sub(re[1], re[4]), d14i = v4f_sub(im[1], im[4]);
+        v4f s23r = v4f_add(re[2], re[3]), s23i = v4f_add(im[2], im[3]);
+        v4f d23r = v4f_sub(re[2], re[3]), d23i = v4f_sub(im[2], im[3]);
+        v4f c1 = v4f_set1(FFT_C51), c2 = v4f_set1(FFT_C52), s1 = v4f_set1(FFT_S51), s2 = v4f_set1(FFT_S52);
+        v4f a1r = v4f_madd(c2, s23r, v4f_madd(c1, s14r, re[0])), a1i = v4f_madd(c2, s23i, v4f_madd(c1, s14i, im[0]));
+        v4f a2r = v4f_madd(c1, s23r, v4f_madd(c2, s14r, re[0])), a2i = v4f_madd(c1, s23i, v4f_madd(c2, s14i, im[0]));
+        v4f b1r = v4f_madd(s2, d23r, v4f_mul(s1, d14r)), b1i = v4f_madd(s2, d23i, v4f_mul(s1, d14i));
+        v4f b2r = v4f_sub(v4f_mul(s2, d14r), v4f_mul(s1, d23r)), b2i = v4f_sub(v4f_mul(s2, d14i), v4f_mul(s1, d23i));
+        re[0] = v4f_add(re[0], v4f_add(s14r, s23r)); im[0] = v4f_add(im[0], v4f_add(s14i, s23i));
+        re[1] = v4f_add(a1r, b1i); im[1] = v4f_sub(a1i, b1r);
+        re[4] = v4f_sub(a1r, b1i); im[4] = v4f_add(a1i, b1r);
+        re[2] = v4f_add(a2r, b2i); im[2] = v4f_sub(a2i, b2r);
+        re[3] = v4f_sub(a2r, b2i); im[3] = v4f_add(a2i, b2r);
+        break;
+    }
+    }
+}
+
+static inline void fft_dft_scalar(ma_uint32 radix, float *re, float *im)
+{
+    float t0r, t0i, t1r, t1i, t2r, t2i, t3r, t3i;
+
+    switch (radix) {
+    case 2:
+        t0r = re[0]; t0i = im[0];
+        re[0] = t0r + re[1]; im[0] = t0i + im[1];
+        re[1] = t0r - re[1]; im[1] = t0i - im[1];
+        break;
+    case 3: {
+        float sr = re[1] + re[2], si = im[1] + im[2];
+        float dr = (re[1] - re[2]) * FFT_S3, di = (im[1] - im[2]) * FFT_S3;
+        float mr = re[0] + FFT_C3 * sr, mi = im[0] + FFT_C3 * si;
+        re[0] += sr; im[0] += si;
+        re[1] = mr + di; im[1] = mi - dr;
+        re[2] = mr - di; im[2] = mi + dr;
+        break;
+    }
+    case 4:
+        t0r = re[0] + re[2]; t0i = im[0] + im[2];
+        t1r = re[0] - re[2]; t1i = im[0] - im[2];
+        t2r = re[1] + re[3]; t2i = im[1] + im[3];
+        t3r = re[1] - re[3]; t3i = im[1] - im[3];
+        re[0] = t0r + t2r; im[0] = t0i + t2i;
+        re[2] = t0r - t2r; im[2] = t0i - t2i;
+        re[1] = t1r + t3i; im[1] = t1i - t3r;
+        re[3] = t1r - t3i; im[3] = t1i + t3r;
+        break;
+    case 5: {
+        float s14r = re[1] + re[4], s14i = im[1] + im[4];
+        float d14r = re[1] - re[4], d14i = im[1] - im[4];
+        float s23r = re[2] + re[3], s23i = im[2] + im[3];
+        float d23r = re[2] - re[3], d23i = im[2] - im[3];
+        float a1r = re[0] + FFT_C51 * s14r + FFT_C52 * s23r, a1i = im[0] + FFT_C51 * s14i + FFT_C52 * s23i;
+        float a2r = re[0] + FFT_C52 * s14r + FFT_C51 * s23r, a2i = im[0] + FFT_C52 * s14i + FFT_C51 * s23i;
+        float b1r = FFT_S51 * d14r + FFT_S52 * d23r, b1i = FFT_S51 * d14i + FFT_S52 * d23i;
+        float b2r = FFT_S52 * d14r - FFT_S51 * d23r, b2i = FFT_S52 * d14i - FFT_S51 * d23i;
+        re[0] += s14r + s23r; im[0] += s14i + s23i;
+        re[1] = a1r + b1i; im[1] = a1i - b1r;
+        re[4] = a1r - b1i; im[4] = a1i + b1r;
+        re[2] = a2r + b2i; im[2] = a2i - b2r;
+        re[3] = a2r - b2i; im[3] = a2i + b2r;
+        break;
+    }
+    }
+}
+
+static inline void fft_cmul_v4f(v4f *re, v4f *im, v4f wr, v4f wi)
+{
+    v4f r = v4f_sub(v4f_mul(*re, wr), v4f_mul(*im, wi));
+    *im = v4f_madd(*re, wi, v4f_mul(*im, wr));
+    *re = r;
+}
+
+/*
+ * One Stockham stage: y[q + s(rp + u)] = W_len^(pu) * DFT_r(x[q + s(p + tm)])[u]
+ * for p < m = len / r and q < s.
+ */
+static void fft_stage_vector_stride(const struct fft_stage *st, const float *xr, const float *xi, float *yr, float *yi)
+{
+    const ma_uint32 r = st->radix, s = st->stride, m = st->length / r;
+    v4f ar[5], ai[5], wr[5], wi[5];
+
+    for (ma_uint32 p = 0; p < m; p++) {
+        for (ma_uint32 u = 1; u < r; u++) {
+            wr[u] = v4f_set1(st->tw_re[(u - 1) * m + p]);
+            wi[u] = v4f_set1(st->tw_im[(u - 1) * m + p]);
+        }
+        for (ma_uint32 q = 0; q < s; q += 4) {
+            for (ma_uint32 t = 0; t < r; t++) {
+                ar[t] = v4f_load(xr + q + s * (p + t * m));
+                ai[t] = v4f_load(xi + q + s * (p + t * m));
+            }
+            fft_dft_v4f(r, ar, ai);
+            v4f_store(yr + q + s * r * p, ar[0]);
+            v4f_store(yi + q + s * r * p, ai[0]);
+            for (ma_uint32 u = 1; u < r; u++) {
+                fft_cmul_v4f(&ar[u], &ai[u], wr[u], wi[u]);
+                v4f_store(yr + q + s * (r * p + u), ar[u]);
+                v4f_store(yi + q + s * (r * p + u), ai[u]);
+            }
+        }
+    }
+}
+
+/* First stage (stride 1): vectorise across p and transpose the outputs into place. */
+static void fft_stage_vector_rows(const struct fft_stage *st, const float *xr, const float *xi, float *yr, float *yi)
+{
+    const ma_uint32 r = st->radix, m = st->length / r;
+    v4f ar[5], ai[5];
+
+    for (ma_uint32 p = 0; p < m; p += 4) {
+        for (ma_uint32 t = 0; t < r; t++) {
+            ar[t] = v4f_load(xr + p + t * m);
+            ai[t] = v4f_load(xi + p + t * m);
+        }
+        fft_dft_v4f(r, ar, ai);
+        for (ma_uint32 u = 1; u < r; u++)
+            fft_cmul_v4f(&ar[u], &ai[u], v4f_load(st->tw_re + (u - 1) * m + p), v4f_load(st->tw_im + (u - 1) * m + p));
+
+        if (r == 4) {
+            v4f_transpose(&ar[0], &ar[1], &ar[2], &ar[3]);
+            v4f_transpose(&ai[0], &ai[1], &ai[2], &ai[3]);
+            for (int j = 0; j < 4; j++) {
+                v4f_store(yr + 4 * p + 4 * j, ar[j]);
+                v4f_store(yi + 4 * p + 4 * j, ai[j]);
+            }
+        } else {
+            v4f lo, hi;
+            v4f_zip(ar[0], ar[1], &lo, &hi);
+            v4f_store(yr + 2 * p, lo);
+            v4f_store(yr + 2 * p + 4, hi);
+            v4f_zip(ai[0], ai[1], &lo, &hi);
+            v4f_store(yi + 2 * p, lo);
+            v4f_store(yi + 2 * p + 4, hi);
+        }
+    }
+}
+
+static void fft_stage_scalar(const struct fft_stage *st, const float *xr, const float *xi, float *yr, float *yi)
+{
+    const ma_uint32 r = st->radix, s = st->stride, m = st->length / r;
+    float ar[5], ai[5];
+
+    for (ma_uint32 p = 0; p < m; p++) {
+        for (ma_uint32 q = 0; q < s; q++) {
+            for (ma_uint32 t = 0; t < r; t++) {
+                ar[t] = xr[q + s * (p + t * m)];
+                ai[t] = xi[q + s * (p + t * m)];
+            }
+            fft_dft_scalar(r, ar, ai);
+            yr[q + s * r * p] = ar[0];
+            yi[q + s * r * p] = ai[0];
+            for (ma_uint32 u = 1; u < r; u++) {
+                float wr = st->tw_re[(u - 1) * m + p], wi = st->tw_im[(u - 1) * m + p];
+                yr[q + s * (r * p + u)] = ar[u] * wr - ai[u] * wi;
+                yi[q + s * (r * p + u)] = ar[u] * wi + ai[u] * wr;
+            }
+        }
+    }
+}
+
+/*
+ * Complex forward FFT of plan->half points. Ping-pongs between (re, im) and
+ * the work arrays; returns the arrays holding the result.
+ */
+static void fft_complex(const struct fft_plan *plan, float *re, float *im, float *work_re, float *work_im,
+        float **out_re, float **out_im)
+{
+    float *xr = re, *xi = im, *yr = work_re, *yi = work_im, *t;
+
+    for (ma_uint32 i = 0; i < plan->stage_count; i++) {
+        const struct fft_stage *st = &plan->stages[i];
+        ma_uint32 m = st->length / st->radix;
+        if (st->stride % 8 == 0 && kernels.fft_stage != NULL)
+            kernels.fft_stage(st->radix, st->stride, m, st->tw_re, st->tw_im, xr, xi, yr, yi);
+        else if (st->stride % 4 == 0)
+            fft_stage_vector_stride(st, xr, xi, yr, yi);
+        else if (st->stride == 1 && m % 4 == 0 && (st->radix == 4 || st->radix == 2))
+            fft_stage_vector_rows(st, xr, xi, yr, yi);
+        else
+            fft_stage_scalar(st, xr, xi, yr, yi);
+        t = xr; xr = yr; yr = t;
+        t = xi; xi = yi; yi = t;
+    }
+    *out_re = xr;
+    *out_im = xi;
+}
+
+/* Forward real FFT of plan->size samples into plan->size/2+1 bins. */
+static void fft_forward(const struct fft_plan *plan, const float *in, float *out_re, float *out_im, float *scratch)
+{
+    const ma_uint32 half = plan->half;
+    float *zr = scratch, *zi = scratch + half, *wr = scratch + 2 * half, *wi = scratch + 3 * half;
+    ma_uint32 k = 0;
+
+    /* z[k] = x[2k] + i x[2k+1] */
+    for (; k + 4 <= half; k += 4) {
+        v4f even, odd;
+        v4f_unzip(v4f_load(in + 2 * k), v4f_load(in + 2 * k + 4), &even, &odd);
+        v4f_store(zr + k, even);
+        v4f_store(zi + k, odd);
+    }
+    for (; k < half; k++) {
+        zr[k] = in[2 * k];
+        zi[k] = in[2 * k + 1];
+    }
+
+    fft_complex(plan, zr, zi, wr, wi, &zr, &zi);
+
+    /*
+     * Split: with A = Z[k], B = conj(Z[half-k]), E = (A+B)/2, O = -i(A-B)/2, T = W^k O:
+     * X[k] = E + T and X[half-k] = conj(E - T).
+     */
+    out_re[0] = zr[0] + zi[0];
+    out_im[0] = 0.0f;
+    out_re[half] = zr[0] - zi[0];
+    out_im[half] = 0.0f;
+
+    const v4f h = v4f_set1(0.5f);
+    for (k = 1; k + 3 <= half / 2; k += 4) {
+        v4f ar = v4f_load(zr + k), ai = v4f_load(zi + k);
+        v4f br = v4f_reverse(v4f_load(zr + half - k - 3));
+        v4f bi = v4f_sub(v4f_zero(), v4f_reverse(v4f_load(zi + half - k - 3)));
+        v4f er = v4f_mul(h, v4f_add(ar, br)), ei = v4f_mul(h, v4f_add(ai, bi));
+        v4f orr = v4f_mul(h, v4f_sub(ai, bi)), oi = v4f_mul(h, v4f_sub(br, ar));
+        v4f tr = orr, ti = oi;
+        fft_cmul_v4f(&tr, &ti, v4f_load(plan->split_re + k), v4f_load(plan->split_im + k));
+        v4f_store(out_re + k, v4f_add(er, tr));
+        v4f_store(out_im + k, v4f_add(ei, ti));
+        v4f_store(out_re + half - k - 3, v4f_reverse(v4f_sub(er, tr)));
+        v4f_store(out_im + half - k - 3, v4f_reverse(v4f_sub(ti, ei)));
+    }
+    for (; k <= half / 2; k++) {
+        float ar = zr[k], ai = zi[k], br = zr[half - k], bi = -zi[half - k];
+        float er = 0.5f * (ar + br), ei = 0.5f * (ai + bi);
+        float orr = 0.5f * (ai - bi), oi = 0.5f * (br - ar);
+        float wr_ = plan->split_re[k], wi_ = plan->split_im[k];
+        float tr = orr * wr_ - oi * wi_, ti = orr * wi_ + oi * wr_;
+        out_re[k] = er + tr;
+        out_im[k] = ei + ti;
+        out_re[half - k] = er - tr;
+        out_im[half - k] = ti - ei;
+    }
+}
+
+/* Inverse real FFT of plan->size/2+1 bins into plan->size samples, scaled by plan->size. */
+static void fft_inverse(const struct fft_plan *plan, const float *in_re, const float *in_im, float *out, float *scratch)
+{
+    const ma_uint32 half = plan->half;
+    float *zr = scratch, *zi = scratch + half, *wr = scratch + 2 * half, *wi = scratch + 3 * half;
+    ma_uint32 k;
+
+    /*
+     * Undo the split: E = X[k] + conj(X[half-k]), O = conj(W^k)(X[k] - conj(X[half-k])),
+     * Z[k] = E + iO and Z[half-k] = conj(E - iO).
+     */
+    zr[0] = in_re[0] + in_re[half];
+    zi[0] = in_re[0] - in_re[half];
+    for (k = 1; k + 3 <= half / 2; k += 4) {
+        v4f ar = v4f_load(in_re + k), ai = v4f_load(in_im + k);
+        v4f br = v4f_reverse(v4f_load(in_re + half - k - 3));
+        v4f bi = v4f_sub(v4f_zero(), v4f_reverse(v4f_load(in_im + half - k - 3)));
+        v4f er = v4f_add(ar, br), ei = v4f_add(ai, bi);
+        v4f dr = v4f_sub(ar, br), di = v4f_sub(ai, bi);
+        v4f w_r = v4f_load(plan->split_re + k), w_i = v4f_load(plan->split_im + k);
+        v4f orr = v4f_madd(dr, w_r, v4f_mul(di, w_i));
+        v4f oi = v4f_sub(v4f_mul(di, w_r), v4f_mul(dr, w_i));
+        v4f_store(zr + k, v4f_sub(er, oi));
+        v4f_store(zi + k, v4f_add(ei, orr));
+        v4f_store(zr + half - k - 3, v4f_reverse(v4f_add(er, oi)));
+        v4f_store(zi + half - k - 3, v4f_reverse(v4f_sub(orr, ei)));
+    }
+    for (; k <= half / 2; k++) {
+        float ar = in_re[k], ai = in_im[k], br = in_re[half - k], bi = -in_im[half - k];
+        float er = ar + br, ei = ai + bi, dr = ar - br, di = ai - bi;
+        float w_r = plan->split_re[k], w_i = plan->split_im[k];
+        float orr = dr * w_r + di * w_i, oi = di * w_r - dr * w_i;
+        zr[k] = er - oi;
+        zi[k] = ei + orr;
+        zr[half - k] = er + oi;
+        zi[half - k] = orr - ei;
+    }
+
+    /* The inverse complex FFT is the forward one with real and imaginary parts swapped. */
+    float *rr, *ri;
+    fft_complex(plan, zi, zr, wi, wr, &ri, &rr);
+
+    for (k = 0; k + 4 <= half; k += 4) {
+        v4f lo, hi;
+        v4f_zip(v4f_load(rr + k), v4f_load(ri + k), &lo, &hi);
+        v4f_store(out + 2 * k, lo);
+        v4f_store(out + 2 * k + 4, hi);
+    }
+    for (; k < half; k++) {
+        out[2 * k] = rr[k];
+        out[2 * k + 1] = ri[k];
+    }
+}
@@ -0,0 +1,411 @@
+/*
+ * Granular synthesis.
+ *
+ * A sound file is decoded to mono once, and grains are short Hann-windowed
+ * reads of it at their own position, pitch and pan. Grain state lives in a
+ * fixed pool kept as arrays (start, offset, step, window phasor, gains),
+ * with no allocation after init. Finished grains are removed by moving the
+ * last grain into their slot. Each grain renders four frames per vector:
+ *
+ * - the two source reads per frame are scalar;
+ * - the read positions, linear interpolation, window and pan are vector.
+ *
+ * The window is the real part of a phasor rotated per vector, so a grain
+ * costs no transcendental calls after it spawns. Grains spawn at jittered
+ * intervals around 1 / density, and each one starts at its exact frame
+ * inside the block.
+ */
+#include "dsp.h"
+
+#define GRANULAR_MAX_GRAINS     1024
+#define GRANULAR_BLOCK          256     /* Frames mixed per pass. */
+#define GRANULAR_MAX_DENSITY    4000.0f /* Grains per second. */
+#define GRANULAR_MIN_SIZE       5.0f    /* ms */
+#define GRANULAR_MAX_SIZE       500.0f  /* ms */
+#define GRANULAR_MAX_PITCH      24.0f   /* Semitones either way. */
+
+struct granular_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    const char *file_name;
+};
+
+struct granular {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    float *source;              /* Mono, source_frames plus zeroed guard frames */
+    ma_uint32 source_frames;
+
+    /* Written by the UI thread, read once per block. */
+    float density;              /* Grains per second */
+    float size;                 /* ms */
+    float position;             /* 0..1 of the source */
+    float position_jitter;      /* 0..1 of the source, either way */
+    float pitch;                /* Semitones */
+    float pitch_jitter;         /* Semitones, either way */
+    float spread;               /* 0 centre .. 1 random pan across the field */
+    float gain;                 /* Linear, before density normalisation */
+    ma_uint32 active;           /* Grains playing, for the UI. */
+
+    /* Audio thread state: the grain pool, one entry per grain. */
+    ma_uint32 grain_count;
+    ma_uint32 *start;           /* Source frame of the grain's first read */
+    float *offset;              /* Frames read so far, fractional */
+    float *step;                /* Source frames per output frame */
+    ma_uint32 *remaining;       /* Output frames left */
+    float *window_re, *window_im;   /* Window phasor; the window is 0.5 - 0.5 re */
+    float *rotate_re, *rotate_im;   /* Phasor step per frame */
+    float *gain_left, *gain_right;
+    float *left, *right;        /* [GRANULAR_BLOCK] mix */
+    float countdown;            /* Frames until the next grain */
+    ma_uint32 seed;
+    struct dsp_arena arena;
+};
+
+static struct granular_config granular_config_init(ma_uint32 channels, ma_uint32 sample_rate, const char *file_name)
+{
+    struct granular_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.file_name = file_name;
+    return config;
+}
+
+static void granular_layout(struct granular *gr)
+{
+    gr->start = (ma_uint32 *)dsp_arena_floats(&gr->arena, GRANULAR_MAX_GRAINS);
+    gr->offset = dsp_arena_floats(&gr->arena, GRANULAR_MAX_GRAINS);
+    gr->step = dsp_arena_floats(&gr->arena, GRANULAR_MAX_GRAINS);
+    gr->remaining = (ma_uint32 *)dsp_arena_floats(&gr->arena, GRANULAR_MAX_GRAINS);
+    gr->window_re = dsp_arena_floats(&gr->arena, GRANULAR_MAX_GRAINS);
+    gr->window_im = dsp_arena_floats(&gr->arena, GRANULAR_MAX_GRAINS);
+    gr->rotate_re = dsp_arena_floats(&gr->arena, GRANULAR_MAX_GRAINS);
+    gr->rotate_im = dsp_arena_floats(&gr->arena, GRANULAR_MAX_GRAINS);
+    gr->gain_left = dsp_arena_floats(&gr->arena, GRANULAR_MAX_GRAINS);
+    gr->gain_right = dsp_arena_floats(&gr->arena, GRANULAR_MAX_GRAINS);
+    gr->left = dsp_arena_floats(&gr->arena, GRANULAR_BLOCK);
+    gr->right = dsp_arena_floats(&gr->arena, GRANULAR_BLOCK);
+}
+
+static ma_result granular_init(const struct granular_config *config, struct granular *gr)
+{
+    ma_result result;
+    ma_uint64 frames = 0;
+    void *decoded = NULL;
+
+    memset(gr, 0, sizeof(*gr));
+    if (config->channels == 0 || config->sample_rate == 0 || config->file_name == NULL)
+        return MA_INVALID_ARGS;
+    gr->channels = config->channels;
+    gr->sample_rate = config->sample_rate;
+
+    /* Grains are panned individually, so the source is mixed down to mono at the engine rate. */
+    ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_f32, 1, config->sample_rate);
+    result = ma_decode_file(config->file_name, &decoder_config, &frames, &decoded);
+    if (result != MA_SUCCESS)
+        return result;
+    if (frames < 4 || frames > 0xFFFFFFFF / 2) {
+        ma_free(decoded, NULL);
+        return MA_INVALID_FILE;
+    }
+    gr->source_frames = (ma_uint32)frames;
+    gr->source = dsp_alloc((size_t)gr->source_frames + 4);
+    if (gr->source == NULL) {
+        ma_free(decoded, NULL);
+        return MA_OUT_OF_MEMORY;
+    }
+    memcpy(gr->source, decoded, sizeof(float) * gr->source_frames);
+    ma_free(decoded, NULL);
+
+    granular_layout(gr);
+    result = dsp_arena_init(&gr->arena, gr->arena.used);
+    if (result != MA_SUCCESS) {
+        dsp_free(gr->source);
+        return result;
+    }
+    granular_layout(gr);
+
+    gr->density = 40.0f;
+    gr->size = 80.0f;
+    gr->position = 0.25f;
+    gr->position_jitter = 0.02f;
+    gr->spread = 0.5f;
+    gr->gain = 1.0f;
+    gr->seed = 0x2545f491u;
+    return MA_SUCCESS;
+}
+
+static void granular_uninit(struct granular *gr)
+{
+    dsp_arena_uninit(&gr->arena);
+    dsp_free(gr->source);
+    gr->source = NULL;
+}
+
+/* Uniform in [0, 1). */
+static float granular_random(struct granular *gr)
+{
+    gr->seed ^= gr->seed << 13;
+    gr->seed ^= gr->seed >> 17;
+    gr->seed ^= gr->seed << 5;
+    return (float)(gr->seed >> 8) / (float)(1u << 24);
+}
+
+/* Mixes `n` frames of grain `i` into left/right from `from`. */
+static void granular_render_grain(struct granular *gr, ma_uint32 i, ma_uint32 from, ma_uint32 n)
+{
+    const float *src = gr->source + gr->start[i];
+    const float step = gr->step[i];
+    const float c1 = gr->rotate_re[i], s1 = gr->rotate_im[i];
+    float *left = gr->left + from, *right = gr->right + from;
+    float offset = gr->offset[i];
+    float index[4], re[4], im[4];
+
+    /* Lane k holds the phasor k frames on; the vector steps by the phasor to the 4th power. */
+    re[0] = gr->window_re[i];
+    im[0] = gr->window_im[i];
+    for (int k = 1; k < 4; k++) {
+        re[k] = re[k - 1] * c1 - im[k - 1] * s1;
+        im[k] = re[k - 1] * s1 + im[k - 1] * c1;
+    }
+    const float c2 = c1 * c1 - s1 * s1, s2 = 2.0f * c1 * s1;
+    const v4f c4 = v4f_set1(c2 * c2 - s2 * s2), s4 = v4f_set1(2.0f * c2 * s2);
+    v4f wr = v4f_load(re), wi = v4f_load(im);
+    const v4f ramp = v4f_set(0.0f, step, 2.0f * step, 3.0f * step);
+    const v4f gl = v4f_set1(gr->gain_left[i]), gright = v4f_set1(gr->gain_right[i]);
+    const v4f half = v4f_set1(0.5f), minus_half = v4f_set1(-0.5f);
+
+    ma_uint32 f = 0;
+    for (; f + 4 <= n; f += 4) {
+        v4f pos = v4f_add(v4f_set1(offset), ramp);
+        v4f whole = v4f_floor(pos);
+        v4f_store(index, whole);
+        ma_uint32 i0 = (ma_uint32)index[0], i1 = (ma_uint32)index[1];
+        ma_uint32 i2 = (ma_uint32)index[2], i3 = (ma_uint32)index[3];
+        v4f a = v4f_set(src[i0], src[i1], src[i2], src[i3]);
+        v4f b = v4f_set(src[i0 + 1], src[i1 + 1], src[i2 + 1], src[i3 + 1]);
+        v4f s = v4f_madd(v4f_sub(b, a), v4f_sub(pos, whole), a);
+        v4f v = v4f_mul(s, v4f_madd(minus_half, wr, half));
+
+        v4f_store(left + f, v4f_madd(v, gl, v4f_load(left + f)));
+        v4f_store(right + f, v4f_madd(v, gright, v4f_load(right + f)));
+
+        v4f r = v4f_sub(v4f_mul(wr, c4), v4f_mul(wi, s4));
+        wi = v4f_madd(wr, s4, v4f_mul(wi, c4));
+        wr = r;
+        offset += 4.0f * step;
+    }
+
+    /* Up to three frames left: lanes 0 .. r - 1 cover them and lane r is where the grain picks up. */
+    ma_uint32 r = n - f;
+    v4f_store(re, wr);
+    v4f_store(im, wi);
+    for (ma_uint32 l = 0; l < r; l++) {
+        float pos = offset + (float)l * step;
+        ma_uint32 k = (ma_uint32)pos;
+        float s = src[k] + (src[k + 1] - src[k]) * (pos - (float)k);
+        float v = s * (0.5f - 0.5f * re[l]);
+        left[f + l] += v * gr->gain_left[i];
+        right[f + l] += v * gr->gain_right[i];
+    }
+    offset += (float)r * step;
+    gr->window_re[i] = re[r];
+    gr->window_im[i] = im[r];
+    gr->offset[i] = offset;
+    gr->remaining[i] -= n;
+}
+
+/* Adds a grain to the pool from the current parameters. Returns false when there's no room. */
+static bool granular_spawn(struct granular *gr, float amplitude)
+{
+    if (gr->grain_count == GRANULAR_MAX_GRAINS)
+        return false;
+
+    const float size = DSP_CLAMP(dsp_load_f32(&gr->size), GRANULAR_MIN_SIZE, GRANULAR_MAX_SIZE);
+    const float pitch = DSP_CLAMP(dsp_load_f32(&gr->pitch), -GRANULAR_MAX_PITCH, GRANULAR_MAX_PITCH);
+    const float pitch_jitter = DSP_CLAMP(dsp_load_f32(&gr->pitch_jitter), 0.0f, GRANULAR_MAX_PITCH);
+    const float position = DSP_CLAMP(dsp_load_f32(&gr->position), 0.0f, 1.0f);
+    const float position_jitter = DSP_CLAMP(dsp_load_f32(&gr->position_jitter), 0.0f, 1.0f);
+    const float spread = DSP_CLAMP(dsp_load_f32(&gr->spread), 0.0f, 1.0f);
+
+    float step = exp2f((pitch + pitch_jitter * (2.0f * granular_random(gr) - 1.0f)) / 12.0f);
+    float length = size * (float)gr->sample_rate / 1000.0f;
+    /* Short sources shorten the grain rather than reading past the end. */
+    length = DSP_MIN(length, (float)(gr->source_frames - 2) / step);
+    if (length < 4.0f)
+        return false;
+
+    float span = length * step + 2.0f;
+    float start = (position + position_jitter * (2.0f * granular_random(gr) - 1.0f)) * (float)gr->source_frames;
+    start = DSP_CLAMP(start, 0.0f, (float)gr->source_frames - span);
+
+    float angle = (float)(DSP_PI / 4.0) * (1.0f + spread * (2.0f * granular_random(gr) - 1.0f));
+    float theta = (float)(2.0 * DSP_PI) / length;
+
+    ma_uint32 i = gr->grain_count++;
+    gr->start[i] = (ma_uint32)start;
+    gr->offset[i] = 0.0f;
+    gr->step[i] = step;
+    gr->remaining[i] = (ma_uint32)length;
+    gr->window_re[i] = 1.0f;
+    gr->window_im[i] = 0.0f;
+    gr->rotate_re[i] = cosf(theta);
+    gr->rotate_im[i] = sinf(theta);
+    if (gr->channels == 2) {
+        gr->gain_left[i] = amplitude * cosf(angle) * (float)DSP_SQRT2;
+        gr->gain_right[i] = amplitude * sinf(angle) * (float)DSP_SQRT2;
+    } else {
+        gr->gain_left[i] = amplitude;
+        gr->gain_right[i] = 0.0f;
+    }
+    return true;
+}
+
+static void granular_remove(struct granular *gr, ma_uint32 i)
+{
+    ma_uint32 last = --gr->grain_count;
+    gr->start[i] = gr->start[last];
+    gr->offset[i] = gr->offset[last];
+    gr->step[i] = gr->step[last];
+    gr->remaining[i] = gr->remaining[last];
+    gr->window_re[i] = gr->window_re[last];
+    gr->window_im[i] = gr->window_im[last];
+    gr->rotate_re[i] = gr->rotate_re[last];
+    gr->rotate_im[i] = gr->rotate_im[last];
+    gr->gain_left[i] = gr->gain_left[last];
+    gr->gain_right[i] = gr->gain_right[last];
+}
+
+/* Mixes the pool and new grains into left/right for `n` frames. */
+static void granular_block(struct granular *gr, ma_uint32 n)
+{
+    const float density = DSP_CLAMP(dsp_load_f32(&gr->density), 0.0f, GRANULAR_MAX_DENSITY);
+    const float size = DSP_CLAMP(dsp_load_f32(&gr->size), GRANULAR_MIN_SIZE, GRANULAR_MAX_SIZE);
+    /* Uncorrelated grains add in power, so scale by the square root of the expected overlap. */
+    const float amplitude = dsp_load_f32(&gr->gain) / sqrtf(DSP_MAX(1.0f, density * size / 1000.0f));
+
+    memset(gr->left, 0, sizeof(float) * n);
+    memset(gr->right, 0, sizeof(float) * n);
+
+    for (ma_uint32 i = 0; i < gr->grain_count; ) {
+        ma_uint32 count = DSP_MIN(n, gr->remaining[i]);
+        granular_render_grain(gr, i, 0, count);
+        if (gr->remaining[i] == 0)
+            granular_remove(gr, i);     /* The moved grain hasn't played this block yet. */
+        else
+            i++;
+    }
+
+    if (density <= 0.0f) {
+        gr->countdown = 0.0f;
+        return;
+    }
+    const float interval = (float)gr->sample_rate / density;
+    float t = gr->countdown;
+    while (t < (float)n) {
+        ma_uint32 from = (ma_uint32)t;
+        if (granular_spawn(gr, amplitude)) {
+            ma_uint32 i = gr->grain_count - 1;
+            granular_render_grain(gr, i, from, DSP_MIN(n - from, gr->remaining[i]));
+            if (gr->remaining[i] == 0)
+                granular_remove(gr, i);
+        }
+        /* Jittered spacing keeps dense clouds from buzzing at the grain rate. */
+        t += interval * (0.5f + granular_random(gr));
+    }
+    gr->countdown = t - (float)n;
+}
+
+static void granular_process(struct granular *gr, float *out, ma_uint32 frame_count)
+{
+    const ma_uint32 channels = gr->channels;
+
+    for (ma_uint32 done = 0; done < frame_count; ) {
+        ma_uint32 n = DSP_MIN(frame_count - done, (ma_uint32)GRANULAR_BLOCK);
+        granular_block(gr, n);
+        float *dst = out + (size_t)done * channels;
+        if (channels == 2) {
+            for (ma_uint32 f = 0; f < n; f++) {
+                dst[2 * f] = gr->left[f];
+                dst[2 * f + 1] = gr->right[f];
+            }
+        } else {
+            for (ma_uint32 f = 0; f < n; f++)
+                for (ma_uint32 ch = 0; ch < channels; ch++)
+                    dst[f * channels + ch] = gr->left[f];
+        }
+        done += n;
+    }
+    dsp_store_u32(&gr->active, gr->grain_count);
+}
+
+
+/*
+ * Granular Node
+ */
+struct granular_node_config {
+    ma_node_config node_config;
+    struct granular_config granular;
+};
+
+struct granular_node {
+    ma_node_base base;
+    struct granular granular;
+};
+
+static struct granular_node_config
+granular_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, const char *file_name)
+{
+    struct granular_node_config config;
+    config.node_config = ma_node_config_init();
+    config.granular = granular_config_init(channels, sample_rate, file_name);
+    return config;
+}
+
+static void granular_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct granular_node *granular = (struct granular_node *)node;
+    (void)frames_in;
+    (void)frame_count_in;
+    granular_process(&granular->granular, frames_out[0], *frame_count_out);
+}
+
+static ma_node_vtable granular_node_vtable = {
+    granular_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    0,      /* No inputs. */
+    1,      /* One output. */
+    0       /* Default flags. */
+};
+
+static ma_result granular_node_init(ma_node_graph *graph, const struct granular_node_config *config,
+        const ma_allocation_callbacks *alloc, struct granular_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = granular_init(&config->granular, &node->granular);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &granular_node_vtable;
+    base_config.pInputChannels = NULL;
+    base_config.pOutputChannels = &config->granular.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        granular_uninit(&node->granular);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void granular_node_uninit(struct granular_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    granular_uninit(&node->granular);
+}
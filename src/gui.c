@@ -10,6 +10,30 @@
 #include "miniaudio.h"
 
 #include "file_dialog.c"
+#include "kernels.c"
+#include "biquad.c"
+#include "fft.c"
+#include "convolver.c"
+#include "stft.c"
+#include "spectral.c"
+#include "fdn.c"
+#include "mixer.c"
+#include "truepeak.c"
+#include "dynamics.c"
+#include "stretch.c"
+#include "midi.c"
+#include "oscillator.c"
+#include "equalizer.c"
+#include "chorus.c"
+#include "granular.c"
+#include "channel_mix.c"
+#include "loudness.c"
+#include "sampler.c"
+#include "plugin.c"
+#include "expression.c"
+#include "linear_eq.c"
+#include "oversampler.c"
+#include "waveshaper.c"
 
 const char *basename(const char *path)
 {
@@ -19,7 +43,6 @@ const char *basename(const char *path)
     return filename? filename + 1 : path;
 }
 
-#define CHANNELS 2
 #define FORMAT ma_format_f32
 #define SAMPLE_RATE 48000
 
@@ -29,9 +52,20 @@ const char *basename(const char *path)
 #define LPF_ORDER           8
 #define DELAY_IN_SECONDS    0.2f
 #define DECAY               0.5f    /* Volume falloff for each echo. */
+#define REVERB_DECAY        2.0f    /* Seconds to -60 dB. */
+#define REVERB_DAMPING      0.5f    /* How much faster high frequencies die out. */
+#define REVERB_MIX          0.3f
+#define MIXER_EDITOR_INPUTS 4       /* Input slots on a new mixer node. */
+#define COMPRESSOR_LOOKAHEAD 0.005f /* Seconds, also the attack time. */
+#define COMPRESSOR_KEY_SLOT 1       /* Input slot of the sidechain key. */
+#define DUCKER_RELEASE      0.4f    /* Seconds, slow enough not to pump between words. */
+#define OSCILLATOR_FREQUENCY 220.0f
+#define NOISE_AMPLITUDE     0.25f
+#define PLUGIN_DIRECTORY    "plugins"
 
 static struct {
     ma_device device;
+    ma_uint32 channels;     /* Device and graph channel count, whatever the device prefers. */
 } audio_state;
 
 enum node_tag {
@@ -40,6 +74,24 @@ enum node_tag {
     NODE_LOW_PASS_FILTER,
     NODE_SPLITTER,
     NODE_DELAY,
+    NODE_CONVOLVER,
+    NODE_SPECTRAL,
+    NODE_REVERB,
+    NODE_MIXER,
+    NODE_COMPRESSOR,
+    NODE_STRETCH,
+    NODE_OSCILLATOR,
+    NODE_NOISE,
+    NODE_EQUALIZER,
+    NODE_CHORUS,
+    NODE_GRANULAR,
+    NODE_LOUDNESS,
+    NODE_SAMPLER,
+    NODE_MIDI,
+    NODE_PLUGIN,
+    NODE_EXPRESSION,
+    NODE_LINEAR_EQ,
+    NODE_WAVESHAPER,
 };
 
 struct node_endpoint {
@@ -57,7 +109,7 @@ struct node_source_decoder {
 };
 
 struct node_low_pass_filter {
-    ma_lpf_node lpf;
+    struct filter_node filter;
 };
 
 struct node_splitter {
@@ -68,6 +120,90 @@ struct node_delay {
     ma_delay_node delay;
 };
 
+struct node_convolver {
+    struct convolver_node convolver;
+    char file_name[MAX_FILE_NAME_SIZE];
+};
+
+struct node_spectral {
+    struct spectral_node spectral;
+};
+
+struct node_reverb {
+    struct fdn_reverb_node reverb;
+};
+
+struct node_mixer {
+    struct mixer_node mixer;
+};
+
+struct node_compressor {
+    struct compressor_node compressor;
+};
+
+struct node_stretch {
+    struct stretch_node stretch;
+};
+
+struct node_oscillator {
+    struct oscillator_node oscillator;
+};
+
+struct node_noise {
+    ma_noise noise;
+    ma_data_source_node source;
+};
+
+struct node_equalizer {
+    struct equalizer_node equalizer;
+    int band;   // Band shown in the editor
+};
+
+struct node_chorus {
+    struct chorus_node chorus;
+};
+
+struct node_granular {
+    struct granular_node granular;
+    char file_name[MAX_FILE_NAME_SIZE];
+};
+
+struct node_loudness {
+    struct loudness_node loudness;
+};
+
+struct node_sampler {
+    struct sampler_node sampler;
+    char file_name[MAX_FILE_NAME_SIZE];
+    int note;   // Played by the editor's Play button
+};
+
+struct node_midi {
+    struct midi_player_node player;
+    char file_name[MAX_FILE_NAME_SIZE];
+};
+
+struct node_plugin {
+    struct plugin_node plugin;
+};
+
+struct node_expression {
+    struct expression_node expression;
+    char text[EXPRESSION_MAX_TEXT];     // Being edited
+    char source[EXPRESSION_MAX_TEXT];   // Last text that compiled
+    char error[64];
+    struct expression_program program;  // Compiled from text, waiting for a free slot while pending
+    bool pending;
+};
+
+struct node_linear_eq {
+    struct linear_eq_node linear_eq;
+};
+
+struct node_waveshaper {
+    struct waveshaper_node waveshaper;
+};
+
 struct node {
     enum node_tag tag;
     int ID;
@@ -86,6 +222,24 @@ struct node {
         struct node_low_pass_filter low_pass_filter;
         struct node_splitter splitter;
         struct node_delay deplay;
+        struct node_convolver convolver;
+        struct node_spectral spectral;
+        struct node_reverb reverb;
+        struct node_mixer mixer;
+        struct node_compressor compressor;
+        struct node_stretch stretch;
+        struct node_oscillator oscillator;
+        struct node_noise noise;
+        struct node_equalizer equalizer;
+        struct node_chorus chorus;
+        struct node_granular granular;
+        struct node_loudness loudness;
+        struct node_sampler sampler;
+        struct node_midi midi;
+        struct node_plugin plugin;
+        struct node_expression expression;
+        struct node_linear_eq linear_eq;
+        struct node_waveshaper waveshaper;
     };
 };
 
@@ -94,6 +248,7 @@ struct node_link {
     int input_slot;
     int output_id; // node id
     int output_slot;
+    struct channel_mix_node *converter; // between the nodes when their channel counts differ
 };
 
 struct node_linking {
@@ -119,13 +274,15 @@ struct node_editor {
     ma_node_graph audio_graph;
 };
 static struct node_editor nodeEditor;
+static struct plugin_registry pluginRegistry;
 
 void playback(ma_device *pDevice, void *pOutput, const void *pInput, ma_uint32 frameCount)
 {
+    (void)pDevice;
     (void)pInput;
-    assert(pDevice->playback.channels == CHANNELS);
-
+    ma_uint64 fp_mode = dsp_denormals_flush(MA_TRUE);
     ma_node_graph_read_pcm_frames(&nodeEditor.audio_graph, pOutput, frameCount, NULL);
+    dsp_denormals_restore(fp_mode);
 }
 
 void audio_init(void)
@@ -135,7 +292,7 @@ void audio_init(void)
     // Device Setup
     ma_device_config config = ma_device_config_init(ma_device_type_playback);
     config.playback.format = FORMAT;
-    config.playback.channels = CHANNELS;
+    config.playback.channels = 0;   /* Native channel count, picked up below. */
     config.sampleRate = SAMPLE_RATE;
     config.dataCallback = playback;
     result = ma_device_init(NULL, &config, &audio_state.device);
@@ -143,6 +300,7 @@ void audio_init(void)
         fprintf(stderr, "Error: failed to initalise device, error code = %d\n", result);
         exit(1);
     }
+    audio_state.channels = audio_state.device.playback.channels;
 
     result = ma_device_start(&audio_state.device);
     if (result != MA_SUCCESS) {
@@ -151,12 +309,15 @@ void audio_init(void)
         fprintf(stderr, "Error: failed to start device, error code = %d\n", result);
         exit(1);
     }
-    printf("init audio subsystem\n");
+    printf("init audio subsystem, %u channels\n", audio_state.channels);
 }
 
 void audio_shutdown(void)
 {
     ma_device_uninit(&audio_state.device);
+    plugin_registry_unload(&pluginRegistry);
+    wavetable_cache_clear();
+    fft_plan_cache_clear();
 }
 
 static void
@@ -269,7 +430,7 @@ node_editor_add_source_decoder(struct node_editor *editor, const char *name, str
     ma_result result;
 
     // Decoder
-    ma_decoder_config decoder_config = ma_decoder_config_init(FORMAT, CHANNELS, SAMPLE_RATE);
+    ma_decoder_config decoder_config = ma_decoder_config_init(FORMAT, 0, SAMPLE_RATE);   /* File's own channel count. */
     result = ma_decoder_init_file(node->source_decoder.file_name, &decoder_config, &node->source_decoder.decoder);
     if (result != MA_SUCCESS) {
         fprintf(stderr, "Error: failed to initalise decoder, error code = %d\n", result);
@@ -296,17 +457,18 @@ node_editor_add_low_pass_filter(struct node_editor *editor, const char *name, st
     struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
     node->tag = NODE_LOW_PASS_FILTER;
 
-    /* Low Pass Filter. */
-    ma_lpf_node_config lpfNodeConfig = ma_lpf_node_config_init(CHANNELS, SAMPLE_RATE, SAMPLE_RATE / LPF_CUTOFF_FACTOR, LPF_ORDER);
-    ma_result result = ma_lpf_node_init(&editor->audio_graph, &lpfNodeConfig, NULL, &node->low_pass_filter.lpf);
+    /* Low Pass Filter. Cutoff, order and type can be changed from the node afterwards. */
+    struct filter_node_config filterNodeConfig = filter_node_config_init(audio_state.channels, SAMPLE_RATE, BIQUAD_LOWPASS,
+            SAMPLE_RATE / LPF_CUTOFF_FACTOR, LPF_ORDER);
+    ma_result result = filter_node_init(&editor->audio_graph, &filterNodeConfig, NULL, &node->low_pass_filter.filter);
     if (result != MA_SUCCESS) {
         fprintf(stderr, "Error: failed to initalise low pass filter, error code = %d\n", result);
         return;
     }
 
     /* Set the volume of the low pass filter to make it more of less impactful. */
-    ma_node_set_output_bus_volume(&node->low_pass_filter.lpf, 0, LPF_BIAS);
-    node->audio_node = &node->low_pass_filter.lpf;
+    ma_node_set_output_bus_volume(&node->low_pass_filter.filter, 0, LPF_BIAS);
+    node->audio_node = &node->low_pass_filter.filter;
 }
 
 // Splitter
@@ -317,7 +479,7 @@ node_editor_add_splitter(struct node_editor *editor, const char *name, struct nk
     struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
     node->tag = NODE_SPLITTER;
 
-    ma_splitter_node_config splitterNodeConfig = ma_splitter_node_config_init(CHANNELS);
+    ma_splitter_node_config splitterNodeConfig = ma_splitter_node_config_init(audio_state.channels);
     ma_result result = ma_splitter_node_init(&editor->audio_graph, &splitterNodeConfig, NULL, &node->splitter.splitter);
     if (result != MA_SUCCESS) {
         fprintf(stderr, "Error: failed to initalise splitter, error code = %d\n", result);
@@ -335,7 +497,7 @@ node_editor_add_delay(struct node_editor *editor, const char *name, struct nk_re
     struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
     node->tag = NODE_DELAY;
 
-    ma_delay_node_config delayNodeConfig = ma_delay_node_config_init(CHANNELS, SAMPLE_RATE, (ma_uint32)(SAMPLE_RATE * DELAY_IN_SECONDS), DECAY);
+    ma_delay_node_config delayNodeConfig = ma_delay_node_config_init(audio_state.channels, SAMPLE_RATE, (ma_uint32)(SAMPLE_RATE * DELAY_IN_SECONDS), DECAY);
 
     ma_result result = ma_delay_node_init(&editor->audio_graph, &delayNodeConfig, NULL, &node->deplay.delay);
     if (result != MA_SUCCESS) {
@@ -349,11 +511,801 @@ node_editor_add_delay(struct node_editor *editor, const char *name, struct nk_re
     node->audio_node = &node->deplay.delay;
 }
 
+// Convolution Reverb
+static void
+node_editor_add_convolver(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, const char *file_name)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_CONVOLVER;
+
+    if (file_name == NULL) {
+        FileDialogResult file_result = open_file_dialog("Choose an impulse response", NULL);
+        if (file_result.success) {
+            strncpy(node->convolver.file_name, file_result.path, MAX_FILE_NAME_SIZE);
+            free_file_dialog_result(&file_result);
+        } else {
+            fprintf(stderr, "Error: failed load file\n");
+            return;
+        }
+    } else {
+        strcpy(node->convolver.file_name, file_name);
+    }
+
+    struct convolver_node_config convolverNodeConfig = convolver_node_config_init(audio_state.channels, SAMPLE_RATE, node->convolver.file_name);
+    ma_result result = convolver_node_init(&editor->audio_graph, &convolverNodeConfig, NULL, &node->convolver.convolver);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise convolver, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->convolver.convolver;
+}
+
+// Spectral
+static void
+node_editor_add_spectral(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, enum spectral_effect effect)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_SPECTRAL;
+
+    struct spectral_node_config spectralNodeConfig = spectral_node_config_init(audio_state.channels, SAMPLE_RATE, effect);
+    ma_result result = spectral_node_init(&editor->audio_graph, &spectralNodeConfig, NULL, &node->spectral.spectral);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise spectral node, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->spectral.spectral;
+}
+
+// Reverb
+static void
+node_editor_add_reverb(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_REVERB;
+
+    struct fdn_reverb_node_config reverbNodeConfig = fdn_reverb_node_config_init(audio_state.channels, SAMPLE_RATE,
+            REVERB_DECAY, REVERB_DAMPING, REVERB_MIX);
+    ma_result result = fdn_reverb_node_init(&editor->audio_graph, &reverbNodeConfig, NULL, &node->reverb.reverb);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise reverb, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->reverb.reverb;
+}
+
+// Mixer
+static void
+node_editor_add_mixer(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_MIXER;
+
+    /* One mixer input bus per input slot. */
+    struct mixer_node_config mixerNodeConfig = mixer_node_config_init(audio_state.channels, in_count);
+    ma_result result = mixer_node_init(&editor->audio_graph, &mixerNodeConfig, NULL, &node->mixer.mixer);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise mixer, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->mixer.mixer;
+}
+
+// Compressor / Limiter
+static void
+node_editor_add_compressor(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, float threshold, float ratio, float release)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_COMPRESSOR;
+
+    struct compressor_node_config compressorNodeConfig = compressor_node_config_init(audio_state.channels, SAMPLE_RATE,
+            threshold, ratio, COMPRESSOR_LOOKAHEAD);
+    compressorNodeConfig.compressor.release = release;
+    ma_result result = compressor_node_init(&editor->audio_graph, &compressorNodeConfig, NULL, &node->compressor.compressor);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise compressor, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->compressor.compressor;
+}
+
+// Time Stretch / Pitch Shift
+static void
+node_editor_add_stretch(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_STRETCH;
+
+    struct stretch_node_config stretchNodeConfig = stretch_node_config_init(audio_state.channels, SAMPLE_RATE, 1.0f, 1.0f);
+    ma_result result = stretch_node_init(&editor->audio_graph, &stretchNodeConfig, NULL, &node->stretch.stretch);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise time stretch, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->stretch.stretch;
+}
+
+// Oscillator
+static void
+node_editor_add_oscillator(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, enum oscillator_shape shape, enum oscillator_mode mode, ma_uint32 voice_count)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_OSCILLATOR;
+
+    struct oscillator_node_config oscillatorNodeConfig = oscillator_node_config_init(1, SAMPLE_RATE,
+            shape, mode, OSCILLATOR_FREQUENCY, voice_count);
+    ma_result result = oscillator_node_init(&editor->audio_graph, &oscillatorNodeConfig, NULL, &node->oscillator.oscillator);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise oscillator, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->oscillator.oscillator;
+}
+
+// Noise
+static void
+node_editor_add_noise(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, ma_noise_type type)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_NOISE;
+
+    ma_result result;
+
+    // miniaudio can't change the noise type of a live ma_noise, so it's fixed per node.
+    ma_noise_config noise_config = ma_noise_config_init(FORMAT, 1, type, 0, NOISE_AMPLITUDE);
+    result = ma_noise_init(&noise_config, NULL, &node->noise.noise);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise noise, error code = %d\n", result);
+        return;
+    }
+
+    ma_data_source_node_config source_node_config = ma_data_source_node_config_init(&node->noise.noise);
+    result = ma_data_source_node_init(&editor->audio_graph, &source_node_config, NULL, &node->noise.source);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise source node, error code = %d\n", result);
+        return;
+    }
+    node->audio_node = &node->noise.source;
+}
+
+// Parametric EQ
+static void
+node_editor_add_equalizer(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_EQUALIZER;
+    node->equalizer.band = 1;
+
+    struct equalizer_node_config equalizerNodeConfig = equalizer_node_config_init(audio_state.channels, SAMPLE_RATE);
+    ma_result result = equalizer_node_init(&editor->audio_graph, &equalizerNodeConfig, NULL, &node->equalizer.equalizer);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise equalizer, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->equalizer.equalizer;
+}
+
+// Chorus / Flanger / Vibrato
+static void
+node_editor_add_chorus(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, float delay, float depth, float rate, float feedback, float mix)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_CHORUS;
+
+    struct chorus_node_config chorusNodeConfig = chorus_node_config_init(audio_state.channels, SAMPLE_RATE,
+            delay, depth, rate, feedback, mix);
+    ma_result result = chorus_node_init(&editor->audio_graph, &chorusNodeConfig, NULL, &node->chorus.chorus);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise chorus, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->chorus.chorus;
+}
+
+// Granular
+static void
+node_editor_add_granular(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, const char *file_name)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_GRANULAR;
+
+    if (file_name == NULL) {
+        FileDialogResult file_result = open_file_dialog("Choose a grain source", NULL);
+        if (file_result.success) {
+            strncpy(node->granular.file_name, file_result.path, MAX_FILE_NAME_SIZE);
+            free_file_dialog_result(&file_result);
+        } else {
+            fprintf(stderr, "Error: failed load file\n");
+            return;
+        }
+    } else {
+        strcpy(node->granular.file_name, file_name);
+    }
+
+    struct granular_node_config granularNodeConfig = granular_node_config_init(audio_state.channels, SAMPLE_RATE, node->granular.file_name);
+    ma_result result = granular_node_init(&editor->audio_graph, &granularNodeConfig, NULL, &node->granular.granular);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise granular, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->granular.granular;
+}
+
+// Loudness Meter
+static void
+node_editor_add_loudness(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_LOUDNESS;
+
+    struct loudness_node_config loudnessNodeConfig = loudness_node_config_init(audio_state.channels, SAMPLE_RATE);
+    ma_result result = loudness_node_init(&editor->audio_graph, &loudnessNodeConfig, NULL, &node->loudness.loudness);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise loudness meter, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->loudness.loudness;
+}
+
+// Sampler
+static void
+node_editor_add_sampler(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, const char *file_name)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_SAMPLER;
+    node->sampler.note = SAMPLER_ROOT_NOTE;
+
+    if (file_name == NULL) {
+        FileDialogResult file_result = open_file_dialog("Choose a sample", NULL);
+        if (file_result.success) {
+            strncpy(node->sampler.file_name, file_result.path, MAX_FILE_NAME_SIZE);
+            free_file_dialog_result(&file_result);
+        } else {
+            fprintf(stderr, "Error: failed load file\n");
+            return;
+        }
+    } else {
+        strcpy(node->sampler.file_name, file_name);
+    }
+
+    struct sampler_node_config samplerNodeConfig = sampler_node_config_init(audio_state.channels, SAMPLE_RATE, node->sampler.file_name);
+    ma_result result = sampler_node_init(&editor->audio_graph, &samplerNodeConfig, NULL, &node->sampler.sampler);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise sampler, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->sampler.sampler;
+}
+
+// MIDI Player
+static void
+node_editor_add_midi(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, const char *file_name)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_MIDI;
+
+    if (file_name == NULL) {
+        FileDialogResult file_result = open_file_dialog("Choose a MIDI file", NULL);
+        if (file_result.success) {
+            strncpy(node->midi.file_name, file_result.path, MAX_FILE_NAME_SIZE);
+            free_file_dialog_result(&file_result);
+        } else {
+            fprintf(stderr, "Error: failed load file\n");
+            return;
+        }
+    } else {
+        strcpy(node->midi.file_name, file_name);
+    }
+
+    struct midi_player_node_config midiPlayerNodeConfig = midi_player_node_config_init(SAMPLE_RATE, node->midi.file_name);
+    ma_result result = midi_player_node_init(&editor->audio_graph, &midiPlayerNodeConfig, NULL, &node->midi.player);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise MIDI player, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->midi.player;
+}
+
+// Plugin
+static void
+node_editor_add_plugin(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, const struct soundflow_plugin *plugin)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_PLUGIN;
+
+    struct plugin_node_config pluginNodeConfig = plugin_node_config_init(plugin, audio_state.channels, SAMPLE_RATE);
+    ma_result result = plugin_node_init(&editor->audio_graph, &pluginNodeConfig, NULL, &node->plugin.plugin);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise plugin %s, error code = %d\n", plugin->name, result);
+        return;
+    }
+
+    node->audio_node = &node->plugin.plugin;
+}
+
+// Expression
+static void
+node_editor_add_expression(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, const char *text)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_EXPRESSION;
+    snprintf(node->expression.text, sizeof(node->expression.text), "%s", text);
+    snprintf(node->expression.source, sizeof(node->expression.source), "%s", text);
+
+    struct expression_node_config expressionNodeConfig = expression_node_config_init(audio_state.channels, SAMPLE_RATE, text);
+    ma_result result = expression_node_init(&editor->audio_graph, &expressionNodeConfig, NULL, &node->expression.expression);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise expression, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->expression.expression;
+}
+
+// Linear-Phase EQ
+static void
+node_editor_add_linear_eq(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_LINEAR_EQ;
+
+    struct linear_eq_node_config linearEqNodeConfig = linear_eq_node_config_init(audio_state.channels, SAMPLE_RATE);
+    ma_result result = linear_eq_node_init(&editor->audio_graph, &linearEqNodeConfig, NULL, &node->linear_eq.linear_eq);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise linear-phase EQ, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->linear_eq.linear_eq;
+}
+
+// Waveshaper
+static void
+node_editor_add_waveshaper(struct node_editor *editor, const char *name, struct nk_rect bounds,
+        int in_count, int out_count, enum waveshaper_curve curve, float drive, ma_uint32 oversample)
+{
+    struct node *node = node_editor_add(editor, name, bounds, in_count, out_count);
+    node->tag = NODE_WAVESHAPER;
+
+    struct waveshaper_node_config waveshaperNodeConfig = waveshaper_node_config_init(audio_state.channels, SAMPLE_RATE,
+            curve, drive, oversample);
+    ma_result result = waveshaper_node_init(&editor->audio_graph, &waveshaperNodeConfig, NULL, &node->waveshaper.waveshaper);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "Error: failed to initalise waveshaper, error code = %d\n", result);
+        return;
+    }
+
+    node->audio_node = &node->waveshaper.waveshaper;
+}
+
+static void
+node_link_release_converter(struct node_link *link)
+{
+    if (link->converter == NULL)
+        return;
+    channel_mix_node_uninit(link->converter, NULL);
+    ma_free(link->converter, NULL);
+    link->converter = NULL;
+}
+
+/* Where a node takes its MIDI player on input `slot`, or NULL when it doesn't. */
+static struct midi_player **
+node_midi_input(struct node *node, int slot)
+{
+    if (slot != 0)
+        return NULL;
+    switch (node->tag) {
+    case NODE_OSCILLATOR:
+        return &node->oscillator.oscillator.oscillator.midi;
+    case NODE_SAMPLER:
+        return &node->sampler.sampler.sampler.midi;
+    default:
+        return NULL;
+    }
+}
+
+/* Attaches a link's audio nodes, through a channel converter when their counts differ. */
+static void
+node_editor_connect(struct node_editor *editor, struct node_link *link)
+{
+    // out -> in
+    struct node *out_node = node_editor_node_by_id(editor, link->output_id);
+    struct node *in_node = node_editor_node_by_id(editor, link->input_id);
+    if (out_node == NULL || in_node == NULL
+            || out_node->audio_node == NULL || in_node->audio_node == NULL)
+            return;
+
+    int in_slot = link->input_slot, out_slot = link->output_slot;
+    printf("[DEBUG] connecting nodes %d(%d) -> %d(%d)\n", in_node->ID, in_slot, out_node->ID, out_slot);
+    ma_result result;
+    ma_node *target = out_node->audio_node;
+    ma_uint32 target_slot = (ma_uint32)out_slot;
+
+    // Different channel counts: up/down-mix through a converter in between
+    ma_uint32 channels_from = ma_node_get_output_channels(in_node->audio_node, in_slot);
+    ma_uint32 channels_to = ma_node_get_input_channels(out_node->audio_node, out_slot);
+    if (channels_from != channels_to) {
+        link->converter = ma_malloc(sizeof(*link->converter), NULL);
+        if (link->converter == NULL) {
+            fprintf(stderr, "[ERROR]: failed to allocate channel converter\n");
+            return;
+        }
+        struct channel_mix_node_config channelMixNodeConfig = channel_mix_node_config_init(channels_from, channels_to);
+        result = channel_mix_node_init(&editor->audio_graph, &channelMixNodeConfig, NULL, link->converter);
+        if (result != MA_SUCCESS) {
+            fprintf(stderr, "[ERROR]: failed to initalise channel converter, error code = %d\n", result);
+            ma_free(link->converter, NULL);
+            link->converter = NULL;
+            return;
+        }
+        result = ma_node_attach_output_bus(link->converter, 0, target, target_slot);
+        if (result != MA_SUCCESS) {
+            fprintf(stderr, "[ERROR]: failed to link channel converter, error code = %d\n", result);
+            node_link_release_converter(link);
+            return;
+        }
+        printf("[DEBUG] converting %u -> %u channels\n", channels_from, channels_to);
+        target = link->converter;
+        target_slot = 0;
+    }
+
+    result = ma_node_attach_output_bus(in_node->audio_node, in_slot, target, target_slot);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "[ERROR]: failed to link nodes, error code = %d\n", result);
+        return;
+    }
+    if (out_node->tag == NODE_COMPRESSOR && out_slot == COMPRESSOR_KEY_SLOT)
+        dsp_store_u32(&out_node->compressor.compressor.compressor.keyed, 1);
+    struct midi_player **midi_input = node_midi_input(out_node, out_slot);
+    if (in_node->tag == NODE_MIDI && midi_input != NULL)
+        midi_input_link(midi_input, &in_node->midi.player.player);
+}
+
+/*
+ * Mono stays mono: nodes that process each channel on its own take the
+ * channel count of what feeds them, and the expansion to the device layout is
+ * left to the first node that needs it (mixer, reverb, granular, endpoint).
+ */
+static bool
+node_follows_input(const struct node *node)
+{
+    switch (node->tag) {
+    case NODE_LOW_PASS_FILTER:
+    case NODE_SPLITTER:
+    case NODE_DELAY:
+    case NODE_COMPRESSOR:
+    case NODE_STRETCH:
+    case NODE_EQUALIZER:
+    case NODE_CHORUS:
+    case NODE_LOUDNESS:
+    case NODE_EXPRESSION:
+    case NODE_LINEAR_EQ:
+    case NODE_WAVESHAPER:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Recreates a node's audio object at another channel count, keeping its settings. */
+static ma_result
+node_editor_rebuild(struct node_editor *editor, struct node *node, ma_uint32 channels)
+{
+    ma_result result = MA_INVALID_OPERATION;
+
+    switch (node->tag) {
+    case NODE_LOW_PASS_FILTER: {
+        struct biquad_cascade *cascade = &node->low_pass_filter.filter.cascade;
+        float volume = ma_node_get_output_bus_volume(node->audio_node, 0);
+        struct filter_node_config filterNodeConfig = filter_node_config_init(channels, SAMPLE_RATE,
+                biquad_cascade_get_type(cascade), biquad_cascade_get_cutoff(cascade), biquad_cascade_get_order(cascade));
+        filter_node_uninit(&node->low_pass_filter.filter, NULL);
+        result = filter_node_init(&editor->audio_graph, &filterNodeConfig, NULL, &node->low_pass_filter.filter);
+        if (result == MA_SUCCESS)
+            ma_node_set_output_bus_volume(&node->low_pass_filter.filter, 0, volume);
+        break;
+    }
+    case NODE_SPLITTER: {
+        ma_splitter_node_config splitterNodeConfig = ma_splitter_node_config_init(channels);
+        ma_splitter_node_uninit(&node->splitter.splitter, NULL);
+        result = ma_splitter_node_init(&editor->audio_graph, &splitterNodeConfig, NULL, &node->splitter.splitter);
+        break;
+    }
+    case NODE_DELAY: {
+        float volume = ma_node_get_output_bus_volume(node->audio_node, 0);
+        ma_delay_node_config delayNodeConfig = ma_delay_node_config_init(channels, SAMPLE_RATE, (ma_uint32)(SAMPLE_RATE * DELAY_IN_SECONDS), DECAY);
+        ma_delay_node_uninit(&node->deplay.delay, NULL);
+        result = ma_delay_node_init(&editor->audio_graph, &delayNodeConfig, NULL, &node->deplay.delay);
+        if (result == MA_SUCCESS)
+            ma_node_set_output_bus_volume(&node->deplay.delay, 0, volume);
+        break;
+    }
+    case NODE_COMPRESSOR: {
+        struct compressor *comp = &node->compressor.compressor.compressor;
+        float makeup = dsp_load_f32(&comp->makeup);
+        struct compressor_node_config compressorNodeConfig = compressor_node_config_init(channels, SAMPLE_RATE,
+                dsp_load_f32(&comp->threshold), dsp_load_f32(&comp->ratio), COMPRESSOR_LOOKAHEAD);
+        compressorNodeConfig.compressor.knee = dsp_load_f32(&comp->knee);
+        compressorNodeConfig.compressor.release = dsp_load_f32(&comp->release);
+        compressor_node_uninit(&node->compressor.compressor, NULL);
+        result = compressor_node_init(&editor->audio_graph, &compressorNodeConfig, NULL, &node->compressor.compressor);
+        if (result == MA_SUCCESS)
+            dsp_store_f32(&comp->makeup, makeup);
+        break;
+    }
+    case NODE_STRETCH: {
+        struct stretch *st = &node->stretch.stretch.stretch;
+        struct stretch_node_config stretchNodeConfig = stretch_node_config_init(channels, SAMPLE_RATE,
+                dsp_load_f32(&st->tempo), dsp_load_f32(&st->pitch));
+        stretch_node_uninit(&node->stretch.stretch, NULL);
+        result = stretch_node_init(&editor->audio_graph, &stretchNodeConfig, NULL, &node->stretch.stretch);
+        break;
+    }
+    case NODE_EQUALIZER: {
+        struct equalizer *eq = &node->equalizer.equalizer.equalizer;
+        struct eq_band bands[EQ_BANDS];
+        memcpy(bands, eq->bands, sizeof(bands));
+        struct equalizer_node_config equalizerNodeConfig = equalizer_node_config_init(channels, SAMPLE_RATE);
+        equalizer_node_uninit(&node->equalizer.equalizer, NULL);
+        result = equalizer_node_init(&editor->audio_graph, &equalizerNodeConfig, NULL, &node->equalizer.equalizer);
+        if (result == MA_SUCCESS)
+            memcpy(eq->bands, bands, sizeof(bands));    // Not attached yet, nothing else reads them.
+        break;
+    }
+    case NODE_CHORUS: {
+        struct chorus *ch = &node->chorus.chorus.chorus;
+        struct chorus_node_config chorusNodeConfig = chorus_node_config_init(channels, SAMPLE_RATE,
+                dsp_load_f32(&ch->delay), dsp_load_f32(&ch->depth), dsp_load_f32(&ch->rate),
+                dsp_load_f32(&ch->feedback), dsp_load_f32(&ch->mix));
+        chorus_node_uninit(&node->chorus.chorus, NULL);
+        result = chorus_node_init(&editor->audio_graph, &chorusNodeConfig, NULL, &node->chorus.chorus);
+        break;
+    }
+    case NODE_LOUDNESS: {
+        // Starts measuring afresh, the old readings were of a different layout.
+        struct loudness_node_config loudnessNodeConfig = loudness_node_config_init(channels, SAMPLE_RATE);
+        loudness_node_uninit(&node->loudness.loudness, NULL);
+        result = loudness_node_init(&editor->audio_graph, &loudnessNodeConfig, NULL, &node->loudness.loudness);
+        break;
+    }
+    case NODE_EXPRESSION: {
+        // From the last text that compiled; t restarts.
+        struct expression *ex = &node->expression.expression.expression;
+        float params[EXPRESSION_PARAMS];
+        for (int i = 0; i < EXPRESSION_PARAMS; i++)
+            params[i] = dsp_load_f32(&ex->params[i]);
+        struct expression_node_config expressionNodeConfig = expression_node_config_init(channels, SAMPLE_RATE,
+                node->expression.source);
+        expression_node_uninit(&node->expression.expression, NULL);
+        result = expression_node_init(&editor->audio_graph, &expressionNodeConfig, NULL, &node->expression.expression);
+        if (result == MA_SUCCESS)
+            memcpy(ex->params, params, sizeof(params));
+        node->expression.pending = false;
+        break;
+    }
+    case NODE_LINEAR_EQ: {
+        struct linear_eq *leq = &node->linear_eq.linear_eq.linear_eq;
+        struct linear_eq_node_config linearEqNodeConfig = linear_eq_node_config_init(channels, SAMPLE_RATE);
+        for (int i = 0; i < LINEAR_EQ_POINTS; i++)
+            linearEqNodeConfig.linear_eq.gains[i] = dsp_load_f32(&leq->gains[i]);
+        linear_eq_node_uninit(&node->linear_eq.linear_eq, NULL);
+        result = linear_eq_node_init(&editor->audio_graph, &linearEqNodeConfig, NULL, &node->linear_eq.linear_eq);
+        break;
+    }
+    case NODE_WAVESHAPER: {
+        struct waveshaper *ws = &node->waveshaper.waveshaper.waveshaper;
+        float bias = dsp_load_f32(&ws->bias), output = dsp_load_f32(&ws->output), mix = dsp_load_f32(&ws->mix);
+        struct waveshaper_node_config waveshaperNodeConfig = waveshaper_node_config_init(channels, SAMPLE_RATE,
+                (enum waveshaper_curve)dsp_load_u32(&ws->curve), dsp_load_f32(&ws->drive), dsp_load_u32(&ws->oversample));
+        waveshaper_node_uninit(&node->waveshaper.waveshaper, NULL);
+        result = waveshaper_node_init(&editor->audio_graph, &waveshaperNodeConfig, NULL, &node->waveshaper.waveshaper);
+        if (result == MA_SUCCESS) {
+            ws->bias = bias;
+            ws->output = output;
+            ws->mix = mix;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    if (result != MA_SUCCESS)
+        node->audio_node = NULL;
+    return result;
+}
+
+/*
+ * Brings a channel-following node to the widest of its inputs, wider or
+ * narrower, then its downstream in turn. Only links into the main input
+ * (slot 0) count: a compressor's key is converted to whatever width the
+ * compressor has. Run on a link's target whenever the link is made or
+ * removed. Returns true when the node was rebuilt, which also reconnects
+ * every link touching it.
+ */
+static bool
+node_editor_adapt_channels(struct node_editor *editor, struct node *node)
+{
+    if (node == NULL || node->audio_node == NULL || !node_follows_input(node))
+        return false;
+
+    ma_uint32 channels = 0;
+    for (int i=0; i<editor->link_count; i++) {
+        struct node_link *lk = &editor->links[i];
+        struct node *upstream = node_editor_node_by_id(editor, lk->input_id);
+        if (lk->output_id == node->ID && lk->output_slot == 0 && upstream != NULL && upstream->audio_node != NULL)
+            channels = DSP_MAX(channels, ma_node_get_output_channels(upstream->audio_node, lk->input_slot));
+    }
+    if (channels == 0 || channels == ma_node_get_input_channels(node->audio_node, 0))
+        return false;
+
+    printf("[DEBUG] node %d follows its input to %u channels\n", node->ID, channels);
+    for (int i=0; i<editor->link_count; i++) {
+        struct node_link *lk = &editor->links[i];
+        if (lk->output_id == node->ID || lk->input_id == node->ID)
+            node_link_release_converter(lk);
+    }
+    ma_result result = node_editor_rebuild(editor, node, channels);
+    if (result != MA_SUCCESS) {
+        fprintf(stderr, "[ERROR] failed to rebuild node %d for %u channels, error code = %d\n", node->ID, channels, result);
+        return true;
+    }
+
+    for (int i=0; i<editor->link_count; i++) {
+        struct node_link *lk = &editor->links[i];
+        if (lk->output_id == node->ID)
+            node_editor_connect(editor, lk);
+    }
+    for (int i=0; i<editor->link_count; i++) {
+        struct node_link *lk = &editor->links[i];
+        if (lk->input_id == node->ID
+                && !node_editor_adapt_channels(editor, node_editor_node_by_id(editor, lk->output_id)))
+            node_editor_connect(editor, lk);
+    }
+    return true;
+}
+
+/* Frames by which a node delays what passes through it. */
+/* Latency of a path whose timing drifts, which no delay can line up. */
+#define LATENCY_DRIFTS ((ma_uint32)-1)
+
+static ma_uint32
+node_latency(struct node *node)
+{
+    if (node->audio_node == NULL)
+        return 0;
+    switch (node->tag) {
+    case NODE_CONVOLVER:
+        return convolver_node_get_latency(&node->convolver.convolver);
+    case NODE_SPECTRAL:
+        return stft_get_latency(&node->spectral.spectral.stft.stft);
+    case NODE_COMPRESSOR:
+        return compressor_get_latency(&node->compressor.compressor.compressor);
+    case NODE_STRETCH:
+        if (!stretch_keeps_time(&node->stretch.stretch.stretch))
+            return LATENCY_DRIFTS;
+        return stretch_get_latency(&node->stretch.stretch.stretch);
+    case NODE_LINEAR_EQ:
+        return linear_eq_get_latency(&node->linear_eq.linear_eq.linear_eq);
+    case NODE_WAVESHAPER:
+        return waveshaper_get_latency(&node->waveshaper.waveshaper.waveshaper);
+    default:
+        return 0;
+    }
+}
+
+enum path_state { PATH_UNSEEN, PATH_VISITING, PATH_DONE };
+
+/*
+ * Latency from the sources to the output of `node`: the slowest of its
+ * inputs plus its own. Each node's is worked out once per pass into
+ * `latency`, indexed like node_buf. A link back to a node still being
+ * worked out closes a feedback loop and counts as 0, and a compressor's
+ * key only steers its gain, so neither adds to the path. A path through
+ * anything that drifts (a stretch off tempo 1) drifts too.
+ */
+static ma_uint32
+node_editor_path_latency(struct node_editor *editor, struct node *node, ma_uint32 *latency, unsigned char *state)
+{
+    const ptrdiff_t index = node - editor->node_buf;
+    if (state[index] == PATH_DONE)
+        return latency[index];
+    if (state[index] == PATH_VISITING)
+        return 0;
+    state[index] = PATH_VISITING;
+
+    ma_uint32 upstream = 0;
+    for (int i=0; i<editor->link_count; i++) {
+        struct node_link *lk = &editor->links[i];
+        if (lk->output_id != node->ID
+                || (node->tag == NODE_COMPRESSOR && lk->output_slot == COMPRESSOR_KEY_SLOT))
+            continue;
+        struct node *source = node_editor_node_by_id(editor, lk->input_id);
+        if (source != NULL)
+            upstream = DSP_MAX(upstream, node_editor_path_latency(editor, source, latency, state));
+    }
+    ma_uint32 own = node_latency(node);
+    latency[index] = upstream == LATENCY_DRIFTS || own == LATENCY_DRIFTS ? LATENCY_DRIFTS : upstream + own;
+    state[index] = PATH_DONE;
+    return latency[index];
+}
+
+/*
+ * Delay compensation: paths that meet at a mixer are delayed to the
+ * latency of the slowest, so parallel chains through a linear-phase EQ,
+ * a convolver or a lookahead limiter stay time aligned. Cheap enough to
+ * redo every frame, which also follows latencies that change with a
+ * setting (FFT size, lookahead, oversampling). A stretch away from tempo 1
+ * drifts against everything else, so its paths are left out: they are not
+ * delayed and don't delay the others.
+ */
+static void
+node_editor_compensate(struct node_editor *editor)
+{
+    ma_uint32 path_latency[NK_LEN(editor->node_buf)];
+    unsigned char path_state[NK_LEN(editor->node_buf)] = { PATH_UNSEEN };
+
+    for (struct node *it = editor->begin; it != NULL; it = it->next) {
+        if (it->tag != NODE_MIXER || it->audio_node == NULL)
+            continue;
+        struct mixer_node *mixer = &it->mixer.mixer;
+        ma_uint32 latency[MIXER_MAX_INPUTS] = { 0 }, longest = 0;
+        bool drifts[MIXER_MAX_INPUTS] = { false };
+        for (int i=0; i<editor->link_count; i++) {
+            struct node_link *lk = &editor->links[i];
+            struct node *source = lk->output_id == it->ID ? node_editor_node_by_id(editor, lk->input_id) : NULL;
+            if (source == NULL || lk->output_slot < 0 || (ma_uint32)lk->output_slot >= mixer->input_count)
+                continue;
+            ma_uint32 path = node_editor_path_latency(editor, source, path_latency, path_state);
+            if (path == LATENCY_DRIFTS) {
+                drifts[lk->output_slot] = true;
+                continue;
+            }
+            latency[lk->output_slot] = DSP_MAX(latency[lk->output_slot], path);
+            longest = DSP_MAX(longest, path);
+        }
+        for (ma_uint32 i = 0; i < mixer->input_count; i++) {
+            ma_uint32 delay = drifts[i] ? 0 : DSP_MIN(longest - latency[i], MIXER_MAX_DELAY - MIXER_CHUNK);
+            if (dsp_load_u32(&mixer->inputs[i].delay) != delay)
+                mixer_node_set_delay(mixer, i, delay);
+        }
+    }
+}
+
 static void
 node_editor_link(struct node_editor *editor, int in_id, int in_slot,
     int out_id, int out_slot)
 {
     struct node_link *link = NULL;
+    int old_out_id = -1;
 
     // Check for exiting link
     for (int i=0; i<editor->link_count; i++) {
@@ -377,22 +1329,20 @@ node_editor_link(struct node_editor *editor, int in_id, int in_slot,
         link = &editor->links[editor->link_count++];
         link->input_id = in_id;
         link->input_slot = in_slot;
+        link->converter = NULL;
+    } else {
+        old_out_id = link->output_id;
     }
+    node_link_release_converter(link);
     link->output_id = out_id;
     link->output_slot = out_slot;
 
-    // out -> in
-    struct node *out_node = node_editor_node_by_id(editor, out_id); 
-    struct node *in_node = node_editor_node_by_id(editor, in_id);
-    if (out_node == NULL || in_node == NULL 
-            || out_node->audio_node == NULL || in_node->audio_node == NULL)
-            return;
-
-    printf("[DEBUG] connecting nodes %d(%d) -> %d(%d)\n", in_node->ID, in_slot, out_node->ID, out_slot);
-    ma_result result = ma_node_attach_output_bus(in_node->audio_node, in_slot, out_node->audio_node, out_slot);
-    if (result != MA_SUCCESS) {
-        fprintf(stderr, "[ERROR]: failed to link nodes, error code = %d\n", result);
-    }
+    // A rebuilt node has reconnected all of its links, this one included
+    if (!node_editor_adapt_channels(editor, node_editor_node_by_id(editor, out_id)))
+        node_editor_connect(editor, link);
+    // The node the link was moved away from may narrow again
+    if (old_out_id != out_id)
+        node_editor_adapt_channels(editor, node_editor_find(editor, old_out_id));
 }
 
 static bool node_editor_is_in_linked(struct node_editor *editor, int in_id, int in_slot)
@@ -422,10 +1372,23 @@ node_editor_unlink_in(struct node_editor *editor, int in_id, int in_slot)
 {
     struct node_link *link;
     nk_bool move = nk_false;
+    int out_id = -1;
     for (int i=0; i<editor->link_count; i++) {
         link = &editor->links[i];
-        if (!move && (link->input_id == in_id && link->input_slot == in_slot))
+        if (!move && (link->input_id == in_id && link->input_slot == in_slot)) {
+            out_id = link->output_id;
+            struct node *out_node = node_editor_node_by_id(editor, link->output_id);
+            if (out_node != NULL && out_node->audio_node != NULL
+                    && out_node->tag == NODE_COMPRESSOR && link->output_slot == COMPRESSOR_KEY_SLOT)
+                dsp_store_u32(&out_node->compressor.compressor.compressor.keyed, 0);
+            struct midi_player **midi_input = out_node != NULL && out_node->audio_node != NULL
+                    ? node_midi_input(out_node, link->output_slot) : NULL;
+            struct node *source = node_editor_node_by_id(editor, link->input_id);
+            if (midi_input != NULL && source != NULL && source->tag == NODE_MIDI)
+                midi_input_link(midi_input, NULL);
+            node_link_release_converter(link);
             move = nk_true;
+        }
 
         if (move) {
             if (i < editor->link_count - 1)
@@ -433,6 +1396,10 @@ node_editor_unlink_in(struct node_editor *editor, int in_id, int in_slot)
         }
     }
     editor->link_count--;
+
+    // Without the link a channel-following node may be wider than its inputs
+    // now; nodes being deleted are already out of the list and stay as they are.
+    node_editor_adapt_channels(editor, node_editor_find(editor, out_id));
 }
 
 // static void
@@ -524,17 +1491,22 @@ start:
 static void
 node_editor_init(struct node_editor *editor)
 {
+    // The kernel table is read by the audio callback, so pick it before the device starts
+    printf("[INFO] DSP kernels: %s\n", kernels_init());
     audio_init();
 
     memset(editor, 0, sizeof(*editor));
 
-    ma_node_graph_config node_graph_config = ma_node_graph_config_init(CHANNELS);
+    ma_node_graph_config node_graph_config = ma_node_graph_config_init(audio_state.channels);
     ma_result result = ma_node_graph_init(&node_graph_config, NULL, &editor->audio_graph);
     if (result != MA_SUCCESS) {
         fprintf(stderr, "[ERROR] failed to init node graph, error code = %d\n", result);
         exit(1);
     }
 
+    ma_uint32 plugin_count = plugin_registry_load(&pluginRegistry, PLUGIN_DIRECTORY);
+    printf("[INFO] %u plugin nodes from %s/\n", plugin_count, PLUGIN_DIRECTORY);
+
     node_editor_add_source_decoder(editor, "Data Source 1", nk_rect(40, 10, 180, 220), 0, 1, "sounds/jungle.mp3");
     node_editor_add_endpoint(editor, "Endpoint", nk_rect(940, 10, 180, 220), 1, 0);
     /*node_editor_link(editor, 0, 0, 1, 0);*/
@@ -586,6 +1558,7 @@ static int node_editor(struct nk_context *ctx, struct nk_rect bounds)
         node_editor_init(&nodeEditor);
         nodeEditor.initialized = 1;
     }
+    node_editor_compensate(nodedit);
 
     if (nk_begin(ctx, "Node Editor", bounds,
         NK_WINDOW_BORDER|NK_WINDOW_NO_SCROLLBAR)) {
@@ -655,7 +1628,19 @@ static int node_editor(struct nk_context *ctx, struct nk_rect bounds)
                             ma_node_set_output_bus_volume(&it->source_decoder.source, 0, vol);
                             break;
                         case NODE_LOW_PASS_FILTER:
-                            nk_label(ctx, "Low Pass Filter", NK_TEXT_ALIGN_CENTERED);
+                            if (it->audio_node == NULL)
+                                break;
+                            struct biquad_cascade *cascade = &it->low_pass_filter.filter.cascade;
+                            static const char *filter_type_names[BIQUAD_FILTER_TYPE_COUNT] = { "Low Pass", "High Pass" };
+                            int type = nk_combo(ctx, filter_type_names, BIQUAD_FILTER_TYPE_COUNT,
+                                    biquad_cascade_get_type(cascade), 25, nk_vec2(150, 100));
+                            biquad_cascade_set_type(cascade, (enum biquad_filter_type)type);
+                            float cutoff = nk_propertyf(ctx, "#Cutoff", 10, biquad_cascade_get_cutoff(cascade), SAMPLE_RATE / 2, 10, 5);
+                            biquad_cascade_set_cutoff(cascade, cutoff);
+                            int order = nk_propertyi(ctx, "#Order", 1, biquad_cascade_get_order(cascade), BIQUAD_MAX_ORDER, 1, 0.2f);
+                            biquad_cascade_set_order(cascade, order);
+                            // Picked from the poles, see biquad.c
+                            nk_label(ctx, biquad_cascade_is_precise(cascade) ? "Precision 64-bit" : "Precision 32-bit", NK_TEXT_ALIGN_LEFT);
                             break;
                         case NODE_SPLITTER:
                             nk_label(ctx, "SPLITTER", NK_TEXT_ALIGN_CENTERED);
@@ -663,6 +1648,373 @@ static int node_editor(struct nk_context *ctx, struct nk_rect bounds)
                         case NODE_DELAY:
                             nk_label(ctx, "Echo / Delay", NK_TEXT_ALIGN_CENTERED);
                             break;
+                        case NODE_CONVOLVER:
+                            nk_label(ctx, basename(it->convolver.file_name), NK_TEXT_ALIGN_CENTERED);
+                            if (it->audio_node == NULL)
+                                break;
+                            struct convolver_node *convolver = &it->convolver.convolver;
+                            float mix = nk_propertyf(ctx, "#Mix", 0, dsp_load_f32(&convolver->mix), 1, 0.01, 0.005);
+                            dsp_store_f32(&convolver->mix, mix);
+                            char info[64];
+                            snprintf(info, sizeof(info), "IR %.2fs, %u tail levels",
+                                    (float)convolver->ir_frames / SAMPLE_RATE, convolver->level_count);
+                            nk_label(ctx, info, NK_TEXT_ALIGN_LEFT);
+                            snprintf(info, sizeof(info), "Latency %u, late %u",
+                                    convolver_node_get_latency(convolver), dsp_load_u32(&convolver->underruns));
+                            nk_label(ctx, info, NK_TEXT_ALIGN_LEFT);
+                            break;
+                        case NODE_SPECTRAL:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct spectral_node *spectral = &it->spectral.spectral;
+                            int effect = nk_combo(ctx, spectral_effect_names, SPECTRAL_EFFECT_COUNT,
+                                    dsp_load_u32(&spectral->effect), 25, nk_vec2(150, 100));
+                            dsp_store_u32(&spectral->effect, effect);
+                            switch (effect) {
+                            case SPECTRAL_FILTER: {
+                                float low = nk_propertyf(ctx, "#Low", 0, dsp_load_f32(&spectral->low), SAMPLE_RATE / 2, 10, 5);
+                                float high = nk_propertyf(ctx, "#High", 0, dsp_load_f32(&spectral->high), SAMPLE_RATE / 2, 10, 5);
+                                dsp_store_f32(&spectral->low, low);
+                                dsp_store_f32(&spectral->high, DSP_MAX(low, high));
+                                break;
+                            }
+                            case SPECTRAL_GATE: {
+                                float threshold = nk_propertyf(ctx, "#Threshold", -120, dsp_load_f32(&spectral->threshold), 0, 1, 0.2f);
+                                dsp_store_f32(&spectral->threshold, threshold);
+                                break;
+                            }
+                            case SPECTRAL_FREEZE: {
+                                bool freeze = nk_check_label(ctx, "Freeze", dsp_load_u32(&spectral->freeze));
+                                dsp_store_u32(&spectral->freeze, freeze);
+                                break;
+                            }
+                            }
+                            const struct stft *stft = &spectral->stft.stft;
+                            char spectral_info[64];
+                            snprintf(spectral_info, sizeof(spectral_info), "%s %u/%u, latency %u", stft_window_names[stft->window],
+                                    stft->fft_size, stft->hop, stft_get_latency(stft));
+                            nk_label(ctx, spectral_info, NK_TEXT_ALIGN_LEFT);
+                            break;
+                        case NODE_REVERB:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct fdn_reverb *reverb = &it->reverb.reverb.reverb;
+                            float decay = nk_propertyf(ctx, "#Decay", 0.1f, dsp_load_f32(&reverb->decay), 20, 0.1f, 0.01f);
+                            dsp_store_f32(&reverb->decay, decay);
+                            float damping = nk_propertyf(ctx, "#Damping", 0, dsp_load_f32(&reverb->damping), 1, 0.01f, 0.005f);
+                            dsp_store_f32(&reverb->damping, damping);
+                            float modulation = nk_propertyf(ctx, "#Modulation", 0, dsp_load_f32(&reverb->modulation), 1, 0.01f, 0.005f);
+                            dsp_store_f32(&reverb->modulation, modulation);
+                            float reverb_mix = nk_propertyf(ctx, "#Mix", 0, dsp_load_f32(&reverb->mix), 1, 0.01f, 0.005f);
+                            dsp_store_f32(&reverb->mix, reverb_mix);
+                            break;
+                        case NODE_MIXER:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct mixer_node *mixer = &it->mixer.mixer;
+                            for (ma_uint32 i = 0; i < mixer->input_count; i++) {
+                                struct mixer_input *input = &mixer->inputs[i];
+                                char input_name[16];
+                                snprintf(input_name, sizeof(input_name), "#In %u dB", i + 1);
+                                nk_layout_row_dynamic(ctx, 25, 1);
+                                float db = nk_propertyf(ctx, input_name, -60, dsp_gain_to_db(dsp_load_f32(&input->gain)), 12, 0.5f, 0.1f);
+                                dsp_store_f32(&input->gain, db <= -60 ? 0.0f : dsp_db_to_gain(db));
+                                nk_layout_row_dynamic(ctx, 25, 3);
+                                float pan = nk_propertyf(ctx, "#Pan", -1, dsp_load_f32(&input->pan), 1, 0.05f, 0.01f);
+                                dsp_store_f32(&input->pan, pan);
+                                dsp_store_u32(&input->mute, nk_check_label(ctx, "M", dsp_load_u32(&input->mute)));
+                                dsp_store_u32(&input->solo, nk_check_label(ctx, "S", dsp_load_u32(&input->solo)));
+                            }
+                            break;
+                        case NODE_COMPRESSOR:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct compressor *compressor = &it->compressor.compressor.compressor;
+                            float threshold = nk_propertyf(ctx, "#Threshold", -60, dsp_load_f32(&compressor->threshold), 0, 0.5f, 0.1f);
+                            dsp_store_f32(&compressor->threshold, threshold);
+                            float ratio = nk_propertyf(ctx, "#Ratio", 1, dsp_load_f32(&compressor->ratio), DYNAMICS_MAX_RATIO, 0.5f, 0.05f);
+                            dsp_store_f32(&compressor->ratio, ratio);
+                            float knee = nk_propertyf(ctx, "#Knee", 0, dsp_load_f32(&compressor->knee), 24, 0.5f, 0.1f);
+                            dsp_store_f32(&compressor->knee, knee);
+                            float release = nk_propertyf(ctx, "#Release", 0.005f, dsp_load_f32(&compressor->release), 2, 0.01f, 0.002f);
+                            dsp_store_f32(&compressor->release, release);
+                            float makeup = nk_propertyf(ctx, "#Makeup", 0, dsp_load_f32(&compressor->makeup), 24, 0.5f, 0.1f);
+                            dsp_store_f32(&compressor->makeup, makeup);
+                            char compressor_info[64];
+                            snprintf(compressor_info, sizeof(compressor_info), "%s%s, GR %.1f dB",
+                                    ratio >= DYNAMICS_MAX_RATIO ? "Limit" : "Compress",
+                                    dsp_load_u32(&compressor->keyed) ? " (key)" : "", dsp_load_f32(&compressor->gain_reduction));
+                            nk_label(ctx, compressor_info, NK_TEXT_ALIGN_LEFT);
+                            break;
+                        case NODE_STRETCH:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct stretch *stretch = &it->stretch.stretch.stretch;
+                            float tempo = nk_propertyf(ctx, "#Tempo", STRETCH_MIN_RATIO, dsp_load_f32(&stretch->tempo), STRETCH_MAX_RATIO, 0.05f, 0.01f);
+                            dsp_store_f32(&stretch->tempo, tempo);
+                            float semitones = nk_propertyf(ctx, "#Pitch", -24, 12.0f * log2f(dsp_load_f32(&stretch->pitch)), 24, 1, 0.05f);
+                            dsp_store_f32(&stretch->pitch, exp2f(semitones / 12.0f));
+                            char stretch_info[64];
+                            if (stretch_keeps_time(stretch))
+                                snprintf(stretch_info, sizeof(stretch_info), "Latency %u ms",
+                                        stretch_get_latency(stretch) * 1000 / SAMPLE_RATE);
+                            else
+                                snprintf(stretch_info, sizeof(stretch_info), "Not delay compensated");
+                            nk_label(ctx, stretch_info, NK_TEXT_ALIGN_LEFT);
+                            break;
+                        case NODE_OSCILLATOR:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct oscillator *oscillator = &it->oscillator.oscillator.oscillator;
+                            int shape = nk_combo(ctx, oscillator_shape_names, OSCILLATOR_SHAPE_COUNT,
+                                    dsp_load_u32(&oscillator->shape), 25, nk_vec2(150, 120));
+                            dsp_store_u32(&oscillator->shape, shape);
+                            int mode = nk_combo(ctx, oscillator_mode_names, OSCILLATOR_MODE_COUNT,
+                                    dsp_load_u32(&oscillator->mode), 25, nk_vec2(150, 80));
+                            dsp_store_u32(&oscillator->mode, mode);
+                            float frequency = nk_propertyf(ctx, "#Frequency", 20, dsp_load_f32(&oscillator->frequency), SAMPLE_RATE / 2, 10, 1);
+                            dsp_store_f32(&oscillator->frequency, frequency);
+                            int voices = nk_propertyi(ctx, "#Voices", 1, dsp_load_u32(&oscillator->voice_count), OSCILLATOR_MAX_VOICES, 1, 0.2f);
+                            dsp_store_u32(&oscillator->voice_count, voices);
+                            if (mode == OSCILLATOR_UNISON) {
+                                float detune = nk_propertyf(ctx, "#Detune", 0, dsp_load_f32(&oscillator->detune), 100, 1, 0.2f);
+                                dsp_store_f32(&oscillator->detune, detune);
+                            }
+                            float oscillator_gain = nk_propertyf(ctx, "#Gain", 0, dsp_load_f32(&oscillator->gain), 1, 0.01f, 0.005f);
+                            dsp_store_f32(&oscillator->gain, oscillator_gain);
+                            break;
+                        case NODE_NOISE:
+                            if (it->audio_node == NULL)
+                                break;
+                            float noise_vol = nk_propertyf(ctx, "#Volume", 0, ma_node_get_output_bus_volume(&it->noise.source, 0), 1, 0.01, 0.05);
+                            ma_node_set_output_bus_volume(&it->noise.source, 0, noise_vol);
+                            break;
+                        case NODE_EQUALIZER:
+                            if (it->audio_node == NULL)
+                                break;
+                            it->equalizer.band = nk_propertyi(ctx, "#Band", 1, it->equalizer.band, EQ_BANDS, 1, 0.2f);
+                            struct eq_band *band = &it->equalizer.equalizer.equalizer.bands[it->equalizer.band - 1];
+                            int band_type = nk_combo(ctx, eq_band_type_names, EQ_BAND_TYPE_COUNT,
+                                    dsp_load_u32(&band->type), 25, nk_vec2(150, 180));
+                            dsp_store_u32(&band->type, band_type);
+                            float band_frequency = nk_propertyf(ctx, "#Freq", 10, dsp_load_f32(&band->frequency), SAMPLE_RATE / 2, 10, 5);
+                            dsp_store_f32(&band->frequency, band_frequency);
+                            float band_gain = nk_propertyf(ctx, "#Gain", -EQ_MAX_GAIN, dsp_load_f32(&band->gain), EQ_MAX_GAIN, 0.5f, 0.1f);
+                            dsp_store_f32(&band->gain, band_gain);
+                            float band_q = nk_propertyf(ctx, "#Q", EQ_MIN_Q, dsp_load_f32(&band->q), EQ_MAX_Q, 0.05f, 0.01f);
+                            dsp_store_f32(&band->q, band_q);
+                            break;
+                        case NODE_CHORUS:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct chorus *chorus = &it->chorus.chorus.chorus;
+                            float chorus_delay = nk_propertyf(ctx, "#Delay", 0, dsp_load_f32(&chorus->delay), CHORUS_MAX_DELAY, 0.5f, 0.05f);
+                            dsp_store_f32(&chorus->delay, chorus_delay);
+                            float depth = nk_propertyf(ctx, "#Depth", 0, dsp_load_f32(&chorus->depth), CHORUS_MAX_DEPTH, 0.1f, 0.02f);
+                            dsp_store_f32(&chorus->depth, depth);
+                            float rate = nk_propertyf(ctx, "#Rate", 0, dsp_load_f32(&chorus->rate), 20, 0.05f, 0.01f);
+                            dsp_store_f32(&chorus->rate, rate);
+                            float feedback = nk_propertyf(ctx, "#Feedback", -CHORUS_MAX_FEEDBACK, dsp_load_f32(&chorus->feedback), CHORUS_MAX_FEEDBACK, 0.05f, 0.01f);
+                            dsp_store_f32(&chorus->feedback, feedback);
+                            float chorus_mix = nk_propertyf(ctx, "#Mix", 0, dsp_load_f32(&chorus->mix), 1, 0.01f, 0.005f);
+                            dsp_store_f32(&chorus->mix, chorus_mix);
+                            break;
+                        case NODE_GRANULAR:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct granular *granular = &it->granular.granular.granular;
+                            nk_label(ctx, basename(it->granular.file_name), NK_TEXT_ALIGN_CENTERED);
+                            float density = nk_propertyf(ctx, "#Density", 0, dsp_load_f32(&granular->density), GRANULAR_MAX_DENSITY, 5, 1);
+                            dsp_store_f32(&granular->density, density);
+                            float grain_size = nk_propertyf(ctx, "#Size", GRANULAR_MIN_SIZE, dsp_load_f32(&granular->size), GRANULAR_MAX_SIZE, 1, 0.5f);
+                            dsp_store_f32(&granular->size, grain_size);
+                            dsp_store_f32(&granular->position, nk_slide_float(ctx, 0, dsp_load_f32(&granular->position), 1, 0.001f));
+                            float position_jitter = nk_propertyf(ctx, "#Scatter", 0, dsp_load_f32(&granular->position_jitter), 1, 0.005f, 0.001f);
+                            dsp_store_f32(&granular->position_jitter, position_jitter);
+                            float grain_pitch = nk_propertyf(ctx, "#Pitch", -GRANULAR_MAX_PITCH, dsp_load_f32(&granular->pitch), GRANULAR_MAX_PITCH, 1, 0.05f);
+                            dsp_store_f32(&granular->pitch, grain_pitch);
+                            float pitch_jitter = nk_propertyf(ctx, "#Detune", 0, dsp_load_f32(&granular->pitch_jitter), GRANULAR_MAX_PITCH, 0.1f, 0.02f);
+                            dsp_store_f32(&granular->pitch_jitter, pitch_jitter);
+                            float spread = nk_propertyf(ctx, "#Spread", 0, dsp_load_f32(&granular->spread), 1, 0.01f, 0.005f);
+                            dsp_store_f32(&granular->spread, spread);
+                            float granular_gain = nk_propertyf(ctx, "#Gain", 0, dsp_load_f32(&granular->gain), 4, 0.01f, 0.005f);
+                            dsp_store_f32(&granular->gain, granular_gain);
+                            char granular_info[64];
+                            snprintf(granular_info, sizeof(granular_info), "%u grains", dsp_load_u32(&granular->active));
+                            nk_label(ctx, granular_info, NK_TEXT_ALIGN_LEFT);
+                            break;
+                        case NODE_LOUDNESS:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct loudness *loudness = &it->loudness.loudness.loudness;
+                            char loudness_info[64];
+                            snprintf(loudness_info, sizeof(loudness_info), "M %.1f LUFS", dsp_load_f32(&loudness->momentary));
+                            nk_label(ctx, loudness_info, NK_TEXT_ALIGN_LEFT);
+                            snprintf(loudness_info, sizeof(loudness_info), "S %.1f LUFS", dsp_load_f32(&loudness->short_term));
+                            nk_label(ctx, loudness_info, NK_TEXT_ALIGN_LEFT);
+                            snprintf(loudness_info, sizeof(loudness_info), "I %.1f LUFS", dsp_load_f32(&loudness->integrated));
+                            nk_label(ctx, loudness_info, NK_TEXT_ALIGN_LEFT);
+                            snprintf(loudness_info, sizeof(loudness_info), "LRA %.1f LU", dsp_load_f32(&loudness->range));
+                            nk_label(ctx, loudness_info, NK_TEXT_ALIGN_LEFT);
+                            snprintf(loudness_info, sizeof(loudness_info), "TP %.1f dBTP", dsp_load_f32(&loudness->true_peak));
+                            nk_label(ctx, loudness_info, NK_TEXT_ALIGN_LEFT);
+                            if (nk_button_label(ctx, "Reset"))
+                                dsp_store_u32(&loudness->reset, 1);
+                            break;
+                        case NODE_SAMPLER:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct sampler *sampler = &it->sampler.sampler.sampler;
+                            nk_label(ctx, basename(it->sampler.file_name), NK_TEXT_ALIGN_CENTERED);
+                            it->sampler.note = nk_propertyi(ctx, "#Note", 0, it->sampler.note, 127, 1, 0.2f);
+                            if (nk_button_label(ctx, "Play"))
+                                sampler_note_on(sampler, (ma_uint32)it->sampler.note, 100);
+                            if (nk_button_label(ctx, "Stop"))
+                                sampler_all_off(sampler);
+                            float sampler_attack = nk_propertyf(ctx, "#Attack", 0, dsp_load_f32(&sampler->attack), SAMPLER_MAX_TIME, 1, 0.5f);
+                            dsp_store_f32(&sampler->attack, sampler_attack);
+                            float sampler_decay = nk_propertyf(ctx, "#Decay", 0, dsp_load_f32(&sampler->decay), SAMPLER_MAX_TIME, 5, 1);
+                            dsp_store_f32(&sampler->decay, sampler_decay);
+                            float sampler_sustain = nk_propertyf(ctx, "#Sustain", 0, dsp_load_f32(&sampler->sustain), 1, 0.01f, 0.005f);
+                            dsp_store_f32(&sampler->sustain, sampler_sustain);
+                            float sampler_release = nk_propertyf(ctx, "#Release", 0, dsp_load_f32(&sampler->release), SAMPLER_MAX_TIME, 5, 1);
+                            dsp_store_f32(&sampler->release, sampler_release);
+                            int polyphony = nk_propertyi(ctx, "#Voices", 1, (int)dsp_load_u32(&sampler->polyphony),
+                                    SAMPLER_MAX_VOICES - SAMPLER_SPARE_VOICES, 1, 0.2f);
+                            dsp_store_u32(&sampler->polyphony, (ma_uint32)polyphony);
+                            int steal = nk_combo(ctx, sampler_steal_names, SAMPLER_STEAL_COUNT,
+                                    dsp_load_u32(&sampler->steal), 25, nk_vec2(150, 100));
+                            dsp_store_u32(&sampler->steal, (ma_uint32)steal);
+                            float sampler_spread = nk_propertyf(ctx, "#Spread", 0, dsp_load_f32(&sampler->spread), 1, 0.01f, 0.005f);
+                            dsp_store_f32(&sampler->spread, sampler_spread);
+                            float sampler_gain = nk_propertyf(ctx, "#Gain", 0, dsp_load_f32(&sampler->gain), 4, 0.01f, 0.005f);
+                            dsp_store_f32(&sampler->gain, sampler_gain);
+                            char sampler_info[64];
+                            snprintf(sampler_info, sizeof(sampler_info), "%u voices", dsp_load_u32(&sampler->active));
+                            nk_label(ctx, sampler_info, NK_TEXT_ALIGN_LEFT);
+                            break;
+                        case NODE_MIDI:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct midi_player *player = &it->midi.player.player;
+                            nk_label(ctx, basename(it->midi.file_name), NK_TEXT_ALIGN_CENTERED);
+                            bool midi_playing = dsp_load_u32(&player->playing);
+                            if (nk_button_label(ctx, midi_playing ? "Stop" : "Play"))
+                                dsp_store_u32(&player->playing, !midi_playing);
+                            if (nk_button_label(ctx, "Rewind"))
+                                dsp_store_u32(&player->rewind, 1);
+                            dsp_store_u32(&player->loop, nk_check_label(ctx, "Loop", dsp_load_u32(&player->loop)));
+                            ma_uint32 midi_seconds = DSP_MIN(dsp_load_u32(&player->position), player->file.length) / SAMPLE_RATE;
+                            ma_uint32 midi_length = player->file.length / SAMPLE_RATE;
+                            char midi_info[64];
+                            snprintf(midi_info, sizeof(midi_info), "%u:%02u / %u:%02u",
+                                    midi_seconds / 60, midi_seconds % 60, midi_length / 60, midi_length % 60);
+                            nk_label(ctx, midi_info, NK_TEXT_ALIGN_LEFT);
+                            snprintf(midi_info, sizeof(midi_info), "%u events", player->file.event_count);
+                            nk_label(ctx, midi_info, NK_TEXT_ALIGN_LEFT);
+                            break;
+                        case NODE_PLUGIN:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct plugin_node *plugin = &it->plugin.plugin;
+                            for (uint32_t i = 0; i < plugin->plugin->param_count; i++) {
+                                const struct soundflow_param *param = &plugin->plugin->params[i];
+                                char param_label[64];
+                                snprintf(param_label, sizeof(param_label), "#%s", param->name);
+                                float param_value = nk_propertyf(ctx, param_label, param->min, dsp_load_f32(&plugin->params[i]),
+                                        param->max, param->step, param->step * 0.5f);
+                                dsp_store_f32(&plugin->params[i], param_value);
+                            }
+                            break;
+                        case NODE_EXPRESSION:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct node_expression *expr = &it->expression;
+                            struct expression *ex = &expr->expression.expression;
+                            nk_flags expression_event = nk_edit_string_zero_terminated(ctx, NK_EDIT_FIELD | NK_EDIT_SIG_ENTER,
+                                    expr->text, sizeof(expr->text), nk_filter_ascii);
+                            if ((expression_event & NK_EDIT_COMMITED)
+                                    && expression_compile(expr->text, &expr->program, expr->error, sizeof(expr->error))) {
+                                memcpy(expr->source, expr->text, sizeof(expr->source));
+                                expr->pending = true;
+                            }
+                            if (expr->pending)
+                                expr->pending = !expression_set_program(ex, &expr->program);
+                            nk_label(ctx, expr->error[0] != '\0' ? expr->error : "", NK_TEXT_ALIGN_LEFT);
+                            static const char *const expression_param_names[EXPRESSION_PARAMS] = { "#a", "#b", "#c", "#d" };
+                            for (int i = 0; i < EXPRESSION_PARAMS; i++) {
+                                float expression_param = nk_propertyf(ctx, expression_param_names[i], -1000,
+                                        dsp_load_f32(&ex->params[i]), 1000, 0.01f, 0.005f);
+                                dsp_store_f32(&ex->params[i], expression_param);
+                            }
+                            if (nk_button_label(ctx, "Reset t"))
+                                dsp_store_u32(&ex->reset, 1);
+                            break;
+                        case NODE_LINEAR_EQ:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct linear_eq *leq = &it->linear_eq.linear_eq.linear_eq;
+                            float leq_gains[LINEAR_EQ_POINTS];
+                            struct nk_rect curve;
+                            nk_layout_row_dynamic(ctx, 100, 1);
+                            if (nk_widget(&curve, ctx)) {
+                                // Drawing over the curve moves the nearest point to the mouse
+                                if (nk_input_is_mouse_down(in, NK_BUTTON_LEFT) && nk_input_is_mouse_hovering_rect(in, curve)) {
+                                    int point = (int)((in->mouse.pos.x - curve.x) / curve.w * (LINEAR_EQ_POINTS - 1) + 0.5f);
+                                    float db = (0.5f - (in->mouse.pos.y - curve.y) / curve.h) * 2.0f * LINEAR_EQ_MAX_GAIN;
+                                    dsp_store_f32(&leq->gains[DSP_CLAMP(point, 0, LINEAR_EQ_POINTS - 1)],
+                                            DSP_CLAMP(db, -LINEAR_EQ_MAX_GAIN, LINEAR_EQ_MAX_GAIN));
+                                }
+                                for (int i = 0; i < LINEAR_EQ_POINTS; i++)
+                                    leq_gains[i] = dsp_load_f32(&leq->gains[i]);
+
+                                struct nk_command_buffer *curve_canvas = nk_window_get_canvas(ctx);
+                                const float scale = curve.h / (2.0f * LINEAR_EQ_MAX_GAIN);
+                                nk_fill_rect(curve_canvas, curve, 0, nk_rgb(30, 30, 30));
+                                nk_stroke_line(curve_canvas, curve.x, curve.y + curve.h / 2, curve.x + curve.w, curve.y + curve.h / 2,
+                                        1.0f, nk_rgb(70, 70, 70));
+                                float curve_points[2 * 64];
+                                for (int i = 0; i < 64; i++) {
+                                    float x = (float)i / 63.0f;
+                                    double frequency = LINEAR_EQ_FIRST_HZ * exp2(x * (LINEAR_EQ_POINTS - 1));
+                                    curve_points[2 * i] = curve.x + x * curve.w;
+                                    curve_points[2 * i + 1] = curve.y + curve.h / 2 - linear_eq_curve(leq_gains, frequency) * scale;
+                                }
+                                nk_stroke_polyline(curve_canvas, curve_points, 64, 1.5f, nk_rgb(100, 200, 100));
+                                for (int i = 0; i < LINEAR_EQ_POINTS; i++) {
+                                    float x = curve.x + curve.w * (float)i / (LINEAR_EQ_POINTS - 1);
+                                    float y = curve.y + curve.h / 2 - leq_gains[i] * scale;
+                                    nk_fill_circle(curve_canvas, nk_rect(x - 3, y - 3, 6, 6), nk_rgb(100, 200, 100));
+                                }
+                            }
+                            nk_layout_row_dynamic(ctx, 25, 1);
+                            if (nk_button_label(ctx, "Flat"))
+                                for (int i = 0; i < LINEAR_EQ_POINTS; i++)
+                                    dsp_store_f32(&leq->gains[i], 0.0f);
+                            char leq_info[64];
+                            snprintf(leq_info, sizeof(leq_info), "Latency %u ms", linear_eq_get_latency(leq) * 1000 / SAMPLE_RATE);
+                            nk_label(ctx, leq_info, NK_TEXT_ALIGN_LEFT);
+                            break;
+                        case NODE_WAVESHAPER:
+                            if (it->audio_node == NULL)
+                                break;
+                            struct waveshaper *ws = &it->waveshaper.waveshaper.waveshaper;
+                            int ws_curve = nk_combo(ctx, waveshaper_curve_names, WAVESHAPER_CURVE_COUNT,
+                                    dsp_load_u32(&ws->curve), 25, nk_vec2(150, 100));
+                            dsp_store_u32(&ws->curve, ws_curve);
+                            // Stored as the factor, shown as its power of two
+                            int ws_stages = nk_combo(ctx, waveshaper_oversample_names, OVERSAMPLER_MAX_STAGES + 1,
+                                    oversampler_stages(dsp_load_u32(&ws->oversample)), 25, nk_vec2(150, 120));
+                            dsp_store_u32(&ws->oversample, 1u << ws_stages);
+                            float ws_drive = nk_propertyf(ctx, "#Drive", 0, dsp_load_f32(&ws->drive), WAVESHAPER_MAX_DRIVE, 0.5f, 0.1f);
+                            dsp_store_f32(&ws->drive, ws_drive);
+                            float ws_bias = nk_propertyf(ctx, "#Bias", -1, dsp_load_f32(&ws->bias), 1, 0.01f, 0.005f);
+                            dsp_store_f32(&ws->bias, ws_bias);
+                            float ws_output = nk_propertyf(ctx, "#Output", -WAVESHAPER_MAX_OUTPUT, dsp_load_f32(&ws->output), WAVESHAPER_MAX_OUTPUT, 0.5f, 0.1f);
+                            dsp_store_f32(&ws->output, ws_output);
+                            float ws_mix = nk_propertyf(ctx, "#Mix", 0, dsp_load_f32(&ws->mix), 1, 0.01f, 0.005f);
+                            dsp_store_f32(&ws->mix, ws_mix);
+                            break;
                     }
                     /* ====================================================*/
                 }
@@ -809,7 +2161,7 @@ static int node_editor(struct nk_context *ctx, struct nk_rect bounds)
             }
             struct nk_vec2 mouse = ctx->input.mouse.pos;
             /* contextual menu */
-            if (nk_contextual_begin(ctx, 0, nk_vec2(150, 220), nk_window_get_bounds(ctx))) {
+            if (nk_contextual_begin(ctx, 0, nk_vec2(150, 940 + 30 * pluginRegistry.count), nk_window_get_bounds(ctx))) {
                 nk_layout_row_dynamic(ctx, 25, 1);
                 if (nk_contextual_item_label(ctx, "New Audio File", NK_TEXT_LEFT))
                     node_editor_add_source_decoder(nodedit, "Decoder", nk_rect(mouse.x, mouse.y, 180, 220),
@@ -829,6 +2181,96 @@ static int node_editor(struct nk_context *ctx, struct nk_rect bounds)
                 if (nk_contextual_item_label(ctx, "New Echo / Delay", NK_TEXT_LEFT))
                     node_editor_add_delay(nodedit, "Echo / Delay", nk_rect(mouse.x, mouse.y, 180, 220),
                              1, 1);
+                if (nk_contextual_item_label(ctx, "New Chorus", NK_TEXT_LEFT))
+                    node_editor_add_chorus(nodedit, "Chorus", nk_rect(mouse.x, mouse.y, 180, 240),
+                             1, 1, 15.0f, 5.0f, 0.8f, 0.0f, 0.5f);
+                if (nk_contextual_item_label(ctx, "New Flanger", NK_TEXT_LEFT))
+                    node_editor_add_chorus(nodedit, "Flanger", nk_rect(mouse.x, mouse.y, 180, 240),
+                             1, 1, 2.5f, 2.0f, 0.25f, 0.7f, 0.5f);
+                if (nk_contextual_item_label(ctx, "New Vibrato", NK_TEXT_LEFT))
+                    node_editor_add_chorus(nodedit, "Vibrato", nk_rect(mouse.x, mouse.y, 180, 240),
+                             1, 1, 5.0f, 3.0f, 5.0f, 0.0f, 1.0f);
+                if (nk_contextual_item_label(ctx, "New Convolution Reverb", NK_TEXT_LEFT))
+                    node_editor_add_convolver(nodedit, "Convolution Reverb", nk_rect(mouse.x, mouse.y, 180, 220),
+                             1, 1, NULL);
+                if (nk_contextual_item_label(ctx, "New Spectral Filter", NK_TEXT_LEFT))
+                    node_editor_add_spectral(nodedit, "Spectral Filter", nk_rect(mouse.x, mouse.y, 180, 220),
+                             1, 1, SPECTRAL_FILTER);
+                if (nk_contextual_item_label(ctx, "New Spectral Gate", NK_TEXT_LEFT))
+                    node_editor_add_spectral(nodedit, "Spectral Gate", nk_rect(mouse.x, mouse.y, 180, 220),
+                             1, 1, SPECTRAL_GATE);
+                if (nk_contextual_item_label(ctx, "New Spectral Freeze", NK_TEXT_LEFT))
+                    node_editor_add_spectral(nodedit, "Spectral Freeze", nk_rect(mouse.x, mouse.y, 180, 220),
+                             1, 1, SPECTRAL_FREEZE);
+                if (nk_contextual_item_label(ctx, "New Parametric EQ", NK_TEXT_LEFT))
+                    node_editor_add_equalizer(nodedit, "Parametric EQ", nk_rect(mouse.x, mouse.y, 180, 240),
+                             1, 1);
+                if (nk_contextual_item_label(ctx, "New Linear-Phase EQ", NK_TEXT_LEFT))
+                    node_editor_add_linear_eq(nodedit, "Linear-Phase EQ", nk_rect(mouse.x, mouse.y, 240, 220),
+                             1, 1);
+                if (nk_contextual_item_label(ctx, "New Saturation", NK_TEXT_LEFT))
+                    node_editor_add_waveshaper(nodedit, "Saturation", nk_rect(mouse.x, mouse.y, 180, 260),
+                             1, 1, WAVESHAPER_SOFT, 12.0f, 2);
+                if (nk_contextual_item_label(ctx, "New Waveshaper", NK_TEXT_LEFT))
+                    node_editor_add_waveshaper(nodedit, "Waveshaper", nk_rect(mouse.x, mouse.y, 180, 260),
+                             1, 1, WAVESHAPER_FOLD, 6.0f, 4);
+                if (nk_contextual_item_label(ctx, "New Reverb", NK_TEXT_LEFT))
+                    node_editor_add_reverb(nodedit, "Reverb", nk_rect(mouse.x, mouse.y, 180, 220),
+                             1, 1);
+                if (nk_contextual_item_label(ctx, "New Mixer", NK_TEXT_LEFT))
+                    node_editor_add_mixer(nodedit, "Mixer", nk_rect(mouse.x, mouse.y, 220, 80 + MIXER_EDITOR_INPUTS * 60),
+                             MIXER_EDITOR_INPUTS, 1);
+                if (nk_contextual_item_label(ctx, "New Compressor", NK_TEXT_LEFT))
+                    node_editor_add_compressor(nodedit, "Compressor", nk_rect(mouse.x, mouse.y, 200, 260),
+                             2, 1, -18.0f, 4.0f, 0.1f);
+                if (nk_contextual_item_label(ctx, "New Limiter", NK_TEXT_LEFT))
+                    node_editor_add_compressor(nodedit, "Limiter", nk_rect(mouse.x, mouse.y, 200, 260),
+                             2, 1, -1.0f, DYNAMICS_MAX_RATIO, 0.1f);
+                if (nk_contextual_item_label(ctx, "New Ducker", NK_TEXT_LEFT))
+                    node_editor_add_compressor(nodedit, "Ducker", nk_rect(mouse.x, mouse.y, 200, 260),
+                             2, 1, -36.0f, 8.0f, DUCKER_RELEASE);
+                if (nk_contextual_item_label(ctx, "New Oscillator", NK_TEXT_LEFT))
+                    node_editor_add_oscillator(nodedit, "Oscillator", nk_rect(mouse.x, mouse.y, 180, 260),
+                             1, 1, OSCILLATOR_SAW, OSCILLATOR_UNISON, 1);
+                if (nk_contextual_item_label(ctx, "New Pad", NK_TEXT_LEFT))
+                    node_editor_add_oscillator(nodedit, "Pad", nk_rect(mouse.x, mouse.y, 180, 260),
+                             1, 1, OSCILLATOR_SAW, OSCILLATOR_UNISON, 7);
+                if (nk_contextual_item_label(ctx, "New Sampler", NK_TEXT_LEFT))
+                    node_editor_add_sampler(nodedit, "Sampler", nk_rect(mouse.x, mouse.y, 200, 420),
+                             1, 1, NULL);
+                if (nk_contextual_item_label(ctx, "New Expression", NK_TEXT_LEFT))
+                    node_editor_add_expression(nodedit, "Expression", nk_rect(mouse.x, mouse.y, 240, 280),
+                             2, 1, "in0 * sin(2*pi*220*t)");
+                if (nk_contextual_item_label(ctx, "New MIDI Player", NK_TEXT_LEFT))
+                    node_editor_add_midi(nodedit, "MIDI Player", nk_rect(mouse.x, mouse.y, 200, 200),
+                             0, 1, NULL);
+                for (ma_uint32 i = 0; i < pluginRegistry.count; i++) {
+                    const struct soundflow_plugin *plugin = pluginRegistry.plugins[i];
+                    char plugin_item[64];
+                    snprintf(plugin_item, sizeof(plugin_item), "New %s", plugin->name);
+                    if (nk_contextual_item_label(ctx, plugin_item, NK_TEXT_LEFT))
+                        node_editor_add_plugin(nodedit, plugin->name,
+                                nk_rect(mouse.x, mouse.y, 200, 80 + 30 * plugin->param_count),
+                                plugin->input_count, plugin->output_count, plugin);
+                }
+                if (nk_contextual_item_label(ctx, "New Granular", NK_TEXT_LEFT))
+                    node_editor_add_granular(nodedit, "Granular", nk_rect(mouse.x, mouse.y, 200, 360),
+                             0, 1, NULL);
+                if (nk_contextual_item_label(ctx, "New White Noise", NK_TEXT_LEFT))
+                    node_editor_add_noise(nodedit, "White Noise", nk_rect(mouse.x, mouse.y, 180, 220),
+                             0, 1, ma_noise_type_white);
+                if (nk_contextual_item_label(ctx, "New Pink Noise", NK_TEXT_LEFT))
+                    node_editor_add_noise(nodedit, "Pink Noise", nk_rect(mouse.x, mouse.y, 180, 220),
+                             0, 1, ma_noise_type_pink);
+                if (nk_contextual_item_label(ctx, "New Brown Noise", NK_TEXT_LEFT))
+                    node_editor_add_noise(nodedit, "Brown Noise", nk_rect(mouse.x, mouse.y, 180, 220),
+                             0, 1, ma_noise_type_brownian);
+                if (nk_contextual_item_label(ctx, "New Time Stretch", NK_TEXT_LEFT))
+                    node_editor_add_stretch(nodedit, "Time Stretch", nk_rect(mouse.x, mouse.y, 180, 220),
+                             1, 1);
+                if (nk_contextual_item_label(ctx, "New Loudness Meter", NK_TEXT_LEFT))
+                    node_editor_add_loudness(nodedit, "Loudness Meter", nk_rect(mouse.x, mouse.y, 180, 260),
+                             1, 1);
                 nk_contextual_end(ctx);
             }
         }
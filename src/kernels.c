@@ -0,0 +1,635 @@
+/*
+ * Runtime selected DSP kernels.
+ *
+ * Everything else is written against the 4-wide v4f layer, which the
+ * compiler targets at the build's baseline: SSE2 on x86-64, since release
+ * builds don't pass -march so one binary runs everywhere. The loops that
+ * dominate the heavier nodes are also compiled for AVX2+FMA and AVX-512
+ * with per-function target attributes, and kernels_init() picks the widest
+ * set the CPU and OS support at startup through cpuid and xgetbv:
+ *
+ *  - the complex multiply-accumulate of partitioned convolution and the
+ *    spectral multiplies of the STFT, flat loops over whole spectra;
+ *  - the FFT's radix passes, across the stride of every stage after the
+ *    first;
+ *  - the mixer's ramped summing of interleaved buses;
+ *  - the biquad wavefront, two channels side by side;
+ *  - channel count conversion: mono to stereo, stereo to mono and the
+ *    general matrix.
+ *
+ * All but the first keep their 4-wide code in fft.c, mixer.c, biquad.c and
+ * channel_mix.c, which runs where the table entry is NULL, as in the
+ * baseline set. Their AVX-512 entries are the AVX2 kernels: eight lanes
+ * already cover a whole mixer group pair, most FFT strides, a stereo pair
+ * of wavefronts and a 7.1 frame, and the memory-bound flat loops are where
+ * sixteen lanes pay. Sample format conversion is miniaudio's, at the
+ * device and decoder edges, and has no kernel here.
+ *
+ * Kernels are called through the `kernels` table, which starts out with
+ * the baseline set so code that never calls kernels_init() (benchmarks,
+ * plugins) still works. SOUNDFLOW_KERNELS=baseline|avx2|avx512 caps the
+ * choice, for comparing variants on one machine.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dsp.h"
+
+#if defined(DSP_SSE2) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64))
+    #define KERNELS_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define KERNELS_TARGET(features)
+    #else
+        #include <cpuid.h>
+        #define KERNELS_TARGET(features) __attribute__((target(features)))
+    #endif
+#endif
+
+enum kernels_level {
+    KERNELS_BASELINE,
+    KERNELS_AVX2,
+    KERNELS_AVX512,
+    KERNELS_LEVEL_COUNT
+};
+
+static const char *kernels_level_names[KERNELS_LEVEL_COUNT] = {
+    "baseline", "avx2", "avx512",
+};
+
+#define KERNELS_MIX_CHANNELS    8       /* Widest bus the mix kernel takes */
+
+/* Constants of the radix 3 and 5 butterflies, shared by fft.c. */
+#define FFT_C3  -0.5f
+#define FFT_S3  0.86602540378443864676f
+#define FFT_C51 0.30901699437494742410f
+#define FFT_C52 -0.80901699437494742410f
+#define FFT_S51 0.95105651629515357212f
+#define FFT_S52 0.58778525229247312917f
+
+struct kernel_table {
+    const char *name;
+
+    /* acc += x * h, complex and split, over `count` bins; count a multiple of 4. */
+    void (*cmac)(float *acc_re, float *acc_im, const float *xr, const float *xi,
+            const float *hr, const float *hi, ma_uint32 count);
+    /* dst[i] = a[i] * b[i] */
+    void (*multiply)(float *dst, const float *a, const float *b, ma_uint32 n);
+    /* dst[i] += a[i] * b[i] */
+    void (*multiply_add)(float *dst, const float *a, const float *b, ma_uint32 n);
+
+    /*
+     * One Stockham pass of the FFT for a stride that is a multiple of 8:
+     * y[q + s(rp + u)] = W^(pu) * DFT_r(x[q + s(p + tm)])[u], with the
+     * stage's (radix - 1) rows of m twiddles (see fft.c).
+     */
+    void (*fft_stage)(ma_uint32 radix, ma_uint32 stride, ma_uint32 m, const float *tw_re, const float *tw_im,
+            const float *xr, const float *xi, float *yr, float *yi);
+    /*
+     * out (=|+=) sum of in[i] * gain over `count` <= 4 inputs, for `groups`
+     * groups of four frames of a bus of at most KERNELS_MIX_CHANNELS. The
+     * gains of input i are pattern[i] in the first group, `channels` vectors
+     * of four, plus step[i] per group (see mixer.c).
+     */
+    void (*mix)(float *out, const float **in, const float **pattern, const float **step,
+            ma_uint32 count, ma_uint32 channels, ma_uint32 groups, bool first);
+    /*
+     * Four cascaded biquad sections as a wavefront (see biquad.c) over `n`
+     * frames of two adjacent channels of an interleaved buffer: `out` and
+     * `in` point at the first, `stride` floats per frame. `c` holds b0, b1,
+     * b2, a1 and a2 of the four sections, four floats each; the second
+     * channel's state is `z_stride` floats after the first's.
+     */
+    void (*biquad_pair)(float *out, const float *in, ma_uint32 n, ma_uint32 stride, const float *c,
+            float *z1, float *z2, ma_uint32 z_stride);
+    /* Interleaved stereo from mono: out[2f] = in[f] * left, out[2f + 1] = in[f] * right. */
+    void (*mono_to_stereo)(float *out, const float *in, ma_uint32 frame_count, float left, float right);
+    /* Mono from interleaved stereo: out[f] = in[2f] * left + in[2f + 1] * right. */
+    void (*stereo_to_mono)(float *out, const float *in, ma_uint32 frame_count, float left, float right);
+    /*
+     * out = matrix * in for every frame, `matrix` holding a column of
+     * `stride` output gains (a multiple of 4, zero padded) per input
+     * channel (see channel_mix.c).
+     */
+    void (*channel_matrix)(float *out, const float *in, ma_uint32 frame_count, const float *matrix,
+            ma_uint32 channels_in, ma_uint32 channels_out, ma_uint32 stride);
+};
+
+/*
+ * Baseline: the v4f layer, SSE2, NEON or scalar.
+ */
+static void kernels_cmac_v4f(float *acc_re, float *acc_im, const float *xr, const float *xi,
+        const float *hr, const float *hi, ma_uint32 count)
+{
+    for (ma_uint32 k = 0; k < count; k += 4) {
+        v4f a = v4f_load(xr + k), b = v4f_load(xi + k);
+        v4f c = v4f_load(hr + k), d = v4f_load(hi + k);
+        v4f_store(acc_re + k, v4f_sub(v4f_madd(a, c, v4f_load(acc_re + k)), v4f_mul(b, d)));
+        v4f_store(acc_im + k, v4f_madd(a, d, v4f_madd(b, c, v4f_load(acc_im + k))));
+    }
+}
+
+static void kernels_multiply_v4f(float *dst, const float *a, const float *b, ma_uint32 n)
+{
+    ma_uint32 i = 0;
+    for (; i + 4 <= n; i += 4)
+        v4f_store(dst + i, v4f_mul(v4f_load(a + i), v4f_load(b + i)));
+    for (; i < n; i++)
+        dst[i] = a[i] * b[i];
+}
+
+static void kernels_multiply_add_v4f(float *dst, const float *a, const float *b, ma_uint32 n)
+{
+    ma_uint32 i = 0;
+    for (; i + 4 <= n; i += 4)
+        v4f_store(dst + i, v4f_madd(v4f_load(a + i), v4f_load(b + i), v4f_load(dst + i)));
+    for (; i < n; i++)
+        dst[i] += a[i] * b[i];
+}
+
+#if defined(KERNELS_X86)
+/*
+ * AVX2 + FMA: eight lanes, the last group of four falls back to the
+ * baseline kernel.
+ */
+KERNELS_TARGET("avx2,fma")
+static void kernels_cmac_avx2(float *acc_re, float *acc_im, const float *xr, const float *xi,
+        const float *hr, const float *hi, ma_uint32 count)
+{
+    ma_uint32 k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 a = _mm256_loadu_ps(xr + k), b = _mm256_loadu_ps(xi + k);
+        __m256 c = _mm256_loadu_ps(hr + k), d = _mm256_loadu_ps(hi + k);
+        __m256 re = _mm256_fmadd_ps(a, c, _mm256_loadu_ps(acc_re + k));
+        __m256 im = _mm256_fmadd_ps(a, d, _mm256_loadu_ps(acc_im + k));
+        _mm256_storeu_ps(acc_re + k, _mm256_fnmadd_ps(b, d, re));
+        _mm256_storeu_ps(acc_im + k, _mm256_fmadd_ps(b, c, im));
+    }
+    if (k < count)
+        kernels_cmac_v4f(acc_re + k, acc_im + k, xr + k, xi + k, hr + k, hi + k, count - k);
+}
+
+KERNELS_TARGET("avx2,fma")
+static void kernels_multiply_avx2(float *dst, const float *a, const float *b, ma_uint32 n)
+{
+    ma_uint32 i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    for (; i < n; i++)
+        dst[i] = a[i] * b[i];
+}
+
+KERNELS_TARGET("avx2,fma")
+static void kernels_multiply_add_avx2(float *dst, const float *a, const float *b, ma_uint32 n)
+{
+    ma_uint32 i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), _mm256_loadu_ps(dst + i)));
+    for (; i < n; i++)
+        dst[i] += a[i] * b[i];
+}
+
+/* fft_dft_v4f of fft.c, eight lanes wide. */
+KERNELS_TARGET("avx2,fma")
+static inline void kernels_dft_avx2(ma_uint32 radix, __m256 *re, __m256 *im)
+{
+    __m256 t0r, t0i, t1r, t1i, t2r, t2i, t3r, t3i;
+
+    switch (radix) {
+    case 2:
+        t0r = re[0]; t0i = im[0];
+        re[0] = _mm256_add_ps(t0r, re[1]); im[0] = _mm256_add_ps(t0i, im[1]);
+        re[1] = _mm256_sub_ps(t0r, re[1]); im[1] = _mm256_sub_ps(t0i, im[1]);
+        break;
+    case 3: {
+        __m256 sr = _mm256_add_ps(re[1], re[2]), si = _mm256_add_ps(im[1], im[2]);
+        __m256 dr = _mm256_mul_ps(_mm256_sub_ps(re[1], re[2]), _mm256_set1_ps(FFT_S3));
+        __m256 di = _mm256_mul_ps(_mm256_sub_ps(im[1], im[2]), _mm256_set1_ps(FFT_S3));
+        __m256 mr = _mm256_fmadd_ps(sr, _mm256_set1_ps(FFT_C3), re[0]), mi = _mm256_fmadd_ps(si, _mm256_set1_ps(FFT_C3), im[0]);
+        re[0] = _mm256_add_ps(re[0], sr); im[0] = _mm256_add_ps(im[0], si);
+        re[1] = _mm256_add_ps(mr, di); im[1] = _mm256_sub_ps(mi, dr);
+        re[2] = _mm256_sub_ps(mr, di); im[2] = _mm256_add_ps(mi, dr);
+        break;
+    }
+    case 4:
+        t0r = _mm256_add_ps(re[0], re[2]); t0i = _mm256_add_ps(im[0], im[2]);
+        t1r = _mm256_sub_ps(re[0], re[2]); t1i = _mm256_sub_ps(im[0], im[2]);
+        t2r = _mm256_add_ps(re[1], re[3]); t2i = _mm256_add_ps(im[1], im[3]);
+        t3r = _mm256_sub_ps(re[1], re[3]); t3i = _mm256_sub_ps(im[1], im[3]);
+        re[0] = _mm256_add_ps(t0r, t2r); im[0] = _mm256_add_ps(t0i, t2i);
+        re[2] = _mm256_sub_ps(t0r, t2r); im[2] = _mm256_sub_ps(t0i, t2i);
+        re[1] = _mm256_add_ps(t1r, t3i); im[1] = _mm256_sub_ps(t1i, t3r);
+        re[3] = _mm256_sub_ps(t1r, t3i); im[3] = _mm256_add_ps(t1i, t3r);
+        break;
+    case 5: {
+        __m256 s14r = _mm256_add_ps(re[1], re[4]), s14i = _mm256_add_ps(im[1], im[4]);
+        __m256 d14r = _mm256_sub_ps(re[1], re[4]), d14i = _mm256_sub_ps(im[1], im[4]);
+        __m256 s23r = _mm256_add_ps(re[2], re[3]), s23i = _mm256_add_ps(im[2], im[3]);
+        __m256 d23r = _mm256_sub_ps(re[2], re[3]), d23i = _mm256_sub_ps(im[2], im[3]);
+        __m256 c1 = _mm256_set1_ps(FFT_C51), c2 = _mm256_set1_ps(FFT_C52);
+        __m256 s1 = _mm256_set1_ps(FFT_S51), s2 = _mm256_set1_ps(FFT_S52);
+        __m256 a1r = _mm256_fmadd_ps(c2, s23r, _mm256_fmadd_ps(c1, s14r, re[0]));
+        __m256 a1i = _mm256_fmadd_ps(c2, s23i, _mm256_fmadd_ps(c1, s14i, im[0]));
+        __m256 a2r = _mm256_fmadd_ps(c1, s23r, _mm256_fmadd_ps(c2, s14r, re[0]));
+        __m256 a2i = _mm256_fmadd_ps(c1, s23i, _mm256_fmadd_ps(c2, s14i, im[0]));
+        __m256 b1r = _mm256_fmadd_ps(s2, d23r, _mm256_mul_ps(s1, d14r));
+        __m256 b1i = _mm256_fmadd_ps(s2, d23i, _mm256_mul_ps(s1, d14i));
+        __m256 b2r = _mm256_fmsub_ps(s2, d14r, _mm256_mul_ps(s1, d23r));
+        __m256 b2i = _mm256_fmsub_ps(s2, d14i, _mm256_mul_ps(s1, d23i));
+        re[0] = _mm256_add_ps(re[0], _mm256_add_ps(s14r, s23r)); im[0] = _mm256_add_ps(im[0], _mm256_add_ps(s14i, s23i));
+        re[1] = _mm256_add_ps(a1r, b1i); im[1] = _mm256_sub_ps(a1i, b1r);
+        re[4] = _mm256_sub_ps(a1r, b1i); im[4] = _mm256_add_ps(a1i, b1r);
+        re[2] = _mm256_add_ps(a2r, b2i); im[2] = _mm256_sub_ps(a2i, b2r);
+        re[3] = _mm256_sub_ps(a2r, b2i); im[3] = _mm256_add_ps(a2i, b2r);
+        break;
+    }
+    }
+}
+
+KERNELS_TARGET("avx2,fma")
+static void kernels_fft_stage_avx2(ma_uint32 r, ma_uint32 s, ma_uint32 m, const float *tw_re, const float *tw_im,
+        const float *xr, const float *xi, float *yr, float *yi)
+{
+    __m256 ar[5], ai[5], wr[5], wi[5];
+
+    for (ma_uint32 p = 0; p < m; p++) {
+        for (ma_uint32 u = 1; u < r; u++) {
+            wr[u] = _mm256_set1_ps(tw_re[(u - 1) * m + p]);
+            wi[u] = _mm256_set1_ps(tw_im[(u - 1) * m + p]);
+        }
+        for (ma_uint32 q = 0; q < s; q += 8) {
+            for (ma_uint32 t = 0; t < r; t++) {
+                ar[t] = _mm256_loadu_ps(xr + q + s * (p + t * m));
+                ai[t] = _mm256_loadu_ps(xi + q + s * (p + t * m));
+            }
+            kernels_dft_avx2(r, ar, ai);
+            _mm256_storeu_ps(yr + q + s * r * p, ar[0]);
+            _mm256_storeu_ps(yi + q + s * r * p, ai[0]);
+            for (ma_uint32 u = 1; u < r; u++) {
+                __m256 re = _mm256_fmsub_ps(ar[u], wr[u], _mm256_mul_ps(ai[u], wi[u]));
+                __m256 im = _mm256_fmadd_ps(ar[u], wi[u], _mm256_mul_ps(ai[u], wr[u]));
+                _mm256_storeu_ps(yr + q + s * (r * p + u), re);
+                _mm256_storeu_ps(yi + q + s * (r * p + u), im);
+            }
+        }
+    }
+}
+
+/*
+ * Two groups of four frames per pass: vector j of a pair covers the
+ * four-lane vectors 2j and 2j + 1, which may belong to different groups
+ * and so ramp from different starting gains.
+ */
+KERNELS_TARGET("avx2,fma")
+static void kernels_mix_avx2(float *out, const float **in, const float **pattern, const float **step,
+        ma_uint32 count, ma_uint32 channels, ma_uint32 groups, bool first)
+{
+    __m256 p[4][KERNELS_MIX_CHANNELS], d[4][KERNELS_MIX_CHANNELS];
+    const ma_uint32 pairs = groups / 2;
+
+    for (ma_uint32 i = 0; i < count; i++) {
+        for (ma_uint32 j = 0; j < channels; j++) {
+            const ma_uint32 v0 = (2 * j) % channels, g0 = (2 * j) / channels;
+            const ma_uint32 v1 = (2 * j + 1) % channels, g1 = (2 * j + 1) / channels;
+            __m128 s0 = _mm_loadu_ps(step[i] + 4 * v0), s1 = _mm_loadu_ps(step[i] + 4 * v1);
+            __m128 lo = _mm_fmadd_ps(_mm_set1_ps((float)g0), s0, _mm_loadu_ps(pattern[i] + 4 * v0));
+            __m128 hi = _mm_fmadd_ps(_mm_set1_ps((float)g1), s1, _mm_loadu_ps(pattern[i] + 4 * v1));
+            p[i][j] = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+            d[i][j] = _mm256_mul_ps(_mm256_set1_ps(2.0f), _mm256_insertf128_ps(_mm256_castps128_ps256(s0), s1, 1));
+        }
+    }
+
+    for (ma_uint32 h = 0; h < pairs; h++) {
+        for (ma_uint32 j = 0; j < channels; j++) {
+            size_t at = ((size_t)h * channels + j) * 8;
+            __m256 acc = first ? _mm256_setzero_ps() : _mm256_loadu_ps(out + at);
+            for (ma_uint32 i = 0; i < count; i++) {
+                acc = _mm256_fmadd_ps(_mm256_loadu_ps(in[i] + at), p[i][j], acc);
+                p[i][j] = _mm256_add_ps(p[i][j], d[i][j]);
+            }
+            _mm256_storeu_ps(out + at, acc);
+        }
+    }
+
+    /* An odd last group, four lanes at a time. */
+    if (groups & 1) {
+        const ma_uint32 g = groups - 1;
+        for (ma_uint32 v = 0; v < channels; v++) {
+            size_t at = ((size_t)g * channels + v) * 4;
+            __m128 acc = first ? _mm_setzero_ps() : _mm_loadu_ps(out + at);
+            for (ma_uint32 i = 0; i < count; i++) {
+                __m128 gain = _mm_fmadd_ps(_mm_set1_ps((float)g), _mm_loadu_ps(step[i] + 4 * v), _mm_loadu_ps(pattern[i] + 4 * v));
+                acc = _mm_fmadd_ps(_mm_loadu_ps(in[i] + at), gain, acc);
+            }
+            _mm_storeu_ps(out + at, acc);
+        }
+    }
+}
+
+KERNELS_TARGET("avx2,fma")
+static inline __m256 kernels_load_halves(const float *lo, const float *hi)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(hi), 1);
+}
+
+/* Sections are busy at step t where 0 <= t - lane < n; the same four lanes in each half. */
+KERNELS_TARGET("avx2,fma")
+static inline __m256 kernels_biquad_valid_avx2(ma_uint32 t, ma_uint32 n)
+{
+    const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 0.0f, 1.0f, 2.0f, 3.0f);
+    const __m256 ft = _mm256_set1_ps((float)t);
+    return _mm256_and_ps(_mm256_cmp_ps(ft, lane, _CMP_GE_OQ),
+            _mm256_cmp_ps(_mm256_add_ps(lane, _mm256_set1_ps((float)n)), ft, _CMP_GT_OQ));
+}
+
+/*
+ * One channel's wavefront per 128-bit half. The AVX2 byte shift works
+ * within each half, so it hands every section's output to the next section
+ * of the same channel, and both inputs are blended in at lanes 0 and 4.
+ */
+KERNELS_TARGET("avx2,fma")
+static void kernels_biquad_pair_avx2(float *out, const float *in, ma_uint32 n, ma_uint32 stride, const float *c,
+        float *z1s, float *z2s, ma_uint32 z_stride)
+{
+    const __m256 b0 = kernels_load_halves(c, c), b1 = kernels_load_halves(c + 4, c + 4);
+    const __m256 b2 = kernels_load_halves(c + 8, c + 8);
+    const __m256 a1 = kernels_load_halves(c + 12, c + 12), a2 = kernels_load_halves(c + 16, c + 16);
+    __m256 z1 = kernels_load_halves(z1s, z1s + z_stride), z2 = kernels_load_halves(z2s, z2s + z_stride);
+    __m256 y = _mm256_setzero_ps();
+    const ma_uint32 lag = 3;
+    ma_uint32 t = 0;
+
+#define KERNELS_BIQUAD_STEP(a, b)                                                               \
+    do {                                                                                        \
+        __m256 x = _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(y), 4));           \
+        x = _mm256_blend_ps(x, _mm256_setr_ps(a, 0.0f, 0.0f, 0.0f, b, 0.0f, 0.0f, 0.0f), 0x11);  \
+        y = _mm256_fmadd_ps(b0, x, z1);                                                         \
+        nz1 = _mm256_fnmadd_ps(a1, y, _mm256_fmadd_ps(b1, x, z2));                              \
+        nz2 = _mm256_fnmadd_ps(a2, y, _mm256_mul_ps(b2, x));                                    \
+    } while (0)
+
+#define KERNELS_BIQUAD_OUT(f)                                                                   \
+    do {                                                                                        \
+        __m128 lo = _mm256_castps256_ps128(y), hi = _mm256_extractf128_ps(y, 1);                \
+        out[(f) * stride] = _mm_cvtss_f32(_mm_shuffle_ps(lo, lo, _MM_SHUFFLE(3, 3, 3, 3)));     \
+        out[(f) * stride + 1] = _mm_cvtss_f32(_mm_shuffle_ps(hi, hi, _MM_SHUFFLE(3, 3, 3, 3))); \
+    } while (0)
+
+    /* Prologue: later sections have no input yet. */
+    for (; t < DSP_MIN(lag, n); t++) {
+        __m256 nz1, nz2, valid = kernels_biquad_valid_avx2(t, n);
+        KERNELS_BIQUAD_STEP(in[t * stride], in[t * stride + 1]);
+        z1 = _mm256_blendv_ps(z1, nz1, valid);
+        z2 = _mm256_blendv_ps(z2, nz2, valid);
+    }
+
+    /* Steady state: every section busy. */
+    for (; t < n; t++) {
+        __m256 nz1, nz2;
+        KERNELS_BIQUAD_STEP(in[t * stride], in[t * stride + 1]);
+        z1 = nz1;
+        z2 = nz2;
+        KERNELS_BIQUAD_OUT(t - lag);
+    }
+
+    /* Epilogue: drain the samples still travelling through later sections. */
+    for (; t < n + lag; t++) {
+        __m256 nz1, nz2, valid = kernels_biquad_valid_avx2(t, n);
+        KERNELS_BIQUAD_STEP(0.0f, 0.0f);
+        z1 = _mm256_blendv_ps(z1, nz1, valid);
+        z2 = _mm256_blendv_ps(z2, nz2, valid);
+        if (t >= lag)
+            KERNELS_BIQUAD_OUT(t - lag);
+    }
+#undef KERNELS_BIQUAD_STEP
+#undef KERNELS_BIQUAD_OUT
+
+    __m128 lo, hi;
+    lo = _mm256_castps256_ps128(z1), hi = _mm256_extractf128_ps(z1, 1);
+    _mm_storeu_ps(z1s, lo);
+    _mm_storeu_ps(z1s + z_stride, hi);
+    lo = _mm256_castps256_ps128(z2), hi = _mm256_extractf128_ps(z2, 1);
+    _mm_storeu_ps(z2s, lo);
+    _mm_storeu_ps(z2s + z_stride, hi);
+}
+
+KERNELS_TARGET("avx2,fma")
+static void kernels_mono_to_stereo_avx2(float *out, const float *in, ma_uint32 frame_count, float left, float right)
+{
+    const __m256 gains = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+    const __m256i lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3), hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    ma_uint32 f = 0;
+    for (; f + 8 <= frame_count; f += 8) {
+        __m256 x = _mm256_loadu_ps(in + f);
+        _mm256_storeu_ps(out + 2 * f, _mm256_mul_ps(_mm256_permutevar8x32_ps(x, lo), gains));
+        _mm256_storeu_ps(out + 2 * f + 8, _mm256_mul_ps(_mm256_permutevar8x32_ps(x, hi), gains));
+    }
+    for (; f < frame_count; f++) {
+        out[2 * f] = in[f] * left;
+        out[2 * f + 1] = in[f] * right;
+    }
+}
+
+/* Pairwise sums of the weighted frames come out as frames 0 1 4 5 2 3 6 7, put back in order per 64 bits. */
+KERNELS_TARGET("avx2,fma")
+static void kernels_stereo_to_mono_avx2(float *out, const float *in, ma_uint32 frame_count, float left, float right)
+{
+    const __m256 gains = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+    ma_uint32 f = 0;
+    for (; f + 8 <= frame_count; f += 8) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + 2 * f), gains);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + 2 * f + 8), gains);
+        __m256d sums = _mm256_castps_pd(_mm256_hadd_ps(a, b));
+        _mm256_storeu_ps(out + f, _mm256_castpd_ps(_mm256_permute4x64_pd(sums, _MM_SHUFFLE(3, 1, 2, 0))));
+    }
+    for (; f < frame_count; f++)
+        out[f] = in[2 * f] * left + in[2 * f + 1] * right;
+}
+
+/*
+ * The matrix eight outputs per vector, four frames at a time, with a 4-wide
+ * top vector where the stride is an odd multiple of 4. As in channel_mix.c
+ * the vectors go from last to first, so the padding lanes only spill into
+ * the next frame before it is stored.
+ */
+KERNELS_TARGET("avx2,fma")
+static void kernels_channel_matrix_avx2(float *out, const float *in, ma_uint32 frame_count, const float *matrix,
+        ma_uint32 cin, ma_uint32 cout, ma_uint32 stride)
+{
+    const ma_uint32 wide = stride & ~7u;
+    ma_uint32 f = 0;
+
+    for (; f + 4 <= frame_count && (size_t)(f + 3) * cout + stride <= (size_t)frame_count * cout; f += 4) {
+        const float *x = in + (size_t)f * cin;
+        float *y = out + (size_t)f * cout;
+        if (wide != stride) {
+            __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps(), acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+            for (ma_uint32 i = 0; i < cin; i++) {
+                __m128 column = _mm_loadu_ps(matrix + (size_t)i * stride + wide);
+                acc0 = _mm_fmadd_ps(column, _mm_broadcast_ss(x + i), acc0);
+                acc1 = _mm_fmadd_ps(column, _mm_broadcast_ss(x + cin + i), acc1);
+                acc2 = _mm_fmadd_ps(column, _mm_broadcast_ss(x + 2 * cin + i), acc2);
+                acc3 = _mm_fmadd_ps(column, _mm_broadcast_ss(x + 3 * cin + i), acc3);
+            }
+            _mm_storeu_ps(y + wide, acc0);
+            _mm_storeu_ps(y + cout + wide, acc1);
+            _mm_storeu_ps(y + 2 * cout + wide, acc2);
+            _mm_storeu_ps(y + 3 * cout + wide, acc3);
+        }
+        for (ma_uint32 end = wide; end > 0; end -= 8) {
+            const ma_uint32 v = end - 8;
+            __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+            __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+            for (ma_uint32 i = 0; i < cin; i++) {
+                __m256 column = _mm256_loadu_ps(matrix + (size_t)i * stride + v);
+                acc0 = _mm256_fmadd_ps(column, _mm256_broadcast_ss(x + i), acc0);
+                acc1 = _mm256_fmadd_ps(column, _mm256_broadcast_ss(x + cin + i), acc1);
+                acc2 = _mm256_fmadd_ps(column, _mm256_broadcast_ss(x + 2 * cin + i), acc2);
+                acc3 = _mm256_fmadd_ps(column, _mm256_broadcast_ss(x + 3 * cin + i), acc3);
+            }
+            _mm256_storeu_ps(y + v, acc0);
+            _mm256_storeu_ps(y + cout + v, acc1);
+            _mm256_storeu_ps(y + 2 * cout + v, acc2);
+            _mm256_storeu_ps(y + 3 * cout + v, acc3);
+        }
+    }
+    for (; f < frame_count; f++) {
+        const float *x = in + (size_t)f * cin;
+        for (ma_uint32 o = 0; o < cout; o++) {
+            float acc = 0.0f;
+            for (ma_uint32 i = 0; i < cin; i++)
+                acc += matrix[(size_t)i * stride + o] * x[i];
+            out[(size_t)f * cout + o] = acc;
+        }
+    }
+}
+
+/*
+ * AVX-512: sixteen lanes, with a masked last group so there is no tail loop.
+ */
+KERNELS_TARGET("avx512f")
+static void kernels_cmac_avx512(float *acc_re, float *acc_im, const float *xr, const float *xi,
+        const float *hr, const float *hi, ma_uint32 count)
+{
+    for (ma_uint32 k = 0; k < count; k += 16) {
+        __mmask16 m = count - k >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - k)) - 1);
+        __m512 a = _mm512_maskz_loadu_ps(m, xr + k), b = _mm512_maskz_loadu_ps(m, xi + k);
+        __m512 c = _mm512_maskz_loadu_ps(m, hr + k), d = _mm512_maskz_loadu_ps(m, hi + k);
+        __m512 re = _mm512_fmadd_ps(a, c, _mm512_maskz_loadu_ps(m, acc_re + k));
+        __m512 im = _mm512_fmadd_ps(a, d, _mm512_maskz_loadu_ps(m, acc_im + k));
+        _mm512_mask_storeu_ps(acc_re + k, m, _mm512_fnmadd_ps(b, d, re));
+        _mm512_mask_storeu_ps(acc_im + k, m, _mm512_fmadd_ps(b, c, im));
+    }
+}
+
+KERNELS_TARGET("avx512f")
+static void kernels_multiply_avx512(float *dst, const float *a, const float *b, ma_uint32 n)
+{
+    for (ma_uint32 i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(dst + i, m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i)));
+    }
+}
+
+KERNELS_TARGET("avx512f")
+static void kernels_multiply_add_avx512(float *dst, const float *a, const float *b, ma_uint32 n)
+{
+    for (ma_uint32 i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(dst + i, m, _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i),
+                _mm512_maskz_loadu_ps(m, b + i), _mm512_maskz_loadu_ps(m, dst + i)));
+    }
+}
+
+static void kernels_cpuid(ma_uint32 leaf, ma_uint32 subleaf, ma_uint32 regs[4])
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++)
+        regs[i] = (ma_uint32)r[i];
+#else
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    if (!__get_cpuid_count(leaf, subleaf, &a, &b, &c, &d))
+        a = b = c = d = 0;
+    regs[0] = a, regs[1] = b, regs[2] = c, regs[3] = d;
+#endif
+}
+
+/* XCR0: which register states the OS saves on a context switch. */
+static ma_uint64 kernels_xgetbv(void)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    ma_uint32 lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((ma_uint64)hi << 32) | lo;
+#endif
+}
+
+static enum kernels_level kernels_detect(void)
+{
+    ma_uint32 regs[4];
+    kernels_cpuid(0, 0, regs);
+    const ma_uint32 max_leaf = regs[0];
+    if (max_leaf < 7)
+        return KERNELS_BASELINE;
+
+    kernels_cpuid(1, 0, regs);
+    const bool osxsave = (regs[2] >> 27) & 1, avx = (regs[2] >> 28) & 1, fma = (regs[2] >> 12) & 1;
+    if (!osxsave || !avx || !fma)
+        return KERNELS_BASELINE;
+    const ma_uint64 xcr0 = kernels_xgetbv();
+    if ((xcr0 & 0x6) != 0x6)            /* XMM and YMM state */
+        return KERNELS_BASELINE;
+
+    kernels_cpuid(7, 0, regs);
+    const bool avx2 = (regs[1] >> 5) & 1, avx512f = (regs[1] >> 16) & 1;
+    if (!avx2)
+        return KERNELS_BASELINE;
+    if (avx512f && (xcr0 & 0xE0) == 0xE0)   /* Opmask and ZMM state */
+        return KERNELS_AVX512;
+    return KERNELS_AVX2;
+}
+#else
+static enum kernels_level kernels_detect(void)
+{
+    return KERNELS_BASELINE;
+}
+#endif
+
+static const struct kernel_table kernels_variants[KERNELS_LEVEL_COUNT] = {
+    { "baseline", kernels_cmac_v4f, kernels_multiply_v4f, kernels_multiply_add_v4f,
+        NULL, NULL, NULL, NULL, NULL, NULL },
+#if defined(KERNELS_X86)
+    { "avx2", kernels_cmac_avx2, kernels_multiply_avx2, kernels_multiply_add_avx2,
+        kernels_fft_stage_avx2, kernels_mix_avx2, kernels_biquad_pair_avx2,
+        kernels_mono_to_stereo_avx2, kernels_stereo_to_mono_avx2, kernels_channel_matrix_avx2 },
+    { "avx512", kernels_cmac_avx512, kernels_multiply_avx512, kernels_multiply_add_avx512,
+        kernels_fft_stage_avx2, kernels_mix_avx2, kernels_biquad_pair_avx2,
+        kernels_mono_to_stereo_avx2, kernels_stereo_to_mono_avx2, kernels_channel_matrix_avx2 },
+#endif
+};
+
+static struct kernel_table kernels = {
+    "baseline", kernels_cmac_v4f, kernels_multiply_v4f, kernels_multiply_add_v4f,
+    NULL, NULL, NULL, NULL, NULL, NULL
+};
+
+/* Selects a variant. Call once at startup, before any audio runs; returns the variant's name. */
+static const char *kernels_init(void)
+{
+    enum kernels_level level = kernels_detect();
+
+    const char *cap = getenv("SOUNDFLOW_KERNELS");
+    if (cap != NULL) {
+        for (int i = 0; i < KERNELS_LEVEL_COUNT; i++)
+            if (strcmp(cap, kernels_level_names[i]) == 0 && (enum kernels_level)i < level)
+                level = (enum kernels_level)i;
+    }
+    kernels = kernels_variants[level];
+    return kernels.name;
+}
@@ -0,0 +1,369 @@
+/*
+ * Linear-phase EQ.
+ *
+ * The response is a curve through ten points an octave apart, from 31 Hz
+ * to 16 kHz, in dB. The curve is sampled at every bin of a
+ * LINEAR_EQ_TAPS-point spectrum with zero phase, transformed back, centred
+ * and windowed: a symmetric FIR, so every frequency is delayed by the same
+ * LINEAR_EQ_TAPS / 2 frames and nothing is phase shifted. The FIR runs on
+ * the partitioned convolver from convolver.c.
+ *
+ * Redesigns happen on a worker thread. The audio thread notices a moved
+ * point once per block and posts the new curve; the worker designs into
+ * the spare set of partition spectra and reports back; the audio thread
+ * then runs one block through both filters over the same input history
+ * and crossfades, and the spare becomes current. There is at most one
+ * design in flight, and the last curve posted always wins.
+ *
+ * The node's latency, LINEAR_EQ_BLOCK + LINEAR_EQ_TAPS / 2 frames, is
+ * reported through linear_eq_get_latency() for the editor's delay
+ * compensation.
+ */
+#include <pthread.h>
+
+#include "dsp.h"
+
+#define LINEAR_EQ_TAPS          8192
+#define LINEAR_EQ_BLOCK         256     /* Partition size, and the crossfade length */
+#define LINEAR_EQ_POINTS        10
+#define LINEAR_EQ_FIRST_HZ      31.25   /* Points at LINEAR_EQ_FIRST_HZ * 2^i */
+#define LINEAR_EQ_MAX_GAIN      18.0f   /* dB */
+
+struct linear_eq_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    float gains[LINEAR_EQ_POINTS];      /* dB */
+};
+
+struct linear_eq {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+
+    /* Written by the UI thread, read once per block. */
+    float gains[LINEAR_EQ_POINTS];
+
+    /*
+     * Redesigns. The audio thread writes `design` and bumps `posted` only
+     * while the worker is idle and its last result has been taken, so the
+     * worker owns `design` and the spare spectra until it bumps `done`.
+     */
+    float design[LINEAR_EQ_POINTS];
+    ma_uint32 posted;
+    ma_uint32 done;
+    ma_uint32 quit;
+    struct dsp_wake wake;
+    pthread_t thread;
+    bool running;
+
+    /* Audio thread only. */
+    ma_uint32 applied;          /* Designs swapped in so far. */
+    struct upols conv;
+    float *current_re, *current_im;
+    float *spare_re, *spare_im;
+    float *in_block;            /* [channel][LINEAR_EQ_BLOCK], planar */
+    float *out_block;
+    float *fade_block;
+    ma_uint32 pos;
+
+    /* Worker (and init) only. */
+    const struct fft_plan *plan;        /* LINEAR_EQ_TAPS points */
+    float *response_re, *response_im;
+    float *fir;
+    float *design_time;
+    float *design_scratch;
+    struct dsp_arena arena;
+};
+
+static struct linear_eq_config linear_eq_config_init(ma_uint32 channels, ma_uint32 sample_rate)
+{
+    struct linear_eq_config config;
+    memset(&config, 0, sizeof(config));
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    return config;
+}
+
+static double linear_eq_point_frequency(ma_uint32 point)
+{
+    return LINEAR_EQ_FIRST_HZ * (double)(1u << point);
+}
+
+/* Gain in dB at `frequency`: smoothstep between neighbouring points on a log frequency axis, flat beyond the ends. */
+static float linear_eq_curve(const float *gains, double frequency)
+{
+    double x = log2(DSP_MAX(frequency, 1.0) / LINEAR_EQ_FIRST_HZ);
+    if (x <= 0.0)
+        return gains[0];
+    if (x >= LINEAR_EQ_POINTS - 1)
+        return gains[LINEAR_EQ_POINTS - 1];
+    ma_uint32 i = (ma_uint32)x;
+    float u = (float)(x - i);
+    u = u * u * (3.0f - 2.0f * u);
+    return gains[i] + (gains[i + 1] - gains[i]) * u;
+}
+
+/* The windowed, centred FIR for `gains` into eq->fir. */
+static void linear_eq_design_fir(struct linear_eq *eq, const float *gains)
+{
+    const ma_uint32 N = LINEAR_EQ_TAPS;
+    const double bin_hz = (double)eq->sample_rate / N;
+    float clamped[LINEAR_EQ_POINTS];
+
+    for (ma_uint32 i = 0; i < LINEAR_EQ_POINTS; i++)
+        clamped[i] = DSP_CLAMP(gains[i], -LINEAR_EQ_MAX_GAIN, LINEAR_EQ_MAX_GAIN);
+
+    /* Zero phase, with the 1/N of the inverse transform folded in. */
+    for (ma_uint32 k = 0; k <= N / 2; k++) {
+        eq->response_re[k] = dsp_db_to_gain(linear_eq_curve(clamped, k * bin_hz)) / (float)N;
+        eq->response_im[k] = 0.0f;
+    }
+    fft_inverse(eq->plan, eq->response_re, eq->response_im, eq->design_time, eq->design_scratch);
+
+    /* Rotate tap 0 to the centre and taper with a Blackman window, which is 0 at tap 0. */
+    for (ma_uint32 n = 0; n < N; n++) {
+        double phase = 2.0 * DSP_PI * n / N;
+        double window = 0.42 - 0.5 * cos(phase) + 0.08 * cos(2.0 * phase);
+        eq->fir[n] = eq->design_time[(n + N / 2) % N] * (float)window;
+    }
+}
+
+static void *linear_eq_worker(void *user)
+{
+    struct linear_eq *eq = (struct linear_eq *)user;
+    const ma_uint64 fp_mode = dsp_denormals_flush(MA_TRUE);
+
+    for (;;) {
+        dsp_wake_wait(&eq->wake);
+        if (dsp_load_u32(&eq->quit))
+            break;
+        ma_uint32 posted = dsp_load_acquire_u32(&eq->posted);
+        if (posted == eq->done)
+            continue;
+        linear_eq_design_fir(eq, eq->design);
+        upols_transform(&eq->conv, eq->fir, LINEAR_EQ_TAPS, eq->spare_re, eq->spare_im,
+                eq->design_time, eq->design_scratch);
+        dsp_store_release_u32(&eq->done, posted);
+    }
+    dsp_denormals_restore(fp_mode);
+    return NULL;
+}
+
+static void linear_eq_layout(struct linear_eq *eq, size_t spectra, size_t scratch)
+{
+    const size_t block = (size_t)eq->channels * LINEAR_EQ_BLOCK;
+    eq->spare_re = dsp_arena_floats(&eq->arena, spectra);
+    eq->spare_im = dsp_arena_floats(&eq->arena, spectra);
+    eq->in_block = dsp_arena_floats(&eq->arena, block);
+    eq->out_block = dsp_arena_floats(&eq->arena, block);
+    eq->fade_block = dsp_arena_floats(&eq->arena, block);
+    eq->response_re = dsp_arena_floats(&eq->arena, LINEAR_EQ_TAPS / 2 + 4);
+    eq->response_im = dsp_arena_floats(&eq->arena, LINEAR_EQ_TAPS / 2 + 4);
+    eq->fir = dsp_arena_floats(&eq->arena, LINEAR_EQ_TAPS);
+    eq->design_time = dsp_arena_floats(&eq->arena, LINEAR_EQ_TAPS);
+    eq->design_scratch = dsp_arena_floats(&eq->arena, scratch);
+}
+
+static void linear_eq_uninit(struct linear_eq *eq)
+{
+    if (eq->running) {
+        dsp_store_u32(&eq->quit, 1);
+        dsp_wake_post(&eq->wake);
+        pthread_join(eq->thread, NULL);
+        dsp_wake_uninit(&eq->wake);
+        eq->running = false;
+    }
+    upols_uninit(&eq->conv);
+    dsp_arena_uninit(&eq->arena);
+}
+
+static ma_result linear_eq_init(const struct linear_eq_config *config, struct linear_eq *eq)
+{
+    ma_result result;
+
+    memset(eq, 0, sizeof(*eq));
+    if (config->channels == 0 || config->sample_rate == 0)
+        return MA_INVALID_ARGS;
+    eq->channels = config->channels;
+    eq->sample_rate = config->sample_rate;
+    memcpy(eq->gains, config->gains, sizeof(eq->gains));
+    memcpy(eq->design, config->gains, sizeof(eq->design));
+
+    eq->plan = fft_plan_get(LINEAR_EQ_TAPS);
+    const struct fft_plan *block_plan = fft_plan_get(2 * LINEAR_EQ_BLOCK);
+    if (eq->plan == NULL || block_plan == NULL)
+        return MA_INVALID_ARGS;
+    const size_t scratch = DSP_MAX(fft_scratch_size(eq->plan), fft_scratch_size(block_plan));
+    const size_t partitions = LINEAR_EQ_TAPS / LINEAR_EQ_BLOCK;
+    const size_t spectra = partitions * (((LINEAR_EQ_BLOCK + 1) + 3) & ~3u);
+
+    linear_eq_layout(eq, spectra, scratch);
+    result = dsp_arena_init(&eq->arena, eq->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    linear_eq_layout(eq, spectra, scratch);
+
+    /* The first design is made here; the convolver keeps it as its own response. */
+    linear_eq_design_fir(eq, eq->design);
+    result = upols_init(&eq->conv, eq->fir, LINEAR_EQ_TAPS, 1, eq->channels, LINEAR_EQ_BLOCK);
+    if (result != MA_SUCCESS) {
+        linear_eq_uninit(eq);
+        return result;
+    }
+    eq->current_re = eq->conv.ir_re;
+    eq->current_im = eq->conv.ir_im;
+
+    result = dsp_wake_init(&eq->wake);
+    if (result == MA_SUCCESS && pthread_create(&eq->thread, NULL, linear_eq_worker, eq) != 0) {
+        dsp_wake_uninit(&eq->wake);
+        result = MA_ERROR;
+    }
+    if (result != MA_SUCCESS) {
+        linear_eq_uninit(eq);
+        return result;
+    }
+    eq->running = true;
+    return MA_SUCCESS;
+}
+
+static ma_uint32 linear_eq_get_latency(const struct linear_eq *eq)
+{
+    (void)eq;
+    return LINEAR_EQ_BLOCK + LINEAR_EQ_TAPS / 2;
+}
+
+/* Runs one block from in_block into out_block, swapping in a finished design and posting a new one. */
+static void linear_eq_process_block(struct linear_eq *eq)
+{
+    upols_push(&eq->conv, eq->in_block);
+    upols_convolve(&eq->conv, eq->current_re, eq->current_im, eq->out_block);
+
+    ma_uint32 done = dsp_load_acquire_u32(&eq->done);
+    if (done != eq->applied) {
+        /* Both filters see the same history, so a one block crossfade is enough. */
+        upols_convolve(&eq->conv, eq->spare_re, eq->spare_im, eq->fade_block);
+        const float step = 1.0f / LINEAR_EQ_BLOCK;
+        for (ma_uint32 ch = 0; ch < eq->channels; ch++) {
+            float *out = eq->out_block + (size_t)ch * LINEAR_EQ_BLOCK;
+            const float *next = eq->fade_block + (size_t)ch * LINEAR_EQ_BLOCK;
+            v4f t = v4f_set(1.0f * step, 2.0f * step, 3.0f * step, 4.0f * step);
+            for (ma_uint32 i = 0; i < LINEAR_EQ_BLOCK; i += 4, t = v4f_add(t, v4f_set1(4.0f * step))) {
+                v4f a = v4f_load(out + i);
+                v4f_store(out + i, v4f_madd(v4f_sub(v4f_load(next + i), a), t, a));
+            }
+        }
+        float *re = eq->current_re, *im = eq->current_im;
+        eq->current_re = eq->spare_re;
+        eq->current_im = eq->spare_im;
+        eq->spare_re = re;
+        eq->spare_im = im;
+        eq->applied = done;
+    }
+
+    if (eq->applied == eq->posted) {
+        bool moved = false;
+        for (ma_uint32 i = 0; i < LINEAR_EQ_POINTS; i++) {
+            float gain = dsp_load_f32(&eq->gains[i]);
+            moved |= gain != eq->design[i];
+            eq->design[i] = gain;
+        }
+        if (moved) {
+            dsp_store_release_u32(&eq->posted, eq->posted + 1);
+            dsp_wake_post(&eq->wake);
+        }
+    }
+}
+
+static void linear_eq_process(struct linear_eq *eq, float *out, const float *in, ma_uint32 frame_count)
+{
+    const ma_uint32 channels = eq->channels;
+
+    while (frame_count > 0) {
+        ma_uint32 n = DSP_MIN(frame_count, LINEAR_EQ_BLOCK - eq->pos);
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            float *in_block = eq->in_block + (size_t)ch * LINEAR_EQ_BLOCK + eq->pos;
+            const float *out_block = eq->out_block + (size_t)ch * LINEAR_EQ_BLOCK + eq->pos;
+            for (ma_uint32 i = 0; i < n; i++) {
+                in_block[i] = in[i * channels + ch];
+                out[i * channels + ch] = out_block[i];
+            }
+        }
+        in += n * channels;
+        out += n * channels;
+        frame_count -= n;
+        eq->pos += n;
+
+        if (eq->pos == LINEAR_EQ_BLOCK) {
+            linear_eq_process_block(eq);
+            eq->pos = 0;
+        }
+    }
+}
+
+
+/*
+ * Linear-Phase EQ Node
+ */
+struct linear_eq_node_config {
+    ma_node_config node_config;
+    struct linear_eq_config linear_eq;
+};
+
+struct linear_eq_node {
+    ma_node_base base;
+    struct linear_eq linear_eq;
+};
+
+static struct linear_eq_node_config linear_eq_node_config_init(ma_uint32 channels, ma_uint32 sample_rate)
+{
+    struct linear_eq_node_config config;
+    config.node_config = ma_node_config_init();
+    config.linear_eq = linear_eq_config_init(channels, sample_rate);
+    return config;
+}
+
+static void linear_eq_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct linear_eq_node *eq = (struct linear_eq_node *)node;
+    (void)frame_count_in;
+    linear_eq_process(&eq->linear_eq, frames_out[0], frames_in[0], *frame_count_out);
+}
+
+static ma_node_vtable linear_eq_node_vtable = {
+    linear_eq_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input. */
+    1,      /* One output. */
+    0       /* Default flags. */
+};
+
+static ma_result linear_eq_node_init(ma_node_graph *graph, const struct linear_eq_node_config *config,
+        const ma_allocation_callbacks *alloc, struct linear_eq_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = linear_eq_init(&config->linear_eq, &node->linear_eq);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &linear_eq_node_vtable;
+    base_config.pInputChannels = &config->linear_eq.channels;
+    base_config.pOutputChannels = &config->linear_eq.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        linear_eq_uninit(&node->linear_eq);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void linear_eq_node_uninit(struct linear_eq_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    linear_eq_uninit(&node->linear_eq);
+}
@@ -0,0 +1,405 @@
+/*
+ * Loudness metering after ITU-R BS.1770 and EBU R128 / Tech 3342.
+ *
+ * The input is K-weighted (a high shelf and a high pass, run as one biquad
+ * wavefront group per channel) and its channel-weighted energy summed over
+ * 100 ms steps. Momentary loudness averages the last 4 steps, short-term the
+ * last 30. Every momentary block feeds the integrated loudness and every
+ * short-term value the loudness range, both through fixed histograms of
+ * LOUDNESS_BIN_WIDTH LU, so a meter left running costs the same after an
+ * hour as after a second. True peak comes from truepeak.c on the unweighted
+ * input. The node passes its input through unchanged.
+ */
+#include "dsp.h"
+
+#define LOUDNESS_STEP           0.1f    /* Seconds per gating step. */
+#define LOUDNESS_MOMENTARY      4       /* Steps in a 400 ms momentary block. */
+#define LOUDNESS_SHORT_TERM     30      /* Steps in a 3 s short-term window. */
+#define LOUDNESS_ABSOLUTE_GATE  -70.0f  /* LUFS */
+#define LOUDNESS_RELATIVE_GATE  -10.0f  /* LU under the ungated integrated loudness. */
+#define LOUDNESS_RANGE_GATE     -20.0f  /* LU, relative gate of the loudness range. */
+#define LOUDNESS_BIN_WIDTH      0.1f    /* LU */
+#define LOUDNESS_BINS           800     /* -70 .. +10 LUFS */
+#define LOUDNESS_CHUNK          256     /* Frames K-weighted at a time. */
+
+struct loudness_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+};
+
+struct loudness {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+
+    /* Written by the audio thread after every step, read by the UI. */
+    float momentary;            /* LUFS */
+    float short_term;           /* LUFS */
+    float integrated;           /* LUFS */
+    float range;                /* LU */
+    float true_peak;            /* dBTP, highest since the last reset */
+
+    /* Written by the UI thread, read once per block. */
+    ma_uint32 reset;
+
+    /* Audio thread state. */
+    struct biquad_coeffs coeffs;
+    float *z1, *z2;             /* [channel][BIQUAD_MAX_STAGES] */
+    float *weights;             /* [4][channel], channel gains repeated for four frames */
+    float *weighted;            /* [LOUDNESS_CHUNK][channel] */
+    float *peak;                /* [LOUDNESS_CHUNK] */
+    struct truepeak truepeak;
+    float peak_max;
+
+    ma_uint32 step_frames;
+    ma_uint32 step_done;        /* Frames summed into step_energy so far. */
+    float step_energy;
+    float steps[LOUDNESS_SHORT_TERM];   /* Mean weighted energy of the latest steps, a ring. */
+    ma_uint32 step_pos;
+    ma_uint32 step_count;       /* Steps seen, saturating at LOUDNESS_SHORT_TERM. */
+
+    float bin_energy[LOUDNESS_BINS];    /* Energy at the centre of each bin. */
+    ma_uint32 blocks[LOUDNESS_BINS];    /* Momentary blocks above the absolute gate. */
+    ma_uint32 windows[LOUDNESS_BINS];   /* Short-term values above the absolute gate. */
+
+    struct dsp_arena arena;
+};
+
+static struct loudness_config loudness_config_init(ma_uint32 channels, ma_uint32 sample_rate)
+{
+    struct loudness_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    return config;
+}
+
+static void loudness_layout(struct loudness *ld)
+{
+    ld->z1 = dsp_arena_floats(&ld->arena, (size_t)ld->channels * BIQUAD_MAX_STAGES);
+    ld->z2 = dsp_arena_floats(&ld->arena, (size_t)ld->channels * BIQUAD_MAX_STAGES);
+    ld->weights = dsp_arena_floats(&ld->arena, (size_t)ld->channels * 4);
+    ld->weighted = dsp_arena_floats(&ld->arena, (size_t)ld->channels * LOUDNESS_CHUNK);
+    ld->peak = dsp_arena_floats(&ld->arena, LOUDNESS_CHUNK);
+}
+
+/* The two K-weighting stages, designed for the actual rate so it isn't tied to 48 kHz. */
+static void loudness_design(struct biquad_coeffs *c, ma_uint32 sample_rate)
+{
+    const double fs = (double)sample_rate;
+
+    biquad_coeffs_identity(c);
+
+    /* Head related high shelf, +4 dB above about 1.5 kHz. */
+    double k = tan(DSP_PI * 1681.974450955533 / fs);
+    double q = 0.7071752369554196;
+    double vh = pow(10.0, 3.999843853973347 / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    biquad_coeffs_set(c, 0, vh + vb * k / q + k * k, 2.0 * (k * k - vh), vh - vb * k / q + k * k,
+            1.0 + k / q + k * k, 2.0 * (k * k - 1.0), 1.0 - k / q + k * k);
+
+    /* RLB high pass at 38 Hz. */
+    k = tan(DSP_PI * 38.13547087602444 / fs);
+    q = 0.5003270373238773;
+    biquad_coeffs_set(c, 1, 1.0, -2.0, 1.0, 1.0 + k / q + k * k, 2.0 * (k * k - 1.0), 1.0 - k / q + k * k);
+}
+
+/* BS.1770 channel gains by position: surrounds +1.5 dB, LFE left out. */
+static float loudness_channel_weight(ma_channel position)
+{
+    switch (position) {
+    case MA_CHANNEL_LFE:
+        return 0.0f;
+    case MA_CHANNEL_SIDE_LEFT:
+    case MA_CHANNEL_SIDE_RIGHT:
+    case MA_CHANNEL_BACK_LEFT:
+    case MA_CHANNEL_BACK_RIGHT:
+        return 1.41f;
+    default:
+        return 1.0f;
+    }
+}
+
+static float loudness_lufs(float energy)
+{
+    return energy > 0.0f ? -0.691f + 10.0f * log10f(energy) : -INFINITY;
+}
+
+static void loudness_clear(struct loudness *ld)
+{
+    memset(ld->z1, 0, sizeof(float) * ld->channels * BIQUAD_MAX_STAGES);
+    memset(ld->z2, 0, sizeof(float) * ld->channels * BIQUAD_MAX_STAGES);
+    memset(ld->steps, 0, sizeof(ld->steps));
+    memset(ld->blocks, 0, sizeof(ld->blocks));
+    memset(ld->windows, 0, sizeof(ld->windows));
+    ld->step_done = 0;
+    ld->step_energy = 0.0f;
+    ld->step_pos = 0;
+    ld->step_count = 0;
+    ld->peak_max = 0.0f;
+    dsp_store_f32(&ld->momentary, -INFINITY);
+    dsp_store_f32(&ld->short_term, -INFINITY);
+    dsp_store_f32(&ld->integrated, -INFINITY);
+    dsp_store_f32(&ld->range, 0.0f);
+    dsp_store_f32(&ld->true_peak, -INFINITY);
+}
+
+static ma_result loudness_init(const struct loudness_config *config, struct loudness *ld)
+{
+    ma_result result;
+    ma_channel map[MA_MAX_CHANNELS];
+
+    memset(ld, 0, sizeof(*ld));
+    if (config->channels == 0 || config->channels > MA_MAX_CHANNELS || config->sample_rate == 0)
+        return MA_INVALID_ARGS;
+
+    ld->channels = config->channels;
+    ld->sample_rate = config->sample_rate;
+    ld->step_frames = (ma_uint32)(LOUDNESS_STEP * config->sample_rate + 0.5f);
+
+    loudness_layout(ld);
+    result = dsp_arena_init(&ld->arena, ld->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    loudness_layout(ld);
+
+    result = truepeak_init(&ld->truepeak, ld->channels);
+    if (result != MA_SUCCESS) {
+        dsp_arena_uninit(&ld->arena);
+        return result;
+    }
+
+    loudness_design(&ld->coeffs, ld->sample_rate);
+    ma_channel_map_init_standard(ma_standard_channel_map_default, map, MA_MAX_CHANNELS, ld->channels);
+    for (ma_uint32 f = 0; f < 4; f++)
+        for (ma_uint32 c = 0; c < ld->channels; c++)
+            ld->weights[f * ld->channels + c] = ld->channels <= 2 ? 1.0f : loudness_channel_weight(map[c]);
+    for (ma_uint32 b = 0; b < LOUDNESS_BINS; b++)
+        ld->bin_energy[b] = powf(10.0f, (LOUDNESS_ABSOLUTE_GATE + (b + 0.5f) * LOUDNESS_BIN_WIDTH + 0.691f) / 10.0f);
+    loudness_clear(ld);
+    return MA_SUCCESS;
+}
+
+static void loudness_uninit(struct loudness *ld)
+{
+    truepeak_uninit(&ld->truepeak);
+    dsp_arena_uninit(&ld->arena);
+}
+
+static void loudness_histogram_add(ma_uint32 *histogram, float lufs)
+{
+    if (!(lufs >= LOUDNESS_ABSOLUTE_GATE))
+        return;
+    int bin = (int)((lufs - LOUDNESS_ABSOLUTE_GATE) / LOUDNESS_BIN_WIDTH);
+    histogram[DSP_MIN(bin, LOUDNESS_BINS - 1)]++;
+}
+
+static int loudness_bin(float lufs)
+{
+    return DSP_CLAMP((int)ceilf((lufs - LOUDNESS_ABSOLUTE_GATE) / LOUDNESS_BIN_WIDTH), 0, LOUDNESS_BINS);
+}
+
+/* Mean loudness of the histogram bins from `first` up, -inf when they're empty. */
+static float loudness_histogram_mean(const struct loudness *ld, const ma_uint32 *histogram, int first)
+{
+    double energy = 0.0;
+    ma_uint64 count = 0;
+    for (int b = first; b < LOUDNESS_BINS; b++) {
+        energy += (double)histogram[b] * ld->bin_energy[b];
+        count += histogram[b];
+    }
+    return count ? loudness_lufs((float)(energy / (double)count)) : -INFINITY;
+}
+
+/* Integrated loudness: mean of the blocks above the absolute gate, then of those above the relative gate. */
+static float loudness_integrated(const struct loudness *ld)
+{
+    float ungated = loudness_histogram_mean(ld, ld->blocks, 0);
+    if (ungated == -INFINITY)
+        return -INFINITY;
+    return loudness_histogram_mean(ld, ld->blocks, loudness_bin(ungated + LOUDNESS_RELATIVE_GATE));
+}
+
+/* Loudness range: spread between the 10th and 95th percentiles of the gated short-term values. */
+static float loudness_range(const struct loudness *ld)
+{
+    float ungated = loudness_histogram_mean(ld, ld->windows, 0);
+    if (ungated == -INFINITY)
+        return 0.0f;
+
+    int first = loudness_bin(ungated + LOUDNESS_RANGE_GATE);
+    ma_uint64 count = 0;
+    for (int b = first; b < LOUDNESS_BINS; b++)
+        count += ld->windows[b];
+    if (count == 0)
+        return 0.0f;
+
+    const ma_uint64 low_rank = (ma_uint64)(0.10 * (double)(count - 1));
+    const ma_uint64 high_rank = (ma_uint64)(0.95 * (double)(count - 1));
+    int low = first, high = first;
+    ma_uint64 seen = 0;
+    for (int b = first; b < LOUDNESS_BINS; b++) {
+        if (seen <= low_rank)
+            low = b;
+        if (seen <= high_rank)
+            high = b;
+        seen += ld->windows[b];
+    }
+    return (float)(high - low) * LOUDNESS_BIN_WIDTH;
+}
+
+/* Closes a 100 ms step: updates the sliding windows, the histograms and the published values. */
+static void loudness_step(struct loudness *ld)
+{
+    ld->steps[ld->step_pos] = ld->step_energy / (float)ld->step_frames;
+    ld->step_pos = (ld->step_pos + 1) % LOUDNESS_SHORT_TERM;
+    ld->step_count = DSP_MIN(ld->step_count + 1, (ma_uint32)LOUDNESS_SHORT_TERM);
+    ld->step_energy = 0.0f;
+    ld->step_done = 0;
+
+    float momentary = 0.0f, short_term = 0.0f;
+    for (ma_uint32 i = 0; i < ld->step_count; i++) {
+        float e = ld->steps[(ld->step_pos + LOUDNESS_SHORT_TERM - 1 - i) % LOUDNESS_SHORT_TERM];
+        if (i < LOUDNESS_MOMENTARY)
+            momentary += e;
+        short_term += e;
+    }
+    momentary = loudness_lufs(momentary / (float)DSP_MIN(ld->step_count, (ma_uint32)LOUDNESS_MOMENTARY));
+    short_term = loudness_lufs(short_term / (float)ld->step_count);
+
+    if (ld->step_count >= LOUDNESS_MOMENTARY)
+        loudness_histogram_add(ld->blocks, momentary);
+    if (ld->step_count >= LOUDNESS_SHORT_TERM)
+        loudness_histogram_add(ld->windows, short_term);
+
+    dsp_store_f32(&ld->momentary, momentary);
+    dsp_store_f32(&ld->short_term, short_term);
+    dsp_store_f32(&ld->integrated, loudness_integrated(ld));
+    dsp_store_f32(&ld->range, loudness_range(ld));
+    dsp_store_f32(&ld->true_peak, dsp_gain_to_db(ld->peak_max));
+}
+
+/* K-weights `frame_count` <= LOUDNESS_CHUNK frames and returns their channel-weighted energy. */
+static float loudness_energy(struct loudness *ld, const float *in, ma_uint32 frame_count)
+{
+    const ma_uint32 channels = ld->channels;
+
+    for (ma_uint32 ch = 0; ch < channels; ch++)
+        biquad_group_process(ld->weighted + ch, in + ch, frame_count, channels, &ld->coeffs, 0,
+                ld->z1 + ch * BIQUAD_MAX_STAGES, ld->z2 + ch * BIQUAD_MAX_STAGES);
+
+    /* Four frames are exactly `channels` vectors, so the repeated weights line up. */
+    v4f acc = v4f_zero();
+    ma_uint32 f = 0;
+    for (; f + 4 <= frame_count; f += 4) {
+        const float *y = ld->weighted + (size_t)f * channels;
+        for (ma_uint32 j = 0; j < channels; j++) {
+            v4f x = v4f_load(y + 4 * j);
+            acc = v4f_madd(v4f_mul(x, x), v4f_load(ld->weights + 4 * j), acc);
+        }
+    }
+    float energy = v4f_hsum(acc);
+    for (; f < frame_count; f++) {
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            float y = ld->weighted[f * channels + ch];
+            energy += y * y * ld->weights[ch];
+        }
+    }
+    return energy;
+}
+
+static void loudness_process(struct loudness *ld, const float *in, ma_uint32 frame_count)
+{
+    if (dsp_load_u32(&ld->reset)) {
+        dsp_store_u32(&ld->reset, 0);
+        loudness_clear(ld);
+    }
+
+    ma_uint32 done = 0;
+    while (done < frame_count) {
+        ma_uint32 n = DSP_MIN(frame_count - done, (ma_uint32)LOUDNESS_CHUNK);
+        n = DSP_MIN(n, ld->step_frames - ld->step_done);
+        const float *src = in + (size_t)done * ld->channels;
+
+        ld->step_energy += loudness_energy(ld, src, n);
+        truepeak_process(&ld->truepeak, src, n, ld->peak);
+        for (ma_uint32 f = 0; f < n; f++)
+            ld->peak_max = DSP_MAX(ld->peak_max, ld->peak[f]);
+
+        ld->step_done += n;
+        if (ld->step_done == ld->step_frames)
+            loudness_step(ld);
+        done += n;
+    }
+}
+
+
+/*
+ * Loudness Node
+ */
+struct loudness_node_config {
+    ma_node_config node_config;
+    struct loudness_config loudness;
+};
+
+struct loudness_node {
+    ma_node_base base;
+    struct loudness loudness;
+};
+
+static struct loudness_node_config loudness_node_config_init(ma_uint32 channels, ma_uint32 sample_rate)
+{
+    struct loudness_node_config config;
+    config.node_config = ma_node_config_init();
+    config.loudness = loudness_config_init(channels, sample_rate);
+    return config;
+}
+
+static void loudness_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct loudness_node *meter = (struct loudness_node *)node;
+    const ma_uint32 frame_count = *frame_count_out;
+    (void)frame_count_in;
+
+    loudness_process(&meter->loudness, frames_in[0], frame_count);
+    if (frames_out[0] != frames_in[0])
+        memcpy(frames_out[0], frames_in[0], sizeof(float) * frame_count * meter->loudness.channels);
+}
+
+static ma_node_vtable loudness_node_vtable = {
+    loudness_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input. */
+    1,      /* One output. */
+    0       /* Default flags. */
+};
+
+static ma_result loudness_node_init(ma_node_graph *graph, const struct loudness_node_config *config,
+        const ma_allocation_callbacks *alloc, struct loudness_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = loudness_init(&config->loudness, &node->loudness);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &loudness_node_vtable;
+    base_config.pInputChannels = &config->loudness.channels;
+    base_config.pOutputChannels = &config->loudness.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        loudness_uninit(&node->loudness);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void loudness_node_uninit(struct loudness_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    loudness_uninit(&node->loudness);
+}
@@ -0,0 +1,507 @@
+/*
+ * Standard MIDI file playback.
+ *
+ * A file is parsed once at load: every track is read, the note and control
+ * change events merged into one array sorted by time, and their tick times
+ * converted to frames at the engine rate through the file's tempo map. An
+ * event is 8 bytes, so a long song stays a few hundred kilobytes and the
+ * player only ever walks forward through it.
+ *
+ * The player node outputs one channel of silence. Linking it to the MIDI
+ * input of a sampler or oscillator does two things: the graph pulls the
+ * player before the target every block, and the target is handed a pointer
+ * to the player. Each process call the player gathers the events that fall
+ * inside the block with their frame offsets, and the target reads them
+ * after its input has been pulled and splits its rendering at each offset,
+ * so event timing does not depend on the buffer size.
+ *
+ * Targets are omni: the channel nibble is kept but not acted on.
+ */
+#include "dsp.h"
+
+#define MIDI_BLOCK_EVENTS       256     /* Events per process call; later ones slip to the next call. */
+#define MIDI_DEFAULT_TEMPO      500000  /* us per quarter note, 120 BPM */
+#define MIDI_MAX_FRAMES         0xFFFFFFFFu
+
+enum midi_status {
+    MIDI_NOTE_OFF = 0x80,
+    MIDI_NOTE_ON = 0x90,
+    MIDI_CONTROL = 0xB0,
+};
+
+enum midi_control {
+    MIDI_CONTROL_SUSTAIN = 64,
+    MIDI_CONTROL_SOUND_OFF = 120,
+    MIDI_CONTROL_NOTES_OFF = 123,
+};
+
+struct midi_event {
+    ma_uint32 time;             /* Frames: from the start in a file, into the block from a player. */
+    ma_uint8 status;            /* Message in the high nibble, channel in the low one. */
+    ma_uint8 data1;             /* Note or controller */
+    ma_uint8 data2;             /* Velocity or value */
+};
+
+/* Graph input of a target: the player is linked to it over a mono bus. */
+static const ma_uint32 midi_input_channels = 1;
+
+/*
+ * Parsing
+ */
+struct midi_raw {
+    ma_uint64 tick;
+    ma_uint32 order;            /* Position in the file, to keep simultaneous events in order. */
+    ma_uint32 tempo;            /* us per quarter note for a tempo change, 0 for a channel event */
+    ma_uint8 status, data1, data2;
+};
+
+struct midi_raw_list {
+    struct midi_raw *items;
+    size_t count;
+    size_t capacity;
+};
+
+static bool midi_raw_push(struct midi_raw_list *list, ma_uint64 tick, ma_uint32 tempo,
+        ma_uint8 status, ma_uint8 data1, ma_uint8 data2)
+{
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        struct midi_raw *items = (struct midi_raw *)ma_realloc(list->items, capacity * sizeof(*items), NULL);
+        if (items == NULL)
+            return false;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    struct midi_raw *raw = &list->items[list->count];
+    raw->tick = tick;
+    raw->order = (ma_uint32)list->count;
+    raw->tempo = tempo;
+    raw->status = status;
+    raw->data1 = data1;
+    raw->data2 = data2;
+    list->count++;
+    return true;
+}
+
+static int midi_raw_compare(const void *a, const void *b)
+{
+    const struct midi_raw *x = (const struct midi_raw *)a, *y = (const struct midi_raw *)b;
+    if (x->tick != y->tick)
+        return x->tick < y->tick ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static ma_uint32 midi_read_u32(const ma_uint8 *p)
+{
+    return ((ma_uint32)p[0] << 24) | ((ma_uint32)p[1] << 16) | ((ma_uint32)p[2] << 8) | p[3];
+}
+
+/* Variable length quantity, at most four bytes. */
+static bool midi_read_vlq(const ma_uint8 **p, const ma_uint8 *end, ma_uint32 *value)
+{
+    ma_uint32 v = 0;
+    for (int i = 0; i < 4; i++) {
+        if (*p >= end)
+            return false;
+        ma_uint8 byte = *(*p)++;
+        v = (v << 7) | (byte & 0x7f);
+        if ((byte & 0x80) == 0) {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* One MTrk chunk's events; returns the tick it ends on through `end_tick`. */
+static ma_result midi_parse_track(const ma_uint8 *p, const ma_uint8 *end, struct midi_raw_list *list, ma_uint64 *end_tick)
+{
+    ma_uint64 tick = 0;
+    ma_uint8 running = 0;
+
+    while (p < end) {
+        ma_uint32 delta, length;
+        if (!midi_read_vlq(&p, end, &delta) || p >= end)
+            return MA_INVALID_FILE;
+        tick += delta;
+
+        ma_uint8 status = *p;
+        if (status == 0xFF) {
+            /* Meta event: only tempo changes and the end of the track matter. */
+            if (end - p < 2)
+                return MA_INVALID_FILE;
+            ma_uint8 type = p[1];
+            p += 2;
+            if (!midi_read_vlq(&p, end, &length) || (size_t)(end - p) < length)
+                return MA_INVALID_FILE;
+            if (type == 0x51 && length == 3) {
+                ma_uint32 tempo = ((ma_uint32)p[0] << 16) | ((ma_uint32)p[1] << 8) | p[2];
+                if (tempo > 0 && !midi_raw_push(list, tick, tempo, 0, 0, 0))
+                    return MA_OUT_OF_MEMORY;
+            }
+            p += length;
+            if (type == 0x2F)
+                break;
+            continue;
+        }
+        if (status == 0xF0 || status == 0xF7) {
+            /* System exclusive: skipped. It cancels running status. */
+            p++;
+            if (!midi_read_vlq(&p, end, &length) || (size_t)(end - p) < length)
+                return MA_INVALID_FILE;
+            p += length;
+            running = 0;
+            continue;
+        }
+
+        if (status & 0x80) {
+            running = status;
+            p++;
+        } else if (running == 0) {
+            return MA_INVALID_FILE;
+        }
+        ma_uint8 type = running & 0xF0;
+        int size = (type == 0xC0 || type == 0xD0) ? 1 : 2;
+        if (end - p < size)
+            return MA_INVALID_FILE;
+        ma_uint8 data1 = p[0] & 0x7f, data2 = size == 2 ? (p[1] & 0x7f) : 0;
+        p += size;
+
+        /* Note on with velocity 0 is stored as the note off it stands for. */
+        if (type == MIDI_NOTE_ON && data2 == 0)
+            type = MIDI_NOTE_OFF;
+        if (type == MIDI_NOTE_OFF || type == MIDI_NOTE_ON || type == MIDI_CONTROL) {
+            if (!midi_raw_push(list, tick, 0, (ma_uint8)(type | (running & 0x0F)), data1, data2))
+                return MA_OUT_OF_MEMORY;
+        }
+    }
+    *end_tick = DSP_MAX(*end_tick, tick);
+    return MA_SUCCESS;
+}
+
+struct midi_file {
+    struct midi_event *events;  /* Sorted by time */
+    ma_uint32 event_count;
+    ma_uint32 length;           /* Frames to the end of the longest track */
+};
+
+/*
+ * Loads a format 0, 1 or 2 file at `sample_rate`. Format 2's independent
+ * sequences are merged like format 1's tracks.
+ */
+static ma_result midi_file_load(struct midi_file *file, const char *file_name, ma_uint32 sample_rate)
+{
+    void *data = NULL;
+    size_t size = 0;
+    struct midi_raw_list list = { 0 };
+    ma_uint64 end_tick = 0;
+    ma_result result;
+
+    memset(file, 0, sizeof(*file));
+    if (file_name == NULL || sample_rate == 0)
+        return MA_INVALID_ARGS;
+    result = ma_vfs_open_and_read_file(NULL, file_name, &data, &size, NULL);
+    if (result != MA_SUCCESS)
+        return result;
+
+    const ma_uint8 *p = (const ma_uint8 *)data, *end = p + size;
+    if (size < 14 || memcmp(p, "MThd", 4) != 0 || midi_read_u32(p + 4) < 6 || midi_read_u32(p + 4) > size - 8) {
+        ma_free(data, NULL);
+        return MA_INVALID_FILE;
+    }
+    const ma_uint16 division = (ma_uint16)((p[12] << 8) | p[13]);
+    p += 8 + midi_read_u32(p + 4);
+
+    /* Frames per tick: from the tempo with a metrical division, fixed with a SMPTE one. */
+    double per_quarter = 0.0, per_tick = 0.0;
+    if (division & 0x8000) {
+        int fps = -(int)(ma_int8)(division >> 8);
+        int ticks = division & 0xFF;
+        if (fps <= 0 || ticks == 0) {
+            ma_free(data, NULL);
+            return MA_INVALID_FILE;
+        }
+        per_tick = (double)sample_rate / ((fps == 29 ? 29.97 : fps) * ticks);
+    } else {
+        if (division == 0) {
+            ma_free(data, NULL);
+            return MA_INVALID_FILE;
+        }
+        per_quarter = (double)sample_rate / (1e6 * division);
+        per_tick = per_quarter * MIDI_DEFAULT_TEMPO;
+    }
+
+    /* Tracks; other chunk types are skipped. */
+    result = MA_SUCCESS;
+    while (end - p >= 8 && result == MA_SUCCESS) {
+        ma_uint32 length = midi_read_u32(p + 4);
+        if (length > (size_t)(end - p) - 8) {
+            result = MA_INVALID_FILE;
+            break;
+        }
+        if (memcmp(p, "MTrk", 4) == 0)
+            result = midi_parse_track(p + 8, p + 8 + length, &list, &end_tick);
+        p += 8 + length;
+    }
+    ma_free(data, NULL);
+    if (result != MA_SUCCESS) {
+        ma_free(list.items, NULL);
+        return result;
+    }
+
+    qsort(list.items, list.count, sizeof(*list.items), midi_raw_compare);
+
+    ma_uint32 count = 0;
+    for (size_t i = 0; i < list.count; i++)
+        count += list.items[i].tempo == 0;
+    file->events = (struct midi_event *)ma_malloc(DSP_MAX(count, 1u) * sizeof(*file->events), NULL);
+    if (file->events == NULL) {
+        ma_free(list.items, NULL);
+        return MA_OUT_OF_MEMORY;
+    }
+
+    /* Walk the tempo map, accumulating frames in double so long songs don't drift. */
+    double frames = 0.0;
+    ma_uint64 tick = 0;
+    for (size_t i = 0; i < list.count; i++) {
+        const struct midi_raw *raw = &list.items[i];
+        frames += (double)(raw->tick - tick) * per_tick;
+        tick = raw->tick;
+        if (raw->tempo != 0) {
+            if (per_quarter > 0.0)
+                per_tick = per_quarter * raw->tempo;
+            continue;
+        }
+        struct midi_event *ev = &file->events[file->event_count++];
+        ev->time = (ma_uint32)DSP_MIN(frames + 0.5, (double)MIDI_MAX_FRAMES);
+        ev->status = raw->status;
+        ev->data1 = raw->data1;
+        ev->data2 = raw->data2;
+    }
+    frames += (double)(end_tick - tick) * per_tick;
+    file->length = (ma_uint32)DSP_MIN(frames + 0.5, (double)MIDI_MAX_FRAMES);
+    ma_free(list.items, NULL);
+    return MA_SUCCESS;
+}
+
+static void midi_file_unload(struct midi_file *file)
+{
+    ma_free(file->events, NULL);
+    memset(file, 0, sizeof(*file));
+}
+
+/*
+ * Player
+ */
+struct midi_player_config {
+    ma_uint32 sample_rate;
+    const char *file_name;
+};
+
+struct midi_player {
+    ma_uint32 sample_rate;
+    struct midi_file file;
+
+    /* Written by the UI thread, read once per block. */
+    ma_uint32 playing;
+    ma_uint32 loop;
+    ma_uint32 rewind;           /* Set by the UI, cleared once the audio thread is back at the start. */
+
+    /* Written by the audio thread, read by the UI. */
+    ma_uint32 position;         /* Frames */
+
+    /* Audio thread state. */
+    ma_uint32 next;             /* Next event in the file */
+    ma_uint32 frame;
+    ma_uint32 sounding;         /* Playing last block: stopping sends notes off. */
+
+    /* The latest block's events, read by the target after the graph has pulled this node. */
+    struct midi_event block[MIDI_BLOCK_EVENTS];
+    ma_uint32 block_count;
+};
+
+static struct midi_player_config midi_player_config_init(ma_uint32 sample_rate, const char *file_name)
+{
+    struct midi_player_config config;
+    config.sample_rate = sample_rate;
+    config.file_name = file_name;
+    return config;
+}
+
+static ma_result midi_player_init(const struct midi_player_config *config, struct midi_player *player)
+{
+    memset(player, 0, sizeof(*player));
+    if (config->sample_rate == 0 || config->file_name == NULL)
+        return MA_INVALID_ARGS;
+    player->sample_rate = config->sample_rate;
+    player->loop = 1;
+    return midi_file_load(&player->file, config->file_name, config->sample_rate);
+}
+
+static void midi_player_uninit(struct midi_player *player)
+{
+    midi_file_unload(&player->file);
+}
+
+static bool midi_player_emit(struct midi_player *player, ma_uint32 time, ma_uint8 status, ma_uint8 data1, ma_uint8 data2)
+{
+    if (player->block_count == MIDI_BLOCK_EVENTS)
+        return false;
+    struct midi_event *ev = &player->block[player->block_count++];
+    ev->time = time;
+    ev->status = status;
+    ev->data1 = data1;
+    ev->data2 = data2;
+    return true;
+}
+
+/* Releases everything the target holds: the sustain pedal, then every note. */
+static void midi_player_silence(struct midi_player *player, ma_uint32 time)
+{
+    midi_player_emit(player, time, MIDI_CONTROL, MIDI_CONTROL_SUSTAIN, 0);
+    midi_player_emit(player, time, MIDI_CONTROL, MIDI_CONTROL_NOTES_OFF, 0);
+}
+
+/* Gathers the events of the next `frame_count` frames into the block, with offsets into it. */
+static void midi_player_process(struct midi_player *player, ma_uint32 frame_count)
+{
+    const struct midi_event *events = player->file.events;
+    const ma_uint32 count = player->file.event_count;
+    const ma_uint32 length = player->file.length;
+    const bool playing = dsp_load_u32(&player->playing) != 0;
+    const bool loop = dsp_load_u32(&player->loop) != 0;
+
+    player->block_count = 0;
+    if (dsp_load_u32(&player->rewind)) {
+        if (player->sounding)
+            midi_player_silence(player, 0);
+        player->frame = 0;
+        player->next = 0;
+        dsp_store_u32(&player->rewind, 0);
+    }
+    if (!playing) {
+        if (player->sounding)
+            midi_player_silence(player, 0);
+        player->sounding = 0;
+        dsp_store_u32(&player->position, player->frame);
+        return;
+    }
+    player->sounding = 1;
+
+    for (ma_uint32 at = 0; at < frame_count; ) {
+        ma_uint32 n = frame_count - at;
+        if (loop && length > player->frame)
+            n = DSP_MIN(n, length - player->frame);
+        const ma_uint64 end = (ma_uint64)player->frame + n;
+
+        /* Events held back by a full block come out late, at the block's start. */
+        for (; player->next < count && events[player->next].time < end; player->next++) {
+            const struct midi_event *ev = &events[player->next];
+            ma_uint32 time = at + (ev->time > player->frame ? ev->time - player->frame : 0);
+            if (!midi_player_emit(player, time, ev->status, ev->data1, ev->data2))
+                break;
+        }
+        player->frame = (ma_uint32)DSP_MIN(end, (ma_uint64)MIDI_MAX_FRAMES);
+        at += n;
+
+        if (loop && length > 0 && player->frame >= length) {
+            midi_player_silence(player, DSP_MIN(at, frame_count - 1));
+            player->frame = 0;
+            player->next = 0;
+        }
+    }
+    dsp_store_u32(&player->position, player->frame);
+}
+
+/*
+ * Target side. `input` is the target's player pointer, written by the UI on
+ * linking. Returns NULL when no player is linked. The block's events are
+ * only current when the graph delivered input this call, i.e. when
+ * frames_in is not NULL; otherwise the list is empty.
+ */
+static const struct midi_event *midi_input_events(struct midi_player *const *input, const float *frames_in, ma_uint32 *count)
+{
+    const struct midi_player *player = __atomic_load_n(input, __ATOMIC_ACQUIRE);
+    if (player == NULL) {
+        *count = 0;
+        return NULL;
+    }
+    *count = frames_in != NULL ? player->block_count : 0;
+    return player->block;
+}
+
+static void midi_input_link(struct midi_player **input, struct midi_player *player)
+{
+    __atomic_store_n(input, player, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * MIDI Player Node
+ */
+struct midi_player_node_config {
+    ma_node_config node_config;
+    struct midi_player_config player;
+};
+
+struct midi_player_node {
+    ma_node_base base;
+    struct midi_player player;
+};
+
+static struct midi_player_node_config midi_player_node_config_init(ma_uint32 sample_rate, const char *file_name)
+{
+    struct midi_player_node_config config;
+    config.node_config = ma_node_config_init();
+    config.player = midi_player_config_init(sample_rate, file_name);
+    return config;
+}
+
+static void midi_player_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct midi_player_node *player = (struct midi_player_node *)node;
+    (void)frames_in;
+    (void)frame_count_in;
+    midi_player_process(&player->player, *frame_count_out);
+    memset(frames_out[0], 0, sizeof(float) * *frame_count_out);
+}
+
+static ma_node_vtable midi_player_node_vtable = {
+    midi_player_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    0,      /* No inputs. */
+    1,      /* One output, silent: it orders the graph. */
+    0       /* Default flags. */
+};
+
+static ma_result midi_player_node_init(ma_node_graph *graph, const struct midi_player_node_config *config,
+        const ma_allocation_callbacks *alloc, struct midi_player_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = midi_player_init(&config->player, &node->player);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &midi_player_node_vtable;
+    base_config.pInputChannels = NULL;
+    base_config.pOutputChannels = &midi_input_channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        midi_player_uninit(&node->player);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void midi_player_node_uninit(struct midi_player_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    midi_player_uninit(&node->player);
+}
@@ -0,0 +1,380 @@
+/*
+ * Mixer / bus node.
+ *
+ * Sums any number of input buses into one output with per-input gain, pan,
+ * mute and solo. Gains are ramped linearly across each block so changes
+ * never click. The kernel works on the interleaved buffers directly: for
+ * four frames of a C channel bus it walks C vectors, and the per-lane gains
+ * for those C vectors repeat every four frames, so one pattern of C gain
+ * vectors (plus its per-group increment for the ramp) covers any channel
+ * count. Inputs are folded four at a time so the output is loaded and
+ * stored once per four inputs. Where the CPU has it, kernels.mix does the
+ * same eight lanes at a time, two groups per vector (see kernels.c).
+ *
+ * Each input can also be delayed, up to MIXER_MAX_DELAY frames, so that
+ * paths through nodes with latency line up when they meet here. The editor
+ * sets the delays from the latencies its nodes report. An input only gets a
+ * delay line the first time it is delayed, and only goes through it while
+ * delayed: undelayed inputs are mixed straight from the graph's buffers.
+ * History the line missed while idle reads as silence. When a delay
+ * changes, the old and new read positions are crossfaded over one chunk.
+ */
+#include "dsp.h"
+
+#define MIXER_MAX_INPUTS    64
+#define MIXER_MAX_HELD      KERNELS_MIX_CHANNELS    /* Widest bus whose gain patterns are kept in registers. */
+#define MIXER_MAX_DELAY     16384   /* Frames, a power of two. */
+#define MIXER_CHUNK         512     /* Frames mixed at once, the size of the delayed input buffers. */
+
+struct mixer_input {
+    /* Written by the UI thread, read once per block. */
+    float gain;                 /* Linear. */
+    float pan;                  /* -1 left .. 1 right, stereo buses only. */
+    ma_uint32 mute;
+    ma_uint32 solo;
+    ma_uint32 delay;            /* Frames, below MIXER_MAX_DELAY. */
+};
+
+struct mixer_node_config {
+    ma_node_config node_config;
+    ma_uint32 channels;
+    ma_uint32 input_count;
+};
+
+struct mixer_node {
+    ma_node_base base;
+    ma_uint32 channels;
+    ma_uint32 input_count;
+    struct mixer_input inputs[MIXER_MAX_INPUTS];
+    ma_uint32 input_channels[MIXER_MAX_INPUTS];
+    float *applied;             /* [input][channel], gain reached at the end of the last block */
+    float *pattern;             /* [input][channel][4], lane gains of the current group of four frames */
+    float *step;                /* [input][channel][4], pattern increment per group */
+    float *lines[MIXER_MAX_INPUTS];     /* [MIXER_MAX_DELAY][channel], allocated by the UI thread on first use */
+    ma_uint32 history[MIXER_MAX_INPUTS];    /* Frames written to each line since it was last idle */
+    ma_uint32 read_delay[MIXER_MAX_INPUTS]; /* Delay each input was last read at */
+    float *delayed;             /* [4][MIXER_CHUNK][channel], delayed inputs of one batch */
+    float *fade;                /* [MIXER_CHUNK][channel], the old read position while a delay changes */
+    ma_uint32 line_pos;         /* Frame the next chunk is written at. */
+    struct dsp_arena arena;
+};
+
+static struct mixer_node_config mixer_node_config_init(ma_uint32 channels, ma_uint32 input_count)
+{
+    struct mixer_node_config config;
+    config.node_config = ma_node_config_init();
+    config.channels = channels;
+    config.input_count = input_count;
+    return config;
+}
+
+static void mixer_node_target_gains(const struct mixer_node *mixer, ma_uint32 index, bool any_solo, float *gains)
+{
+    const struct mixer_input *input = &mixer->inputs[index];
+    float gain = dsp_load_f32(&input->gain);
+    if (dsp_load_u32(&input->mute) || (any_solo && !dsp_load_u32(&input->solo)))
+        gain = 0.0f;
+
+    for (ma_uint32 ch = 0; ch < mixer->channels; ch++)
+        gains[ch] = gain;
+    if (mixer->channels == 2) {
+        /* Constant power, normalised to unity in the centre. */
+        float angle = (DSP_CLAMP(dsp_load_f32(&input->pan), -1.0f, 1.0f) + 1.0f) * (float)(DSP_PI / 4.0);
+        gains[0] *= cosf(angle) * (float)DSP_SQRT2;
+        gains[1] *= sinf(angle) * (float)DSP_SQRT2;
+    }
+}
+
+/* Sets up the lane patterns of one input to ramp from its applied gains to `target` over `frame_count`. */
+static void mixer_node_ramp(struct mixer_node *mixer, ma_uint32 index, const float *target, ma_uint32 frame_count)
+{
+    const ma_uint32 channels = mixer->channels;
+    float *applied = mixer->applied + (size_t)index * channels;
+    float *pattern = mixer->pattern + (size_t)index * channels * 4;
+    float *step = mixer->step + (size_t)index * channels * 4;
+
+    for (ma_uint32 lane = 0; lane < channels * 4; lane++) {
+        ma_uint32 frame = lane / channels, ch = lane % channels;
+        float delta = (target[ch] - applied[ch]) / (float)frame_count;
+        pattern[lane] = applied[ch] + delta * (float)(frame + 1);
+        step[lane] = delta * 4.0f;
+    }
+    memcpy(applied, target, sizeof(float) * channels);
+}
+
+/* out (=|+=) sum of in[i] * ramped gain of inputs[i], i < count, count <= 4 */
+static void mixer_node_accumulate(struct mixer_node *mixer, float *out, const float **in, const ma_uint32 *inputs,
+        ma_uint32 count, ma_uint32 frame_count, bool first)
+{
+    const ma_uint32 channels = mixer->channels;
+    const ma_uint32 groups = frame_count / 4;
+    const float *pattern[4], *step[4];
+    v4f p[4][MIXER_MAX_HELD];
+
+    for (ma_uint32 i = 0; i < count; i++) {
+        pattern[i] = mixer->pattern + (size_t)inputs[i] * channels * 4;
+        step[i] = mixer->step + (size_t)inputs[i] * channels * 4;
+    }
+
+    if (channels <= MIXER_MAX_HELD && kernels.mix != NULL) {
+        kernels.mix(out, in, pattern, step, count, channels, groups, first);
+    } else if (channels <= MIXER_MAX_HELD) {
+        /* Patterns live in registers (or at least on the stack) for the whole block. */
+        for (ma_uint32 i = 0; i < count; i++)
+            for (ma_uint32 v = 0; v < channels; v++)
+                p[i][v] = v4f_load(pattern[i] + 4 * v);
+
+        for (ma_uint32 g = 0; g < groups; g++) {
+            for (ma_uint32 v = 0; v < channels; v++) {
+                size_t at = ((size_t)g * channels + v) * 4;
+                v4f acc = first ? v4f_zero() : v4f_load(out + at);
+                for (ma_uint32 i = 0; i < count; i++) {
+                    acc = v4f_madd(v4f_load(in[i] + at), p[i][v], acc);
+                    p[i][v] = v4f_add(p[i][v], v4f_load(step[i] + 4 * v));
+                }
+                v4f_store(out + at, acc);
+            }
+        }
+    } else {
+        /* Wide buses: one input at a time, the pattern is recomputed from the group index. */
+        for (ma_uint32 i = 0; i < count; i++) {
+            for (ma_uint32 g = 0; g < groups; g++) {
+                v4f k = v4f_set1((float)g);
+                for (ma_uint32 v = 0; v < channels; v++) {
+                    size_t at = ((size_t)g * channels + v) * 4;
+                    v4f gain = v4f_madd(v4f_load(step[i] + 4 * v), k, v4f_load(pattern[i] + 4 * v));
+                    v4f acc = (first && i == 0) ? v4f_zero() : v4f_load(out + at);
+                    v4f_store(out + at, v4f_madd(v4f_load(in[i] + at), gain, acc));
+                }
+            }
+        }
+    }
+
+    /* Up to three trailing frames; the ramp has reached its target by the last one. */
+    for (ma_uint32 f = groups * 4; f < frame_count; f++) {
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            size_t at = (size_t)f * channels + ch;
+            float acc = first ? 0.0f : out[at];
+            for (ma_uint32 i = 0; i < count; i++) {
+                ma_uint32 lane = (f % 4) * channels + ch;
+                float gain = pattern[i][lane] + step[i][lane] * (float)(f / 4);
+                acc += in[i][at] * gain;
+            }
+            out[at] = acc;
+        }
+    }
+}
+
+/* Appends `count` frames of `in` to the delay line of input `index`. */
+static void mixer_node_line_write(struct mixer_node *mixer, ma_uint32 index, const float *in, ma_uint32 count)
+{
+    const ma_uint32 channels = mixer->channels;
+    float *line = mixer->lines[index];
+    ma_uint32 head = DSP_MIN(count, MIXER_MAX_DELAY - mixer->line_pos);
+    memcpy(line + (size_t)mixer->line_pos * channels, in, sizeof(float) * head * channels);
+    memcpy(line, in + (size_t)head * channels, sizeof(float) * (count - head) * channels);
+    mixer->history[index] = DSP_MIN(mixer->history[index] + count, (ma_uint32)MIXER_MAX_DELAY);
+}
+
+/*
+ * Reads the `count` frames written last, `delay` frames ago, from the delay
+ * line of input `index`. Frames from before the line's history are silent.
+ */
+static void mixer_node_line_read(struct mixer_node *mixer, ma_uint32 index, ma_uint32 delay, float *out, ma_uint32 count)
+{
+    const ma_uint32 channels = mixer->channels;
+    const float *line = mixer->lines[index];
+    ma_uint32 missing = DSP_MIN(count, DSP_MAX(delay + count, mixer->history[index]) - mixer->history[index]);
+    ma_uint32 pos = (mixer->line_pos - delay + missing) & (MIXER_MAX_DELAY - 1);
+    ma_uint32 head = DSP_MIN(count - missing, MIXER_MAX_DELAY - pos);
+    memset(out, 0, sizeof(float) * missing * channels);
+    out += (size_t)missing * channels;
+    memcpy(out, line + (size_t)pos * channels, sizeof(float) * head * channels);
+    memcpy(out + (size_t)head * channels, line, sizeof(float) * (count - missing - head) * channels);
+}
+
+/*
+ * Input `index` through a delay moving from `from` to `to` frames: both
+ * read positions, crossfaded linearly across the chunk into `out`.
+ */
+static void mixer_node_line_fade(struct mixer_node *mixer, ma_uint32 index, const float *in, ma_uint32 from,
+        ma_uint32 to, float *out, ma_uint32 count)
+{
+    const ma_uint32 channels = mixer->channels;
+    const float *a = in, *b = in;
+    const float step = 1.0f / (float)count;
+
+    if (from > 0) {
+        mixer_node_line_read(mixer, index, from, mixer->fade, count);
+        a = mixer->fade;
+    }
+    if (to > 0) {
+        mixer_node_line_read(mixer, index, to, out, count);
+        b = out;
+    }
+    for (ma_uint32 f = 0; f < count; f++) {
+        const float t = (float)(f + 1) * step;
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            size_t at = (size_t)f * channels + ch;
+            out[at] = a[at] + (b[at] - a[at]) * t;
+        }
+    }
+}
+
+/* Mixes one chunk of at most MIXER_CHUNK frames. */
+static void mixer_node_mix(struct mixer_node *mixer, const float **frames_in, float *out, ma_uint32 offset,
+        ma_uint32 frame_count)
+{
+    const ma_uint32 channels = mixer->channels;
+    float target[MA_MAX_CHANNELS];
+    const float *in[4];
+    ma_uint32 active[4], count = 0;
+    bool any_solo = false, first = true;
+
+    for (ma_uint32 i = 0; i < mixer->input_count; i++)
+        any_solo |= dsp_load_u32(&mixer->inputs[i].solo) != 0;
+
+    for (ma_uint32 i = 0; i < mixer->input_count; i++) {
+        if (frames_in[i] == NULL)
+            continue;
+        /* Acquire: pairs with mixer_node_set_delay, the line of a delayed input is in place. */
+        ma_uint32 delay = DSP_MIN(dsp_load_acquire_u32(&mixer->inputs[i].delay), MIXER_MAX_DELAY - MIXER_CHUNK);
+        const ma_uint32 from = mixer->read_delay[i];
+        const float *input = frames_in[i] + (size_t)offset * channels;
+        if (delay > 0 || from > 0)
+            mixer_node_line_write(mixer, i, input, frame_count);
+        else
+            mixer->history[i] = 0;
+        mixer->read_delay[i] = delay;
+
+        const float *applied = mixer->applied + (size_t)i * channels;
+        bool silent = true;
+        mixer_node_target_gains(mixer, i, any_solo, target);
+        for (ma_uint32 ch = 0; ch < channels; ch++)
+            silent &= target[ch] == 0.0f && applied[ch] == 0.0f;
+        if (silent)
+            continue;
+
+        float *delayed = mixer->delayed + (size_t)count * MIXER_CHUNK * channels;
+        if (delay != from) {
+            mixer_node_line_fade(mixer, i, input, from, delay, delayed, frame_count);
+            input = delayed;
+        } else if (delay > 0) {
+            mixer_node_line_read(mixer, i, delay, delayed, frame_count);
+            input = delayed;
+        }
+
+        mixer_node_ramp(mixer, i, target, frame_count);
+        in[count] = input;
+        active[count++] = i;
+        if (count == 4) {
+            mixer_node_accumulate(mixer, out, in, active, count, frame_count, first);
+            first = false;
+            count = 0;
+        }
+    }
+    if (count > 0) {
+        mixer_node_accumulate(mixer, out, in, active, count, frame_count, first);
+        first = false;
+    }
+    if (first)
+        memset(out, 0, sizeof(float) * frame_count * channels);
+    mixer->line_pos = (mixer->line_pos + frame_count) & (MIXER_MAX_DELAY - 1);
+}
+
+static void mixer_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct mixer_node *mixer = (struct mixer_node *)node;
+    const ma_uint32 frame_count = *frame_count_out;
+    (void)frame_count_in;
+
+    for (ma_uint32 done = 0; done < frame_count; ) {
+        ma_uint32 n = DSP_MIN(frame_count - done, (ma_uint32)MIXER_CHUNK);
+        mixer_node_mix(mixer, frames_in, frames_out[0] + (size_t)done * mixer->channels, done, n);
+        done += n;
+    }
+}
+
+static ma_node_vtable mixer_node_vtable = {
+    mixer_node_process_pcm_frames,
+    NULL,                       /* onGetRequiredInputFrameCount */
+    MA_NODE_BUS_COUNT_UNKNOWN,  /* Set by the config. */
+    1,                          /* One output. */
+    0                           /* Default flags. */
+};
+
+static void mixer_node_layout(struct mixer_node *mixer)
+{
+    size_t lanes = (size_t)mixer->input_count * mixer->channels;
+    mixer->applied = dsp_arena_floats(&mixer->arena, lanes);
+    mixer->pattern = dsp_arena_floats(&mixer->arena, lanes * 4);
+    mixer->step = dsp_arena_floats(&mixer->arena, lanes * 4);
+    mixer->delayed = dsp_arena_floats(&mixer->arena, (size_t)4 * MIXER_CHUNK * mixer->channels);
+    mixer->fade = dsp_arena_floats(&mixer->arena, (size_t)MIXER_CHUNK * mixer->channels);
+}
+
+/*
+ * Sets the delay of input `index`, from the UI thread. The input's delay
+ * line is allocated the first time it is delayed and then kept, as the
+ * audio thread may be reading it; on failure the delay is left as it was.
+ */
+static ma_result mixer_node_set_delay(struct mixer_node *mixer, ma_uint32 index, ma_uint32 delay)
+{
+    delay = DSP_MIN(delay, MIXER_MAX_DELAY - MIXER_CHUNK);
+    if (delay > 0 && mixer->lines[index] == NULL) {
+        float *line = dsp_alloc((size_t)MIXER_MAX_DELAY * mixer->channels);
+        if (line == NULL)
+            return MA_OUT_OF_MEMORY;
+        mixer->lines[index] = line;
+    }
+    /* Release: the line is in place before the audio thread sees a delay that reads it. */
+    dsp_store_release_u32(&mixer->inputs[index].delay, delay);
+    return MA_SUCCESS;
+}
+
+static ma_result mixer_node_init(ma_node_graph *graph, const struct mixer_node_config *config,
+        const ma_allocation_callbacks *alloc, struct mixer_node *mixer)
+{
+    ma_result result;
+
+    if (mixer == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(mixer, 0, sizeof(*mixer));
+    if (config->channels == 0 || config->channels > MA_MAX_CHANNELS
+            || config->input_count == 0 || config->input_count > MIXER_MAX_INPUTS)
+        return MA_INVALID_ARGS;
+
+    mixer->channels = config->channels;
+    mixer->input_count = config->input_count;
+    for (ma_uint32 i = 0; i < mixer->input_count; i++) {
+        mixer->inputs[i].gain = 1.0f;
+        mixer->input_channels[i] = config->channels;
+    }
+
+    mixer_node_layout(mixer);
+    result = dsp_arena_init(&mixer->arena, mixer->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    mixer_node_layout(mixer);
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &mixer_node_vtable;
+    base_config.inputBusCount = config->input_count;
+    base_config.pInputChannels = mixer->input_channels;
+    base_config.pOutputChannels = &config->channels;
+    result = ma_node_init(graph, &base_config, alloc, &mixer->base);
+    if (result != MA_SUCCESS) {
+        dsp_arena_uninit(&mixer->arena);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void mixer_node_uninit(struct mixer_node *mixer, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&mixer->base, alloc);
+    for (ma_uint32 i = 0; i < mixer->input_count; i++)
+        dsp_free(mixer->lines[i]);
+    dsp_arena_uninit(&mixer->arena);
+}
@@ -0,0 +1,498 @@
+/*
+ * Band-limited wavetable oscillator bank.
+ *
+ * Each shape is stored as a mip-map of single cycle tables, one per octave,
+ * each holding only the harmonics that stay below Nyquist for the pitches it
+ * plays. The tables are built once by inverse FFT and shared by every node.
+ * A node runs up to OSCILLATOR_MAX_VOICES voices kept as arrays of phase,
+ * increment and amplitude. A voice renders four frames per vector: the
+ * table reads are scalar, the phase update and interpolation are vector.
+ * Voices either spread as a detuned unison for pads or stack as a harmonic
+ * series of partials for additive tones.
+ *
+ * With a MIDI player linked to its input (see midi.c) the bank plays as a
+ * monophonic voice: the last note on sets the frequency and opens a gate
+ * scaled by its velocity, its note off closes the gate. Rendering is split
+ * at each event's frame, and the gate slews over OSCILLATOR_GATE_TIME so
+ * notes start and stop without clicks.
+ */
+#include "dsp.h"
+
+#define WAVETABLE_SIZE          2048
+#define WAVETABLE_LEVELS        11      /* Level l holds up to (WAVETABLE_SIZE / 2) >> l harmonics. */
+#define WAVETABLE_STRIDE        (WAVETABLE_SIZE + 4)    /* One guard sample for interpolation, padded. */
+#define OSCILLATOR_MAX_VOICES   256
+#define OSCILLATOR_BLOCK        256     /* Frames rendered in mono before spreading to the channels. */
+#define OSCILLATOR_GATE_TIME    2.0f    /* ms for the gate to open or close fully */
+#define OSCILLATOR_NO_NOTE      128
+
+enum oscillator_shape {
+    OSCILLATOR_SINE,
+    OSCILLATOR_TRIANGLE,
+    OSCILLATOR_SAW,
+    OSCILLATOR_SQUARE,
+    OSCILLATOR_SHAPE_COUNT
+};
+
+static const char *oscillator_shape_names[OSCILLATOR_SHAPE_COUNT] = {
+    "Sine", "Triangle", "Saw", "Square",
+};
+
+enum oscillator_mode {
+    OSCILLATOR_UNISON,          /* Voices detuned around the frequency. */
+    OSCILLATOR_PARTIALS,        /* Voice v at (v + 1) times the frequency, 1 / (v + 1) amplitude. */
+    OSCILLATOR_MODE_COUNT
+};
+
+static const char *oscillator_mode_names[OSCILLATOR_MODE_COUNT] = {
+    "Unison", "Partials",
+};
+
+static struct {
+    pthread_mutex_t lock;
+    float *tables[OSCILLATOR_SHAPE_COUNT];  /* [level][WAVETABLE_STRIDE] */
+} wavetable_cache = { PTHREAD_MUTEX_INITIALIZER, { 0 } };
+
+/* Amplitude of sine harmonic h (1 based) of a unit shape. */
+static double wavetable_harmonic(enum oscillator_shape shape, ma_uint32 h)
+{
+    switch (shape) {
+    case OSCILLATOR_SINE:
+        return h == 1 ? 1.0 : 0.0;
+    case OSCILLATOR_TRIANGLE:
+        return h % 2 == 0 ? 0.0 : 8.0 / (DSP_PI * DSP_PI * h * h) * ((h / 2) % 2 ? -1.0 : 1.0);
+    case OSCILLATOR_SAW:
+        return 2.0 / (DSP_PI * h) * (h % 2 ? 1.0 : -1.0);
+    case OSCILLATOR_SQUARE:
+        return h % 2 == 0 ? 0.0 : 4.0 / (DSP_PI * h);
+    default:
+        return 0.0;
+    }
+}
+
+static float *wavetable_create(enum oscillator_shape shape)
+{
+    const struct fft_plan *plan = fft_plan_get(WAVETABLE_SIZE);
+    const ma_uint32 bins = WAVETABLE_SIZE / 2 + 1;
+    if (plan == NULL)
+        return NULL;
+
+    float *tables = dsp_alloc((size_t)WAVETABLE_LEVELS * WAVETABLE_STRIDE);
+    float *re = dsp_alloc(bins), *im = dsp_alloc(bins), *scratch = dsp_alloc(fft_scratch_size(plan));
+    if (tables == NULL || re == NULL || im == NULL || scratch == NULL) {
+        dsp_free(tables);
+        tables = NULL;
+        goto done;
+    }
+
+    for (ma_uint32 level = 0; level < WAVETABLE_LEVELS; level++) {
+        /* The Nyquist bin can't carry a sine, so level 0 stops one short. */
+        ma_uint32 harmonics = DSP_MIN((ma_uint32)(WAVETABLE_SIZE / 2) >> level, bins - 2);
+        memset(re, 0, sizeof(float) * bins);
+        memset(im, 0, sizeof(float) * bins);
+        for (ma_uint32 h = 1; h <= harmonics; h++)
+            im[h] = (float)(-0.5 * wavetable_harmonic(shape, h));
+
+        float *table = tables + (size_t)level * WAVETABLE_STRIDE;
+        fft_inverse(plan, re, im, table, scratch);
+        for (ma_uint32 i = WAVETABLE_SIZE; i < WAVETABLE_STRIDE; i++)
+            table[i] = table[i - WAVETABLE_SIZE];
+    }
+
+done:
+    dsp_free(re);
+    dsp_free(im);
+    dsp_free(scratch);
+    return tables;
+}
+
+/* Returns the shared mip-map for `shape`, building it on first use. */
+static const float *wavetable_get(enum oscillator_shape shape)
+{
+    float *tables;
+
+    if (shape >= OSCILLATOR_SHAPE_COUNT)
+        return NULL;
+    pthread_mutex_lock(&wavetable_cache.lock);
+    if (wavetable_cache.tables[shape] == NULL)
+        wavetable_cache.tables[shape] = wavetable_create(shape);
+    tables = wavetable_cache.tables[shape];
+    pthread_mutex_unlock(&wavetable_cache.lock);
+    return tables;
+}
+
+static void wavetable_cache_clear(void)
+{
+    pthread_mutex_lock(&wavetable_cache.lock);
+    for (int i = 0; i < OSCILLATOR_SHAPE_COUNT; i++) {
+        dsp_free(wavetable_cache.tables[i]);
+        wavetable_cache.tables[i] = NULL;
+    }
+    pthread_mutex_unlock(&wavetable_cache.lock);
+}
+
+/* Mip level whose harmonics all stay below Nyquist at `increment` cycles per sample. */
+static ma_uint32 wavetable_level(float increment)
+{
+    int exponent;
+    float mantissa = frexpf(increment * WAVETABLE_SIZE, &exponent);
+    int level = mantissa == 0.5f ? exponent - 1 : exponent;     /* ceil(log2) */
+    return (ma_uint32)DSP_CLAMP(level, 0, WAVETABLE_LEVELS - 1);
+}
+
+struct oscillator_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    enum oscillator_shape shape;
+    enum oscillator_mode mode;
+    float frequency;
+    ma_uint32 voice_count;
+};
+
+struct oscillator {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    const float *tables[OSCILLATOR_SHAPE_COUNT];
+
+    /* Written by the UI thread, read once per block. */
+    ma_uint32 shape;
+    ma_uint32 mode;
+    float frequency;            /* Hz */
+    float detune;               /* Cents between the outermost unison voices. */
+    ma_uint32 voice_count;
+    float gain;                 /* Linear. */
+    struct midi_player *midi;   /* Linked player, or NULL */
+
+    /* Audio thread state, one entry per voice. */
+    float *phase;               /* Cycles, 0..1 */
+    float *increment;           /* Cycles per frame */
+    float *amplitude;
+    const float **table;        /* Mip level in use */
+    float applied_gain;
+    float *mono;                /* [OSCILLATOR_BLOCK], plus a vector of spill */
+
+    /* Audio thread state, MIDI. */
+    bool keyed;                 /* A player is linked: the gate follows its notes. */
+    ma_uint32 note;             /* Sounding note, or OSCILLATOR_NO_NOTE */
+    float note_frequency;       /* Hz */
+    float gate;                 /* Target level, velocity scaled */
+    float level;
+    struct dsp_arena arena;
+};
+
+static struct oscillator_config
+oscillator_config_init(ma_uint32 channels, ma_uint32 sample_rate, enum oscillator_shape shape,
+        enum oscillator_mode mode, float frequency, ma_uint32 voice_count)
+{
+    struct oscillator_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.shape = shape;
+    config.mode = mode;
+    config.frequency = frequency;
+    config.voice_count = voice_count;
+    return config;
+}
+
+static void oscillator_layout(struct oscillator *osc)
+{
+    osc->phase = dsp_arena_floats(&osc->arena, OSCILLATOR_MAX_VOICES);
+    osc->increment = dsp_arena_floats(&osc->arena, OSCILLATOR_MAX_VOICES);
+    osc->amplitude = dsp_arena_floats(&osc->arena, OSCILLATOR_MAX_VOICES);
+    osc->table = (const float **)dsp_arena_floats(&osc->arena,
+            OSCILLATOR_MAX_VOICES * sizeof(const float *) / sizeof(float));
+    osc->mono = dsp_arena_floats(&osc->arena, OSCILLATOR_BLOCK + 4);
+}
+
+static ma_result oscillator_init(const struct oscillator_config *config, struct oscillator *osc)
+{
+    ma_result result;
+
+    memset(osc, 0, sizeof(*osc));
+    if (config->channels == 0 || config->sample_rate == 0 || config->shape >= OSCILLATOR_SHAPE_COUNT
+            || config->mode >= OSCILLATOR_MODE_COUNT)
+        return MA_INVALID_ARGS;
+    for (int i = 0; i < OSCILLATOR_SHAPE_COUNT; i++) {
+        osc->tables[i] = wavetable_get((enum oscillator_shape)i);
+        if (osc->tables[i] == NULL)
+            return MA_OUT_OF_MEMORY;
+    }
+
+    osc->channels = config->channels;
+    osc->sample_rate = config->sample_rate;
+    osc->shape = config->shape;
+    osc->mode = config->mode;
+    osc->frequency = config->frequency;
+    osc->detune = 20.0f;
+    osc->voice_count = DSP_CLAMP(config->voice_count, 1u, (ma_uint32)OSCILLATOR_MAX_VOICES);
+    osc->gain = 0.5f;
+    osc->note = OSCILLATOR_NO_NOTE;
+    osc->gate = 1.0f;
+    osc->level = 1.0f;
+
+    oscillator_layout(osc);
+    result = dsp_arena_init(&osc->arena, osc->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    oscillator_layout(osc);
+
+    /* Spread the starting phases so unison voices don't start out as one loud peak. */
+    ma_uint32 seed = 0x9e3779b9u;
+    for (ma_uint32 v = 0; v < OSCILLATOR_MAX_VOICES; v++) {
+        seed = seed * 1664525u + 1013904223u;
+        osc->phase[v] = (float)(seed >> 8) / (float)(1u << 24);
+    }
+    return MA_SUCCESS;
+}
+
+static void oscillator_uninit(struct oscillator *osc)
+{
+    dsp_arena_uninit(&osc->arena);
+}
+
+/*
+ * Sets each voice's increment, amplitude and mip level from the UI parameters
+ * at `frequency`; returns the voice count.
+ */
+static ma_uint32 oscillator_update_voices(struct oscillator *osc, float frequency)
+{
+    const ma_uint32 count = DSP_CLAMP(dsp_load_u32(&osc->voice_count), 1u, (ma_uint32)OSCILLATOR_MAX_VOICES);
+    const ma_uint32 shape = DSP_MIN(dsp_load_u32(&osc->shape), (ma_uint32)OSCILLATOR_SHAPE_COUNT - 1);
+    const float base = DSP_CLAMP(frequency, 0.0f, 0.5f * osc->sample_rate) / osc->sample_rate;
+    const float *tables = osc->tables[shape];
+
+    if (dsp_load_u32(&osc->mode) == OSCILLATOR_PARTIALS) {
+        float norm = 0.0f;
+        for (ma_uint32 v = 0; v < count; v++)
+            norm += 1.0f / (float)(v + 1);
+        for (ma_uint32 v = 0; v < count; v++) {
+            float increment = base * (float)(v + 1);
+            osc->increment[v] = increment;
+            /* Partials at or above Nyquist are silenced rather than aliased. */
+            osc->amplitude[v] = increment < 0.5f ? 1.0f / ((float)(v + 1) * norm) : 0.0f;
+            osc->table[v] = tables + (size_t)wavetable_level(increment) * WAVETABLE_STRIDE;
+        }
+    } else {
+        const float cents = dsp_load_f32(&osc->detune);
+        const float amplitude = 1.0f / sqrtf((float)count);
+        for (ma_uint32 v = 0; v < count; v++) {
+            float offset = count > 1 ? (float)v / (float)(count - 1) - 0.5f : 0.0f;
+            float increment = DSP_MIN(base * exp2f(offset * cents / 1200.0f), 0.5f);
+            osc->increment[v] = increment;
+            osc->amplitude[v] = amplitude;
+            osc->table[v] = tables + (size_t)wavetable_level(increment) * WAVETABLE_STRIDE;
+        }
+    }
+    return count;
+}
+
+/* mono[0 .. frame_count) = sum of one voice, frame_count a multiple of 4 */
+static void oscillator_render_voice(struct oscillator *osc, ma_uint32 v, float *mono, ma_uint32 frame_count, bool first)
+{
+    const float *table = osc->table[v];
+    const float increment = osc->increment[v];
+    const v4f amplitude = v4f_set1(osc->amplitude[v]);
+    const v4f size = v4f_set1((float)WAVETABLE_SIZE);
+    const v4f ramp = v4f_set(0.0f, increment, 2.0f * increment, 3.0f * increment);
+    float phase = osc->phase[v];
+    float index[4];
+
+    for (ma_uint32 f = 0; f < frame_count; f += 4) {
+        v4f p = v4f_add(v4f_set1(phase), ramp);
+        p = v4f_sub(p, v4f_floor(p));
+        v4f x = v4f_mul(p, size);
+        v4f whole = v4f_floor(x);
+        v4f_store(index, whole);
+
+        /* Four table reads per lane pair; everything else stays in vectors. */
+        ma_uint32 i0 = (ma_uint32)index[0], i1 = (ma_uint32)index[1];
+        ma_uint32 i2 = (ma_uint32)index[2], i3 = (ma_uint32)index[3];
+        v4f a = v4f_set(table[i0], table[i1], table[i2], table[i3]);
+        v4f b = v4f_set(table[i0 + 1], table[i1 + 1], table[i2 + 1], table[i3 + 1]);
+        v4f sample = v4f_madd(v4f_sub(b, a), v4f_sub(x, whole), a);
+
+        v4f acc = first ? v4f_zero() : v4f_load(mono + f);
+        v4f_store(mono + f, v4f_madd(sample, amplitude, acc));
+
+        phase += 4.0f * increment;
+        phase -= floorf(phase);
+    }
+    osc->phase[v] = phase;
+}
+
+/* Applies a MIDI event; returns true when the voices need retuning. */
+static bool oscillator_apply(struct oscillator *osc, const struct midi_event *ev)
+{
+    switch (ev->status & 0xF0) {
+    case MIDI_NOTE_ON:
+        osc->note = ev->data1;
+        osc->note_frequency = 440.0f * exp2f(((float)ev->data1 - 69.0f) / 12.0f);
+        osc->gate = (float)ev->data2 / 127.0f;
+        return true;
+    case MIDI_NOTE_OFF:
+        /* Only the sounding note closes the gate: no note stack to fall back on. */
+        if (ev->data1 == osc->note) {
+            osc->note = OSCILLATOR_NO_NOTE;
+            osc->gate = 0.0f;
+        }
+        return false;
+    case MIDI_CONTROL:
+        if (ev->data1 == MIDI_CONTROL_SOUND_OFF || ev->data1 == MIDI_CONTROL_NOTES_OFF) {
+            osc->note = OSCILLATOR_NO_NOTE;
+            osc->gate = 0.0f;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+/* osc->mono[from .. from + frame_count) = every voice, through the gate. */
+static void oscillator_render(struct oscillator *osc, ma_uint32 count, ma_uint32 from, ma_uint32 frame_count)
+{
+    ma_uint32 rendered = (frame_count + 3) & ~3u;
+    float *mono = osc->mono + from;
+
+    for (ma_uint32 v = 0; v < count; v++)
+        oscillator_render_voice(osc, v, mono, rendered, v == 0);
+
+    /*
+     * A stretch rounded up to whole vectors has advanced the phases too
+     * far; wind back the extra frames so the next one continues on. Its
+     * spill past the stretch is overwritten by the next.
+     */
+    if (rendered != frame_count) {
+        for (ma_uint32 v = 0; v < count; v++) {
+            float phase = osc->phase[v] - (float)(rendered - frame_count) * osc->increment[v];
+            osc->phase[v] = phase - floorf(phase);
+        }
+    }
+
+    if (osc->level != 1.0f || osc->gate != 1.0f) {
+        const float slew = 1000.0f / (OSCILLATOR_GATE_TIME * (float)osc->sample_rate);
+        float level = osc->level;
+        for (ma_uint32 f = 0; f < frame_count; f++) {
+            level += DSP_CLAMP(osc->gate - level, -slew, slew);
+            mono[f] *= level;
+        }
+        osc->level = level;
+    }
+}
+
+static void oscillator_process(struct oscillator *osc, float *out, ma_uint32 frame_count,
+        const struct midi_event *events, ma_uint32 event_count)
+{
+    const ma_uint32 channels = osc->channels;
+    const float target = dsp_load_f32(&osc->gain);
+
+    /* Linking a player closes the gate until its first note; unlinking opens it. */
+    if (osc->keyed != (events != NULL)) {
+        osc->keyed = events != NULL;
+        osc->note = OSCILLATOR_NO_NOTE;
+        osc->gate = osc->keyed ? 0.0f : 1.0f;
+    }
+    ma_uint32 count = oscillator_update_voices(osc, osc->keyed ? osc->note_frequency : dsp_load_f32(&osc->frequency));
+
+    ma_uint32 e = 0;
+    for (ma_uint32 done = 0; done < frame_count; ) {
+        ma_uint32 block = DSP_MIN(frame_count - done, (ma_uint32)OSCILLATOR_BLOCK);
+
+        /* Render up to each event's frame, then apply it. */
+        for (ma_uint32 at = 0; at < block; ) {
+            for (; e < event_count && events[e].time <= done + at; e++)
+                if (oscillator_apply(osc, &events[e]))
+                    count = oscillator_update_voices(osc, osc->note_frequency);
+            ma_uint32 end = e < event_count ? DSP_MIN(events[e].time - done, block) : block;
+            oscillator_render(osc, count, at, end - at);
+            at = end;
+        }
+
+        /* Gain ramps to the UI value across the block. */
+        float gain = osc->applied_gain, step = (target - gain) / (float)block;
+        for (ma_uint32 f = 0; f < block; f++) {
+            gain += step;
+            float s = osc->mono[f] * gain;
+            for (ma_uint32 ch = 0; ch < channels; ch++)
+                out[(size_t)(done + f) * channels + ch] = s;
+        }
+        osc->applied_gain = target;
+        done += block;
+    }
+    /* Events at the very end of the call. */
+    for (; e < event_count; e++)
+        oscillator_apply(osc, &events[e]);
+}
+
+
+/*
+ * Oscillator Node
+ */
+struct oscillator_node_config {
+    ma_node_config node_config;
+    struct oscillator_config oscillator;
+};
+
+struct oscillator_node {
+    ma_node_base base;
+    struct oscillator oscillator;
+};
+
+static struct oscillator_node_config
+oscillator_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, enum oscillator_shape shape,
+        enum oscillator_mode mode, float frequency, ma_uint32 voice_count)
+{
+    struct oscillator_node_config config;
+    config.node_config = ma_node_config_init();
+    config.oscillator = oscillator_config_init(channels, sample_rate, shape, mode, frequency, voice_count);
+    return config;
+}
+
+static void oscillator_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct oscillator_node *osc = (struct oscillator_node *)node;
+    ma_uint32 event_count;
+    const struct midi_event *events = midi_input_events(&osc->oscillator.midi,
+            frames_in != NULL ? frames_in[0] : NULL, &event_count);
+    (void)frame_count_in;
+    oscillator_process(&osc->oscillator, frames_out[0], *frame_count_out, events, event_count);
+}
+
+static ma_node_vtable oscillator_node_vtable = {
+    oscillator_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input, from a MIDI player. */
+    1,      /* One output. */
+    MA_NODE_FLAG_CONTINUOUS_PROCESSING | MA_NODE_FLAG_ALLOW_NULL_INPUT  /* Plays with nothing linked. */
+};
+
+static ma_result oscillator_node_init(ma_node_graph *graph, const struct oscillator_node_config *config,
+        const ma_allocation_callbacks *alloc, struct oscillator_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = oscillator_init(&config->oscillator, &node->oscillator);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &oscillator_node_vtable;
+    base_config.pInputChannels = &midi_input_channels;
+    base_config.pOutputChannels = &config->oscillator.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        oscillator_uninit(&node->oscillator);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void oscillator_node_uninit(struct oscillator_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    oscillator_uninit(&node->oscillator);
+}
@@ -0,0 +1,297 @@
+/*
+ * Oversampling for non-linear processing, by 1x, 2x, 4x or 8x.
+ *
+ * Each doubling is a stage of half-band FIR filters. Every other tap of a
+ * half-band filter is zero, apart from the centre tap of 1/2, so it splits
+ * into two polyphase branches: an "even" branch of oversampler_taps[s]
+ * symmetric taps, and an "odd" branch that is a plain delay. Going up, the
+ * even branch makes the even output samples and the delay makes the odd
+ * ones. Going down, the even input samples go through the even branch and
+ * the odd ones through the delay. Either way a stage costs half the taps of
+ * the whole filter at the lower rate. The even branch computes four
+ * consecutive outputs per vector and folds the symmetric taps, so a sample
+ * costs taps / 8 multiply-adds.
+ *
+ * Stage 0 sits at the base rate. It keeps everything up to 20 kHz and, at
+ * 48 kHz, rejects the image of that band by 100 dB, so it needs the steep,
+ * long filter. The stages above only have to reject images far above the
+ * audio band, so they are short.
+ *
+ * The caller's process callback runs on one channel at a time at the
+ * oversampled rate, in place. A round trip delays the signal by a whole
+ * number of base rate frames, padded with up to OVERSAMPLER_MAX_FACTOR - 1
+ * samples at the top rate, so the editor can compensate it exactly.
+ */
+#include "dsp.h"
+
+#define OVERSAMPLER_MAX_STAGES  3
+#define OVERSAMPLER_MAX_FACTOR  (1u << OVERSAMPLER_MAX_STAGES)
+#define OVERSAMPLER_MAX_TAPS    64
+#define OVERSAMPLER_CHUNK       128     /* Base rate frames per pass */
+
+/* Even branch taps of each stage, multiples of 4, and the Kaiser window beta each is designed with. */
+static const ma_uint32 oversampler_taps[OVERSAMPLER_MAX_STAGES] = { 64, 12, 8 };
+static const double oversampler_beta[OVERSAMPLER_MAX_STAGES] = { 10.0, 11.0, 11.0 };
+
+/*
+ * Processes `count` samples of one channel in place. `offset` is where the
+ * first of them falls in the block, in oversampled samples, for ramping
+ * parameters across a block.
+ */
+typedef void (*oversampler_callback)(void *user, ma_uint32 channel, float *samples, ma_uint32 offset, ma_uint32 count);
+
+struct oversampler {
+    ma_uint32 channels;
+    ma_uint32 stages;           /* log2 of the factor */
+    ma_uint32 pad;              /* Top rate samples of delay that round the latency to whole frames */
+    float coeffs[OVERSAMPLER_MAX_STAGES][OVERSAMPLER_MAX_TAPS];    /* Even branch of each stage */
+
+    /*
+     * Per channel, each with the stage's taps - 1 samples of history in
+     * front: the input of each upsampling stage, and the input of each
+     * downsampling stage split into its even and odd samples.
+     */
+    float *up[OVERSAMPLER_MAX_STAGES];
+    float *even[OVERSAMPLER_MAX_STAGES];
+    float *odd[OVERSAMPLER_MAX_STAGES];
+    float *top;                 /* [channel][OVERSAMPLER_MAX_FACTOR + chunk], at the oversampled rate */
+    float *scratch;             /* Output of a downsampling stage */
+    struct dsp_arena arena;
+};
+
+/* Per channel length of a stage's buffers. */
+static ma_uint32 oversampler_stride(ma_uint32 stage)
+{
+    return oversampler_taps[stage] - 1 + (OVERSAMPLER_CHUNK << stage);
+}
+
+static ma_uint32 oversampler_top_stride(void)
+{
+    return OVERSAMPLER_MAX_FACTOR + OVERSAMPLER_CHUNK * OVERSAMPLER_MAX_FACTOR;
+}
+
+static ma_uint32 oversampler_stages(ma_uint32 factor)
+{
+    ma_uint32 stages = 0;
+    while (stages < OVERSAMPLER_MAX_STAGES && (2u << stages) <= factor)
+        stages++;
+    return stages;
+}
+
+/* Round trip delay through `stages` stages, in samples at the top rate. */
+static ma_uint32 oversampler_delay(ma_uint32 stages)
+{
+    ma_uint32 delay = 0;
+    for (ma_uint32 s = 0; s < stages; s++)
+        delay += (oversampler_taps[s] - 1) << (stages - s);
+    return delay;
+}
+
+/* Round trip latency at `factor`, in base rate frames. */
+static ma_uint32 oversampler_latency(ma_uint32 factor)
+{
+    const ma_uint32 stages = oversampler_stages(factor), top = 1u << stages;
+    return (oversampler_delay(stages) + top - 1) / top;
+}
+
+static ma_uint32 oversampler_get_factor(const struct oversampler *os)
+{
+    return 1u << os->stages;
+}
+
+/* Clears the filter state when the factor changes: the histories hold samples at the old rates. */
+static void oversampler_set_factor(struct oversampler *os, ma_uint32 factor)
+{
+    const ma_uint32 stages = oversampler_stages(factor);
+    if (stages == os->stages)
+        return;
+    os->stages = stages;
+    os->pad = (oversampler_latency(factor) << stages) - oversampler_delay(stages);
+    memset(os->arena.base, 0, os->arena.size);
+}
+
+static double oversampler_bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static void oversampler_layout(struct oversampler *os)
+{
+    for (ma_uint32 s = 0; s < OVERSAMPLER_MAX_STAGES; s++) {
+        os->up[s] = dsp_arena_floats(&os->arena, (size_t)os->channels * oversampler_stride(s));
+        os->even[s] = dsp_arena_floats(&os->arena, (size_t)os->channels * oversampler_stride(s));
+        os->odd[s] = dsp_arena_floats(&os->arena, (size_t)os->channels * oversampler_stride(s));
+    }
+    os->top = dsp_arena_floats(&os->arena, (size_t)os->channels * oversampler_top_stride());
+    os->scratch = dsp_arena_floats(&os->arena, OVERSAMPLER_CHUNK << (OVERSAMPLER_MAX_STAGES - 1));
+}
+
+static ma_result oversampler_init(struct oversampler *os, ma_uint32 channels, ma_uint32 factor)
+{
+    ma_result result;
+
+    memset(os, 0, sizeof(*os));
+    if (channels == 0)
+        return MA_INVALID_ARGS;
+    os->channels = channels;
+
+    /*
+     * Kaiser windowed sinc cut at a quarter of the upper rate. Only the even
+     * branch is kept, h[2k], normalised to 1/2 at DC like the centre tap.
+     */
+    for (ma_uint32 s = 0; s < OVERSAMPLER_MAX_STAGES; s++) {
+        const ma_uint32 taps = oversampler_taps[s];
+        double sum = 0.0;
+        for (ma_uint32 k = 0; k < taps; k++) {
+            double d = 2.0 * k - (taps - 1.0);      /* Distance from the centre tap, odd */
+            double r = d / (taps + 1.0);
+            double window = oversampler_bessel_i0(oversampler_beta[s] * sqrt(1.0 - r * r))
+                    / oversampler_bessel_i0(oversampler_beta[s]);
+            double h = sin(DSP_PI * d / 2.0) / (DSP_PI * d) * window;
+            os->coeffs[s][k] = (float)h;
+            sum += h;
+        }
+        for (ma_uint32 k = 0; k < taps; k++)
+            os->coeffs[s][k] = (float)(os->coeffs[s][k] * 0.5 / sum);
+    }
+
+    oversampler_layout(os);
+    result = dsp_arena_init(&os->arena, os->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    oversampler_layout(os);
+
+    oversampler_set_factor(os, factor);
+    return MA_SUCCESS;
+}
+
+static void oversampler_uninit(struct oversampler *os)
+{
+    dsp_arena_uninit(&os->arena);
+}
+
+/* Moves the last `history` samples of a buffer that was `count` samples longer to its front. */
+static inline void oversampler_keep(float *buffer, ma_uint32 history, ma_uint32 count)
+{
+    memmove(buffer, buffer + count, history * sizeof(float));
+}
+
+/* y[2i] = 2 * sum_k c[k] x[i - k], y[2i + 1] = x[i - taps / 2 + 1], for `count` samples of x. */
+static void oversampler_up(const float *c, ma_uint32 taps, float *y, const float *x, ma_uint32 count)
+{
+    const ma_uint32 half = taps / 2;
+    ma_uint32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        v4f acc = v4f_zero();
+        for (ma_uint32 k = 0; k < half; k++)
+            acc = v4f_madd(v4f_set1(c[k]), v4f_add(v4f_load(x + i - k), v4f_load(x + i - (taps - 1 - k))), acc);
+        v4f lo, hi;
+        v4f_zip(v4f_add(acc, acc), v4f_load(x + i - half + 1), &lo, &hi);
+        v4f_store(y + 2 * i, lo);
+        v4f_store(y + 2 * i + 4, hi);
+    }
+    for (; i < count; i++) {
+        float acc = 0.0f;
+        for (ma_uint32 k = 0; k < half; k++)
+            acc += c[k] * (x[(int)i - (int)k] + x[(int)i - (int)(taps - 1 - k)]);
+        y[2 * i] = 2.0f * acc;
+        y[2 * i + 1] = x[(int)i - (int)half + 1];
+    }
+}
+
+/* y[i] = sum_k c[k] e[i - k] + o[i - taps / 2] / 2, where e and o are the even and odd input samples. */
+static void oversampler_down(const float *c, ma_uint32 taps, float *y, const float *e, const float *o, ma_uint32 count)
+{
+    const ma_uint32 half = taps / 2;
+    ma_uint32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        v4f acc = v4f_mul(v4f_set1(0.5f), v4f_load(o + i - half));
+        for (ma_uint32 k = 0; k < half; k++)
+            acc = v4f_madd(v4f_set1(c[k]), v4f_add(v4f_load(e + i - k), v4f_load(e + i - (taps - 1 - k))), acc);
+        v4f_store(y + i, acc);
+    }
+    for (; i < count; i++) {
+        float acc = 0.5f * o[(int)i - (int)half];
+        for (ma_uint32 k = 0; k < half; k++)
+            acc += c[k] * (e[(int)i - (int)k] + e[(int)i - (int)(taps - 1 - k)]);
+        y[i] = acc;
+    }
+}
+
+/* Splits `2 * count` samples into the even and odd inputs of downsampling stage `s`, for channel `ch`. */
+static void oversampler_split(struct oversampler *os, ma_uint32 s, ma_uint32 ch, const float *x, ma_uint32 count)
+{
+    const ma_uint32 history = oversampler_taps[s] - 1;
+    float *e = os->even[s] + (size_t)ch * oversampler_stride(s) + history;
+    float *o = os->odd[s] + (size_t)ch * oversampler_stride(s) + history;
+    ma_uint32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        v4f even, odd;
+        v4f_unzip(v4f_load(x + 2 * i), v4f_load(x + 2 * i + 4), &even, &odd);
+        v4f_store(e + i, even);
+        v4f_store(o + i, odd);
+    }
+    for (; i < count; i++) {
+        e[i] = x[2 * i];
+        o[i] = x[2 * i + 1];
+    }
+}
+
+/*
+ * Runs `frame_count` interleaved frames from `in` up to the oversampled
+ * rate, through `callback`, and back down into `out`.
+ */
+static void oversampler_process(struct oversampler *os, float *out, const float *in, ma_uint32 frame_count,
+        oversampler_callback callback, void *user)
+{
+    const ma_uint32 channels = os->channels, stages = os->stages;
+
+    for (ma_uint32 done = 0; done < frame_count; ) {
+        const ma_uint32 n = DSP_MIN(OVERSAMPLER_CHUNK, frame_count - done), top_count = n << stages;
+
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            float *top = os->top + (size_t)ch * oversampler_top_stride() + OVERSAMPLER_MAX_FACTOR;
+            float *x = stages == 0 ? top : os->up[0] + (size_t)ch * oversampler_stride(0) + oversampler_taps[0] - 1;
+            for (ma_uint32 i = 0; i < n; i++)
+                x[i] = in[(size_t)(done + i) * channels + ch];
+
+            for (ma_uint32 s = 0; s < stages; s++) {
+                float *y = s + 1 < stages
+                        ? os->up[s + 1] + (size_t)ch * oversampler_stride(s + 1) + oversampler_taps[s + 1] - 1
+                        : top;
+                oversampler_up(os->coeffs[s], oversampler_taps[s], y, x, n << s);
+                oversampler_keep(x - (oversampler_taps[s] - 1), oversampler_taps[s] - 1, n << s);
+                x = y;
+            }
+
+            float *samples = top - os->pad;
+            callback(user, ch, samples, done << stages, top_count);
+
+            if (stages == 0) {
+                for (ma_uint32 i = 0; i < n; i++)
+                    out[(size_t)(done + i) * channels + ch] = samples[i];
+            } else {
+                oversampler_split(os, stages - 1, ch, samples, top_count / 2);
+                for (ma_uint32 s = stages; s-- > 0; ) {
+                    const ma_uint32 history = oversampler_taps[s] - 1, count = n << s;
+                    float *e = os->even[s] + (size_t)ch * oversampler_stride(s);
+                    float *o = os->odd[s] + (size_t)ch * oversampler_stride(s);
+                    oversampler_down(os->coeffs[s], oversampler_taps[s], os->scratch, e + history, o + history, count);
+                    oversampler_keep(e, history, count);
+                    oversampler_keep(o, history, count);
+                    if (s > 0)
+                        oversampler_split(os, s - 1, ch, os->scratch, count / 2);
+                }
+                for (ma_uint32 i = 0; i < n; i++)
+                    out[(size_t)(done + i) * channels + ch] = os->scratch[i];
+            }
+            oversampler_keep(top - OVERSAMPLER_MAX_FACTOR, OVERSAMPLER_MAX_FACTOR, top_count);
+        }
+        done += n;
+    }
+}
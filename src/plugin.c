@@ -0,0 +1,249 @@
+/*
+ * Native node plugins.
+ *
+ * The registry opens every shared library in a directory, asks each for
+ * its node descriptors (see plugin.h) and keeps those that pass a sanity
+ * check. A plugin node wraps one instance: it has the descriptor's ports
+ * as graph buses, all at the graph's channel count, and hands miniaudio's
+ * buffers to process() as they are, so a plugin reads and writes the
+ * graph's memory directly.
+ */
+#include "dsp.h"
+#include "plugin.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <dlfcn.h>
+#endif
+
+#define PLUGIN_MAX_COUNT        64
+#define PLUGIN_MAX_LIBRARIES    32
+
+#if defined(_WIN32)
+    #define PLUGIN_SUFFIX ".dll"
+#elif defined(__APPLE__)
+    #define PLUGIN_SUFFIX ".dylib"
+#else
+    #define PLUGIN_SUFFIX ".so"
+#endif
+
+struct plugin_registry {
+    const struct soundflow_plugin *plugins[PLUGIN_MAX_COUNT];
+    ma_uint32 count;
+    void *libraries[PLUGIN_MAX_LIBRARIES];
+    ma_uint32 library_count;
+};
+
+#if defined(_WIN32)
+static void *plugin_library_open(const char *path)  { return (void *)LoadLibraryA(path); }
+static void plugin_library_close(void *library)     { FreeLibrary((HMODULE)library); }
+static soundflow_plugin_entry_proc plugin_library_entry(void *library)
+{
+    return (soundflow_plugin_entry_proc)GetProcAddress((HMODULE)library, SOUNDFLOW_PLUGIN_ENTRY);
+}
+#else
+static void *plugin_library_open(const char *path)  { return dlopen(path, RTLD_NOW | RTLD_LOCAL); }
+static void plugin_library_close(void *library)     { dlclose(library); }
+static soundflow_plugin_entry_proc plugin_library_entry(void *library)
+{
+    return (soundflow_plugin_entry_proc)dlsym(library, SOUNDFLOW_PLUGIN_ENTRY);
+}
+#endif
+
+static bool plugin_is_valid(const struct soundflow_plugin *plugin)
+{
+    if (plugin->version != SOUNDFLOW_PLUGIN_VERSION || plugin->name == NULL
+            || plugin->input_count > SOUNDFLOW_PLUGIN_MAX_PORTS
+            || plugin->output_count == 0 || plugin->output_count > SOUNDFLOW_PLUGIN_MAX_PORTS
+            || plugin->param_count > SOUNDFLOW_PLUGIN_MAX_PARAMS
+            || (plugin->param_count > 0 && plugin->params == NULL)
+            || plugin->create == NULL || plugin->destroy == NULL || plugin->process == NULL)
+        return false;
+    for (uint32_t i = 0; i < plugin->param_count; i++) {
+        const struct soundflow_param *param = &plugin->params[i];
+        if (param->name == NULL || !(param->min <= param->value && param->value <= param->max))
+            return false;
+    }
+    return true;
+}
+
+/* Opens one library and registers its nodes; returns how many. */
+static ma_uint32 plugin_registry_open(struct plugin_registry *registry, const char *path)
+{
+    if (registry->library_count == PLUGIN_MAX_LIBRARIES)
+        return 0;
+    void *library = plugin_library_open(path);
+    if (library == NULL) {
+        fprintf(stderr, "[ERROR] failed to load plugin %s\n", path);
+        return 0;
+    }
+    soundflow_plugin_entry_proc entry = plugin_library_entry(library);
+    if (entry == NULL) {
+        fprintf(stderr, "[ERROR] plugin %s has no %s()\n", path, SOUNDFLOW_PLUGIN_ENTRY);
+        plugin_library_close(library);
+        return 0;
+    }
+
+    ma_uint32 added = 0;
+    const struct soundflow_plugin *plugin;
+    for (uint32_t i = 0; registry->count < PLUGIN_MAX_COUNT && (plugin = entry(i)) != NULL; i++) {
+        if (!plugin_is_valid(plugin)) {
+            fprintf(stderr, "[ERROR] plugin %s: skipping node %u, wrong version or bad descriptor\n", path, i);
+            continue;
+        }
+        registry->plugins[registry->count++] = plugin;
+        added++;
+    }
+    if (added == 0) {
+        plugin_library_close(library);
+        return 0;
+    }
+    registry->libraries[registry->library_count++] = library;
+    return added;
+}
+
+/* Registers the nodes of every library in `directory`; returns how many. */
+static ma_uint32 plugin_registry_load(struct plugin_registry *registry, const char *directory)
+{
+    DIR *dir = opendir(directory);
+    if (dir == NULL)
+        return 0;
+
+    ma_uint32 added = 0;
+    const size_t suffix = strlen(PLUGIN_SUFFIX);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length <= suffix || strcmp(entry->d_name + length - suffix, PLUGIN_SUFFIX) != 0)
+            continue;
+        char path[1024];
+        if (snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name) >= (int)sizeof(path))
+            continue;
+        added += plugin_registry_open(registry, path);
+    }
+    closedir(dir);
+    return added;
+}
+
+/* Only once no plugin node can run again: their code goes with the libraries. */
+static void plugin_registry_unload(struct plugin_registry *registry)
+{
+    for (ma_uint32 i = 0; i < registry->library_count; i++)
+        plugin_library_close(registry->libraries[i]);
+    memset(registry, 0, sizeof(*registry));
+}
+
+
+/*
+ * Plugin Node
+ */
+struct plugin_node_config {
+    ma_node_config node_config;
+    const struct soundflow_plugin *plugin;
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+};
+
+struct plugin_node {
+    ma_node_base base;
+    const struct soundflow_plugin *plugin;
+    void *instance;
+    ma_uint32 channels;
+
+    /* Written by the UI thread, read once per block. */
+    float params[SOUNDFLOW_PLUGIN_MAX_PARAMS];
+};
+
+static struct plugin_node_config
+plugin_node_config_init(const struct soundflow_plugin *plugin, ma_uint32 channels, ma_uint32 sample_rate)
+{
+    struct plugin_node_config config;
+    config.node_config = ma_node_config_init();
+    config.plugin = plugin;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    return config;
+}
+
+static void plugin_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct plugin_node *pn = (struct plugin_node *)node;
+    const struct soundflow_plugin *plugin = pn->plugin;
+    float params[SOUNDFLOW_PLUGIN_MAX_PARAMS];
+    (void)frame_count_in;
+
+    for (uint32_t i = 0; i < plugin->param_count; i++)
+        params[i] = DSP_CLAMP(dsp_load_f32(&pn->params[i]), plugin->params[i].min, plugin->params[i].max);
+
+    struct soundflow_block block;
+    block.frame_count = *frame_count_out;
+    block.channels = pn->channels;
+    block.inputs = frames_in;
+    block.outputs = frames_out;
+    block.params = params;
+    plugin->process(pn->instance, &block);
+}
+
+static ma_node_vtable plugin_node_vtable = {
+    plugin_node_process_pcm_frames,
+    NULL,                       /* onGetRequiredInputFrameCount */
+    MA_NODE_BUS_COUNT_UNKNOWN,  /* Inputs from the descriptor. */
+    MA_NODE_BUS_COUNT_UNKNOWN,  /* Outputs from the descriptor. */
+    0                           /* Default flags. */
+};
+
+static ma_node_vtable plugin_node_tail_vtable = {
+    plugin_node_process_pcm_frames,
+    NULL,                       /* onGetRequiredInputFrameCount */
+    MA_NODE_BUS_COUNT_UNKNOWN,  /* Inputs from the descriptor. */
+    MA_NODE_BUS_COUNT_UNKNOWN,  /* Outputs from the descriptor. */
+    MA_NODE_FLAG_CONTINUOUS_PROCESSING  /* Silence in, so the tail plays out. */
+};
+
+static ma_result plugin_node_init(ma_node_graph *graph, const struct plugin_node_config *config,
+        const ma_allocation_callbacks *alloc, struct plugin_node *node)
+{
+    ma_result result;
+    ma_uint32 channels[SOUNDFLOW_PLUGIN_MAX_PORTS];
+
+    if (node == NULL || config == NULL || config->plugin == NULL || config->channels == 0)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    const struct soundflow_plugin *plugin = config->plugin;
+    node->plugin = plugin;
+    node->channels = config->channels;
+    for (uint32_t i = 0; i < plugin->param_count; i++)
+        node->params[i] = plugin->params[i].value;
+    node->instance = plugin->create(config->channels, config->sample_rate);
+    if (node->instance == NULL)
+        return MA_ERROR;
+
+    for (int i = 0; i < SOUNDFLOW_PLUGIN_MAX_PORTS; i++)
+        channels[i] = config->channels;
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = (plugin->flags & SOUNDFLOW_PLUGIN_TAIL) ? &plugin_node_tail_vtable : &plugin_node_vtable;
+    base_config.inputBusCount = plugin->input_count;
+    base_config.outputBusCount = plugin->output_count;
+    base_config.pInputChannels = plugin->input_count > 0 ? channels : NULL;
+    base_config.pOutputChannels = channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        plugin->destroy(node->instance);
+        node->instance = NULL;
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void plugin_node_uninit(struct plugin_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    if (node->instance != NULL)
+        node->plugin->destroy(node->instance);
+    node->instance = NULL;
+}
@@ -0,0 +1,73 @@
+/*
+ * Soundflow node plugin ABI.
+ *
+ * A plugin is a shared library exporting one function,
+ * soundflow_plugin_entry(), which returns a descriptor per node type it
+ * provides for index 0, 1, ... and NULL after the last. Soundflow loads
+ * every library in its plugins/ directory at startup and lists each node
+ * type in the editor's menu.
+ *
+ * An instance is created per node at the graph's channel count and sample
+ * rate. process() is called on the audio thread with the graph's own
+ * buffers, interleaved, one per port: read the inputs and write every
+ * output frame. It must not allocate, lock or block. Parameter values are
+ * a snapshot taken for the block, already clamped to their ranges.
+ *
+ * Only fixed width types cross the boundary. A change that breaks
+ * existing plugins bumps SOUNDFLOW_PLUGIN_VERSION, and descriptors
+ * reporting another version are skipped.
+ */
+#ifndef SOUNDFLOW_PLUGIN_H
+#define SOUNDFLOW_PLUGIN_H
+
+#include <stdint.h>
+
+#define SOUNDFLOW_PLUGIN_VERSION        1
+#define SOUNDFLOW_PLUGIN_ENTRY          "soundflow_plugin_entry"
+#define SOUNDFLOW_PLUGIN_MAX_PORTS      8       /* Inputs, and separately outputs */
+#define SOUNDFLOW_PLUGIN_MAX_PARAMS     16
+
+#if defined(_WIN32)
+    #define SOUNDFLOW_PLUGIN_EXPORT __declspec(dllexport)
+#else
+    #define SOUNDFLOW_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+enum soundflow_plugin_flags {
+    SOUNDFLOW_PLUGIN_TAIL = 1 << 0,     /* Keeps producing output with its inputs silent or unlinked. */
+};
+
+struct soundflow_param {
+    const char *name;
+    float min;
+    float max;
+    float value;                /* Default */
+    float step;                 /* Per click in the editor */
+};
+
+struct soundflow_block {
+    uint32_t frame_count;
+    uint32_t channels;          /* Of every port */
+    const float *const *inputs; /* [input_count][frame_count * channels], silence when unlinked */
+    float *const *outputs;      /* [output_count][frame_count * channels] */
+    const float *params;        /* [param_count] */
+};
+
+struct soundflow_plugin {
+    uint32_t version;           /* SOUNDFLOW_PLUGIN_VERSION */
+    const char *name;           /* Shown in the menu and as the node's title. */
+    uint32_t input_count;
+    uint32_t output_count;      /* At least one */
+    uint32_t param_count;
+    const struct soundflow_param *params;
+    uint32_t flags;             /* enum soundflow_plugin_flags */
+
+    /* Returns NULL on failure. Called on the UI thread, free to allocate. */
+    void *(*create)(uint32_t channels, uint32_t sample_rate);
+    void (*destroy)(void *instance);
+    void (*process)(void *instance, const struct soundflow_block *block);
+};
+
+typedef const struct soundflow_plugin *(*soundflow_plugin_entry_proc)(uint32_t index);
+
+#endif /* SOUNDFLOW_PLUGIN_H */
@@ -0,0 +1,615 @@
+/*
+ * Polyphonic sampler.
+ *
+ * A sound file is decoded to mono once, and note events start voices that
+ * play it back at the note's pitch through an ADSR envelope, each with its
+ * own pan. Voice state lives in a fixed pool kept as arrays, like the
+ * grains in granular.c, and each voice mixes four frames per vector.
+ *
+ * The envelope is linear in every stage. A vector clamps its four lanes
+ * to the stage's target, and the stage only changes between vectors, so a
+ * transition lands at most three frames late.
+ *
+ * Polyphony is a limit on sounding voices, below the pool size. A note
+ * over the limit steals the oldest or the quietest voice. The victim
+ * fades out over SAMPLER_STEAL_TIME in one of the spare slots rather than
+ * being cut.
+ *
+ * Events come from the UI thread through a single producer, single
+ * consumer queue, and from a MIDI player linked to the node's input (see
+ * midi.c). Each event carries a frame offset into the process call, the
+ * two sources are merged in time order, and rendering is split at every
+ * offset so timing is sample accurate. Note offs that arrive while the
+ * sustain pedal is down mark their voices held, and lifting the pedal
+ * releases them.
+ */
+#include "dsp.h"
+
+#define SAMPLER_MAX_VOICES      64
+#define SAMPLER_SPARE_VOICES    8       /* Slots kept for voices fading after a steal. */
+#define SAMPLER_QUEUE_SIZE      256     /* Events, a power of two. */
+#define SAMPLER_BLOCK           256     /* Frames mixed per pass. */
+#define SAMPLER_ROOT_NOTE       60      /* Note that plays the file at its own pitch. */
+#define SAMPLER_STEAL_TIME      5.0f    /* ms */
+#define SAMPLER_MAX_TIME        5000.0f /* ms, longest attack, decay or release */
+#define SAMPLER_HELD            0x100   /* Note flag: released while the pedal was down. */
+
+enum sampler_steal {
+    SAMPLER_STEAL_OLDEST,
+    SAMPLER_STEAL_QUIETEST,
+    SAMPLER_STEAL_COUNT,
+};
+
+static const char *sampler_steal_names[SAMPLER_STEAL_COUNT] = {
+    "Steal Oldest",
+    "Steal Quietest",
+};
+
+enum sampler_stage {
+    SAMPLER_ATTACK,
+    SAMPLER_DECAY,              /* Towards sustain, from either side; also the sustain itself. */
+    SAMPLER_RELEASE,
+    SAMPLER_FADE,               /* Stolen: a fast release. */
+};
+
+enum sampler_event_type {
+    SAMPLER_NOTE_ON,
+    SAMPLER_NOTE_OFF,
+    SAMPLER_ALL_OFF,            /* Also lifts the pedal. */
+    SAMPLER_PEDAL,              /* Sustain pedal, down for velocity 64 and up. */
+};
+
+struct sampler_event {
+    ma_uint32 time;             /* Frames into the next process call; 0 from the UI. */
+    ma_uint8 type;
+    ma_uint8 note;
+    ma_uint8 velocity;
+};
+
+struct sampler_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    const char *file_name;
+};
+
+struct sampler {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    float *source;              /* Mono, source_frames plus a zeroed guard frame */
+    ma_uint32 source_frames;
+
+    /* Written by the UI thread, read once per block. */
+    float attack;               /* ms */
+    float decay;                /* ms */
+    float sustain;              /* 0..1 */
+    float release;              /* ms */
+    float spread;               /* 0 centre .. 1 random pan across the field */
+    float gain;
+    ma_uint32 polyphony;        /* Sounding voices, at most SAMPLER_MAX_VOICES - SAMPLER_SPARE_VOICES */
+    ma_uint32 steal;            /* enum sampler_steal */
+    ma_uint32 active;           /* Voices playing, for the UI. */
+    struct midi_player *midi;   /* Linked player, or NULL */
+
+    /* Event queue: the UI thread writes at event_write, the audio thread reads at event_read. */
+    struct sampler_event events[SAMPLER_QUEUE_SIZE];
+    ma_uint32 event_write;
+    ma_uint32 event_read;
+
+    /* Audio thread state: the voice pool, one entry per voice. */
+    ma_uint32 voice_count;
+    ma_uint32 *note;            /* With SAMPLER_HELD once released under the pedal */
+    ma_uint32 *stage;           /* enum sampler_stage */
+    ma_uint32 *age;             /* Trigger order, for stealing the oldest */
+    float *offset;              /* Source frames read so far, fractional */
+    float *step;                /* Source frames per output frame */
+    float *level;               /* Envelope */
+    float *gain_left, *gain_right;
+    float *left, *right;        /* [SAMPLER_BLOCK] mix */
+    ma_uint32 triggers;
+    ma_uint32 seed;
+    ma_uint32 pedal;
+    struct dsp_arena arena;
+};
+
+static struct sampler_config sampler_config_init(ma_uint32 channels, ma_uint32 sample_rate, const char *file_name)
+{
+    struct sampler_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.file_name = file_name;
+    return config;
+}
+
+static void sampler_layout(struct sampler *sp)
+{
+    sp->note = (ma_uint32 *)dsp_arena_floats(&sp->arena, SAMPLER_MAX_VOICES);
+    sp->stage = (ma_uint32 *)dsp_arena_floats(&sp->arena, SAMPLER_MAX_VOICES);
+    sp->age = (ma_uint32 *)dsp_arena_floats(&sp->arena, SAMPLER_MAX_VOICES);
+    sp->offset = dsp_arena_floats(&sp->arena, SAMPLER_MAX_VOICES);
+    sp->step = dsp_arena_floats(&sp->arena, SAMPLER_MAX_VOICES);
+    sp->level = dsp_arena_floats(&sp->arena, SAMPLER_MAX_VOICES);
+    sp->gain_left = dsp_arena_floats(&sp->arena, SAMPLER_MAX_VOICES);
+    sp->gain_right = dsp_arena_floats(&sp->arena, SAMPLER_MAX_VOICES);
+    sp->left = dsp_arena_floats(&sp->arena, SAMPLER_BLOCK);
+    sp->right = dsp_arena_floats(&sp->arena, SAMPLER_BLOCK);
+}
+
+static ma_result sampler_init(const struct sampler_config *config, struct sampler *sp)
+{
+    ma_result result;
+    ma_uint64 frames = 0;
+    void *decoded = NULL;
+
+    memset(sp, 0, sizeof(*sp));
+    if (config->channels == 0 || config->sample_rate == 0 || config->file_name == NULL)
+        return MA_INVALID_ARGS;
+    sp->channels = config->channels;
+    sp->sample_rate = config->sample_rate;
+
+    /* Voices are panned individually, so the source is mixed down to mono at the engine rate. */
+    ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_f32, 1, config->sample_rate);
+    result = ma_decode_file(config->file_name, &decoder_config, &frames, &decoded);
+    if (result != MA_SUCCESS)
+        return result;
+    if (frames < 4 || frames > 0xFFFFFF) {     /* Float offsets stay exact to the frame. */
+        ma_free(decoded, NULL);
+        return MA_INVALID_FILE;
+    }
+    sp->source_frames = (ma_uint32)frames;
+    sp->source = dsp_alloc((size_t)sp->source_frames + 1);
+    if (sp->source == NULL) {
+        ma_free(decoded, NULL);
+        return MA_OUT_OF_MEMORY;
+    }
+    memcpy(sp->source, decoded, sizeof(float) * sp->source_frames);
+    ma_free(decoded, NULL);
+
+    sampler_layout(sp);
+    result = dsp_arena_init(&sp->arena, sp->arena.used);
+    if (result != MA_SUCCESS) {
+        dsp_free(sp->source);
+        return result;
+    }
+    sampler_layout(sp);
+
+    sp->attack = 2.0f;
+    sp->decay = 200.0f;
+    sp->sustain = 1.0f;
+    sp->release = 200.0f;
+    sp->spread = 0.0f;
+    sp->gain = 1.0f;
+    sp->polyphony = 16;
+    sp->steal = SAMPLER_STEAL_OLDEST;
+    sp->seed = 0x9e3779b9u;
+    return MA_SUCCESS;
+}
+
+static void sampler_uninit(struct sampler *sp)
+{
+    dsp_arena_uninit(&sp->arena);
+    dsp_free(sp->source);
+    sp->source = NULL;
+}
+
+/*
+ * UI thread. Queues an event for the start of the next block; returns false
+ * when the queue is full.
+ */
+static bool sampler_push(struct sampler *sp, enum sampler_event_type type, ma_uint32 note, ma_uint32 velocity)
+{
+    ma_uint32 write = sp->event_write;
+    if (write - dsp_load_acquire_u32(&sp->event_read) == SAMPLER_QUEUE_SIZE)
+        return false;
+    struct sampler_event *ev = &sp->events[write & (SAMPLER_QUEUE_SIZE - 1)];
+    ev->time = 0;
+    ev->type = (ma_uint8)type;
+    ev->note = (ma_uint8)DSP_MIN(note, 127u);
+    ev->velocity = (ma_uint8)DSP_MIN(velocity, 127u);
+    dsp_store_release_u32(&sp->event_write, write + 1);
+    return true;
+}
+
+static bool sampler_note_on(struct sampler *sp, ma_uint32 note, ma_uint32 velocity)
+{
+    return sampler_push(sp, SAMPLER_NOTE_ON, note, velocity);
+}
+
+static bool sampler_note_off(struct sampler *sp, ma_uint32 note)
+{
+    return sampler_push(sp, SAMPLER_NOTE_OFF, note, 0);
+}
+
+static bool sampler_all_off(struct sampler *sp)
+{
+    return sampler_push(sp, SAMPLER_ALL_OFF, 0, 0);
+}
+
+/* Uniform in [0, 1). */
+static float sampler_random(struct sampler *sp)
+{
+    sp->seed ^= sp->seed << 13;
+    sp->seed ^= sp->seed >> 17;
+    sp->seed ^= sp->seed << 5;
+    return (float)(sp->seed >> 8) / (float)(1u << 24);
+}
+
+/* Per frame envelope slopes, from the UI times. */
+struct sampler_rates {
+    float attack, decay, release, fade, sustain;
+};
+
+static struct sampler_rates sampler_get_rates(const struct sampler *sp)
+{
+    const float ms = (float)sp->sample_rate / 1000.0f;
+    struct sampler_rates rates;
+    rates.attack = 1.0f / DSP_MAX(DSP_MIN(dsp_load_f32(&sp->attack), SAMPLER_MAX_TIME) * ms, 1.0f);
+    rates.decay = 1.0f / DSP_MAX(DSP_MIN(dsp_load_f32(&sp->decay), SAMPLER_MAX_TIME) * ms, 1.0f);
+    rates.release = 1.0f / DSP_MAX(DSP_MIN(dsp_load_f32(&sp->release), SAMPLER_MAX_TIME) * ms, 1.0f);
+    rates.fade = 1.0f / (SAMPLER_STEAL_TIME * ms);
+    rates.sustain = DSP_CLAMP(dsp_load_f32(&sp->sustain), 0.0f, 1.0f);
+    return rates;
+}
+
+/* Frames until voice `i` runs off the end of the source. */
+static ma_uint32 sampler_frames_left(const struct sampler *sp, ma_uint32 i)
+{
+    float left = ((float)(sp->source_frames - 1) - sp->offset[i]) / sp->step[i];
+    return left > 0.0f ? (ma_uint32)ceilf(left) : 0;
+}
+
+/*
+ * Mixes `n` frames of voice `i` into left/right from `from`. Returns false
+ * once the voice has finished: end of source, or its release reached zero.
+ */
+static bool sampler_render_voice(struct sampler *sp, ma_uint32 i, ma_uint32 from, ma_uint32 n,
+        const struct sampler_rates *rates)
+{
+    const float *src = sp->source;
+    const float step = sp->step[i];
+    const ma_uint32 frames = DSP_MIN(n, sampler_frames_left(sp, i));
+    float *left = sp->left + from, *right = sp->right + from;
+    float offset = sp->offset[i];
+    float level = sp->level[i];
+    ma_uint32 stage = sp->stage[i];
+    float index[4], env[4];
+
+    const v4f ramp = v4f_set(0.0f, step, 2.0f * step, 3.0f * step);
+    const v4f lanes = v4f_set(1.0f, 2.0f, 3.0f, 4.0f);
+    const v4f gl = v4f_set1(sp->gain_left[i]), gright = v4f_set1(sp->gain_right[i]);
+    const v4f sustain = v4f_set1(rates->sustain);
+    const v4f end = v4f_set1((float)(sp->source_frames - 1));
+
+    ma_uint32 f = 0;
+    for (; f < frames; f += 4) {
+        /* Envelope for the four frames, clamped to the stage's target. */
+        v4f e;
+        switch (stage) {
+        case SAMPLER_ATTACK:
+            e = v4f_min(v4f_madd(lanes, v4f_set1(rates->attack), v4f_set1(level)), v4f_set1(1.0f));
+            break;
+        case SAMPLER_DECAY:
+            e = level > rates->sustain
+                    ? v4f_max(v4f_sub(v4f_set1(level), v4f_mul(lanes, v4f_set1(rates->decay))), sustain)
+                    : v4f_min(v4f_madd(lanes, v4f_set1(rates->decay), v4f_set1(level)), sustain);
+            break;
+        default:
+            e = v4f_max(v4f_sub(v4f_set1(level), v4f_mul(lanes,
+                    v4f_set1(stage == SAMPLER_RELEASE ? rates->release : rates->fade))), v4f_zero());
+            break;
+        }
+        level = v4f_lane3(e);
+        if (stage == SAMPLER_ATTACK && level >= 1.0f)
+            stage = SAMPLER_DECAY;
+
+        /* Lanes past the voice's end in the last vector are held on the final frame. */
+        v4f pos = v4f_min(v4f_add(v4f_set1(offset), ramp), end);
+        v4f whole = v4f_floor(pos);
+        v4f_store(index, whole);
+        ma_uint32 i0 = (ma_uint32)index[0], i1 = (ma_uint32)index[1];
+        ma_uint32 i2 = (ma_uint32)index[2], i3 = (ma_uint32)index[3];
+        v4f a = v4f_set(src[i0], src[i1], src[i2], src[i3]);
+        v4f b = v4f_set(src[i0 + 1], src[i1 + 1], src[i2 + 1], src[i3 + 1]);
+        v4f v = v4f_mul(v4f_madd(v4f_sub(b, a), v4f_sub(pos, whole), a), e);
+
+        if (f + 4 <= frames) {
+            v4f_store(left + f, v4f_madd(v, gl, v4f_load(left + f)));
+            v4f_store(right + f, v4f_madd(v, gright, v4f_load(right + f)));
+        } else {
+            /* Last one to three frames of the voice. */
+            v4f_store(env, v);
+            for (ma_uint32 l = 0; l < frames - f; l++) {
+                left[f + l] += env[l] * sp->gain_left[i];
+                right[f + l] += env[l] * sp->gain_right[i];
+            }
+        }
+        offset += 4.0f * step;
+        if (stage >= SAMPLER_RELEASE && level <= 0.0f)
+            return false;
+    }
+
+    sp->offset[i] = sp->offset[i] + (float)frames * step;
+    sp->level[i] = level;
+    sp->stage[i] = stage;
+    return frames == n;
+}
+
+static void sampler_remove(struct sampler *sp, ma_uint32 i)
+{
+    ma_uint32 last = --sp->voice_count;
+    sp->note[i] = sp->note[last];
+    sp->stage[i] = sp->stage[last];
+    sp->age[i] = sp->age[last];
+    sp->offset[i] = sp->offset[last];
+    sp->step[i] = sp->step[last];
+    sp->level[i] = sp->level[last];
+    sp->gain_left[i] = sp->gain_left[last];
+    sp->gain_right[i] = sp->gain_right[last];
+}
+
+/* The voice to give up for a new note, among those that aren't already fading. */
+static ma_uint32 sampler_victim(const struct sampler *sp, bool fading)
+{
+    const bool quietest = dsp_load_u32(&sp->steal) == SAMPLER_STEAL_QUIETEST;
+    ma_uint32 victim = SAMPLER_MAX_VOICES;
+    float best = INFINITY;
+    for (ma_uint32 i = 0; i < sp->voice_count; i++) {
+        if ((sp->stage[i] == SAMPLER_FADE) != fading)
+            continue;
+        /* Ages wrap, so compare distances back from the newest trigger. */
+        float score = quietest ? sp->level[i] * (sp->gain_left[i] + sp->gain_right[i])
+                : -(float)(sp->triggers - sp->age[i]);
+        if (score < best) {
+            best = score;
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+static void sampler_start(struct sampler *sp, ma_uint32 note, ma_uint32 velocity)
+{
+    const ma_uint32 polyphony = DSP_CLAMP(dsp_load_u32(&sp->polyphony), 1u,
+            (ma_uint32)(SAMPLER_MAX_VOICES - SAMPLER_SPARE_VOICES));
+
+    ma_uint32 sounding = 0;
+    for (ma_uint32 i = 0; i < sp->voice_count; i++)
+        sounding += sp->stage[i] != SAMPLER_FADE;
+    if (sounding >= polyphony) {
+        ma_uint32 victim = sampler_victim(sp, false);
+        if (victim < SAMPLER_MAX_VOICES)
+            sp->stage[victim] = SAMPLER_FADE;
+    }
+    /* Every spare slot is fading too: cut the quietest of those. */
+    if (sp->voice_count == SAMPLER_MAX_VOICES)
+        sampler_remove(sp, sampler_victim(sp, true));
+
+    const float spread = DSP_CLAMP(dsp_load_f32(&sp->spread), 0.0f, 1.0f);
+    const float angle = (float)(DSP_PI / 4.0) * (1.0f + spread * (2.0f * sampler_random(sp) - 1.0f));
+    const float amplitude = dsp_load_f32(&sp->gain) * (float)velocity / 127.0f;
+
+    ma_uint32 i = sp->voice_count++;
+    sp->note[i] = note;
+    sp->stage[i] = SAMPLER_ATTACK;
+    sp->age[i] = ++sp->triggers;
+    sp->offset[i] = 0.0f;
+    sp->step[i] = exp2f(((float)note - SAMPLER_ROOT_NOTE) / 12.0f);
+    sp->level[i] = 0.0f;
+    if (sp->channels == 2) {
+        sp->gain_left[i] = amplitude * cosf(angle) * (float)DSP_SQRT2;
+        sp->gain_right[i] = amplitude * sinf(angle) * (float)DSP_SQRT2;
+    } else {
+        sp->gain_left[i] = amplitude;
+        sp->gain_right[i] = 0.0f;
+    }
+}
+
+static void sampler_apply(struct sampler *sp, const struct sampler_event *ev)
+{
+    switch (ev->type) {
+    case SAMPLER_NOTE_ON:
+        if (ev->velocity > 0) {
+            sampler_start(sp, ev->note, ev->velocity);
+            break;
+        }
+        /* Velocity 0 is a note off. */
+        /* fall through */
+    case SAMPLER_NOTE_OFF:
+        for (ma_uint32 i = 0; i < sp->voice_count; i++) {
+            if (sp->note[i] != ev->note || sp->stage[i] >= SAMPLER_RELEASE)
+                continue;
+            if (sp->pedal)
+                sp->note[i] |= SAMPLER_HELD;
+            else
+                sp->stage[i] = SAMPLER_RELEASE;
+        }
+        break;
+    case SAMPLER_ALL_OFF:
+        sp->pedal = 0;
+        for (ma_uint32 i = 0; i < sp->voice_count; i++)
+            if (sp->stage[i] < SAMPLER_RELEASE)
+                sp->stage[i] = SAMPLER_RELEASE;
+        break;
+    case SAMPLER_PEDAL:
+        sp->pedal = ev->velocity >= 64;
+        if (sp->pedal)
+            break;
+        for (ma_uint32 i = 0; i < sp->voice_count; i++)
+            if ((sp->note[i] & SAMPLER_HELD) && sp->stage[i] < SAMPLER_RELEASE)
+                sp->stage[i] = SAMPLER_RELEASE;
+        break;
+    }
+}
+
+/* The sampler's reading of a MIDI event; false for those it ignores. */
+static bool sampler_from_midi(const struct midi_event *midi, struct sampler_event *ev)
+{
+    ev->time = midi->time;
+    ev->note = midi->data1;
+    ev->velocity = midi->data2;
+    switch (midi->status & 0xF0) {
+    case MIDI_NOTE_ON:
+        ev->type = SAMPLER_NOTE_ON;
+        return true;
+    case MIDI_NOTE_OFF:
+        ev->type = SAMPLER_NOTE_OFF;
+        return true;
+    case MIDI_CONTROL:
+        if (midi->data1 == MIDI_CONTROL_SUSTAIN) {
+            ev->type = SAMPLER_PEDAL;
+            return true;
+        }
+        if (midi->data1 == MIDI_CONTROL_SOUND_OFF || midi->data1 == MIDI_CONTROL_NOTES_OFF) {
+            ev->type = SAMPLER_ALL_OFF;
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+/* Mixes every voice into left/right over [from, from + n). */
+static void sampler_render(struct sampler *sp, ma_uint32 from, ma_uint32 n, const struct sampler_rates *rates)
+{
+    for (ma_uint32 i = 0; i < sp->voice_count; ) {
+        if (sampler_render_voice(sp, i, from, n, rates))
+            i++;
+        else
+            sampler_remove(sp, i);     /* The moved voice hasn't played this stretch yet. */
+    }
+}
+
+static void sampler_process(struct sampler *sp, float *out, ma_uint32 frame_count,
+        const struct midi_event *midi, ma_uint32 midi_count)
+{
+    const ma_uint32 channels = sp->channels;
+    const struct sampler_rates rates = sampler_get_rates(sp);
+    const ma_uint32 write = dsp_load_acquire_u32(&sp->event_write);
+    ma_uint32 read = sp->event_read;
+    ma_uint32 m = 0;
+    struct sampler_event midi_event;
+
+    for (ma_uint32 done = 0; done < frame_count; ) {
+        const ma_uint32 n = DSP_MIN(frame_count - done, (ma_uint32)SAMPLER_BLOCK);
+        const bool last = done + n == frame_count;
+        memset(sp->left, 0, sizeof(float) * n);
+        memset(sp->right, 0, sizeof(float) * n);
+
+        /* Render up to each event's frame, then apply it. Events past the call apply at its end. */
+        ma_uint32 at = 0;
+        for (;;) {
+            /* The earlier of the queue's and the MIDI input's next events; the queue first on a tie. */
+            const struct sampler_event *ev = read != write ? &sp->events[read & (SAMPLER_QUEUE_SIZE - 1)] : NULL;
+            while (m < midi_count && !sampler_from_midi(&midi[m], &midi_event))
+                m++;
+            const bool from_midi = m < midi_count && (ev == NULL || midi_event.time < ev->time);
+            if (from_midi)
+                ev = &midi_event;
+            if (ev == NULL)
+                break;
+            ma_uint32 time = ev->time > done ? ev->time - done : 0;
+            if (time >= n && !last)
+                break;
+            time = DSP_MIN(time, n);
+            if (time > at) {
+                sampler_render(sp, at, time - at, &rates);
+                at = time;
+            }
+            sampler_apply(sp, ev);
+            if (from_midi)
+                m++;
+            else
+                read++;
+        }
+        if (at < n)
+            sampler_render(sp, at, n - at, &rates);
+
+        float *dst = out + (size_t)done * channels;
+        if (channels == 2) {
+            for (ma_uint32 f = 0; f < n; f++) {
+                dst[2 * f] = sp->left[f];
+                dst[2 * f + 1] = sp->right[f];
+            }
+        } else {
+            for (ma_uint32 f = 0; f < n; f++)
+                for (ma_uint32 ch = 0; ch < channels; ch++)
+                    dst[f * channels + ch] = sp->left[f];
+        }
+        done += n;
+    }
+    dsp_store_release_u32(&sp->event_read, read);
+    dsp_store_u32(&sp->active, sp->voice_count);
+}
+
+
+/*
+ * Sampler Node
+ */
+struct sampler_node_config {
+    ma_node_config node_config;
+    struct sampler_config sampler;
+};
+
+struct sampler_node {
+    ma_node_base base;
+    struct sampler sampler;
+};
+
+static struct sampler_node_config
+sampler_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, const char *file_name)
+{
+    struct sampler_node_config config;
+    config.node_config = ma_node_config_init();
+    config.sampler = sampler_config_init(channels, sample_rate, file_name);
+    return config;
+}
+
+static void sampler_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct sampler_node *sampler = (struct sampler_node *)node;
+    ma_uint32 midi_count;
+    const struct midi_event *midi = midi_input_events(&sampler->sampler.midi,
+            frames_in != NULL ? frames_in[0] : NULL, &midi_count);
+    (void)frame_count_in;
+    sampler_process(&sampler->sampler, frames_out[0], *frame_count_out, midi, midi_count);
+}
+
+static ma_node_vtable sampler_node_vtable = {
+    sampler_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input, from a MIDI player. */
+    1,      /* One output. */
+    MA_NODE_FLAG_CONTINUOUS_PROCESSING | MA_NODE_FLAG_ALLOW_NULL_INPUT  /* Plays with nothing linked. */
+};
+
+static ma_result sampler_node_init(ma_node_graph *graph, const struct sampler_node_config *config,
+        const ma_allocation_callbacks *alloc, struct sampler_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = sampler_init(&config->sampler, &node->sampler);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &sampler_node_vtable;
+    base_config.pInputChannels = &midi_input_channels;
+    base_config.pOutputChannels = &config->sampler.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        sampler_uninit(&node->sampler);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void sampler_node_uninit(struct sampler_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    sampler_uninit(&node->sampler);
+}
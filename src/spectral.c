@@ -0,0 +1,229 @@
+/*
+ * Spectral effects on top of the STFT node. Each effect is only a frame
+ * callback; windowing, transforms and overlap-add are done by stft.c.
+ */
+#include "dsp.h"
+
+#define SPECTRAL_FFT_SIZE       2048
+#define SPECTRAL_HOP            512
+#define SPECTRAL_FILTER_SLOPE   4       /* Bins in each filter edge. */
+#define SPECTRAL_GATE_RELEASE   0.05    /* Seconds for a closing bin to fall by 1/e. */
+
+enum spectral_effect {
+    SPECTRAL_FILTER,
+    SPECTRAL_GATE,
+    SPECTRAL_FREEZE,
+    SPECTRAL_EFFECT_COUNT,
+};
+
+static const char *spectral_effect_names[SPECTRAL_EFFECT_COUNT] = {
+    "Filter",
+    "Gate",
+    "Freeze",
+};
+
+enum spectral_freeze_state {
+    SPECTRAL_LIVE,
+    SPECTRAL_ARMED,     /* Phases of one frame stored, waiting for the next to measure the advance. */
+    SPECTRAL_FROZEN,
+};
+
+struct spectral_node_config {
+    struct stft_node_config stft;
+    enum spectral_effect effect;
+};
+
+struct spectral_node {
+    struct stft_node stft;      /* First, so this is an ma_node. */
+
+    /* Written by the UI thread, read once per frame. */
+    ma_uint32 effect;
+    float low, high;            /* Filter pass band in Hz. */
+    float threshold;            /* Gate threshold in dB relative to a full scale sine. */
+    ma_uint32 freeze;
+
+    /* Audio thread state. */
+    float mask_low, mask_high;  /* Band the filter mask was built for. */
+    float release;              /* Gate release coefficient per frame. */
+    float *mask;                /* [bins] */
+    float *gain;                /* [channel][bins] */
+    float *magnitude;           /* [channel][bins] */
+    float *phase;               /* [channel][bins] */
+    float *advance;             /* [channel][bins] */
+    ma_uint32 state[MA_MAX_CHANNELS];
+    ma_uint32 stride;           /* bins rounded up to the vector width */
+    struct dsp_arena arena;
+};
+
+static struct spectral_node_config
+spectral_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, enum spectral_effect effect)
+{
+    struct spectral_node_config config;
+    config.stft = stft_node_config_init(channels, sample_rate, SPECTRAL_FFT_SIZE, SPECTRAL_HOP,
+            STFT_WINDOW_HANN, NULL, NULL);
+    config.effect = effect;
+    return config;
+}
+
+static void spectral_build_mask(struct spectral_node *sp, float low, float high)
+{
+    const struct stft *st = &sp->stft.stft;
+    const float slope = SPECTRAL_FILTER_SLOPE;
+    const float bin_low = low * st->fft_size / st->sample_rate;
+    const float bin_high = high * st->fft_size / st->sample_rate;
+
+    /* Raised cosine edges centred on the band edges. */
+    for (ma_uint32 k = 0; k < st->bins; k++) {
+        float lo = DSP_CLAMP(((float)k - bin_low) / slope + 0.5f, 0.0f, 1.0f);
+        float hi = DSP_CLAMP((bin_high - (float)k) / slope + 0.5f, 0.0f, 1.0f);
+        float g = lo * hi;
+        sp->mask[k] = 0.5f - 0.5f * cosf((float)DSP_PI * g);
+    }
+    sp->mask_low = low;
+    sp->mask_high = high;
+}
+
+static void spectral_filter_frame(void *user, ma_uint32 channel, float *re, float *im, ma_uint32 bins)
+{
+    struct spectral_node *sp = (struct spectral_node *)user;
+
+    if (channel == 0) {
+        float low = dsp_load_f32(&sp->low), high = dsp_load_f32(&sp->high);
+        if (low != sp->mask_low || high != sp->mask_high)
+            spectral_build_mask(sp, low, high);
+    }
+    for (ma_uint32 k = 0; k < bins; k += 4) {
+        v4f m = v4f_load_aligned(sp->mask + k);
+        v4f_store_aligned(re + k, v4f_mul(v4f_load_aligned(re + k), m));
+        v4f_store_aligned(im + k, v4f_mul(v4f_load_aligned(im + k), m));
+    }
+}
+
+static void spectral_gate_frame(void *user, ma_uint32 channel, float *re, float *im, ma_uint32 bins)
+{
+    struct spectral_node *sp = (struct spectral_node *)user;
+    const float threshold = sp->stft.stft.window_gain * dsp_db_to_gain(dsp_load_f32(&sp->threshold));
+    const v4f threshold2 = v4f_set1(threshold * threshold);
+    const v4f release = v4f_set1(sp->release);
+    const v4f one = v4f_set1(1.0f);
+    float *gain = sp->gain + (size_t)channel * sp->stride;
+
+    /* Bins above the threshold open at once and close with a release, which keeps musical noise down. */
+    for (ma_uint32 k = 0; k < bins; k += 4) {
+        v4f r = v4f_load_aligned(re + k), i = v4f_load_aligned(im + k);
+        v4f power = v4f_madd(r, r, v4f_mul(i, i));
+        v4f g = v4f_load_aligned(gain + k);
+        g = v4f_select(v4f_cmpgt(power, threshold2), one, v4f_mul(g, release));
+        v4f_store_aligned(gain + k, g);
+        v4f_store_aligned(re + k, v4f_mul(r, g));
+        v4f_store_aligned(im + k, v4f_mul(i, g));
+    }
+}
+
+static float spectral_wrap_phase(float phase)
+{
+    const float two_pi = (float)(2.0 * DSP_PI);
+    return phase - two_pi * floorf(phase / two_pi + 0.5f);
+}
+
+static void spectral_freeze_frame(void *user, ma_uint32 channel, float *re, float *im, ma_uint32 bins)
+{
+    struct spectral_node *sp = (struct spectral_node *)user;
+    float *magnitude = sp->magnitude + (size_t)channel * sp->stride;
+    float *phase = sp->phase + (size_t)channel * sp->stride;
+    float *advance = sp->advance + (size_t)channel * sp->stride;
+
+    if (!dsp_load_u32(&sp->freeze)) {
+        sp->state[channel] = SPECTRAL_LIVE;
+        return;
+    }
+
+    /* Capture magnitudes and the per-hop phase advance of two frames, then keep advancing. */
+    switch (sp->state[channel]) {
+    case SPECTRAL_LIVE:
+        for (ma_uint32 k = 0; k < bins; k++)
+            phase[k] = atan2f(im[k], re[k]);
+        sp->state[channel] = SPECTRAL_ARMED;
+        return;
+    case SPECTRAL_ARMED:
+        for (ma_uint32 k = 0; k < bins; k++) {
+            float p = atan2f(im[k], re[k]);
+            advance[k] = spectral_wrap_phase(p - phase[k]);
+            phase[k] = p;
+            magnitude[k] = sqrtf(re[k] * re[k] + im[k] * im[k]);
+        }
+        sp->state[channel] = SPECTRAL_FROZEN;
+        return;
+    default:
+        for (ma_uint32 k = 0; k < bins; k++) {
+            phase[k] = spectral_wrap_phase(phase[k] + advance[k]);
+            re[k] = magnitude[k] * cosf(phase[k]);
+            im[k] = magnitude[k] * sinf(phase[k]);
+        }
+        return;
+    }
+}
+
+static void spectral_process_frame(void *user, ma_uint32 channel, float *re, float *im, ma_uint32 bins)
+{
+    struct spectral_node *sp = (struct spectral_node *)user;
+
+    switch (dsp_load_u32(&sp->effect)) {
+    case SPECTRAL_FILTER: spectral_filter_frame(user, channel, re, im, bins); break;
+    case SPECTRAL_GATE:   spectral_gate_frame(user, channel, re, im, bins); break;
+    case SPECTRAL_FREEZE: spectral_freeze_frame(user, channel, re, im, bins); break;
+    }
+}
+
+static void spectral_layout(struct spectral_node *sp, ma_uint32 channels)
+{
+    size_t per_channel = (size_t)channels * sp->stride;
+    sp->mask = dsp_arena_floats(&sp->arena, sp->stride);
+    sp->gain = dsp_arena_floats(&sp->arena, per_channel);
+    sp->magnitude = dsp_arena_floats(&sp->arena, per_channel);
+    sp->phase = dsp_arena_floats(&sp->arena, per_channel);
+    sp->advance = dsp_arena_floats(&sp->arena, per_channel);
+}
+
+static ma_result spectral_node_init(ma_node_graph *graph, const struct spectral_node_config *config,
+        const ma_allocation_callbacks *alloc, struct spectral_node *sp)
+{
+    ma_result result;
+
+    if (sp == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(sp, 0, sizeof(*sp));
+    if (config->effect >= SPECTRAL_EFFECT_COUNT || config->stft.stft.channels > MA_MAX_CHANNELS)
+        return MA_INVALID_ARGS;
+
+    const struct stft_config *stft = &config->stft.stft;
+    sp->stride = ((stft->fft_size / 2 + 1) + 3) & ~3u;
+    spectral_layout(sp, stft->channels);
+    result = dsp_arena_init(&sp->arena, sp->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    spectral_layout(sp, stft->channels);
+
+    sp->effect = config->effect;
+    sp->low = 200.0f;
+    sp->high = 4000.0f;
+    sp->threshold = -60.0f;
+    sp->release = expf(-(float)stft->hop / (float)(stft->sample_rate * SPECTRAL_GATE_RELEASE));
+
+    struct stft_node_config stft_config = config->stft;
+    stft_config.stft.process = spectral_process_frame;
+    stft_config.stft.user = sp;
+    result = stft_node_init(graph, &stft_config, alloc, &sp->stft);
+    if (result != MA_SUCCESS) {
+        dsp_arena_uninit(&sp->arena);
+        return result;
+    }
+    spectral_build_mask(sp, sp->low, sp->high);
+    return MA_SUCCESS;
+}
+
+static void spectral_node_uninit(struct spectral_node *sp, const ma_allocation_callbacks *alloc)
+{
+    stft_node_uninit(&sp->stft, alloc);
+    dsp_arena_uninit(&sp->arena);
+}
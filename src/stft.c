@@ -0,0 +1,308 @@
+/*
+ * Short-time Fourier transform with weighted overlap-add.
+ *
+ * Input is cut into windowed frames of `fft_size` samples every `hop`
+ * samples, transformed, handed to a frame callback that edits the bins in
+ * place, transformed back, windowed again and overlap-added into the output.
+ * Each sample of the output is the sum of fft_size / hop frames, which see it
+ * at the window positions that share its phase within the hop. The
+ * synthesis window is normalised by that phase's sum of analysis *
+ * analysis, so any window at any hop that divides fft_size adds back to
+ * one, and a callback that does nothing gives back the input, delayed by
+ * fft_size samples.
+ *
+ * All buffers are carved from one aligned arena at init; the audio thread
+ * never allocates.
+ */
+#include "dsp.h"
+
+enum stft_window {
+    STFT_WINDOW_HANN,
+    STFT_WINDOW_HAMMING,
+    STFT_WINDOW_BLACKMAN,
+    STFT_WINDOW_COUNT,
+};
+
+static const char *stft_window_names[STFT_WINDOW_COUNT] = {
+    "Hann",
+    "Hamming",
+    "Blackman",
+};
+
+/*
+ * Edits the `bins` bins of one frame of `channel` in place. `re` and `im` are
+ * aligned and padded with zeros to a multiple of four, so whole vectors may
+ * be processed past the last bin.
+ */
+typedef void (*stft_frame_proc)(void *user, ma_uint32 channel, float *re, float *im, ma_uint32 bins);
+
+struct stft_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    ma_uint32 fft_size;
+    ma_uint32 hop;
+    enum stft_window window;
+    stft_frame_proc process;
+    void *user;
+};
+
+struct stft {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    ma_uint32 fft_size;
+    ma_uint32 hop;
+    ma_uint32 bins;
+    enum stft_window window;
+    float window_gain;          /* Spectrum magnitude of a full scale sine at its bin. */
+    stft_frame_proc process;
+    void *user;
+    const struct fft_plan *plan;
+
+    float *analysis;            /* [fft_size] */
+    float *synthesis;           /* [fft_size], includes the OLA and 1/N scale */
+    float *input;               /* [channel][fft_size], newest samples last */
+    float *accum;               /* [channel][fft_size], overlap-add accumulator */
+    float *ready;               /* [channel][hop], finished output being played */
+    float *frame;               /* [fft_size] */
+    float *re, *im;             /* [bins], padded */
+    float *scratch;
+    ma_uint32 pos;              /* Frames into the current hop. */
+    struct dsp_arena arena;
+};
+
+static struct stft_config
+stft_config_init(ma_uint32 channels, ma_uint32 sample_rate, ma_uint32 fft_size, ma_uint32 hop,
+        enum stft_window window, stft_frame_proc process, void *user)
+{
+    struct stft_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.fft_size = fft_size;
+    config.hop = hop;
+    config.window = window;
+    config.process = process;
+    config.user = user;
+    return config;
+}
+
+static double stft_window_value(enum stft_window window, ma_uint32 i, ma_uint32 n)
+{
+    /* Periodic windows, so they overlap-add exactly. */
+    double x = 2.0 * DSP_PI * (double)i / (double)n;
+    switch (window) {
+    case STFT_WINDOW_HAMMING:  return 0.54 - 0.46 * cos(x);
+    case STFT_WINDOW_BLACKMAN: return 0.42 - 0.5 * cos(x) + 0.08 * cos(2.0 * x);
+    default:                   return 0.5 - 0.5 * cos(x);
+    }
+}
+
+static void stft_layout(struct stft *st)
+{
+    const size_t padded = (st->bins + 3) & ~3u;
+    st->analysis = dsp_arena_floats(&st->arena, st->fft_size);
+    st->synthesis = dsp_arena_floats(&st->arena, st->fft_size);
+    st->input = dsp_arena_floats(&st->arena, (size_t)st->channels * st->fft_size);
+    st->accum = dsp_arena_floats(&st->arena, (size_t)st->channels * st->fft_size);
+    st->ready = dsp_arena_floats(&st->arena, (size_t)st->channels * st->hop);
+    st->frame = dsp_arena_floats(&st->arena, st->fft_size);
+    st->re = dsp_arena_floats(&st->arena, padded);
+    st->im = dsp_arena_floats(&st->arena, padded);
+    st->scratch = dsp_arena_floats(&st->arena, fft_scratch_size(st->plan));
+}
+
+static ma_result stft_init(const struct stft_config *config, struct stft *st)
+{
+    ma_result result;
+
+    memset(st, 0, sizeof(*st));
+    if (config->channels == 0 || config->hop == 0 || config->fft_size % config->hop != 0
+            || config->window >= STFT_WINDOW_COUNT)
+        return MA_INVALID_ARGS;
+    st->plan = fft_plan_get(config->fft_size);
+    if (st->plan == NULL)
+        return MA_INVALID_ARGS;
+
+    st->channels = config->channels;
+    st->sample_rate = config->sample_rate;
+    st->fft_size = config->fft_size;
+    st->hop = config->hop;
+    st->bins = config->fft_size / 2 + 1;
+    st->window = config->window;
+    st->process = config->process;
+    st->user = config->user;
+
+    stft_layout(st);
+    result = dsp_arena_init(&st->arena, st->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    stft_layout(st);
+
+    const ma_uint32 n = st->fft_size, hop = st->hop;
+    double sum = 0.0;
+    for (ma_uint32 i = 0; i < n; i++) {
+        st->analysis[i] = (float)stft_window_value(config->window, i, n);
+        sum += st->analysis[i];
+    }
+    /*
+     * Sum of analysis^2 at each phase of the hop. It is only flat by itself
+     * when fft_size / hop exceeds twice the window's highest cosine term
+     * (Hann at a quarter hop, not Blackman), so divide it out per phase. A
+     * phase every frame sees at a zero of the window can't be recovered.
+     */
+    for (ma_uint32 p = 0; p < hop; p++) {
+        double overlap = 0.0;
+        for (ma_uint32 i = p; i < n; i += hop)
+            overlap += (double)st->analysis[i] * st->analysis[i];
+        if (overlap < 1e-6) {
+            dsp_arena_uninit(&st->arena);
+            return MA_INVALID_ARGS;
+        }
+        for (ma_uint32 i = p; i < n; i += hop)
+            st->synthesis[i] = (float)(st->analysis[i] / (overlap * n));
+    }
+    st->window_gain = (float)(sum / 2.0);
+    return MA_SUCCESS;
+}
+
+static void stft_uninit(struct stft *st)
+{
+    dsp_arena_uninit(&st->arena);
+}
+
+/*
+ * A sample read at phase p of a hop sits at fft_size - hop + p of the frame
+ * taken at the end of that hop, and is played from the start of the
+ * accumulator fft_size / hop - 1 hops later, at phase p again.
+ */
+static ma_uint32 stft_get_latency(const struct stft *st)
+{
+    return st->fft_size;
+}
+
+static float stft_bin_frequency(const struct stft *st, ma_uint32 bin)
+{
+    return (float)bin * (float)st->sample_rate / (float)st->fft_size;
+}
+
+static void stft_hop(struct stft *st)
+{
+    const ma_uint32 n = st->fft_size, hop = st->hop;
+
+    for (ma_uint32 ch = 0; ch < st->channels; ch++) {
+        float *input = st->input + (size_t)ch * n;
+        float *accum = st->accum + (size_t)ch * n;
+
+        kernels.multiply(st->frame, input, st->analysis, n);
+        fft_forward(st->plan, st->frame, st->re, st->im, st->scratch);
+        if (st->process)
+            st->process(st->user, ch, st->re, st->im, st->bins);
+        fft_inverse(st->plan, st->re, st->im, st->frame, st->scratch);
+        kernels.multiply_add(accum, st->frame, st->synthesis, n);
+
+        /* The first hop of the accumulator is complete: play it, then slide both buffers. */
+        memcpy(st->ready + (size_t)ch * hop, accum, sizeof(float) * hop);
+        memmove(accum, accum + hop, sizeof(float) * (n - hop));
+        memset(accum + n - hop, 0, sizeof(float) * hop);
+        memmove(input, input + hop, sizeof(float) * (n - hop));
+    }
+}
+
+/* Interleaved in and out; `in` may equal `out`. */
+static void stft_process(struct stft *st, float *out, const float *in, ma_uint32 frame_count)
+{
+    const ma_uint32 channels = st->channels, n = st->fft_size, hop = st->hop;
+
+    while (frame_count > 0) {
+        ma_uint32 count = DSP_MIN(frame_count, hop - st->pos);
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            float *input = st->input + (size_t)ch * n + (n - hop) + st->pos;
+            const float *ready = st->ready + (size_t)ch * hop + st->pos;
+            for (ma_uint32 i = 0; i < count; i++) {
+                input[i] = in[i * channels + ch];
+                out[i * channels + ch] = ready[i];
+            }
+        }
+        in += count * channels;
+        out += count * channels;
+        frame_count -= count;
+        st->pos += count;
+        if (st->pos == hop) {
+            stft_hop(st);
+            st->pos = 0;
+        }
+    }
+}
+
+
+/*
+ * STFT Node
+ *
+ * Base node for spectral effects: embed it first in the effect's struct and
+ * pass the effect's frame callback in the config.
+ */
+struct stft_node_config {
+    ma_node_config node_config;
+    struct stft_config stft;
+};
+
+struct stft_node {
+    ma_node_base base;
+    struct stft stft;
+};
+
+static struct stft_node_config
+stft_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, ma_uint32 fft_size, ma_uint32 hop,
+        enum stft_window window, stft_frame_proc process, void *user)
+{
+    struct stft_node_config config;
+    config.node_config = ma_node_config_init();
+    config.stft = stft_config_init(channels, sample_rate, fft_size, hop, window, process, user);
+    return config;
+}
+
+static void stft_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct stft_node *stft = (struct stft_node *)node;
+    (void)frame_count_in;
+    stft_process(&stft->stft, frames_out[0], frames_in[0], *frame_count_out);
+}
+
+static ma_node_vtable stft_node_vtable = {
+    stft_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input. */
+    1,      /* One output. */
+    0       /* Default flags. */
+};
+
+static ma_result stft_node_init(ma_node_graph *graph, const struct stft_node_config *config,
+        const ma_allocation_callbacks *alloc, struct stft_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = stft_init(&config->stft, &node->stft);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &stft_node_vtable;
+    base_config.pInputChannels = &config->stft.channels;
+    base_config.pOutputChannels = &config->stft.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        stft_uninit(&node->stft);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void stft_node_uninit(struct stft_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    stft_uninit(&node->stft);
+}
@@ -0,0 +1,417 @@
+/*
+ * Time-stretch and pitch-shift.
+ *
+ * A phase vocoder stretches the input by pitch / tempo: frames are taken
+ * every analysis hop and overlap-added every fixed synthesis hop. Phases use
+ * identity phase locking (Laroche and Dolson): only spectral peaks get a
+ * phase advanced from their measured frequency, and every other bin keeps
+ * its phase offset to the peak whose region it is in. That offset is a
+ * single rotation per region, so a frame needs a few transcendental calls
+ * per peak instead of per bin, and the result has far less phasiness than
+ * a plain vocoder. The stretched signal is then read back at `pitch` times
+ * the rate with a cubic interpolator, which puts the duration back to
+ * 1 / tempo and shifts the pitch.
+ *
+ * The node consumes and produces frames at different rates, so it uses
+ * MA_NODE_FLAG_DIFFERENT_PROCESSING_RATES. All buffers are preallocated.
+ */
+#include "dsp.h"
+
+#define STRETCH_FFT_SIZE        2048
+#define STRETCH_HOP             (STRETCH_FFT_SIZE / 4)  /* Synthesis hop. */
+#define STRETCH_MIN_RATIO       0.25f                   /* Tempo and pitch limits. */
+#define STRETCH_MAX_RATIO       4.0f
+#define STRETCH_OUTPUT_SIZE     (2 * STRETCH_HOP + 4)
+
+struct stretch_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    float tempo;
+    float pitch;
+};
+
+struct stretch {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    ma_uint32 bins;
+    ma_uint32 stride;           /* bins rounded up to the vector width */
+    const struct fft_plan *plan;
+
+    /* Written by the UI thread, read once per vocoder frame. */
+    float tempo;                /* 2 plays twice as fast. */
+    float pitch;                /* 2 is an octave up. */
+
+    float *analysis;            /* [STRETCH_FFT_SIZE] */
+    float *synthesis;           /* [STRETCH_FFT_SIZE], includes the OLA and 1/N scale */
+    float *input;               /* [channel][STRETCH_FFT_SIZE] */
+    ma_uint32 input_len;
+    double analysis_frac;       /* Fractional part of the analysis position. */
+    ma_uint32 analysis_hop;     /* Frames between the previous analysis frame and the next. */
+    ma_uint32 skip;             /* Input frames still to drop when the hop exceeds a frame. */
+    ma_bool32 primed;           /* A previous frame exists to measure phase advances against. */
+
+    float *last_re, *last_im;   /* [channel][stride], previous analysis spectrum */
+    float *synth_re, *synth_im; /* [channel][stride], previous synthesis spectrum */
+    float *accum;               /* [channel][STRETCH_FFT_SIZE] */
+    float *output;              /* [channel][STRETCH_OUTPUT_SIZE], stretched signal not yet resampled */
+    ma_uint32 output_len;
+    double read;                /* Resampler position in output. */
+
+    float *frame;               /* [STRETCH_FFT_SIZE] */
+    float *re, *im, *power;     /* [stride] */
+    ma_uint32 *peaks;           /* [bins] */
+    float *scratch;
+    struct dsp_arena arena;
+};
+
+static struct stretch_config stretch_config_init(ma_uint32 channels, ma_uint32 sample_rate, float tempo, float pitch)
+{
+    struct stretch_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.tempo = tempo;
+    config.pitch = pitch;
+    return config;
+}
+
+static void stretch_layout(struct stretch *st)
+{
+    const size_t spectra = (size_t)st->channels * st->stride;
+    st->analysis = dsp_arena_floats(&st->arena, STRETCH_FFT_SIZE);
+    st->synthesis = dsp_arena_floats(&st->arena, STRETCH_FFT_SIZE);
+    st->input = dsp_arena_floats(&st->arena, (size_t)st->channels * STRETCH_FFT_SIZE);
+    st->last_re = dsp_arena_floats(&st->arena, spectra);
+    st->last_im = dsp_arena_floats(&st->arena, spectra);
+    st->synth_re = dsp_arena_floats(&st->arena, spectra);
+    st->synth_im = dsp_arena_floats(&st->arena, spectra);
+    st->accum = dsp_arena_floats(&st->arena, (size_t)st->channels * STRETCH_FFT_SIZE);
+    st->output = dsp_arena_floats(&st->arena, (size_t)st->channels * STRETCH_OUTPUT_SIZE);
+    st->frame = dsp_arena_floats(&st->arena, STRETCH_FFT_SIZE);
+    st->re = dsp_arena_floats(&st->arena, st->stride);
+    st->im = dsp_arena_floats(&st->arena, st->stride);
+    st->power = dsp_arena_floats(&st->arena, st->stride);
+    st->peaks = (ma_uint32 *)dsp_arena_floats(&st->arena, st->bins);
+    st->scratch = dsp_arena_floats(&st->arena, fft_scratch_size(st->plan));
+}
+
+static ma_result stretch_init(const struct stretch_config *config, struct stretch *st)
+{
+    ma_result result;
+
+    memset(st, 0, sizeof(*st));
+    if (config->channels == 0 || config->sample_rate == 0)
+        return MA_INVALID_ARGS;
+    st->plan = fft_plan_get(STRETCH_FFT_SIZE);
+    if (st->plan == NULL)
+        return MA_INVALID_ARGS;
+
+    st->channels = config->channels;
+    st->sample_rate = config->sample_rate;
+    st->bins = STRETCH_FFT_SIZE / 2 + 1;
+    st->stride = (st->bins + 3) & ~3u;
+    st->tempo = config->tempo;
+    st->pitch = config->pitch;
+
+    stretch_layout(st);
+    result = dsp_arena_init(&st->arena, st->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    stretch_layout(st);
+
+    /* Hann at a quarter hop: w^2 overlap-adds to 1.5. */
+    for (ma_uint32 i = 0; i < STRETCH_FFT_SIZE; i++) {
+        double w = 0.5 - 0.5 * cos(2.0 * DSP_PI * i / STRETCH_FFT_SIZE);
+        st->analysis[i] = (float)w;
+        st->synthesis[i] = (float)(w / (1.5 * STRETCH_FFT_SIZE));
+    }
+
+    /* One frame of history in front of the resampler. */
+    st->output_len = 1;
+    st->read = 1.0;
+    return MA_SUCCESS;
+}
+
+static void stretch_uninit(struct stretch *st)
+{
+    dsp_arena_uninit(&st->arena);
+}
+
+static float stretch_clamp_ratio(float ratio)
+{
+    return DSP_CLAMP(ratio, STRETCH_MIN_RATIO, STRETCH_MAX_RATIO);
+}
+
+/* Whether output time follows input time, i.e. the tempo is 1. Otherwise the output drifts. */
+static bool stretch_keeps_time(struct stretch *st)
+{
+    return stretch_clamp_ratio(dsp_load_f32(&st->tempo)) == 1.0f;
+}
+
+/* Delay of the output behind the input; only meaningful while stretch_keeps_time(). */
+static ma_uint32 stretch_get_latency(const struct stretch *st)
+{
+    (void)st;
+    return STRETCH_FFT_SIZE;
+}
+
+static float stretch_wrap_phase(float phase)
+{
+    const float two_pi = (float)(2.0 * DSP_PI);
+    return phase - two_pi * floorf(phase / two_pi + 0.5f);
+}
+
+/* Replaces re/im of one channel's frame with the phase locked synthesis spectrum. */
+static void stretch_lock_phases(struct stretch *st, ma_uint32 channel)
+{
+    const ma_uint32 bins = st->bins;
+    float *re = st->re, *im = st->im, *power = st->power;
+    float *last_re = st->last_re + (size_t)channel * st->stride;
+    float *last_im = st->last_im + (size_t)channel * st->stride;
+    float *synth_re = st->synth_re + (size_t)channel * st->stride;
+    float *synth_im = st->synth_im + (size_t)channel * st->stride;
+    ma_uint32 *peaks = st->peaks;
+    ma_uint32 peak_count = 0;
+
+    for (ma_uint32 k = 0; k < st->stride; k += 4) {
+        v4f r = v4f_load_aligned(re + k), i = v4f_load_aligned(im + k);
+        v4f_store_aligned(power + k, v4f_madd(r, r, v4f_mul(i, i)));
+    }
+    for (ma_uint32 k = 0; k < bins; k++) {
+        float p = power[k];
+        if ((k < 1 || p > power[k - 1]) && (k < 2 || p > power[k - 2])
+                && (k + 1 >= bins || p >= power[k + 1]) && (k + 2 >= bins || p >= power[k + 2]))
+            peaks[peak_count++] = k;
+    }
+    if (peak_count == 0)
+        peaks[peak_count++] = 0;
+
+    const float hop_in = (float)st->analysis_hop, hop_out = (float)STRETCH_HOP;
+    ma_uint32 start = 0;
+    for (ma_uint32 n = 0; n < peak_count; n++) {
+        const ma_uint32 p = peaks[n];
+        const ma_uint32 end = n + 1 < peak_count ? (p + peaks[n + 1]) / 2 : bins - 1;
+
+        /* Measured frequency of the peak from its phase advance over the analysis hop. */
+        float omega = (float)(2.0 * DSP_PI) * (float)p / STRETCH_FFT_SIZE;
+        float advance = atan2f(im[p] * last_re[p] - re[p] * last_im[p], re[p] * last_re[p] + im[p] * last_im[p]);
+        float frequency = omega + stretch_wrap_phase(advance - omega * hop_in) / hop_in;
+        float target = atan2f(synth_im[p], synth_re[p]) + frequency * hop_out;
+        float rotation = target - atan2f(im[p], re[p]);
+        float c = cosf(rotation), s = sinf(rotation);
+
+        for (ma_uint32 k = start; k <= end; k++) {
+            last_re[k] = re[k];
+            last_im[k] = im[k];
+            float r = re[k] * c - im[k] * s;
+            float i = re[k] * s + im[k] * c;
+            re[k] = synth_re[k] = r;
+            im[k] = synth_im[k] = i;
+        }
+        start = end + 1;
+    }
+}
+
+/* Turns the frame at the front of the input into the next STRETCH_HOP frames of stretched output. */
+static void stretch_frame(struct stretch *st)
+{
+    const ma_uint32 n = STRETCH_FFT_SIZE, hop = STRETCH_HOP;
+
+    for (ma_uint32 ch = 0; ch < st->channels; ch++) {
+        float *input = st->input + (size_t)ch * n;
+        float *accum = st->accum + (size_t)ch * n;
+        float *output = st->output + (size_t)ch * STRETCH_OUTPUT_SIZE + st->output_len;
+
+        for (ma_uint32 i = 0; i < n; i += 4)
+            v4f_store_aligned(st->frame + i, v4f_mul(v4f_load_aligned(input + i), v4f_load_aligned(st->analysis + i)));
+        fft_forward(st->plan, st->frame, st->re, st->im, st->scratch);
+        if (st->primed) {
+            stretch_lock_phases(st, ch);
+        } else {
+            size_t offset = (size_t)ch * st->stride;
+            memcpy(st->last_re + offset, st->re, sizeof(float) * st->bins);
+            memcpy(st->last_im + offset, st->im, sizeof(float) * st->bins);
+            memcpy(st->synth_re + offset, st->re, sizeof(float) * st->bins);
+            memcpy(st->synth_im + offset, st->im, sizeof(float) * st->bins);
+        }
+        fft_inverse(st->plan, st->re, st->im, st->frame, st->scratch);
+        for (ma_uint32 i = 0; i < n; i += 4) {
+            v4f acc = v4f_madd(v4f_load_aligned(st->frame + i), v4f_load_aligned(st->synthesis + i),
+                    v4f_load_aligned(accum + i));
+            v4f_store_aligned(accum + i, acc);
+        }
+
+        memcpy(output, accum, sizeof(float) * hop);
+        memmove(accum, accum + hop, sizeof(float) * (n - hop));
+        memset(accum + n - hop, 0, sizeof(float) * hop);
+    }
+    st->output_len += hop;
+    st->primed = MA_TRUE;
+
+    /* Step the analysis by hop * tempo / pitch, carrying the fraction. */
+    float tempo = stretch_clamp_ratio(dsp_load_f32(&st->tempo));
+    float pitch = stretch_clamp_ratio(dsp_load_f32(&st->pitch));
+    st->analysis_frac += (double)hop * tempo / pitch;
+    ma_uint32 step = (ma_uint32)st->analysis_frac;
+    st->analysis_frac -= step;
+    st->analysis_hop = step;
+    if (step >= n) {
+        st->skip = step - n;
+        st->input_len = 0;
+        return;
+    }
+    for (ma_uint32 ch = 0; ch < st->channels; ch++) {
+        float *input = st->input + (size_t)ch * n;
+        memmove(input, input + step, sizeof(float) * (st->input_len - step));
+    }
+    st->input_len -= step;
+}
+
+/* Drops resampled history, keeping the one frame before the read position. */
+static void stretch_compact_output(struct stretch *st)
+{
+    ma_uint32 drop = (ma_uint32)st->read - 1;
+    if (drop == 0)
+        return;
+    for (ma_uint32 ch = 0; ch < st->channels; ch++) {
+        float *output = st->output + (size_t)ch * STRETCH_OUTPUT_SIZE;
+        memmove(output, output + drop, sizeof(float) * (st->output_len - drop));
+    }
+    st->output_len -= drop;
+    st->read -= drop;
+}
+
+/*
+ * Interleaved in and out. Consumes up to *frame_count_in frames and produces
+ * up to *frame_count_out, and writes back how many of each it did.
+ */
+static void stretch_process(struct stretch *st, float *out, ma_uint32 *frame_count_out,
+        const float *in, ma_uint32 *frame_count_in)
+{
+    const ma_uint32 channels = st->channels, want = *frame_count_out, available = *frame_count_in;
+    const float pitch = stretch_clamp_ratio(dsp_load_f32(&st->pitch));
+    ma_uint32 produced = 0, consumed = 0;
+
+    for (;;) {
+        /* Cubic Hermite read of the stretched signal at `pitch` frames per output frame. */
+        while (produced < want && (ma_uint32)st->read + 2 < st->output_len) {
+            ma_uint32 i = (ma_uint32)st->read;
+            float t = (float)(st->read - i);
+            for (ma_uint32 ch = 0; ch < channels; ch++) {
+                const float *x = st->output + (size_t)ch * STRETCH_OUTPUT_SIZE + i;
+                float c1 = 0.5f * (x[1] - x[-1]);
+                float c2 = x[-1] - 2.5f * x[0] + 2.0f * x[1] - 0.5f * x[2];
+                float c3 = 0.5f * (x[2] - x[-1]) + 1.5f * (x[0] - x[1]);
+                out[produced * channels + ch] = ((c3 * t + c2) * t + c1) * t + x[0];
+            }
+            st->read += pitch;
+            produced++;
+        }
+        if (produced == want)
+            break;
+
+        stretch_compact_output(st);
+        if (st->input_len == STRETCH_FFT_SIZE && st->output_len + STRETCH_HOP <= STRETCH_OUTPUT_SIZE) {
+            stretch_frame(st);
+            continue;
+        }
+        if (consumed < available && st->skip > 0) {
+            ma_uint32 count = DSP_MIN(available - consumed, st->skip);
+            st->skip -= count;
+            consumed += count;
+            continue;
+        }
+        if (consumed < available && st->input_len < STRETCH_FFT_SIZE) {
+            ma_uint32 count = DSP_MIN(available - consumed, STRETCH_FFT_SIZE - st->input_len);
+            for (ma_uint32 ch = 0; ch < channels; ch++) {
+                float *input = st->input + (size_t)ch * STRETCH_FFT_SIZE + st->input_len;
+                for (ma_uint32 f = 0; f < count; f++)
+                    input[f] = in[(consumed + f) * channels + ch];
+            }
+            st->input_len += count;
+            consumed += count;
+            continue;
+        }
+        break;
+    }
+
+    *frame_count_out = produced;
+    *frame_count_in = consumed;
+}
+
+
+/*
+ * Stretch Node
+ */
+struct stretch_node_config {
+    ma_node_config node_config;
+    struct stretch_config stretch;
+};
+
+struct stretch_node {
+    ma_node_base base;
+    struct stretch stretch;
+};
+
+static struct stretch_node_config
+stretch_node_config_init(ma_uint32 channels, ma_uint32 sample_rate, float tempo, float pitch)
+{
+    struct stretch_node_config config;
+    config.node_config = ma_node_config_init();
+    config.stretch = stretch_config_init(channels, sample_rate, tempo, pitch);
+    return config;
+}
+
+static void stretch_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct stretch_node *stretch = (struct stretch_node *)node;
+    stretch_process(&stretch->stretch, frames_out[0], frame_count_out, frames_in[0], frame_count_in);
+}
+
+static ma_result stretch_node_get_required_input_frame_count(ma_node *node, ma_uint32 output_frame_count,
+        ma_uint32 *input_frame_count)
+{
+    struct stretch_node *stretch = (struct stretch_node *)node;
+    float tempo = stretch_clamp_ratio(dsp_load_f32(&stretch->stretch.tempo));
+    *input_frame_count = (ma_uint32)ceilf(output_frame_count * tempo);
+    return MA_SUCCESS;
+}
+
+static ma_node_vtable stretch_node_vtable = {
+    stretch_node_process_pcm_frames,
+    stretch_node_get_required_input_frame_count,
+    1,      /* One input. */
+    1,      /* One output. */
+    MA_NODE_FLAG_DIFFERENT_PROCESSING_RATES
+};
+
+static ma_result stretch_node_init(ma_node_graph *graph, const struct stretch_node_config *config,
+        const ma_allocation_callbacks *alloc, struct stretch_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = stretch_init(&config->stretch, &node->stretch);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &stretch_node_vtable;
+    base_config.pInputChannels = &config->stretch.channels;
+    base_config.pOutputChannels = &config->stretch.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        stretch_uninit(&node->stretch);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void stretch_node_uninit(struct stretch_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    stretch_uninit(&node->stretch);
+}
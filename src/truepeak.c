@@ -0,0 +1,88 @@
+/*
+ * True peak estimation by 4x polyphase oversampling, as in ITU-R BS.1770.
+ *
+ * Each input sample is interpolated at four phases with a 48 tap windowed
+ * sinc. The four phases sit in the four lanes of a vector, so a sample
+ * costs TRUEPEAK_TAPS multiply-adds per channel and one horizontal max.
+ */
+#include "dsp.h"
+
+#define TRUEPEAK_FACTOR     4
+#define TRUEPEAK_TAPS       12                      /* Per phase. */
+#define TRUEPEAK_DELAY      (TRUEPEAK_TAPS / 2)     /* Frames from an input sample to its phase 0 output. */
+
+struct truepeak {
+    ma_uint32 channels;
+    float coeffs[TRUEPEAK_TAPS][TRUEPEAK_FACTOR];   /* [tap][phase] */
+    float *history;             /* [channel][2 * TRUEPEAK_TAPS], mirrored so reads never wrap */
+    ma_uint32 pos;
+};
+
+static ma_result truepeak_init(struct truepeak *tp, ma_uint32 channels)
+{
+    memset(tp, 0, sizeof(*tp));
+    if (channels == 0)
+        return MA_INVALID_ARGS;
+    tp->channels = channels;
+    tp->history = dsp_alloc((size_t)channels * 2 * TRUEPEAK_TAPS);
+    if (tp->history == NULL)
+        return MA_OUT_OF_MEMORY;
+
+    /* Blackman windowed sinc cut at the input Nyquist; each phase is normalised to unity at DC. */
+    const ma_uint32 length = TRUEPEAK_TAPS * TRUEPEAK_FACTOR;
+    for (ma_uint32 p = 0; p < TRUEPEAK_FACTOR; p++) {
+        double sum = 0.0;
+        for (ma_uint32 k = 0; k < TRUEPEAK_TAPS; k++) {
+            ma_uint32 j = k * TRUEPEAK_FACTOR + p;
+            double t = ((double)j - length / 2) / TRUEPEAK_FACTOR;
+            double sinc = t == 0.0 ? 1.0 : sin(DSP_PI * t) / (DSP_PI * t);
+            double x = (double)j / length;
+            double window = 0.42 - 0.5 * cos(2.0 * DSP_PI * x) + 0.08 * cos(4.0 * DSP_PI * x);
+            tp->coeffs[k][p] = (float)(sinc * window);
+            sum += sinc * window;
+        }
+        for (ma_uint32 k = 0; k < TRUEPEAK_TAPS; k++)
+            tp->coeffs[k][p] = (float)(tp->coeffs[k][p] / sum);
+    }
+    return MA_SUCCESS;
+}
+
+static void truepeak_uninit(struct truepeak *tp)
+{
+    dsp_free(tp->history);
+    tp->history = NULL;
+}
+
+/*
+ * Writes the largest absolute value over all channels and phases of each
+ * frame of interleaved `in` to `peak`. peak[n] describes the signal between
+ * input frames n - TRUEPEAK_DELAY and n - TRUEPEAK_DELAY + 1.
+ */
+static void truepeak_process(struct truepeak *tp, const float *in, ma_uint32 frame_count, float *peak)
+{
+    const ma_uint32 channels = tp->channels;
+    v4f coeffs[TRUEPEAK_TAPS];
+    for (ma_uint32 k = 0; k < TRUEPEAK_TAPS; k++)
+        coeffs[k] = v4f_load(tp->coeffs[k]);
+
+    ma_uint32 pos = tp->pos;
+    for (ma_uint32 f = 0; f < frame_count; f++) {
+        v4f level = v4f_zero();
+        for (ma_uint32 ch = 0; ch < channels; ch++) {
+            float *history = tp->history + (size_t)ch * 2 * TRUEPEAK_TAPS;
+            float x = in[f * channels + ch];
+            history[pos] = x;
+            history[pos + TRUEPEAK_TAPS] = x;
+
+            /* newest[-k] is the sample k frames ago. */
+            const float *newest = history + pos + TRUEPEAK_TAPS;
+            v4f acc = v4f_zero();
+            for (ma_uint32 k = 0; k < TRUEPEAK_TAPS; k++)
+                acc = v4f_madd(coeffs[k], v4f_set1(newest[-(int)k]), acc);
+            level = v4f_max(level, v4f_abs(acc));
+        }
+        peak[f] = v4f_hmax(level);
+        pos = pos + 1 == TRUEPEAK_TAPS ? 0 : pos + 1;
+    }
+    tp->pos = pos;
+}
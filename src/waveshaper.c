@@ -0,0 +1,286 @@
+/*
+ * Waveshaper: drive into a static curve.
+ *
+ * A curve bends the waveform and so adds harmonics, and any of them above
+ * the Nyquist frequency fold back down as inharmonic aliasing. The curve
+ * therefore runs inside an oversampler, at 1x, 2x, 4x or 8x chosen per
+ * node: each doubling moves more of the harmonics clear of the band before
+ * they fold, and costs roughly twice the CPU.
+ *
+ * Bias shifts the signal along the curve before shaping, which makes the
+ * shaping asymmetric and adds even harmonics. The curve's value at the
+ * bias is subtracted, and a DC blocker removes the offset that moves with
+ * the level. The dry signal is mixed in at the oversampled rate, so it
+ * passes through the same filters and stays aligned with the wet.
+ */
+#include "dsp.h"
+
+#define WAVESHAPER_MAX_DRIVE    48.0f   /* dB */
+#define WAVESHAPER_MAX_OUTPUT   24.0f   /* dB, either way */
+#define WAVESHAPER_DC_HZ        10.0f
+
+enum waveshaper_curve {
+    WAVESHAPER_SOFT,            /* Rational tanh approximation, saturates at +-1 */
+    WAVESHAPER_HARD,            /* Clips at +-1 */
+    WAVESHAPER_FOLD,            /* Reflects off +-1, over and over */
+    WAVESHAPER_CURVE_COUNT
+};
+
+static const char *waveshaper_curve_names[WAVESHAPER_CURVE_COUNT] = {
+    "Soft Clip", "Hard Clip", "Foldback",
+};
+
+static const char *waveshaper_oversample_names[OVERSAMPLER_MAX_STAGES + 1] = {
+    "Off", "2x", "4x", "8x",
+};
+
+struct waveshaper_config {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    enum waveshaper_curve curve;
+    float drive;
+    ma_uint32 oversample;
+};
+
+struct waveshaper {
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+
+    /* Written by the UI thread, read once per block. */
+    ma_uint32 curve;            /* enum waveshaper_curve */
+    float drive;                /* dB */
+    float bias;                 /* -1 .. 1 */
+    float output;               /* dB */
+    float mix;                  /* 0 dry .. 1 wet */
+    ma_uint32 oversample;       /* 1, 2, 4 or 8 */
+
+    /* Audio thread state. Gains ramp across each block, from applied to target. */
+    float applied_drive, applied_output, applied_mix, applied_bias;
+    float drive_step, output_step, mix_step, bias_step;    /* Per oversampled sample */
+    ma_uint32 block_curve;
+    float dc_coeff;
+    float *dc_in, *dc_out;      /* [channel], DC blocker state */
+    struct oversampler oversampler;
+    struct dsp_arena arena;
+};
+
+static struct waveshaper_config waveshaper_config_init(ma_uint32 channels, ma_uint32 sample_rate,
+        enum waveshaper_curve curve, float drive, ma_uint32 oversample)
+{
+    struct waveshaper_config config;
+    config.channels = channels;
+    config.sample_rate = sample_rate;
+    config.curve = curve;
+    config.drive = drive;
+    config.oversample = oversample;
+    return config;
+}
+
+static void waveshaper_layout(struct waveshaper *ws)
+{
+    ws->dc_in = dsp_arena_floats(&ws->arena, ws->channels);
+    ws->dc_out = dsp_arena_floats(&ws->arena, ws->channels);
+}
+
+static ma_result waveshaper_init(const struct waveshaper_config *config, struct waveshaper *ws)
+{
+    ma_result result;
+
+    memset(ws, 0, sizeof(*ws));
+    if (config->channels == 0 || config->sample_rate == 0)
+        return MA_INVALID_ARGS;
+
+    ws->channels = config->channels;
+    ws->sample_rate = config->sample_rate;
+    ws->curve = config->curve;
+    ws->drive = config->drive;
+    ws->bias = 0.0f;
+    ws->output = 0.0f;
+    ws->mix = 1.0f;
+    ws->oversample = config->oversample;
+
+    waveshaper_layout(ws);
+    result = dsp_arena_init(&ws->arena, ws->arena.used);
+    if (result != MA_SUCCESS)
+        return result;
+    waveshaper_layout(ws);
+
+    result = oversampler_init(&ws->oversampler, ws->channels, ws->oversample);
+    if (result != MA_SUCCESS) {
+        dsp_arena_uninit(&ws->arena);
+        return result;
+    }
+
+    ws->applied_drive = dsp_db_to_gain(DSP_CLAMP(ws->drive, 0.0f, WAVESHAPER_MAX_DRIVE));
+    ws->applied_output = 1.0f;
+    ws->applied_mix = 1.0f;
+    return MA_SUCCESS;
+}
+
+static void waveshaper_uninit(struct waveshaper *ws)
+{
+    oversampler_uninit(&ws->oversampler);
+    dsp_arena_uninit(&ws->arena);
+}
+
+static ma_uint32 waveshaper_get_latency(const struct waveshaper *ws)
+{
+    return oversampler_latency(dsp_load_u32(&ws->oversample));
+}
+
+static inline v4f waveshaper_shape(ma_uint32 curve, v4f x)
+{
+    switch (curve) {
+    case WAVESHAPER_HARD:
+        return v4f_min(v4f_max(x, v4f_set1(-1.0f)), v4f_set1(1.0f));
+    case WAVESHAPER_FOLD: {
+        /* A triangle wave of x: 1 - 4 |t - round(t)| with t = (x + 1) / 4, shifted by a quarter. */
+        v4f t = v4f_mul(v4f_add(x, v4f_set1(1.0f)), v4f_set1(0.25f));
+        v4f r = v4f_abs(v4f_sub(t, v4f_floor(v4f_add(t, v4f_set1(0.5f)))));
+        return v4f_madd(v4f_set1(4.0f), r, v4f_set1(-1.0f));
+    }
+    default: {
+        /* x (27 + x^2) / (27 + 9 x^2), which meets tanh's slope at 0 and reaches 1 at 3. */
+        x = v4f_min(v4f_max(x, v4f_set1(-3.0f)), v4f_set1(3.0f));
+        v4f x2 = v4f_mul(x, x);
+        return v4f_div(v4f_mul(x, v4f_add(v4f_set1(27.0f), x2)), v4f_madd(v4f_set1(9.0f), x2, v4f_set1(27.0f)));
+    }
+    }
+}
+
+/* oversampler_callback: shapes one channel at the oversampled rate. */
+static void waveshaper_run(void *user, ma_uint32 channel, float *samples, ma_uint32 offset, ma_uint32 count)
+{
+    struct waveshaper *ws = (struct waveshaper *)user;
+    const ma_uint32 curve = ws->block_curve;
+    const v4f lane = v4f_set(0.0f, 1.0f, 2.0f, 3.0f);
+    const v4f drive_step = v4f_set1(ws->drive_step), output_step = v4f_set1(ws->output_step);
+    const v4f mix_step = v4f_set1(ws->mix_step), bias_step = v4f_set1(ws->bias_step);
+    const float r = ws->dc_coeff;
+    float dc_in = ws->dc_in[channel], dc_out = ws->dc_out[channel];
+    float y[4];
+
+    for (ma_uint32 i = 0; i < count; i += 4) {
+        const ma_uint32 n = DSP_MIN(4u, count - i);
+        v4f index = v4f_add(v4f_set1((float)(offset + i)), lane);
+        v4f drive = v4f_madd(drive_step, index, v4f_set1(ws->applied_drive));
+        v4f output = v4f_madd(output_step, index, v4f_set1(ws->applied_output));
+        v4f mix = v4f_madd(mix_step, index, v4f_set1(ws->applied_mix));
+        v4f bias = v4f_madd(bias_step, index, v4f_set1(ws->applied_bias));
+
+        for (ma_uint32 l = 0; l < 4; l++)
+            y[l] = l < n ? samples[i + l] : 0.0f;
+        v4f dry = v4f_load(y);
+        v4f wet = v4f_sub(waveshaper_shape(curve, v4f_madd(drive, dry, bias)), waveshaper_shape(curve, bias));
+        v4f_store(y, v4f_madd(mix, v4f_sub(v4f_mul(output, wet), dry), dry));
+
+        /* One-pole DC blocker, y = x - x[-1] + r y[-1]. */
+        for (ma_uint32 l = 0; l < n; l++) {
+            dc_out = y[l] - dc_in + r * dc_out;
+            dc_in = y[l];
+            samples[i + l] = dc_out;
+        }
+    }
+    ws->dc_in[channel] = dc_in;
+    ws->dc_out[channel] = dc_out;
+}
+
+static void waveshaper_process(struct waveshaper *ws, float *out, const float *in, ma_uint32 frame_count)
+{
+    if (frame_count == 0)
+        return;
+
+    ma_uint32 factor = dsp_load_u32(&ws->oversample);
+    oversampler_set_factor(&ws->oversampler, factor);
+    factor = oversampler_get_factor(&ws->oversampler);
+
+    const float drive = dsp_db_to_gain(DSP_CLAMP(dsp_load_f32(&ws->drive), 0.0f, WAVESHAPER_MAX_DRIVE));
+    const float output = dsp_db_to_gain(DSP_CLAMP(dsp_load_f32(&ws->output), -WAVESHAPER_MAX_OUTPUT, WAVESHAPER_MAX_OUTPUT));
+    const float mix = DSP_CLAMP(dsp_load_f32(&ws->mix), 0.0f, 1.0f);
+    const float bias = DSP_CLAMP(dsp_load_f32(&ws->bias), -1.0f, 1.0f);
+    const float samples = (float)(frame_count * factor);
+
+    ws->block_curve = DSP_MIN(dsp_load_u32(&ws->curve), (ma_uint32)WAVESHAPER_CURVE_COUNT - 1);
+    ws->dc_coeff = 1.0f - (float)(2.0 * DSP_PI) * WAVESHAPER_DC_HZ / (float)(ws->sample_rate * factor);
+    ws->drive_step = (drive - ws->applied_drive) / samples;
+    ws->output_step = (output - ws->applied_output) / samples;
+    ws->mix_step = (mix - ws->applied_mix) / samples;
+    ws->bias_step = (bias - ws->applied_bias) / samples;
+
+    oversampler_process(&ws->oversampler, out, in, frame_count, waveshaper_run, ws);
+
+    ws->applied_drive = drive;
+    ws->applied_output = output;
+    ws->applied_mix = mix;
+    ws->applied_bias = bias;
+}
+
+
+/*
+ * Waveshaper Node
+ */
+struct waveshaper_node_config {
+    ma_node_config node_config;
+    struct waveshaper_config waveshaper;
+};
+
+struct waveshaper_node {
+    ma_node_base base;
+    struct waveshaper waveshaper;
+};
+
+static struct waveshaper_node_config waveshaper_node_config_init(ma_uint32 channels, ma_uint32 sample_rate,
+        enum waveshaper_curve curve, float drive, ma_uint32 oversample)
+{
+    struct waveshaper_node_config config;
+    config.node_config = ma_node_config_init();
+    config.waveshaper = waveshaper_config_init(channels, sample_rate, curve, drive, oversample);
+    return config;
+}
+
+static void waveshaper_node_process_pcm_frames(ma_node *node, const float **frames_in, ma_uint32 *frame_count_in,
+        float **frames_out, ma_uint32 *frame_count_out)
+{
+    struct waveshaper_node *waveshaper = (struct waveshaper_node *)node;
+    (void)frame_count_in;
+    waveshaper_process(&waveshaper->waveshaper, frames_out[0], frames_in[0], *frame_count_out);
+}
+
+static ma_node_vtable waveshaper_node_vtable = {
+    waveshaper_node_process_pcm_frames,
+    NULL,   /* onGetRequiredInputFrameCount */
+    1,      /* One input. */
+    1,      /* One output. */
+    0       /* Default flags. */
+};
+
+static ma_result waveshaper_node_init(ma_node_graph *graph, const struct waveshaper_node_config *config,
+        const ma_allocation_callbacks *alloc, struct waveshaper_node *node)
+{
+    ma_result result;
+
+    if (node == NULL || config == NULL)
+        return MA_INVALID_ARGS;
+    memset(node, 0, sizeof(*node));
+
+    result = waveshaper_init(&config->waveshaper, &node->waveshaper);
+    if (result != MA_SUCCESS)
+        return result;
+
+    ma_node_config base_config = config->node_config;
+    base_config.vtable = &waveshaper_node_vtable;
+    base_config.pInputChannels = &config->waveshaper.channels;
+    base_config.pOutputChannels = &config->waveshaper.channels;
+    result = ma_node_init(graph, &base_config, alloc, &node->base);
+    if (result != MA_SUCCESS) {
+        waveshaper_uninit(&node->waveshaper);
+        return result;
+    }
+    return MA_SUCCESS;
+}
+
+static void waveshaper_node_uninit(struct waveshaper_node *node, const ma_allocation_callbacks *alloc)
+{
+    ma_node_uninit(&node->base, alloc);
+    waveshaper_uninit(&node->waveshaper);
+}